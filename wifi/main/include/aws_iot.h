@@ -9,6 +9,9 @@
 #define MAIN_AWS_IOT_H_
 
 #define CONFIG_AWS_EXAMPLE_CLIENT_ID "Udemy_ESP32_Test"
+// QOS1 publishes, one every 3 seconds, summarized in each MQTT round trip
+// time report. A QOS1 publish returns once the broker acknowledged it.
+#define AWS_IOT_RTT_WINDOW 20
 /**
  * Starts AWS IoT task.
  */
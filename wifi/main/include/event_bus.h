@@ -0,0 +1,167 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <freertos/FreeRTOS.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_netif_types.h"
+
+// Subscribers, the callback dispatcher included
+#define EVENT_BUS_MAX_SUBSCRIBERS 4
+// Callbacks run by the dispatcher task
+#define EVENT_BUS_MAX_CALLBACKS 4
+// Pending events per subscriber in each lane
+#define EVENT_BUS_HIGH_DEPTH 8
+#define EVENT_BUS_NORMAL_DEPTH 8
+#define EVENT_BUS_LOW_DEPTH 4
+
+/*
+ * Events, each has a fixed lane and full-lane policy, see event_bus.c
+ */
+typedef enum event_bus_id {
+    // wifi driver events and user requests, handled by the wifi app task
+    EVENT_BUS_WIFI_STA_CONNECTED = 0,
+    EVENT_BUS_WIFI_STA_GOT_IP,
+    EVENT_BUS_WIFI_STA_DISCONNECTED,
+    EVENT_BUS_WIFI_CONNECT_HTTP,
+    EVENT_BUS_WIFI_USER_DISCONNECT,
+    EVENT_BUS_WIFI_RESET_BUTTON,
+    // work of the wifi app task
+    EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS,
+    EVENT_BUS_WIFI_START_HTTP_SERVER,
+    EVENT_BUS_WIFI_STA_RECONNECT,
+    EVENT_BUS_WIFI_AP_STOP,
+    // notifications
+    EVENT_BUS_WIFI_CONNECTED,     // the station got an IP, the services may start
+    EVENT_BUS_WIFI_STATE_CHANGED, // the connection state shown on the page changed
+    EVENT_BUS_OTA_RESULT,
+    EVENT_BUS_TIME_SYNCED,
+    EVENT_BUS_ID_COUNT,
+} event_bus_id_e;
+
+// Subscription mask bit of an event
+#define EVENT_BUS_BIT(id) (1UL << (id))
+
+/*
+ * Priority lanes, a subscriber receives every pending event of a higher
+ * lane first
+ */
+typedef enum event_bus_lane {
+    EVENT_BUS_LANE_HIGH = 0,
+    EVENT_BUS_LANE_NORMAL,
+    EVENT_BUS_LANE_LOW,
+    EVENT_BUS_LANE_COUNT,
+} event_bus_lane_e;
+
+/*
+ * What a publish does when the lane of a subscriber is full
+ */
+typedef enum event_bus_policy {
+    EVENT_BUS_DROP_NEWEST = 0, // the new event is dropped
+    EVENT_BUS_DROP_OLDEST,     // the oldest pending event of the lane is dropped
+    EVENT_BUS_COALESCE,        // a pending event of the same id is dropped, even
+                               // with room left, only the latest one counts
+} event_bus_policy_e;
+
+/*
+ * Event, data is copied by value so publishing never allocates
+ */
+typedef struct event_bus_event {
+    event_bus_id_e id;
+    int64_t timestamp_us; // esp_timer time the event was published
+    uint16_t coalesced;   // pending events of the same id this one replaced, set by the bus
+    union {
+        struct {
+            uint16_t reason; // wifi_err_reason_t
+            int8_t rssi;     // of the AP the station was connected to
+        } sta_disconnected;
+        struct {
+            esp_netif_ip_info_t ip_info;
+        } sta_got_ip;
+        struct {
+            bool has_priority; // the page set a priority, it replaces that of a known network
+            uint8_t priority;  // of the network once it connected
+        } connect_http;
+        struct {
+            bool success;
+        } ota_result;
+    } data;
+} event_bus_event_t;
+
+/*
+ * Counters of a lane, over every subscriber
+ */
+typedef struct event_bus_lane_stats {
+    uint32_t published; // events queued to a subscriber
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t depth; // pending events
+    uint32_t max_depth;
+    uint32_t max_latency_us; // from publish to receive
+    uint64_t total_latency_us; // average is total_latency_us / delivered
+} event_bus_lane_stats_t;
+
+typedef struct event_bus_subscriber event_bus_subscriber_t;
+
+/*
+ * Callback subscriber, run by the dispatcher task so it may block without
+ * holding back the publishers.
+ * @param event received event
+ * @param ctx ctx given to event_bus_subscribe_callback
+ */
+typedef void (*event_bus_callback_t)(const event_bus_event_t *event, void *ctx);
+
+/*
+ * Subscribes a task, which receives the events with event_bus_receive.
+ * Events published before subscribing are not delivered.
+ * @param mask EVENT_BUS_BIT of each event to receive
+ * @return subscriber, NULL once EVENT_BUS_MAX_SUBSCRIBERS are used
+ */
+event_bus_subscriber_t *event_bus_subscribe(uint32_t mask);
+
+/*
+ * Subscribes a callback, the dispatcher task is started with the first one.
+ * @param mask EVENT_BUS_BIT of each event to receive
+ * @param callback callback
+ * @param ctx passed to the callback
+ * @return ESP_OK, or ESP_ERR_NO_MEM
+ */
+esp_err_t event_bus_subscribe_callback(uint32_t mask, event_bus_callback_t callback, void *ctx);
+
+/*
+ * Publishes an event to its subscribers, never blocks, the full-lane policy
+ * of the event applies. Not for ISRs.
+ * @param event event, its timestamp is set
+ */
+void event_bus_publish(event_bus_event_t *event);
+
+/*
+ * Publishes an event without data.
+ * @param id event
+ */
+void event_bus_post(event_bus_id_e id);
+
+/*
+ * Receives the next event, from the highest lane with one pending.
+ * @param subscriber subscriber from event_bus_subscribe
+ * @param event filled with the event
+ * @param timeout ticks to wait, portMAX_DELAY to wait forever
+ * @return true if an event was received
+ */
+bool event_bus_receive(event_bus_subscriber_t *subscriber, event_bus_event_t *event, TickType_t timeout);
+
+/*
+ * Gets the counters of every lane.
+ * @param stats array of EVENT_BUS_LANE_COUNT lanes
+ */
+void event_bus_get_stats(event_bus_lane_stats_t *stats);
+
+/*
+ * Gets the name of an event, for logs.
+ */
+const char *event_bus_name(event_bus_id_e id);
+
+#endif // !EVENT_BUS_H
@@ -0,0 +1,112 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+#include <esp_http_server.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "json_writer.h"
+
+// Max request body accepted by routes that are not flagged as streaming
+#define HTTP_ROUTER_MAX_BODY_LEN 1024
+// Number of latency histogram buckets, bucket n counts requests that took
+// less than HTTP_ROUTER_LATENCY_MIN_US << n, the last one counts the slower ones
+#define HTTP_ROUTER_LATENCY_BUCKETS 14
+#define HTTP_ROUTER_LATENCY_MIN_US 256
+// Number of worker tasks running the slow routes
+#define HTTP_ROUTER_WORKERS 2
+// Slow requests waiting for a worker, more get 503
+#define HTTP_ROUTER_WORKER_QUEUE_LEN 4
+
+/*
+ * Route flags, used as a bit mask
+ */
+typedef enum http_route_flag {
+    HTTP_ROUTE_CACHEABLE = (1 << 0), // the handler sets its own caching headers, otherwise no-store is sent
+    HTTP_ROUTE_STREAMING = (1 << 1), // the handler streams a request body of any size
+    HTTP_ROUTE_SLOW = (1 << 2),      // the handler blocks, it runs on a worker instead of the httpd task
+} http_route_flag_e;
+
+/*
+ * Route of the router table
+ */
+typedef struct http_route {
+    const char *path;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;         // passed to the handler as req->user_ctx
+    uint32_t flags;         // bit mask of http_route_flag_e
+    uint8_t max_concurrent; // requests handled at once, more get 503, 0 for no limit
+} http_route_t;
+
+/*
+ * Per route metrics recorded by the dispatcher
+ */
+typedef struct http_route_stats {
+    uint32_t count;          // requests handled
+    uint32_t errors;         // handler failures, the connection was closed
+    uint32_t rejected;       // requests refused with 413 or 503
+    uint32_t in_flight;      // requests being handled, or waiting for a worker
+    uint32_t max_in_flight;
+    uint64_t bytes_in;       // request bodies
+    uint64_t bytes_out;      // responses, headers included
+    uint32_t max_latency_us;
+    uint32_t latency_hist[HTTP_ROUTER_LATENCY_BUCKETS];
+} http_route_stats_t;
+
+/*
+ * Adds a table of routes, must be called before http_router_register. The
+ * table is referenced, not copied, and must outlive the router.
+ * @param routes route table
+ * @param count number of routes
+ * @return ESP_OK, ESP_ERR_NO_MEM or ESP_ERR_INVALID_STATE once registered
+ */
+esp_err_t http_router_add_routes(const http_route_t *routes, size_t count);
+
+/*
+ * Gets the number of httpd URI handlers http_router_register needs, one per
+ * HTTP method used by the routes.
+ */
+size_t http_router_uri_handler_count(void);
+
+/*
+ * Sorts the routes and registers the dispatcher on the http server, which
+ * must be configured with httpd_uri_match_wildcard. URI handlers registered
+ * before take precedence over the routes. The worker tasks of the slow
+ * routes are started on the first call.
+ * @param server http server handle
+ * @return ESP_OK or the httpd_register_uri_handler error
+ */
+esp_err_t http_router_register(httpd_handle_t server);
+
+/*
+ * Session open callback, to be set as httpd_config_t open_fn so the bytes
+ * sent on each connection are counted.
+ * @param hd http server handle
+ * @param sockfd socket of the new session
+ * @return ESP_OK, ESP_ERR_NO_MEM closes the session
+ */
+esp_err_t http_router_session_open(httpd_handle_t hd, int sockfd);
+
+/*
+ * Writes the metrics of every route as a JSON array.
+ * @param json writer
+ * @param key member name, NULL at the top level or inside arrays
+ */
+void http_router_write_stats(json_writer_t *json, const char *key);
+
+/*
+ * Looks up a route by binary search.
+ * @param method HTTP method
+ * @param uri request URI, the query string is ignored
+ * @return the route, NULL if no route matches
+ */
+const http_route_t *http_router_lookup(httpd_method_t method, const char *uri);
+
+/*
+ * Removes every route, e.g. after the http server is stopped.
+ */
+void http_router_reset(void);
+
+#endif // !HTTP_ROUTER_H
@@ -1,6 +1,12 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SEVER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/ip4_addr.h"
+#include "wifi.h"
+
 #define OTA_UPDATE_PENDING 0
 #define OTA_UPDATE_SUCCESSFUL 1
 #define OTA_UPDATE_FAILED -1
@@ -17,32 +23,56 @@ typedef enum http_server_wifi_connect_status{
 } http_server_wifi_connect_status_e;
 
 /*
- * Messages for the http monitor
+ * Fields of the /status.json snapshot, used as a bit mask
+ */
+typedef enum http_server_status_field {
+    HTTP_STATUS_FIELD_SSID = (1 << 0),
+    HTTP_STATUS_FIELD_OTA = (1 << 1),
+    HTTP_STATUS_FIELD_WIFI_STATUS = (1 << 2),
+    HTTP_STATUS_FIELD_CONNECT_INFO = (1 << 3),
+    HTTP_STATUS_FIELD_DHT_SENSOR = (1 << 4),
+    HTTP_STATUS_FIELD_LOCAL_TIME = (1 << 5),
+    HTTP_STATUS_FIELD_ALL = (1 << 6) - 1
+} http_server_status_field_e;
+
+// Max size of the /status.json response
+#define HTTP_STATUS_JSON_MAX_LEN 512
+// Size of the buffer JSON is written through when streamed as response chunks
+#define HTTP_SERVER_JSON_CHUNK_SIZE 128
+// Max size of the Content-Type header of an OTA upload, fits the longest boundary
+#define HTTP_SERVER_CONTENT_TYPE_MAX_LEN 128
+
+/*
+ * Snapshot of the state served by /status.json
  */
-#include "portmacro.h"
-typedef enum http_server_message {
-    HTTP_MSG_WIFI_CONNECT_INIT = 0,
-    HTTP_MSG_WIFI_CONNECT_SUCCESS,
-    HTTP_MSG_WIFI_CONNECT_FAIL,
-    HTTP_MSG_OTA_UPDATE_SUCCESSFULL,
-    HTTP_MSG_OTA_UPDATE_FAILED,
-    HTTP_MSG_WIFI_USER_DISCONNECT,
-    HTTP_TIME_SERVICE_INITIALIZED
-} http_server_message_e;
+typedef struct http_server_status_snapshot {
+    uint32_t fields;
+    char ap_ssid[MAX_SSID_LENGTH + 1];
+    int fw_update_status;
+    int wifi_connect_status;
+    bool connected;
+    char sta_ssid[MAX_SSID_LENGTH + 1];
+    char ip[IP4ADDR_STRLEN_MAX];
+    char netmask[IP4ADDR_STRLEN_MAX];
+    char gateway[IP4ADDR_STRLEN_MAX];
+    float temperature;
+    float humidity;
+    bool time_set;
+    char local_time[32];
+} http_server_status_snapshot_t;
 
 /*
- * Struct for the message queue
+ * Gets the wifi connect status shown on the web page, derived from the wifi
+ * connection state.
+ * @return http_server_wifi_connect_status_e value
  */
-typedef struct http_server_queue_message{
-    http_server_message_e msgID;
-} http_server_queue_message_t;
+int http_server_get_wifi_connect_status(void);
 
 /*
- * Sends a message to the queue
- * @param msgID message ID from the http_server_message_e enum.
- * @return pdTRUE if an item was successfully sent to the queue, otherwise pdFalse.
+ * Checks whether the local time was set by the time service.
+ * @return true if sntp is initialized
  */
-BaseType_t http_server_monitor_send_message(http_server_message_e msgID);
+bool http_server_is_local_time_set(void);
 
 /*
  * Starts http server
@@ -0,0 +1,49 @@
+#ifndef HTTP_SERVER_WS_H
+#define HTTP_SERVER_WS_H
+
+#include <esp_http_server.h>
+#include <stdint.h>
+
+// Number of httpd URI handlers registered by http_server_ws_register
+#define HTTP_SERVER_WS_URI_HANDLERS 1
+// Max number of dashboard clients subscribed to the push channel
+#define HTTP_SERVER_WS_MAX_CLIENTS 4
+// Max size of a telemetry frame
+#define HTTP_SERVER_WS_FRAME_MAX_LEN 256
+// Max size of a frame received from a client, larger frames are dropped
+#define HTTP_SERVER_WS_RX_MAX_LEN 64
+// Frames in a row a client may miss on a full send buffer before it is closed
+#define HTTP_SERVER_WS_MAX_MISSED 3
+// Period of the local time updates while the time is set (10 seconds)
+#define HTTP_SERVER_WS_CLOCK_PERIOD_US 10000000
+
+/*
+ * Telemetry topics pushed to the subscribed clients, used as a bit mask
+ */
+typedef enum http_server_ws_topic {
+    HTTP_WS_TOPIC_DHT_SENSOR = (1 << 0),
+    HTTP_WS_TOPIC_LOCAL_TIME = (1 << 1),
+    HTTP_WS_TOPIC_WIFI_STATUS = (1 << 2),
+    HTTP_WS_TOPIC_ALL = (1 << 3) - 1
+} http_server_ws_topic_e;
+
+/*
+ * Registers the /ws WebSocket endpoint on the http server.
+ * @param server http server handle
+ */
+void http_server_ws_register(httpd_handle_t server);
+
+/*
+ * Forgets the clients and the server, called before the server is stopped.
+ */
+void http_server_ws_unregister(void);
+
+/*
+ * Notifies the subscribed clients that a topic changed. Only the latest state
+ * is sent, notifications arriving while a client still has a frame queued are
+ * merged into that frame.
+ * @param topics bit mask of http_server_ws_topic_e
+ */
+void http_server_ws_notify(uint32_t topics);
+
+#endif // !HTTP_SERVER_WS_H
@@ -0,0 +1,137 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Max nesting of objects and arrays
+#define JSON_WRITER_MAX_DEPTH 8
+// Max number of decimals of fixed-point numbers
+#define JSON_WRITER_MAX_DECIMALS 6
+
+/*
+ * Flush callback, sends the buffered JSON text to the sink (e.g. an
+ * httpd_resp_send_chunk wrapper).
+ * @param ctx flush_ctx passed to json_writer_init
+ * @param data JSON text
+ * @param len length of data
+ * @return ESP_OK if the text was consumed
+ */
+typedef esp_err_t (*json_writer_flush_t)(void *ctx, const char *data, size_t len);
+
+/*
+ * JSON writer state, no heap is used. Errors are sticky: once a write fails
+ * every later call is a no-op and json_writer_finish returns the error.
+ */
+typedef struct json_writer {
+    char *buf;
+    size_t size;
+    size_t len;                // bytes in buf
+    size_t total_len;          // bytes written, including the flushed ones
+    json_writer_flush_t flush; // NULL writes into buf only
+    void *flush_ctx;
+    uint8_t depth;
+    uint32_t has_members;      // bit n set when the container at depth n has a member
+    esp_err_t err;
+} json_writer_t;
+
+/*
+ * Initializes a JSON writer.
+ * @param w writer to initialize
+ * @param buf caller provided buffer
+ * @param size size of buf
+ * @param flush sink called when buf is full and on json_writer_finish, NULL to
+ * write into buf only; the text is then NUL terminated and overflowing it is
+ * an ESP_ERR_INVALID_SIZE error
+ * @param flush_ctx context passed to flush
+ */
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_writer_flush_t flush, void *flush_ctx);
+
+/*
+ * Opens an object.
+ * @param key member name, NULL at the top level or inside arrays
+ */
+void json_writer_begin_object(json_writer_t *w, const char *key);
+
+/*
+ * Closes the innermost object.
+ */
+void json_writer_end_object(json_writer_t *w);
+
+/*
+ * Opens an array.
+ * @param key member name, NULL at the top level or inside arrays
+ */
+void json_writer_begin_array(json_writer_t *w, const char *key);
+
+/*
+ * Closes the innermost array.
+ */
+void json_writer_end_array(json_writer_t *w);
+
+/*
+ * Writes an escaped string member, '<' is escaped as well so the text can be
+ * inlined in a <script> element.
+ * @param key member name, NULL inside arrays
+ * @param value NUL terminated string
+ */
+void json_writer_string(json_writer_t *w, const char *key, const char *value);
+
+/*
+ * Writes an escaped string member of at most len bytes, for fixed size
+ * fields such as SSIDs which are not NUL terminated when full.
+ * @param key member name, NULL inside arrays
+ * @param value string, stops at the first NUL
+ * @param len max length of value
+ */
+void json_writer_string_n(json_writer_t *w, const char *key, const char *value, size_t len);
+
+/*
+ * Writes an integer member.
+ * @param key member name, NULL inside arrays
+ */
+void json_writer_int(json_writer_t *w, const char *key, int64_t value);
+
+/*
+ * Writes a fixed-point number member, e.g. 21.5 with one decimal. NaN,
+ * infinity and values whose value * 10^decimals does not fit in 64 bits are
+ * written as null.
+ * @param key member name, NULL inside arrays
+ * @param decimals number of decimals, up to JSON_WRITER_MAX_DECIMALS
+ */
+void json_writer_fixed(json_writer_t *w, const char *key, float value, uint8_t decimals);
+
+/*
+ * Same as json_writer_fixed but the number is written as a string, e.g. "21.5",
+ * a value json_writer_fixed writes as null is still a bare null.
+ */
+void json_writer_fixed_string(json_writer_t *w, const char *key, float value, uint8_t decimals);
+
+/*
+ * Writes a boolean member.
+ * @param key member name, NULL inside arrays
+ */
+void json_writer_bool(json_writer_t *w, const char *key, bool value);
+
+/*
+ * Writes a null member.
+ * @param key member name, NULL inside arrays
+ */
+void json_writer_null(json_writer_t *w, const char *key);
+
+/*
+ * Flushes the buffered text to the sink, or NUL terminates it without sink.
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if buf overflowed, ESP_ERR_INVALID_STATE
+ * if containers are left open, or the flush error
+ */
+esp_err_t json_writer_finish(json_writer_t *w);
+
+/*
+ * Gets the length of the JSON text, including the flushed bytes.
+ */
+size_t json_writer_length(const json_writer_t *w);
+
+#endif // !JSON_WRITER_H
@@ -0,0 +1,65 @@
+#ifndef MQTT_OTA_H
+#define MQTT_OTA_H
+
+#include <stdbool.h>
+
+#include "aws_iot.h"
+#include "aws_iot_mqtt_client_interface.h"
+#include "esp_err.h"
+
+/*
+ * OTA over MQTT, for devices that only keep the MQTT session. Topics, under
+ * MQTT_OTA_TOPIC_PREFIX:
+ *  notify  job from the server, {"job", "size", "sha256"}, best retained so
+ *          a device rebooted mid-update gets it again and resumes, a job
+ *          for the running image is reported SUCCEEDED without a download
+ *  request chunk requests from the device, {"job", "token", "offset", "len"}
+ *  data    chunks from the server, token and offset as little endian
+ *          uint32_t followed by the bytes
+ *  status  job result from the device, {"job", "status", "offset", "error"}
+ * tools/mqtt_ota_server.py implements the server side.
+ */
+#define MQTT_OTA_TOPIC_PREFIX CONFIG_AWS_EXAMPLE_CLIENT_ID "/ota/"
+#define MQTT_OTA_TOPIC_NOTIFY MQTT_OTA_TOPIC_PREFIX "notify"
+#define MQTT_OTA_TOPIC_REQUEST MQTT_OTA_TOPIC_PREFIX "request"
+#define MQTT_OTA_TOPIC_DATA MQTT_OTA_TOPIC_PREFIX "data"
+#define MQTT_OTA_TOPIC_STATUS MQTT_OTA_TOPIC_PREFIX "status"
+
+// Chunk size, one flash sector. CONFIG_AWS_IOT_MQTT_RX_BUF_LEN must hold a
+// chunk, its header and the topic.
+#define MQTT_OTA_CHUNK_SIZE 4096
+#define MQTT_OTA_CHUNK_HEADER_LEN 8
+// Chunks requested and not received yet, they are reordered in a buffer of
+// this many chunks
+#define MQTT_OTA_WINDOW 4
+// Outstanding chunks are requested again after this long without a chunk
+#define MQTT_OTA_REQUEST_TIMEOUT_MS 5000
+#define MQTT_OTA_JOB_ID_MAX_LEN 64
+
+/*
+ * Subscribes to the notify and data topics.
+ * @param client connected client
+ * @return ESP_OK, ESP_FAIL if a subscription failed
+ */
+esp_err_t mqtt_ota_subscribe(AWS_IoT_Client *client);
+
+/*
+ * Starts the notified jobs, requests chunks and reports the job status. The
+ * MQTT client cannot publish from its callbacks, so this is called after each
+ * aws_iot_mqtt_yield.
+ * @param client connected client
+ */
+void mqtt_ota_poll(AWS_IoT_Client *client);
+
+/*
+ * Requests the outstanding chunks again, called once the client reconnected
+ * as the requests in flight were lost.
+ */
+void mqtt_ota_reconnected(void);
+
+/*
+ * Checks whether a job is being received.
+ */
+bool mqtt_ota_is_active(void);
+
+#endif // !MQTT_OTA_H
@@ -0,0 +1,93 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Max length of a boundary (RFC 2046)
+#define MULTIPART_BOUNDARY_MAX_LEN 70
+// Delimiter is CRLF "--" boundary
+#define MULTIPART_DELIMITER_MAX_LEN (MULTIPART_BOUNDARY_MAX_LEN + 4)
+// Part header lines are truncated to this length, only Content-Disposition is used
+#define MULTIPART_HEADER_LINE_MAX_LEN 128
+
+/*
+ * Called with the bytes of the file part, straight from the fed chunks.
+ * @param ctx context passed to multipart_parser_init
+ * @param data file bytes
+ * @param len length of data
+ * @return ESP_OK to continue, any other value stops the parser
+ */
+typedef esp_err_t (*multipart_data_cb_t)(void *ctx, const char *data, size_t len);
+
+/*
+ * Parser states
+ */
+typedef enum multipart_state {
+    MULTIPART_STATE_PREAMBLE = 0, // before the first delimiter
+    MULTIPART_STATE_DELIMITER_END, // after a delimiter, CRLF starts a part, "--" ends the body
+    MULTIPART_STATE_HEADERS,
+    MULTIPART_STATE_BODY,
+    MULTIPART_STATE_DONE, // closing delimiter seen, the epilogue is ignored
+    MULTIPART_STATE_ERROR
+} multipart_state_e;
+
+/*
+ * Incremental multipart/form-data parser. It keeps no copy of the body: file
+ * bytes are passed to the callback from the fed chunk, and the few bytes held
+ * back when a chunk ends inside a possible delimiter are passed from the
+ * delimiter string itself once they turn out to be data.
+ */
+typedef struct multipart_parser {
+    char delimiter[MULTIPART_DELIMITER_MAX_LEN + 1];
+    uint8_t delimiter_len;
+    uint8_t failure[MULTIPART_DELIMITER_MAX_LEN + 1]; // KMP failure function of the delimiter
+    uint8_t match_len;                                // delimiter bytes matched so far
+    uint8_t carry_len;                                // matched bytes that came from previous chunks
+    multipart_state_e state;
+    char header_line[MULTIPART_HEADER_LINE_MAX_LEN];
+    uint16_t header_len;
+    char delimiter_end;       // first character after a delimiter
+    bool part_has_file;       // the part being parsed has a filename
+    bool file_seen;
+    size_t file_len;          // bytes passed to the callback
+    multipart_data_cb_t on_file_data;
+    void *ctx;
+    esp_err_t err;
+} multipart_parser_t;
+
+/*
+ * Initializes a parser from the request Content-Type.
+ * @param p parser to initialize
+ * @param content_type e.g. multipart/form-data; boundary=----WebKitFormBoundary
+ * @param on_file_data called with the bytes of the parts holding a file
+ * @param ctx context passed to on_file_data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if there is no valid boundary
+ */
+esp_err_t multipart_parser_init(multipart_parser_t *p,
+                                const char *content_type,
+                                multipart_data_cb_t on_file_data,
+                                void *ctx);
+
+/*
+ * Feeds the next chunk of the body, chunks can be split anywhere.
+ * @param p parser
+ * @param data body bytes
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE on a malformed body, or the
+ * on_file_data error
+ */
+esp_err_t multipart_parser_feed(multipart_parser_t *p, const char *data, size_t len);
+
+/*
+ * Checks the body was complete.
+ * @return ESP_OK if the closing delimiter was seen after a file part,
+ * ESP_ERR_INVALID_SIZE if the body is truncated or holds no file, or the
+ * parser error
+ */
+esp_err_t multipart_parser_finish(const multipart_parser_t *p);
+
+#endif // !MULTIPART_H
@@ -2,24 +2,106 @@
 #define NVS_H
 
 #include "esp_err.h"
+#include "esp_netif_types.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Known station networks kept in nvs
+#define APP_NVS_MAX_STA_NETWORKS 5
+
+/*
+ * Resumable OTA session persisted across connection drops and reboots
+ */
+typedef struct app_nvs_ota_session {
+    uint32_t id;
+    uint32_t size;              // image size
+    uint32_t offset;            // image bytes written to flash
+    uint32_t partition_address; // update partition the bytes were written to
+    uint8_t sha256[32];         // expected image digest
+    uint8_t channel;            // ota_session_channel_e that opened it
+} app_nvs_ota_session_t;
+
+/*
+ * Known station network
+ */
+typedef struct app_nvs_sta_network {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t priority;          // higher is preferred
+    uint32_t last_success_seq; // orders the last successful connections, 0 never
+    int64_t last_success;      // epoch seconds, 0 when the clock was not set
+} app_nvs_sta_network_t;
 
 /*
- * Saves station mode wifi credentials to nvs.
+ * Last successful station connection, used to reconnect without a full scan
+ * and DHCP exchange
+ */
+typedef struct app_nvs_sta_cache {
+    uint8_t ssid[32];            // network the cache belongs to
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info; // DHCP lease
+    uint32_t dns;                // main DNS server of the lease
+    uint32_t lease_s;            // lease time granted by the server, 0 when unknown
+    int64_t lease_expires;       // epoch seconds, 0 when unknown
+} app_nvs_sta_cache_t;
+
+/*
+ * Saves the known station networks to nvs, replacing the saved list.
+ * @param networks known networks
+ * @param count number of networks, up to APP_NVS_MAX_STA_NETWORKS
  * @return ESP_OK if successful.
  */
-esp_err_t app_nvs_save_sta_creds(void);
+esp_err_t app_nvs_save_sta_networks(const app_nvs_sta_network_t *networks, size_t count);
+
+/*
+ * Loads the known station networks from nvs. Credentials saved by earlier
+ * firmware as a single ssid/password pair are returned as one network.
+ * @param networks filled with the saved networks
+ * @param max capacity of networks
+ * @return number of networks loaded
+ */
+size_t app_nvs_load_sta_networks(app_nvs_sta_network_t *networks, size_t max);
+
+/*
+ * Saves the last successful station connection to nvs.
+ * @param cache connection to save
+ * @return ESP_OK if successful
+ */
+esp_err_t app_nvs_save_sta_cache(const app_nvs_sta_cache_t *cache);
+
+/*
+ * Loads the last successful station connection from nvs.
+ * @param cache filled with the saved connection
+ * @return true if a connection was saved
+ */
+bool app_nvs_load_sta_cache(app_nvs_sta_cache_t *cache);
+
+/*
+ * Clears the last successful station connection from nvs.
+ * @return ESP_OK if successful
+ */
+esp_err_t app_nvs_clear_sta_cache(void);
+
+/*
+ * Saves the resumable OTA session to nvs.
+ * @param session session to save
+ * @return ESP_OK if successful
+ */
+esp_err_t app_nvs_save_ota_session(const app_nvs_ota_session_t *session);
 
 /*
- * Loads previosly saved credentials from nvs.
- * @return true if previosly saved credentials are found.
+ * Loads the resumable OTA session from nvs.
+ * @param session filled with the saved session
+ * @return true if a session was saved
  */
-bool app_nvs_load_sta_creds(void);
+bool app_nvs_load_ota_session(app_nvs_ota_session_t *session);
 
 /*
- * Clear sta credentials from nvs
+ * Clears the resumable OTA session from nvs.
  * @return ESP_OK if successful
  */
-esp_err_t app_nvs_clear_sta_creds(void);
+esp_err_t app_nvs_clear_ota_session(void);
 
 #endif // !NVS_H
@@ -0,0 +1,81 @@
+#ifndef OTA_DECODER_H
+#define OTA_DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/*
+ * Uploaded image formats, told apart by their first bytes. A zlib stream may
+ * hold an application image or a delta.
+ */
+typedef enum ota_decoder_format {
+    OTA_DECODER_FORMAT_UNKNOWN = 0,
+    OTA_DECODER_FORMAT_IMAGE, // application image, starts with ESP_IMAGE_HEADER_MAGIC
+    OTA_DECODER_FORMAT_ZLIB,  // zlib stream (deflate with a zlib header)
+    OTA_DECODER_FORMAT_DELTA, // "ESPD" delta against the running partition
+} ota_decoder_format_e;
+
+// Delta magic, followed by the header and the operations (tools/ota_pack.py)
+#define OTA_DELTA_MAGIC "ESPD"
+#define OTA_DELTA_MAGIC_LEN 4
+
+/*
+ * Header of a delta, integers are little endian
+ */
+typedef struct __attribute__((packed)) ota_delta_header {
+    char magic[OTA_DELTA_MAGIC_LEN];
+    uint32_t source_size;      // bytes of the running partition the delta was made against
+    uint32_t target_size;      // size of the image the delta rebuilds
+    uint8_t source_sha256[32]; // SHA-256 of those source_size bytes
+} ota_delta_header_t;
+
+/*
+ * Delta operations, each one starts with a 9 byte header: op, offset, len
+ */
+typedef enum ota_delta_op {
+    OTA_DELTA_OP_COPY = 1,   // copy len bytes of the running partition from offset
+    OTA_DELTA_OP_INSERT = 2, // insert the len bytes following the header, offset is 0
+} ota_delta_op_e;
+
+#define OTA_DELTA_OP_HEADER_LEN 9
+
+/*
+ * Starts an update of a partition from an uploaded image, compressed image
+ * or delta. The format is detected on the first bytes and decoded as it
+ * streams, with a bounded amount of RAM, into the ota_writer.
+ * @param partition partition to update
+ * @return ESP_OK, or the ota_writer_begin error
+ */
+esp_err_t ota_decoder_begin(const esp_partition_t *partition);
+
+/*
+ * Decodes the next uploaded bytes.
+ * @param data uploaded bytes
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED for an unknown format,
+ * ESP_ERR_INVALID_RESPONSE for a corrupt stream, ESP_ERR_INVALID_VERSION for
+ * a delta made against another image, or the ota_writer error
+ */
+esp_err_t ota_decoder_write(const void *data, size_t len);
+
+/*
+ * Checks the upload was complete and ends the update with ota_writer_end.
+ * @return ESP_OK if the image was fully decoded and is valid
+ */
+esp_err_t ota_decoder_end(void);
+
+/*
+ * Cancels the update.
+ */
+void ota_decoder_abort(void);
+
+/*
+ * Checks whether an update is being decoded.
+ */
+bool ota_decoder_is_active(void);
+
+#endif // !OTA_DECODER_H
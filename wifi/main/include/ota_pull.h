@@ -0,0 +1,47 @@
+#ifndef OTA_PULL_H
+#define OTA_PULL_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "ota_session.h"
+
+// Manifest polled by the device, {"version", "size", "sha256", "url"}, made by
+// tools/ota_pack.py manifest. A python -m http.server serving build/ota works.
+#ifndef OTA_PULL_MANIFEST_URL
+#define OTA_PULL_MANIFEST_URL "http://192.168.0.10:8000/manifest.json"
+#endif
+// Time between two manifest checks
+#define OTA_PULL_INTERVAL_MS (60 * 60 * 1000)
+// Download attempts of one check, each continues from the bytes already received
+#define OTA_PULL_MAX_ATTEMPTS 5
+#define OTA_PULL_TIMEOUT_MS 10000
+#define OTA_PULL_MANIFEST_MAX_LEN 512
+#define OTA_PULL_URL_MAX_LEN 256
+#define OTA_PULL_VERSION_MAX_LEN 32
+// Download buffer
+#define OTA_PULL_BUFFER_SIZE 4096
+
+/*
+ * Update manifest
+ */
+typedef struct ota_pull_manifest {
+    char version[OTA_PULL_VERSION_MAX_LEN];
+    uint32_t size;
+    uint8_t sha256[OTA_SESSION_SHA256_LEN];
+    char url[OTA_PULL_URL_MAX_LEN];
+} ota_pull_manifest_t;
+
+/*
+ * Starts the task polling the manifest, an image with a newer version than
+ * the running one is downloaded into the update partition and booted.
+ */
+void ota_pull_start(void);
+
+/*
+ * Compares two versions number by number, e.g. 1.10.0 > 1.9.3, v2.0 > 1.9.
+ * @return < 0, 0 or > 0 as a is older than, the same as or newer than b
+ */
+int ota_pull_version_compare(const char *a, const char *b);
+
+#endif // !OTA_PULL_H
@@ -0,0 +1,114 @@
+#ifndef OTA_SESSION_H
+#define OTA_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Length of a SHA-256 digest
+#define OTA_SESSION_SHA256_LEN 32
+// The write offset is saved to nvs each time this many more bytes are in flash
+#define OTA_SESSION_CHECKPOINT_SIZE (64 * 1024)
+// A paused session of another channel may be replaced once idle this long
+#define OTA_SESSION_IDLE_TIMEOUT_S 3600
+
+/*
+ * Where an upload comes from, a session belongs to the channel that opened it
+ */
+typedef enum ota_session_channel {
+    OTA_SESSION_CHANNEL_HTTP = 0, // /OTAsession
+    OTA_SESSION_CHANNEL_MQTT,     // AWS IoT job
+    OTA_SESSION_CHANNEL_PULL,     // manifest poll
+} ota_session_channel_e;
+
+/*
+ * State of a resumable upload, as reported to the client
+ */
+typedef struct ota_session_info {
+    uint32_t id;
+    uint32_t size;   // image size
+    uint32_t offset; // next image byte expected
+} ota_session_info_t;
+
+/*
+ * Opens an upload session for an image. A session saved for the same image,
+ * before a disconnect or a reboot, is resumed instead of started over, from
+ * any channel. A session for another image is replaced only when it belongs
+ * to the same channel, or has been idle for OTA_SESSION_IDLE_TIMEOUT_S.
+ * @param channel channel of the upload
+ * @param size image size
+ * @param sha256 expected SHA-256 of the image
+ * @param info filled with the session
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the image does not fit the update
+ * partition, ESP_ERR_INVALID_STATE while a session is opened or receiving,
+ * or another channel's session for another image is paused
+ */
+esp_err_t ota_session_open(ota_session_channel_e channel,
+                           uint32_t size,
+                           const uint8_t sha256[OTA_SESSION_SHA256_LEN],
+                           ota_session_info_t *info);
+
+/*
+ * Gets a session, the offset is where the client continues the upload.
+ * @param id session id
+ * @param info filled with the session
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the id is not the open session
+ */
+esp_err_t ota_session_get(uint32_t id, ota_session_info_t *info);
+
+/*
+ * Starts receiving the image bytes from an offset.
+ * @param id session id
+ * @param offset image offset of the first byte, must be the session offset
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_INVALID_ARG if the offset is not
+ * the session offset, ESP_ERR_INVALID_STATE while the session is opened or
+ * receiving, or another update is running
+ */
+esp_err_t ota_session_write_begin(uint32_t id, uint32_t offset);
+
+/*
+ * Hashes the next image bytes and hands them over to the ota_writer.
+ * @param data image bytes
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE past the image size, or the ota_writer
+ * error
+ */
+esp_err_t ota_session_write(const void *data, size_t len);
+
+/*
+ * Stops receiving. A complete image is validated, its digest compared to the
+ * expected one and only then set as the boot partition. An incomplete one is
+ * paused and its offset saved, so the upload can be continued.
+ * @param complete set when the whole image was received and activated
+ * @return ESP_OK, ESP_ERR_INVALID_CRC on a digest mismatch, or the ota_writer
+ * error, the session is discarded on an error
+ */
+esp_err_t ota_session_write_end(bool *complete);
+
+/*
+ * Forgets the open or saved session, called when the update partition is
+ * written by another upload. Does nothing while the session is opened or
+ * receiving.
+ */
+void ota_session_discard(void);
+
+/*
+ * Checks whether an image is the one running, by hashing as many bytes of
+ * the running partition as the image holds.
+ * @param size image size
+ * @param sha256 SHA-256 of the image
+ * @return true if the running partition starts with the image
+ */
+bool ota_session_is_running_image(uint32_t size, const uint8_t sha256[OTA_SESSION_SHA256_LEN]);
+
+/*
+ * Parses a hex encoded SHA-256 digest.
+ * @param hex 64 hex digits
+ * @param sha256 filled with the digest
+ * @return true if hex holds a digest
+ */
+bool ota_session_parse_sha256(const char *hex, uint8_t sha256[OTA_SESSION_SHA256_LEN]);
+
+#endif // !OTA_SESSION_H
@@ -0,0 +1,79 @@
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// Size of a ring buffer, one flash sector so every write is sector aligned
+#define OTA_WRITER_BUFFER_SIZE 4096
+// Number of buffers in the ring
+#define OTA_WRITER_BUFFER_COUNT 4
+
+/*
+ * Throughput of the running or last update
+ */
+typedef struct ota_writer_stats {
+    uint32_t bytes_written;
+    uint32_t elapsed_ms;
+    uint32_t kbytes_per_s;
+    uint32_t producer_stall_ms; // receiver waiting for a free buffer, flash bound
+    uint32_t writer_stall_ms;   // flash writer waiting for data, network bound
+} ota_writer_stats_t;
+
+/*
+ * Starts an update of a partition. The image is written by a dedicated flash
+ * writer task while the caller keeps receiving into the next buffers of the
+ * ring, so receiving and flash erase/program overlap.
+ * @param partition partition to update
+ * @param offset 0 for a new image, otherwise the image offset a paused update
+ * resumes at, the bytes before it are kept
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if an update is running or being
+ * started by another task, ESP_ERR_NO_MEM
+ */
+esp_err_t ota_writer_begin(const esp_partition_t *partition, size_t offset);
+
+/*
+ * Appends image bytes, blocks while every buffer of the ring is waiting to be
+ * written.
+ * @param data image bytes
+ * @param len length of data
+ * @return ESP_OK, or the first flash error of the update
+ */
+esp_err_t ota_writer_write(const void *data, size_t len);
+
+/*
+ * Writes the remaining bytes, waits for the flash writer and validates the
+ * image with esp_ota_end.
+ * @return ESP_OK if the image is complete and valid
+ */
+esp_err_t ota_writer_end(void);
+
+/*
+ * Writes the remaining bytes and stops without validating the image, so the
+ * update can be resumed with ota_writer_begin at the image offset reached.
+ * @return ESP_OK if every byte was written
+ */
+esp_err_t ota_writer_pause(void);
+
+/*
+ * Cancels the running update, the partition is left invalid.
+ */
+void ota_writer_abort(void);
+
+/*
+ * Checks whether an update is running, between ota_writer_begin and
+ * ota_writer_end or ota_writer_abort.
+ */
+bool ota_writer_is_active(void);
+
+/*
+ * Gets the throughput of the running or last update.
+ * @param stats filled with the statistics
+ */
+void ota_writer_get_stats(ota_writer_stats_t *stats);
+
+#endif // !OTA_WRITER_H
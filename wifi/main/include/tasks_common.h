@@ -5,6 +5,11 @@
 #define WIFI_APP_TASK_PRIORITY 5
 #define WIFI_APP_TASK_CORE_ID 0
 
+// Runs the event bus callbacks, which may start other tasks
+#define EVENT_BUS_TASK_STACK_SIZE 4096
+#define EVENT_BUS_TASK_PRIORITY 4
+#define EVENT_BUS_TASK_CORE_ID 0
+
 #define HTTP_SERVER_TASK_STACK_SIZE 8192
 #define HTTP_SERVER_TASK_PRIORITY 4
 #define HTTP_SERVER_TASK_CORE_ID 0
@@ -13,6 +18,20 @@
 #define HTTP_SERVER_MONITOR_PRIORITY 3
 #define HTTP_SERVER_MONITOR_CORE_ID 0
 
+// Below the http server task, so slow requests never delay the fast ones
+#define HTTP_ROUTER_WORKER_STACK_SIZE 6144
+#define HTTP_ROUTER_WORKER_PRIORITY 3
+#define HTTP_ROUTER_WORKER_CORE_ID 0
+
+#define OTA_WRITER_TASK_STACK_SIZE 4096
+#define OTA_WRITER_TASK_PRIORITY 4
+#define OTA_WRITER_TASK_CORE_ID 0
+
+// TLS handshakes of the manifest and image downloads run on this stack
+#define OTA_PULL_TASK_STACK_SIZE 8192
+#define OTA_PULL_TASK_PRIORITY 2
+#define OTA_PULL_TASK_CORE_ID 0
+
 #define WIFI_RESET_BUTTON_TASK_STACK_SIZE 2048
 #define WIFI_RESET_BUTTON_TASK_PRIORITY 6
 #define WIFI_RESET_BUTTON_TASK_CORE_ID 0
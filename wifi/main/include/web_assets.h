@@ -0,0 +1,29 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Buffer size for a quoted asset ETag, "<hash>-<encoding>"
+#define WEB_ASSET_ETAG_MAX_LEN 32
+
+/*
+ * Web page asset, the table is generated at build time by tools/web_assets.py
+ * from the files in main/webpage.
+ */
+typedef struct web_asset {
+    const char *path;             // request path, e.g. "/app.js"
+    const char *mime_type;        // Content-Type of the asset
+    const char *encoding;         // Content-Encoding of data, NULL when data is not encoded
+    const char *hash;             // hex content hash of the minified bytes, also the ?v= URL version
+    const uint8_t *data;          // bytes to send to clients accepting the encoding
+    size_t data_len;
+    const uint8_t *identity_data; // minified bytes without any encoding
+    size_t identity_len;
+    int32_t splice_offset;        // offset of the removed <!--@INITIAL_STATE--> marker, -1 if none
+} web_asset_t;
+
+extern const web_asset_t web_assets[];
+extern const size_t web_assets_count;
+
+#endif // !WEB_ASSETS_H
@@ -0,0 +1,41 @@
+#ifndef WEB_CACHE_H
+#define WEB_CACHE_H
+
+#include <stdbool.h>
+
+#include "web_assets.h"
+
+// Cache-Control of web assets requested through their versioned URL (?v=<hash>)
+#define WEB_CACHE_CONTROL_IMMUTABLE "public, max-age=31536000, immutable"
+// Cache-Control of unversioned web assets, revalidated with the ETag on every use
+#define WEB_CACHE_CONTROL_REVALIDATE "no-cache"
+
+/*
+ * How to answer a web asset request
+ */
+typedef struct web_cache_response {
+    bool encoded;                      // send data with Content-Encoding, otherwise identity_data
+    bool not_modified;                 // answer 304 Not Modified without a body
+    const char *cache_control;         // Cache-Control header
+    char etag[WEB_ASSET_ETAG_MAX_LEN]; // quoted strong ETag of the representation
+} web_cache_response_t;
+
+/*
+ * Picks the representation of a web asset and the caching headers from the
+ * request headers. Every representation has a strong ETag, a client already
+ * holding it gets 304 Not Modified, and versioned URLs are cached by the
+ * browser for good. Plain C, so browser request sequences can be replayed on
+ * a host.
+ * @param asset requested web asset
+ * @param accept_encoding Accept-Encoding header, NULL when absent
+ * @param query URL query string, NULL when absent
+ * @param if_none_match If-None-Match header, NULL when absent
+ * @param response set to the answer
+ */
+void web_cache_respond(const web_asset_t *asset,
+                       const char *accept_encoding,
+                       const char *query,
+                       const char *if_none_match,
+                       web_cache_response_t *response);
+
+#endif // !WEB_CACHE_H
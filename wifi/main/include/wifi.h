@@ -4,11 +4,11 @@
 #include "esp_netif.h"
 #include "esp_wifi_types_generic.h"
 #include <freertos/FreeRTOS.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-
-// callback typedef
-typedef void (*wifi_connected_event_callback_t)(void);
+#include "wifi_reconnect.h"
+#include "wifi_state.h"
 
 // AP Name
 #define WIFI_AP_SSID "ESP32_AP"
@@ -28,49 +28,35 @@ typedef void (*wifi_connected_event_callback_t)(void);
 #define WIFI_AP_GATEWAY "192.168.0.1"
 // AP Netmask
 #define WIFI_AP_NETMASK "255.255.255.0"
+// AP switched off this long after the station got an IP, so the radio stays
+// on the station channel. It comes back on the station channel when the
+// station disconnects or the reset button is pressed. 0 keeps it on.
+#define WIFI_AP_OFF_DELAY_MS (5 * 60 * 1000)
 // AP Bandwidth (HT20 = 20mhz)
 #define WIFI_AP_BANDWIDTH WIFI_BW_HT20
-// WIFI Power save (NONE = not used)
-#define WIFI_STA_POWER_SAVE WIFI_PS_NONE
 // WIFI max SSID length
 #define MAX_SSID_LENGTH 32
 // WIFI max password length
 #define MAX_PASSWORD_LENGTH 64
-// WIFI max connection retries
-#define MAX_CONNECTION_RETRIES 5
 
 extern esp_netif_t *esp_netif_sta;
 extern esp_netif_t *esp_netif_ap;
 
 /*
- * Message IDs for the WIFI application task
- * @note Expand this based on requirements
- */
-typedef enum wifi_app_message {
-    WIFI_APP_MSG_START_HTTP_SERVER = 0,
-    WIFI_APP_MSG_CONNECTING_HTTP_SERVER,
-    WIFI_APP_MSG_STA_CONNECTED_GOT_IP,
-    WIFI_APP_MSG_STA_DISCONNECTED,
-    WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT,
-    WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS
-} wifi_app_message_e;
-
-/*
- * Struct for message queue
- */
-typedef struct wifi_app_queue_message {
-    wifi_app_message_e msgID;
-} wifi_app_queue_message_t;
-
-/*
- * Sends message to the queue
- * @param msgID message ID from the wifi_app_message_e enum.
- * @return pdTRUE if an item is successfully sent to the queue, otherwise false.
+ * SoftAP state and the time it spent on and off, for comparing the airtime
+ * and latency with and without it
  */
-BaseType_t wifi_app_send_message(wifi_app_message_e msgID);
+typedef struct wifi_ap_stats {
+    bool enabled;
+    uint8_t clients;
+    uint32_t on_ms;
+    uint32_t off_ms;
+} wifi_ap_stats_t;
 
 /*
- * Starts the wifi RTOs task
+ * Starts the wifi RTOs task, it receives the driver events, the user
+ * requests and its own work from the event bus, and publishes
+ * EVENT_BUS_WIFI_CONNECTED each time the station gets an IP
  */
 void wifi_app_start(void);
 
@@ -80,18 +66,29 @@ void wifi_app_start(void);
 wifi_config_t *wifi_get_config(void);
 
 /*
- * Sets callback
+ * Gets the last RSSI sampled by the link quality sampler, without calling
+ * the wifi driver.
+ * @return RSSI in dBm, the last known one while the station is down
  */
-void wifi_set_callback(wifi_connected_event_callback_t cb);
+int8_t wifi_get_rssi(void);
 
 /*
- *Calls callback
+ * Gets the SoftAP state and on/off time.
+ * @param stats copy of the statistics
  */
-void wifi_call_callback(void);
+void wifi_get_ap_stats(wifi_ap_stats_t *stats);
 
 /*
- * Get RSSI from wifi data
+ * Gets the station connection state, with its transition history and the
+ * time to connect, time to IP and outage metrics.
+ * @param state copy of the state machine
  */
-int8_t wifi_get_rssi(void);
+void wifi_get_state(wifi_state_machine_t *state);
+
+/*
+ * Gets the time to reconnect statistics of the station.
+ * @param stats copy of the statistics
+ */
+void wifi_get_reconnect_stats(wifi_reconnect_stats_t *stats);
 
 #endif
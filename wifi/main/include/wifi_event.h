@@ -0,0 +1,96 @@
+#ifndef WIFI_EVENT_H
+#define WIFI_EVENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_event_base.h"
+#include "event_bus.h"
+#include "wifi_reconnect.h"
+#include "wifi_state.h"
+
+// WIFI max connection retries of credentials from the http server, saved
+// credentials and lost links are retried with backoff until they connect
+#define MAX_CONNECTION_RETRIES 5
+
+/*
+ * What the link events ask of the radio and of the rest of the wifi app.
+ * wifi.c drives the driver and the services with them, the host test of the
+ * event path records them.
+ */
+typedef struct wifi_event_actions {
+    // connection attempt now, esp_wifi_connect
+    void (*connect)(void);
+    // connection attempt once delay_ms passed, through the reconnect timer
+    void (*retry_start)(uint32_t delay_ms);
+    // the pending attempt is no longer needed
+    void (*retry_stop)(void);
+    // the link went down, the page must stay reachable
+    void (*link_lost)(void);
+    // an attempt failed before GOT_IP, origin of the credentials tried
+    void (*attempt_failed)(wifi_state_origin_e origin);
+    // the station got an IP, origin of the credentials that connected
+    void (*connected)(const event_bus_event_t *event, wifi_state_origin_e origin);
+} wifi_event_actions_t;
+
+/*
+ * Initializes the station state machine in WIFI_STATE_IDLE and the
+ * reconnect scheduler.
+ * @param actions side effects of the link events, kept
+ * @param seed jitter seed of the reconnect scheduler, e.g. esp_random()
+ * @param now_us current time
+ */
+void wifi_event_init(const wifi_event_actions_t *actions, uint32_t seed, int64_t now_us);
+
+/*
+ * Handles a wifi driver or IP event from the system event task: the link
+ * information is updated and the event is published on the bus by value,
+ * for the wifi app task. Never blocks nor allocates.
+ * @param event_base WIFI_EVENT or IP_EVENT, other bases are ignored
+ * @param event_id event of the base
+ * @param event_data event data of the driver
+ * @return true if a bus event was published
+ */
+bool wifi_event_from_driver(esp_event_base_t event_base, int32_t event_id, const void *event_data);
+
+/*
+ * Handles a link event received by the wifi app task: STA_CONNECTED,
+ * STA_GOT_IP, STA_DISCONNECTED and STA_RECONNECT drive the state machine and
+ * the reconnect scheduler, other events are ignored.
+ * @param event event from the bus
+ */
+void wifi_event_handle(const event_bus_event_t *event);
+
+/*
+ * Feeds an event to the connection state machine and lets the http server
+ * know when the state it shows changed, for the user requests of the wifi
+ * app task.
+ * @param event state machine event
+ * @param now_us time of the event
+ * @return true if the event was accepted in the current state
+ */
+bool wifi_event_dispatch(wifi_state_event_e event, int64_t now_us);
+
+/*
+ * Forgets the current outage and stops the pending attempt.
+ */
+void wifi_event_cancel_reconnect(void);
+
+/*
+ * Gets the current station state, for the wifi app task.
+ */
+wifi_state_e wifi_event_get_state(void);
+
+/*
+ * Gets a copy of the state machine, from any task.
+ * @param state copy of the state machine
+ */
+void wifi_event_get_state_machine(wifi_state_machine_t *state);
+
+/*
+ * Gets the time to reconnect statistics, from any task.
+ * @param stats copy of the statistics
+ */
+void wifi_event_get_reconnect_stats(wifi_reconnect_stats_t *stats);
+
+#endif // !WIFI_EVENT_H
@@ -0,0 +1,85 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_netif_types.h"
+#include "esp_wifi_types_generic.h"
+
+// Period of the RSSI sampler while the station is associated
+#define WIFI_LINK_SAMPLE_MS 2000
+// Weight of a new sample in the RSSI average, 1 / 2^WIFI_LINK_EWMA_SHIFT
+#define WIFI_LINK_EWMA_SHIFT 3
+// Disconnect reasons kept
+#define WIFI_LINK_REASON_HISTORY_LEN 8
+
+/*
+ * A link loss
+ */
+typedef struct wifi_link_disconnect {
+    int64_t timestamp_us;
+    uint16_t reason; // wifi_err_reason_t
+    int8_t rssi;
+} wifi_link_disconnect_t;
+
+/*
+ * Link quality and addressing of the station, RSSI statistics cover the
+ * current association
+ */
+typedef struct wifi_link_info {
+    bool associated;
+    bool has_ip;
+    uint8_t ssid[MAX_SSID_LEN + 1];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;     // last sample
+    int8_t rssi_avg; // exponentially weighted moving average
+    int8_t rssi_min;
+    int8_t rssi_max;
+    uint32_t samples;
+    int64_t sampled_us; // esp_timer time of the last sample
+    esp_netif_ip_info_t ip_info;
+    uint32_t disconnects; // the last one is at
+                          // history[(disconnects - 1) % WIFI_LINK_REASON_HISTORY_LEN]
+    wifi_link_disconnect_t history[WIFI_LINK_REASON_HISTORY_LEN];
+} wifi_link_info_t;
+
+/*
+ * Starts the sampler, called by the wifi app task before the event handler
+ * is registered.
+ */
+void wifi_link_init(void);
+
+/*
+ * Records an association, from WIFI_EVENT_STA_CONNECTED.
+ * @param event event data
+ */
+void wifi_link_associated(const wifi_event_sta_connected_t *event);
+
+/*
+ * Records the station address, from IP_EVENT_STA_GOT_IP.
+ * @param ip_info address
+ */
+void wifi_link_got_ip(const esp_netif_ip_info_t *ip_info);
+
+/*
+ * Forgets the station address, from IP_EVENT_STA_LOST_IP.
+ */
+void wifi_link_lost_ip(void);
+
+/*
+ * Records a link loss, from WIFI_EVENT_STA_DISCONNECTED.
+ * @param reason wifi_err_reason_t
+ * @param rssi RSSI of the access point
+ */
+void wifi_link_disconnected(uint16_t reason, int8_t rssi);
+
+/*
+ * Copies the link information without locking and without calling the wifi
+ * driver, a copy racing with an update is retried.
+ * @param info filled with the copy
+ */
+void wifi_link_get(wifi_link_info_t *info);
+
+#endif // !WIFI_LINK_H
@@ -0,0 +1,73 @@
+#ifndef WIFI_NETWORKS_H
+#define WIFI_NETWORKS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_wifi_types_generic.h"
+#include "nvs.h"
+#include "wifi_scan.h"
+
+// Failed attempts on a network before the next ranked one is tried
+#define WIFI_NETWORKS_ATTEMPTS 2
+// Score of one priority step, in dB of RSSI
+#define WIFI_NETWORKS_PRIORITY_DB 10
+// Score of the network of the last successful connection, in dB of RSSI
+#define WIFI_NETWORKS_LAST_SUCCESS_DB 8
+// Score of a network that connected before, in dB of RSSI
+#define WIFI_NETWORKS_HISTORY_DB 4
+
+/*
+ * Loads the known networks from nvs.
+ * @return number of known networks
+ */
+size_t wifi_networks_load(void);
+
+/*
+ * Records a successful connection: a new network is added, evicting the
+ * least preferred one when the store is full, and a known one becomes the
+ * last success. Saved to nvs only when something changed.
+ * @param config station config that connected
+ * @param set_priority true for a connect from the http server with a
+ * priority, it replaces that of a known network
+ * @param priority priority of the network, used for a new network and when
+ * set_priority is true
+ * @return ESP_OK, or the nvs error
+ */
+esp_err_t wifi_networks_connected(const wifi_config_t *config, bool set_priority, uint8_t priority);
+
+/*
+ * Forgets a network, e.g. when the user disconnects from it.
+ * @param ssid network to forget
+ * @return ESP_OK, or the nvs error
+ */
+esp_err_t wifi_networks_forget(const uint8_t *ssid);
+
+/*
+ * Ranks the known networks seen by a scan, by RSSI plus the priority and
+ * history bonuses. Without scan results every known network is ranked by
+ * priority and history only.
+ * @param results scan results, NULL to rank without a scan
+ * @param count number of scan results
+ * @return number of ranked networks
+ */
+size_t wifi_networks_rank(const wifi_scan_result_t *results, size_t count);
+
+/*
+ * Selects a known network by SSID, e.g. the network of the cached
+ * connection, as the only ranked one.
+ * @param ssid network to select
+ * @return true if the network is known
+ */
+bool wifi_networks_select(const uint8_t *ssid);
+
+/*
+ * Copies the credentials of the next ranked network to a station config.
+ * @param config station config, the credentials replace its content
+ * @return false once every ranked network was returned
+ */
+bool wifi_networks_next(wifi_config_t *config);
+
+#endif // !WIFI_NETWORKS_H
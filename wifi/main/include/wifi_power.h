@@ -0,0 +1,134 @@
+#ifndef WIFI_POWER_H
+#define WIFI_POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "wifi_power_model.h"
+
+/*
+ * Power profiles, each sets the station modem sleep mode, the listen
+ * interval and the MQTT keepalive
+ */
+typedef enum wifi_power_profile {
+    WIFI_POWER_PERFORMANCE = 0, // radio always on, lowest latency
+    WIFI_POWER_BALANCED,        // wakes every DTIM, always on while busy
+    WIFI_POWER_LOW_POWER,       // wakes every listen interval
+    WIFI_POWER_PROFILE_COUNT,
+} wifi_power_profile_e;
+
+/*
+ * Activities the balanced profile keeps the radio on for
+ */
+typedef enum wifi_power_busy {
+    WIFI_POWER_BUSY_HTTP = 0, // an http request is being handled
+    WIFI_POWER_BUSY_OTA,      // the OTA writer is active
+    WIFI_POWER_BUSY_COUNT,
+} wifi_power_busy_e;
+
+// Profile used at boot
+#define WIFI_POWER_PROFILE_DEFAULT WIFI_POWER_BALANCED
+// The radio stays on this long after the last http request, so the next
+// request of the same page or poll is not delayed by modem sleep
+#define WIFI_POWER_BUSY_HOLD_MS 5000
+// DTIM period of the access point, in beacons, most use 1
+#define WIFI_POWER_DTIM_PERIOD 1
+
+/*
+ * Report of one profile, modeled over the same time and traffic as the one
+ * in use
+ */
+typedef struct wifi_power_profile_report {
+    uint32_t radio_on_ms;
+    uint32_t energy_mj;
+    uint32_t latency_ms; // average delay of frames sent to the station
+} wifi_power_profile_report_t;
+
+/*
+ * Power report
+ */
+typedef struct wifi_power_report {
+    wifi_power_profile_e profile;
+    bool awake;  // radio always on right now
+    uint8_t busy; // bit per wifi_power_busy_e
+    uint32_t elapsed_ms;
+    uint32_t tx_count;
+    wifi_power_profile_report_t profiles[WIFI_POWER_PROFILE_COUNT];
+} wifi_power_report_t;
+
+/*
+ * Applies the default profile, called by the wifi app task once the wifi
+ * driver is initialized.
+ */
+void wifi_power_init(void);
+
+/*
+ * Selects a profile, the listen interval applies from the next connection
+ * and the MQTT keepalive from the next MQTT connection.
+ * @param profile profile to use
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG
+ */
+esp_err_t wifi_power_set_profile(wifi_power_profile_e profile);
+
+/*
+ * Gets the profile in use.
+ */
+wifi_power_profile_e wifi_power_get_profile(void);
+
+/*
+ * Gets the name of a profile, e.g. for JSON.
+ * @param profile profile
+ * @return "performance", "balanced", "low-power", or NULL
+ */
+const char *wifi_power_profile_name(wifi_power_profile_e profile);
+
+/*
+ * Looks a profile up by name.
+ * @param name name as returned by wifi_power_profile_name
+ * @param profile set to the profile found
+ * @return true if found
+ */
+bool wifi_power_parse_profile(const char *name, wifi_power_profile_e *profile);
+
+/*
+ * Gets the station listen interval of the profile in use, in beacons.
+ */
+uint16_t wifi_power_listen_interval(void);
+
+/*
+ * Gets the MQTT keepalive of the profile in use, in seconds.
+ */
+uint16_t wifi_power_keepalive_s(void);
+
+/*
+ * Marks the start of an activity, calls may nest.
+ * @param busy activity
+ */
+void wifi_power_busy_begin(wifi_power_busy_e busy);
+
+/*
+ * Marks the end of an activity started with wifi_power_busy_begin.
+ * @param busy activity
+ */
+void wifi_power_busy_end(wifi_power_busy_e busy);
+
+/*
+ * Accounts a transmission of the application, e.g. an MQTT publish.
+ */
+void wifi_power_tx(void);
+
+/*
+ * Records a SoftAP state change, the station does not sleep while the
+ * SoftAP is on.
+ * @param enabled SoftAP on
+ */
+void wifi_power_ap_changed(bool enabled);
+
+/*
+ * Gets the power report.
+ * @param report filled with the report
+ */
+void wifi_power_get_report(wifi_power_report_t *report);
+
+#endif // !WIFI_POWER_H
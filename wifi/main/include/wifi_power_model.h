@@ -0,0 +1,80 @@
+#ifndef WIFI_POWER_MODEL_H
+#define WIFI_POWER_MODEL_H
+
+#include <stdint.h>
+
+/*
+ * Radio on time model of the station power save modes. The driver does not
+ * report how long the radio was on, so it is estimated from the time spent
+ * in each mode and the transmissions:
+ *  - awake (WIFI_PS_NONE, or any mode while the SoftAP is on): the receiver
+ *    is always on, frames to the station are received immediately
+ *  - modem sleep: the radio wakes every wake interval (the DTIM period, or
+ *    the listen interval with WIFI_PS_MAX_MODEM) for a beacon, frames
+ *    buffered by the access point wait half an interval on average
+ *  - each transmission keeps the radio on for the frame and the time the
+ *    station waits for a reply before sleeping again
+ * The currents are typical ESP32-C6 figures, the results are estimates to
+ * compare the profiles, not measurements. Pure C with the clock passed in,
+ * so it also runs on a host.
+ */
+
+// Beacon interval of most access points, 100 TU
+#define WIFI_POWER_MODEL_BEACON_US 102400
+// Radio on time of a beacon wake up
+#define WIFI_POWER_MODEL_BEACON_RX_US 3000
+// Radio on time of a transmission and the wait for its reply
+#define WIFI_POWER_MODEL_TX_US 30000
+// Supply voltage and currents with the radio receiving and asleep
+#define WIFI_POWER_MODEL_SUPPLY_MV 3300
+#define WIFI_POWER_MODEL_RX_MA 80
+#define WIFI_POWER_MODEL_SLEEP_MA 20
+
+/*
+ * Accumulated model
+ */
+typedef struct wifi_power_model {
+    uint64_t elapsed_us;
+    uint64_t radio_on_us;
+    uint64_t latency_us_x_us; // modeled downlink latency weighted by time
+    uint32_t wakeups;
+    uint32_t tx_count;
+    uint32_t residual_us; // time since the last modeled wake up
+} wifi_power_model_t;
+
+/*
+ * Initializes a model.
+ * @param m model
+ */
+void wifi_power_model_init(wifi_power_model_t *m);
+
+/*
+ * Accounts the time spent in one mode.
+ * @param m model
+ * @param wake_interval_us radio wake up interval, 0 when always awake
+ * @param elapsed_us time spent in the mode
+ */
+void wifi_power_model_advance(wifi_power_model_t *m, uint32_t wake_interval_us, uint64_t elapsed_us);
+
+/*
+ * Accounts a transmission.
+ * @param m model
+ * @param wake_interval_us radio wake up interval, 0 when always awake
+ */
+void wifi_power_model_tx(wifi_power_model_t *m, uint32_t wake_interval_us);
+
+/*
+ * Gets the estimated energy used by the radio and the modem.
+ * @param m model
+ * @return energy in millijoules
+ */
+uint32_t wifi_power_model_energy_mj(const wifi_power_model_t *m);
+
+/*
+ * Gets the modeled average latency added to frames sent to the station.
+ * @param m model
+ * @return latency in milliseconds
+ */
+uint32_t wifi_power_model_latency_ms(const wifi_power_model_t *m);
+
+#endif // !WIFI_POWER_MODEL_H
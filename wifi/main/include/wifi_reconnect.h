@@ -0,0 +1,67 @@
+#ifndef WIFI_RECONNECT_H
+#define WIFI_RECONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// First backoff delay, after the immediate retry
+#define WIFI_RECONNECT_BASE_MS 500
+// Backoff cap, the scheduler keeps retrying at this pace
+#define WIFI_RECONNECT_MAX_MS 60000
+
+/*
+ * Time to reconnect statistics
+ */
+typedef struct wifi_reconnect_stats {
+    uint32_t disconnects;  // links lost, or first connections failed
+    uint32_t reconnects;   // links recovered
+    uint32_t attempts;     // connection attempts scheduled
+    uint32_t last_ms;      // time to reconnect of the last recovery
+    uint32_t max_ms;
+    uint64_t total_ms;     // average is total_ms / reconnects
+} wifi_reconnect_stats_t;
+
+/*
+ * Reconnect scheduler. Pure logic, the clock is passed in, so it runs the
+ * same with esp_timer on the target and with a simulated clock on a host.
+ */
+typedef struct wifi_reconnect {
+    uint32_t attempt;        // failed attempts since the link was lost
+    int64_t disconnected_us; // time the link was lost, 0 while connected
+    uint32_t rng;            // xorshift32 state of the jitter
+    wifi_reconnect_stats_t stats;
+} wifi_reconnect_t;
+
+/*
+ * Initializes a scheduler.
+ * @param r scheduler
+ * @param seed jitter seed, e.g. esp_random(), 0 is replaced
+ */
+void wifi_reconnect_init(wifi_reconnect_t *r, uint32_t seed);
+
+/*
+ * Records a disconnect or a failed attempt and gets the delay of the next
+ * attempt: 0 the first time, then WIFI_RECONNECT_BASE_MS doubling up to
+ * WIFI_RECONNECT_MAX_MS, with half of it randomized so devices losing the
+ * same AP do not retry in step.
+ * @param r scheduler
+ * @param now_us current time
+ * @return delay before the next attempt in milliseconds
+ */
+uint32_t wifi_reconnect_on_disconnect(wifi_reconnect_t *r, int64_t now_us);
+
+/*
+ * Records a connection and the time it took to recover.
+ * @param r scheduler
+ * @param now_us current time
+ */
+void wifi_reconnect_on_connected(wifi_reconnect_t *r, int64_t now_us);
+
+/*
+ * Forgets the current outage, e.g. when the user disconnects or connects to
+ * another network. The statistics are kept.
+ * @param r scheduler
+ */
+void wifi_reconnect_reset(wifi_reconnect_t *r);
+
+#endif // !WIFI_RECONNECT_H
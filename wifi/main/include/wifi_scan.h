@@ -0,0 +1,69 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Access points kept from a scan, the strongest per SSID
+#define WIFI_SCAN_MAX_APS 20
+// Age after which the cached results are refreshed, a scan takes the radio
+// off the station channel for a few seconds
+#define WIFI_SCAN_TTL_MS 30000
+// Longest wait for a scan requested by wifi_scan_wait
+#define WIFI_SCAN_TIMEOUT_MS 6000
+
+/*
+ * Access point seen by a scan
+ */
+typedef struct wifi_scan_result {
+    char ssid[33];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t authmode; // wifi_auth_mode_t
+} wifi_scan_result_t;
+
+/*
+ * Initializes the scan service, called before wifi is started.
+ */
+void wifi_scan_init(void);
+
+/*
+ * Starts a scan in the background unless one is running. It fails while the
+ * station is connecting.
+ * @return ESP_OK, or the esp_wifi_scan_start error
+ */
+esp_err_t wifi_scan_start(void);
+
+/*
+ * Reads the results of the scan into the cache, called on
+ * WIFI_EVENT_SCAN_DONE. A failed scan keeps the previous results.
+ * @param success scan status of the event is 0
+ */
+void wifi_scan_done(bool success);
+
+/*
+ * Copies the cached results, deduplicated by SSID and strongest first, and
+ * starts a background scan when they are older than WIFI_SCAN_TTL_MS. Never
+ * blocks on the radio.
+ * @param results filled with the cached results
+ * @param max capacity of results
+ * @param age_ms age of the results, UINT32_MAX if no scan completed yet
+ * @param scanning true while a scan is running
+ * @return number of results copied
+ */
+size_t wifi_scan_get(wifi_scan_result_t *results, size_t max, uint32_t *age_ms, bool *scanning);
+
+/*
+ * Gets fresh results, scanning and waiting up to WIFI_SCAN_TIMEOUT_MS when
+ * the cached ones are stale. Not to be called from the event loop task, which
+ * completes the scan.
+ * @param results filled with the results
+ * @param max capacity of results
+ * @return number of results copied, 0 if the scan failed
+ */
+size_t wifi_scan_wait(wifi_scan_result_t *results, size_t max);
+
+#endif // !WIFI_SCAN_H
@@ -0,0 +1,134 @@
+#ifndef WIFI_STATE_H
+#define WIFI_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Transitions kept with their timestamp
+#define WIFI_STATE_HISTORY_LEN 8
+// A link lost sooner than this after GOT_IP counts as a flap
+#define WIFI_STATE_FLAP_MS 30000
+
+/*
+ * Station connection states
+ */
+typedef enum wifi_state {
+    WIFI_STATE_IDLE = 0,      // no network to connect to
+    WIFI_STATE_CONNECTING,    // connecting to a network, until GOT_IP
+    WIFI_STATE_CONNECTED,     // GOT_IP
+    WIFI_STATE_RECONNECTING,  // link lost, retried until it is back
+    WIFI_STATE_FAILED,        // credentials from the http server did not connect
+    WIFI_STATE_DISCONNECTING, // user requested disconnect, until the link is down
+    WIFI_STATE_DISCONNECTED,  // disconnected by the user
+    WIFI_STATE_COUNT,
+} wifi_state_e;
+
+/*
+ * Events driving the state machine
+ */
+typedef enum wifi_state_event {
+    WIFI_STATE_EV_CONNECT_SAVED = 0, // connecting to a known network
+    WIFI_STATE_EV_CONNECT_HTTP,      // connecting with credentials from the http server
+    WIFI_STATE_EV_ASSOCIATED,        // WIFI_EVENT_STA_CONNECTED
+    WIFI_STATE_EV_GOT_IP,            // IP_EVENT_STA_GOT_IP
+    WIFI_STATE_EV_LINK_DOWN,         // WIFI_EVENT_STA_DISCONNECTED
+    WIFI_STATE_EV_GIVE_UP,           // retries of the http server credentials exhausted
+    WIFI_STATE_EV_USER_DISCONNECT,   // disconnect from the page or the reset button
+    WIFI_STATE_EV_COUNT,
+} wifi_state_event_e;
+
+/*
+ * Where the credentials being connected come from
+ */
+typedef enum wifi_state_origin {
+    WIFI_STATE_ORIGIN_NONE = 0,
+    WIFI_STATE_ORIGIN_SAVED, // known network, or one that connected before
+    WIFI_STATE_ORIGIN_HTTP,  // new credentials from the http server
+} wifi_state_origin_e;
+
+/*
+ * A transition, self transitions included
+ */
+typedef struct wifi_state_transition {
+    int64_t timestamp_us;
+    uint8_t from;   // wifi_state_e
+    uint8_t to;     // wifi_state_e
+    uint8_t event;  // wifi_state_event_e
+    uint8_t origin; // wifi_state_origin_e of the from state
+} wifi_state_transition_t;
+
+/*
+ * Connection metrics, times are measured from the connect request, or from
+ * the link loss for a reconnect
+ */
+typedef struct wifi_state_metrics {
+    uint32_t connects;            // GOT_IP reached
+    uint32_t last_connect_ms;     // time to associate
+    uint32_t max_connect_ms;
+    uint32_t last_ip_ms;          // time to GOT_IP
+    uint32_t max_ip_ms;
+    uint32_t outages;             // links lost
+    uint32_t flaps;               // links lost within WIFI_STATE_FLAP_MS
+    uint32_t last_outage_ms;
+    uint32_t max_outage_ms;
+    uint64_t total_outage_ms;
+} wifi_state_metrics_t;
+
+/*
+ * State machine. Pure logic driven through a transition table, the clock is
+ * passed in, so it builds for the linux target and scenarios can be replayed
+ * with a simulated clock.
+ */
+typedef struct wifi_state_machine {
+    wifi_state_e state;
+    wifi_state_origin_e origin;
+    int64_t entered_us;       // time the state was entered
+    int64_t attempt_us;       // start of the connection or the outage
+    int64_t associated_us;    // time of the association, 0 until then
+    int64_t outage_us;        // start of the outage, 0 when none
+    wifi_state_metrics_t metrics;
+    wifi_state_transition_t history[WIFI_STATE_HISTORY_LEN];
+    uint32_t transitions;     // transitions so far, the last one is at
+                              // history[(transitions - 1) % WIFI_STATE_HISTORY_LEN]
+} wifi_state_machine_t;
+
+/*
+ * Initializes a state machine in WIFI_STATE_IDLE.
+ * @param sm state machine
+ * @param now_us current time
+ */
+void wifi_state_init(wifi_state_machine_t *sm, int64_t now_us);
+
+/*
+ * Feeds an event, the table gives the next state. Events the table has no
+ * transition for in the current state are ignored.
+ * @param sm state machine
+ * @param event event
+ * @param now_us time of the event
+ * @param transition set to the transition taken, may be NULL
+ * @return true if a transition was taken
+ */
+bool wifi_state_dispatch(wifi_state_machine_t *sm,
+                         wifi_state_event_e event,
+                         int64_t now_us,
+                         wifi_state_transition_t *transition);
+
+/*
+ * Gets the outage duration up to now, the outage in progress included.
+ * @param sm state machine
+ * @param now_us current time
+ * @return total outage in milliseconds
+ */
+uint64_t wifi_state_outage_ms(const wifi_state_machine_t *sm, int64_t now_us);
+
+/*
+ * Gets the name of a state, for logs and JSON.
+ */
+const char *wifi_state_name(wifi_state_e state);
+
+/*
+ * Gets the name of an event, for logs and JSON.
+ */
+const char *wifi_state_event_name(wifi_state_event_e event);
+
+#endif // !WIFI_STATE_H
@@ -41,20 +41,63 @@
 #include "driver/sdmmc_host.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include "json_writer.h"
+#include "mqtt_ota.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "tasks_common.h"
 #include "wifi.h"
+#include "wifi_power.h"
 
 static const char *TAG = "aws_iot";
 
 // AWS IoT task handle
 static TaskHandle_t task_aws_iot = NULL;
 
+// MQTT round trip times of the current report window
+static uint32_t rtt_min_ms = UINT32_MAX;
+static uint32_t rtt_max_ms;
+static uint32_t rtt_total_ms;
+static uint32_t rtt_count;
+
+/*
+ * Records the round trip time of a QOS1 publish and logs the window with the
+ * SoftAP state, to compare the latency with the SoftAP on and off.
+ * @param rtt_ms publish to acknowledgment time
+ */
+static void aws_iot_record_rtt(uint32_t rtt_ms)
+{
+    wifi_ap_stats_t ap_stats;
+
+    rtt_min_ms = rtt_ms < rtt_min_ms ? rtt_ms : rtt_min_ms;
+    rtt_max_ms = rtt_ms > rtt_max_ms ? rtt_ms : rtt_max_ms;
+    rtt_total_ms += rtt_ms;
+    if (++rtt_count < AWS_IOT_RTT_WINDOW)
+    {
+        return;
+    }
+
+    wifi_get_ap_stats(&ap_stats);
+    ESP_LOGI(TAG,
+             "MQTT RTT min %lu avg %lu max %lu ms, SoftAP %s (on %lu ms, off %lu ms)",
+             (unsigned long)rtt_min_ms,
+             (unsigned long)(rtt_total_ms / rtt_count),
+             (unsigned long)rtt_max_ms,
+             ap_stats.enabled ? "on" : "off",
+             (unsigned long)ap_stats.on_ms,
+             (unsigned long)ap_stats.off_ms);
+
+    rtt_min_ms = UINT32_MAX;
+    rtt_max_ms = 0;
+    rtt_total_ms = 0;
+    rtt_count = 0;
+}
+
 /**
  * CA Root certificate, device ("Thing") certificate and device ("Thing") key.
  * "Embedded Certs" are loaded from files in "certs/" and embedded into the app
@@ -120,12 +163,12 @@ void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data)
 void aws_iot_task(void *param)
 {
     char cPayload[100];
-
-    int32_t i = 0;
+    json_writer_t json;
 
     IoT_Error_t rc = FAILURE;
 
-    AWS_IoT_Client client;
+    // static, its buffers hold a whole OTA chunk (CONFIG_AWS_IOT_MQTT_RX_BUF_LEN)
+    static AWS_IoT_Client client;
     IoT_Client_Init_Params mqttInitParams = iotClientInitParamsDefault;
     IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
 
@@ -155,7 +198,7 @@ void aws_iot_task(void *param)
         abort();
     }
 
-    connectParams.keepAliveIntervalInSec = 10;
+    connectParams.keepAliveIntervalInSec = wifi_power_keepalive_s();
     connectParams.isCleanSession = true;
     connectParams.MQTTVersion = MQTT_3_1_1;
     /* Client ID is set in aws_iot.h and AKA your Thing's Name in AWS IoT */
@@ -198,7 +241,10 @@ void aws_iot_task(void *param)
         abort();
     }
 
-    sprintf(cPayload, "%s : %ld ", "hello from SDK", i);
+    if (mqtt_ota_subscribe(&client) != ESP_OK)
+    {
+        abort();
+    }
 
     paramsQOS0.qos = QOS0;
     paramsQOS0.payload = (void *)cPayload;
@@ -208,6 +254,7 @@ void aws_iot_task(void *param)
     paramsQOS1.payload = (void *)cPayload;
     paramsQOS1.isRetained = 0;
 
+    int64_t last_publish_us = 0;
     while ((NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc))
     {
         // Max time the yield function will wait for read messages
@@ -218,20 +265,48 @@ void aws_iot_task(void *param)
             // loop.
             continue;
         }
+        if (NETWORK_RECONNECTED == rc)
+        {
+            mqtt_ota_reconnected();
+        }
+
+        // OTA chunks are requested as soon as the previous ones arrived, the
+        // sensor readings are still published every 3 seconds
+        mqtt_ota_poll(&client);
+        if (esp_timer_get_time() - last_publish_us < 3000000)
+        {
+            continue;
+        }
+        last_publish_us = esp_timer_get_time();
 
         ESP_LOGI(TAG,
                  "Stack remaining for task '%s' is %d bytes",
                  pcTaskGetName(NULL),
                  uxTaskGetStackHighWaterMark(NULL));
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
-        sprintf(cPayload, "%s : %d ", "WiFi RSSI", wifi_get_rssi());
-        paramsQOS0.payloadLen = strlen(cPayload);
+        json_writer_init(&json, cPayload, sizeof(cPayload), NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_int(&json, "rssi", wifi_get_rssi());
+        json_writer_end_object(&json);
+        json_writer_finish(&json);
+        paramsQOS0.payloadLen = json_writer_length(&json);
         rc = aws_iot_mqtt_publish(&client, TOPIC, TOPIC_LEN, &paramsQOS0);
-
-        sprintf(cPayload, "%s : %.1f, %s : %.1f", "Temperature", 10.0, "Humidity", 20.0);
-        paramsQOS1.payloadLen = strlen(cPayload);
+        wifi_power_tx();
+
+        json_writer_init(&json, cPayload, sizeof(cPayload), NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_fixed(&json, "temperature", temperature, 1);
+        json_writer_fixed(&json, "humidity", humidity, 1);
+        json_writer_end_object(&json);
+        json_writer_finish(&json);
+        paramsQOS1.payloadLen = json_writer_length(&json);
+        int64_t publish_us = esp_timer_get_time();
         rc = aws_iot_mqtt_publish(&client, TOPIC, TOPIC_LEN, &paramsQOS1);
-        if (rc == MQTT_REQUEST_TIMEOUT_ERROR)
+        wifi_power_tx();
+        if (rc == SUCCESS)
+        {
+            aws_iot_record_rtt((esp_timer_get_time() - publish_us) / 1000);
+        }
+        else if (rc == MQTT_REQUEST_TIMEOUT_ERROR)
         {
             ESP_LOGW(TAG, "QOS1 publish ack not received.");
             rc = SUCCESS;
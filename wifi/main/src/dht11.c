@@ -5,6 +5,7 @@
 #include "dht.h"
 #include "esp_log.h"
 #include "freertos/idf_additions.h"
+#include "http_server_ws.h"
 #include "portmacro.h"
 #include "tasks_common.h"
 
@@ -17,6 +18,9 @@ static const char TAG[] = "DHT11";
  */
 static void DHT11_task(void *pvParameter)
 {
+    float last_humidity = -1.0f;
+    float last_temperature = -1.0f;
+
     ESP_LOGI(TAG, "DHT11_task: starting task");
 
     for (;;)
@@ -25,6 +29,14 @@ static void DHT11_task(void *pvParameter)
         temperature = 20.0f;
         humidity = 100.0f;
 
+        // push the sample to the web page only when it changed
+        if (humidity != last_humidity || temperature != last_temperature)
+        {
+            last_humidity = humidity;
+            last_temperature = temperature;
+            http_server_ws_notify(HTTP_WS_TOPIC_DHT_SENSOR);
+        }
+
         printf("humidity: %.1f ", humidity);
         printf("temperature: %.1f", temperature);
         printf("\n");
@@ -0,0 +1,346 @@
+#include "event_bus.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "portmacro.h"
+#include "tasks_common.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "event_bus";
+
+/*
+ * Lane and full-lane policy of each event. Link events and user requests
+ * take the high lane and coalesce, so the latest one is always delivered
+ * and in order; work the wifi app task posts itself takes the normal lane,
+ * page notifications the low one.
+ */
+static const struct {
+    uint8_t lane;   // event_bus_lane_e
+    uint8_t policy; // event_bus_policy_e
+    const char *name;
+} event_bus_events[EVENT_BUS_ID_COUNT] = {
+    [EVENT_BUS_WIFI_STA_CONNECTED] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_COALESCE, "WIFI_STA_CONNECTED"},
+    [EVENT_BUS_WIFI_STA_GOT_IP] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_COALESCE, "WIFI_STA_GOT_IP"},
+    [EVENT_BUS_WIFI_STA_DISCONNECTED] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_COALESCE, "WIFI_STA_DISCONNECTED"},
+    [EVENT_BUS_WIFI_CONNECT_HTTP] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_COALESCE, "WIFI_CONNECT_HTTP"},
+    [EVENT_BUS_WIFI_USER_DISCONNECT] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_COALESCE, "WIFI_USER_DISCONNECT"},
+    // a second press means more than the first one
+    [EVENT_BUS_WIFI_RESET_BUTTON] = {EVENT_BUS_LANE_HIGH, EVENT_BUS_DROP_NEWEST, "WIFI_RESET_BUTTON"},
+    [EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS] = {EVENT_BUS_LANE_NORMAL,
+                                               EVENT_BUS_DROP_NEWEST,
+                                               "WIFI_LOAD_SAVED_CREDENTIALS"},
+    [EVENT_BUS_WIFI_START_HTTP_SERVER] = {EVENT_BUS_LANE_NORMAL, EVENT_BUS_DROP_NEWEST, "WIFI_START_HTTP_SERVER"},
+    [EVENT_BUS_WIFI_STA_RECONNECT] = {EVENT_BUS_LANE_NORMAL, EVENT_BUS_COALESCE, "WIFI_STA_RECONNECT"},
+    [EVENT_BUS_WIFI_AP_STOP] = {EVENT_BUS_LANE_NORMAL, EVENT_BUS_COALESCE, "WIFI_AP_STOP"},
+    [EVENT_BUS_WIFI_CONNECTED] = {EVENT_BUS_LANE_NORMAL, EVENT_BUS_COALESCE, "WIFI_CONNECTED"},
+    [EVENT_BUS_WIFI_STATE_CHANGED] = {EVENT_BUS_LANE_LOW, EVENT_BUS_COALESCE, "WIFI_STATE_CHANGED"},
+    [EVENT_BUS_OTA_RESULT] = {EVENT_BUS_LANE_NORMAL, EVENT_BUS_COALESCE, "OTA_RESULT"},
+    [EVENT_BUS_TIME_SYNCED] = {EVENT_BUS_LANE_LOW, EVENT_BUS_COALESCE, "TIME_SYNCED"},
+};
+
+static const uint8_t event_bus_lane_depth[EVENT_BUS_LANE_COUNT] = {
+    EVENT_BUS_HIGH_DEPTH, EVENT_BUS_NORMAL_DEPTH, EVENT_BUS_LOW_DEPTH};
+
+#define EVENT_BUS_SLOTS (EVENT_BUS_HIGH_DEPTH + EVENT_BUS_NORMAL_DEPTH + EVENT_BUS_LOW_DEPTH)
+
+/*
+ * Pending events of a subscriber in one lane, oldest first
+ */
+typedef struct event_bus_ring {
+    event_bus_event_t *slots;
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+} event_bus_ring_t;
+
+struct event_bus_subscriber {
+    uint32_t mask;
+    SemaphoreHandle_t signal; // given after each publish to the subscriber
+    event_bus_ring_t lanes[EVENT_BUS_LANE_COUNT];
+};
+
+// Subscribers, appended only, the rings and counters are guarded by the lock
+static event_bus_subscriber_t event_bus_subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+static event_bus_event_t event_bus_slots[EVENT_BUS_MAX_SUBSCRIBERS][EVENT_BUS_SLOTS];
+static volatile size_t event_bus_subscriber_count;
+static event_bus_lane_stats_t event_bus_stats[EVENT_BUS_LANE_COUNT];
+static portMUX_TYPE event_bus_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Callbacks and the subscriber of their dispatcher task
+static struct {
+    uint32_t mask;
+    event_bus_callback_t callback;
+    void *ctx;
+} event_bus_callbacks[EVENT_BUS_MAX_CALLBACKS];
+static volatile size_t event_bus_callback_count;
+static event_bus_subscriber_t *event_bus_dispatcher;
+
+/*
+ * Gets a pending event of a ring, 0 is the oldest.
+ */
+static event_bus_event_t *event_bus_ring_at(event_bus_ring_t *ring, uint8_t index)
+{
+    return &ring->slots[(ring->head + index) % ring->depth];
+}
+
+/*
+ * Removes a pending event, the newer ones move up.
+ */
+static void event_bus_ring_remove(event_bus_ring_t *ring, uint8_t index)
+{
+    for (uint8_t i = index; i + 1 < ring->count; i++)
+    {
+        *event_bus_ring_at(ring, i) = *event_bus_ring_at(ring, i + 1);
+    }
+    ring->count--;
+}
+
+/*
+ * Queues an event to one subscriber, called with the lock held.
+ * @return true if queued
+ */
+static bool event_bus_enqueue(event_bus_subscriber_t *subscriber, const event_bus_event_t *event)
+{
+    event_bus_lane_e lane = event_bus_events[event->id].lane;
+    event_bus_policy_e policy = event_bus_events[event->id].policy;
+    event_bus_ring_t *ring = &subscriber->lanes[lane];
+    event_bus_lane_stats_t *stats = &event_bus_stats[lane];
+    uint16_t coalesced = 0;
+
+    if (policy == EVENT_BUS_COALESCE)
+    {
+        for (uint8_t i = 0; i < ring->count; i++)
+        {
+            if (event_bus_ring_at(ring, i)->id == event->id)
+            {
+                // the new one goes to the tail, so events of other ids
+                // published in between are still seen before it, and it
+                // counts the ones it replaced
+                coalesced = event_bus_ring_at(ring, i)->coalesced;
+                coalesced += coalesced < UINT16_MAX;
+                event_bus_ring_remove(ring, i);
+                stats->coalesced++;
+                stats->depth--;
+                break;
+            }
+        }
+    }
+
+    if (ring->count == ring->depth)
+    {
+        stats->dropped++;
+        if (policy == EVENT_BUS_DROP_NEWEST)
+        {
+            return false;
+        }
+        ring->head = (ring->head + 1) % ring->depth;
+        ring->count--;
+        stats->depth--;
+    }
+
+    *event_bus_ring_at(ring, ring->count) = *event;
+    event_bus_ring_at(ring, ring->count)->coalesced = coalesced;
+    ring->count++;
+    stats->published++;
+    stats->depth++;
+    if (stats->depth > stats->max_depth)
+    {
+        stats->max_depth = stats->depth;
+    }
+    return true;
+}
+
+/*
+ * Dispatcher task, runs the callbacks.
+ * @param param unused
+ */
+static void event_bus_dispatcher_task(void *param)
+{
+    event_bus_event_t event;
+
+    for (;;)
+    {
+        if (event_bus_receive(event_bus_dispatcher, &event, portMAX_DELAY))
+        {
+            for (size_t i = 0; i < event_bus_callback_count; i++)
+            {
+                if (event_bus_callbacks[i].mask & EVENT_BUS_BIT(event.id))
+                {
+                    event_bus_callbacks[i].callback(&event, event_bus_callbacks[i].ctx);
+                }
+            }
+        }
+    }
+}
+
+event_bus_subscriber_t *event_bus_subscribe(uint32_t mask)
+{
+    event_bus_subscriber_t *subscriber = NULL;
+    SemaphoreHandle_t signal = xSemaphoreCreateBinary();
+
+    if (signal == NULL)
+    {
+        return NULL;
+    }
+
+    taskENTER_CRITICAL(&event_bus_lock);
+    if (event_bus_subscriber_count < EVENT_BUS_MAX_SUBSCRIBERS)
+    {
+        size_t index = event_bus_subscriber_count;
+        event_bus_event_t *slots = event_bus_slots[index];
+
+        subscriber = &event_bus_subscribers[index];
+        subscriber->mask = mask;
+        subscriber->signal = signal;
+        for (size_t lane = 0; lane < EVENT_BUS_LANE_COUNT; lane++)
+        {
+            subscriber->lanes[lane] = (event_bus_ring_t){.slots = slots, .depth = event_bus_lane_depth[lane]};
+            slots += event_bus_lane_depth[lane];
+        }
+        event_bus_subscriber_count = index + 1;
+    }
+    taskEXIT_CRITICAL(&event_bus_lock);
+
+    if (subscriber == NULL)
+    {
+        ESP_LOGE(TAG, "event_bus_subscribe: EVENT_BUS_MAX_SUBSCRIBERS reached");
+        vSemaphoreDelete(signal);
+    }
+    return subscriber;
+}
+
+esp_err_t event_bus_subscribe_callback(uint32_t mask, event_bus_callback_t callback, void *ctx)
+{
+    if (event_bus_callback_count == EVENT_BUS_MAX_CALLBACKS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (event_bus_dispatcher == NULL)
+    {
+        event_bus_dispatcher = event_bus_subscribe(0);
+        if (event_bus_dispatcher == NULL ||
+            xTaskCreatePinnedToCore(&event_bus_dispatcher_task,
+                                    "event_bus",
+                                    EVENT_BUS_TASK_STACK_SIZE,
+                                    NULL,
+                                    EVENT_BUS_TASK_PRIORITY,
+                                    NULL,
+                                    EVENT_BUS_TASK_CORE_ID) != pdPASS)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    event_bus_callbacks[event_bus_callback_count].mask = mask;
+    event_bus_callbacks[event_bus_callback_count].callback = callback;
+    event_bus_callbacks[event_bus_callback_count].ctx = ctx;
+    event_bus_callback_count++;
+
+    taskENTER_CRITICAL(&event_bus_lock);
+    event_bus_dispatcher->mask |= mask;
+    taskEXIT_CRITICAL(&event_bus_lock);
+
+    return ESP_OK;
+}
+
+void event_bus_publish(event_bus_event_t *event)
+{
+    size_t count = event_bus_subscriber_count;
+
+    event->timestamp_us = esp_timer_get_time();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        event_bus_subscriber_t *subscriber = &event_bus_subscribers[i];
+        bool subscribed;
+        bool queued = false;
+
+        taskENTER_CRITICAL(&event_bus_lock);
+        subscribed = subscriber->mask & EVENT_BUS_BIT(event->id);
+        if (subscribed)
+        {
+            queued = event_bus_enqueue(subscriber, event);
+        }
+        taskEXIT_CRITICAL(&event_bus_lock);
+
+        if (queued)
+        {
+            xSemaphoreGive(subscriber->signal);
+        }
+        else if (subscribed)
+        {
+            ESP_LOGW(TAG, "event_bus_publish: %s dropped", event_bus_events[event->id].name);
+        }
+    }
+}
+
+void event_bus_post(event_bus_id_e id)
+{
+    event_bus_event_t event = {.id = id};
+    event_bus_publish(&event);
+}
+
+bool event_bus_receive(event_bus_subscriber_t *subscriber, event_bus_event_t *event, TickType_t timeout)
+{
+    for (;;)
+    {
+        bool received = false;
+
+        taskENTER_CRITICAL(&event_bus_lock);
+        for (size_t lane = 0; lane < EVENT_BUS_LANE_COUNT && !received; lane++)
+        {
+            event_bus_ring_t *ring = &subscriber->lanes[lane];
+            if (ring->count > 0)
+            {
+                event_bus_lane_stats_t *stats = &event_bus_stats[lane];
+                uint32_t latency_us;
+
+                *event = *event_bus_ring_at(ring, 0);
+                ring->head = (ring->head + 1) % ring->depth;
+                ring->count--;
+
+                latency_us = (uint32_t)(esp_timer_get_time() - event->timestamp_us);
+                stats->depth--;
+                stats->delivered++;
+                stats->total_latency_us += latency_us;
+                if (latency_us > stats->max_latency_us)
+                {
+                    stats->max_latency_us = latency_us;
+                }
+                received = true;
+            }
+        }
+        taskEXIT_CRITICAL(&event_bus_lock);
+
+        if (received)
+        {
+            return true;
+        }
+        if (xSemaphoreTake(subscriber->signal, timeout) != pdTRUE)
+        {
+            return false;
+        }
+    }
+}
+
+void event_bus_get_stats(event_bus_lane_stats_t *stats)
+{
+    taskENTER_CRITICAL(&event_bus_lock);
+    memcpy(stats, event_bus_stats, sizeof(event_bus_stats));
+    taskEXIT_CRITICAL(&event_bus_lock);
+}
+
+const char *event_bus_name(event_bus_id_e id)
+{
+    return id < EVENT_BUS_ID_COUNT ? event_bus_events[id].name : "UNKNOWN";
+}
@@ -0,0 +1,563 @@
+#include "http_router.h"
+
+#include <errno.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/idf_additions.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "http_parser.h"
+#include "json_writer.h"
+#include "portmacro.h"
+#include "tasks_common.h"
+#include "wifi_power.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "http_router";
+
+// Routes sorted by path then method once registered
+static const http_route_t **router_routes = NULL;
+static size_t router_route_count = 0;
+static bool router_registered = false;
+
+// Metrics of each route, same order as router_routes, guarded by router_stats_mux
+static http_route_stats_t *router_stats = NULL;
+static portMUX_TYPE router_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Slow request handed over to a worker
+ */
+typedef struct http_router_job {
+    httpd_req_t *req; // copy made by httpd_req_async_handler_begin
+    size_t index;     // route index
+    int64_t start_us;
+    uint64_t bytes_out_start;
+} http_router_job_t;
+
+// Slow requests waiting for a worker
+static QueueHandle_t router_job_queue = NULL;
+
+/*
+ * Session transport context, counts the bytes sent on the connection
+ */
+typedef struct http_router_session {
+    uint64_t bytes_out;
+} http_router_session_t;
+
+/*
+ * qsort comparator ordering routes by path, then by method.
+ */
+static int http_router_compare(const void *a, const void *b)
+{
+    const http_route_t *route_a = *(const http_route_t *const *)a;
+    const http_route_t *route_b = *(const http_route_t *const *)b;
+    int cmp = strcmp(route_a->path, route_b->path);
+
+    return cmp != 0 ? cmp : (int)route_a->method - (int)route_b->method;
+}
+
+/*
+ * Compares a URI path, which is not NUL terminated, with a route path.
+ * @return <0, 0 or >0 like strcmp
+ */
+static int http_router_compare_path(const char *path, size_t path_len, const char *route_path)
+{
+    int cmp = strncmp(path, route_path, path_len);
+
+    if (cmp == 0 && route_path[path_len] != '\0')
+    {
+        return -1; // path is a prefix of the route path
+    }
+    return cmp;
+}
+
+/*
+ * Finds the first route of a path by binary search.
+ * @param path URI path
+ * @param path_len length of path
+ * @return index of the route, router_route_count if not found
+ */
+static size_t http_router_find_path(const char *path, size_t path_len)
+{
+    size_t low = 0;
+    size_t high = router_route_count;
+
+    // lower bound, so the first of the routes sharing the path is found
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (http_router_compare_path(path, path_len, router_routes[mid]->path) > 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if (low < router_route_count && http_router_compare_path(path, path_len, router_routes[low]->path) == 0)
+    {
+        return low;
+    }
+    return router_route_count;
+}
+
+/*
+ * Looks up the route of a path and method.
+ * @param path_found set to true if the path has a route for any method
+ * @return index of the route, router_route_count if not found
+ */
+static size_t http_router_find(httpd_method_t method, const char *path, size_t path_len, bool *path_found)
+{
+    size_t i = http_router_find_path(path, path_len);
+
+    *path_found = i < router_route_count;
+
+    // the routes of a path are adjacent, sorted by method
+    for (; i < router_route_count && http_router_compare_path(path, path_len, router_routes[i]->path) == 0; i++)
+    {
+        if (router_routes[i]->method == method)
+        {
+            return i;
+        }
+    }
+
+    return router_route_count;
+}
+
+/*
+ * Counting send function installed on every session, same as the httpd
+ * default send.
+ */
+static int http_router_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    if (buf == NULL)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT
+                                                                           : HTTPD_SOCK_ERR_FAIL;
+    }
+
+    http_router_session_t *session = httpd_sess_get_transport_ctx(hd, sockfd);
+    if (session != NULL)
+    {
+        session->bytes_out += ret;
+    }
+    return ret;
+}
+
+/*
+ * Gets the number of bytes sent so far on the connection of a request.
+ */
+static uint64_t http_router_bytes_out(httpd_req_t *req)
+{
+    http_router_session_t *session = httpd_sess_get_transport_ctx(req->handle, httpd_req_to_sockfd(req));
+
+    return session != NULL ? session->bytes_out : 0;
+}
+
+/*
+ * Admits a request to a route unless its concurrency limit is reached.
+ * @param index route index
+ * @return true if admitted
+ */
+static bool http_router_enter(size_t index)
+{
+    const http_route_t *route = router_routes[index];
+    http_route_stats_t *stats = &router_stats[index];
+    bool admitted;
+
+    taskENTER_CRITICAL(&router_stats_mux);
+    admitted = route->max_concurrent == 0 || stats->in_flight < route->max_concurrent;
+    if (admitted)
+    {
+        stats->in_flight++;
+        if (stats->in_flight > stats->max_in_flight)
+        {
+            stats->max_in_flight = stats->in_flight;
+        }
+    }
+    else
+    {
+        stats->rejected++;
+    }
+    taskEXIT_CRITICAL(&router_stats_mux);
+
+    return admitted;
+}
+
+/*
+ * Records a completed request.
+ * @param index route index
+ * @param req completed request
+ * @param start_us esp_timer_get_time when the request was admitted
+ * @param bytes_out_start http_router_bytes_out when the request was admitted
+ * @param err handler result
+ */
+static void http_router_leave(size_t index, httpd_req_t *req, int64_t start_us, uint64_t bytes_out_start, esp_err_t err)
+{
+    http_route_stats_t *stats = &router_stats[index];
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - start_us);
+    uint64_t bytes_out = http_router_bytes_out(req) - bytes_out_start;
+    size_t bucket = 0;
+
+    while (bucket < HTTP_ROUTER_LATENCY_BUCKETS - 1 && latency_us >= ((uint32_t)HTTP_ROUTER_LATENCY_MIN_US << bucket))
+    {
+        bucket++;
+    }
+
+    taskENTER_CRITICAL(&router_stats_mux);
+    stats->in_flight--;
+    stats->count++;
+    stats->errors += err != ESP_OK;
+    stats->bytes_in += req->content_len;
+    stats->bytes_out += bytes_out;
+    stats->latency_hist[bucket]++;
+    if (latency_us > stats->max_latency_us)
+    {
+        stats->max_latency_us = latency_us;
+    }
+    taskEXIT_CRITICAL(&router_stats_mux);
+}
+
+/*
+ * Calls the handler of an admitted request and records it.
+ * @param index route index
+ * @param req request, or its async copy on a worker
+ * @param start_us esp_timer_get_time when the request was admitted
+ * @param bytes_out_start http_router_bytes_out when the request was admitted
+ * @return the handler result
+ */
+static esp_err_t http_router_call(size_t index, httpd_req_t *req, int64_t start_us, uint64_t bytes_out_start)
+{
+    const http_route_t *route = router_routes[index];
+
+    if (!(route->flags & HTTP_ROUTE_CACHEABLE))
+    {
+        httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    }
+
+    req->user_ctx = route->user_ctx;
+    wifi_power_busy_begin(WIFI_POWER_BUSY_HTTP);
+    esp_err_t err = route->handler(req);
+    wifi_power_busy_end(WIFI_POWER_BUSY_HTTP);
+
+    http_router_leave(index, req, start_us, bytes_out_start, err);
+    return err;
+}
+
+/*
+ * Worker task running the handlers of the slow routes, so the httpd task
+ * keeps serving the other clients meanwhile.
+ * @param param unused
+ */
+static void http_router_worker(void *param)
+{
+    http_router_job_t job;
+
+    for (;;)
+    {
+        if (xQueueReceive(router_job_queue, &job, portMAX_DELAY))
+        {
+            if (http_router_call(job.index, job.req, job.start_us, job.bytes_out_start) != ESP_OK)
+            {
+                // what the httpd task does when a handler fails
+                httpd_sess_trigger_close(job.req->handle, httpd_req_to_sockfd(job.req));
+            }
+            httpd_req_async_handler_complete(job.req);
+        }
+    }
+}
+
+/*
+ * Hands a slow request over to a worker.
+ * @param job job of the request, req is replaced by its async copy
+ * @return ESP_OK, ESP_ERR_NO_MEM if every worker is busy and the queue is full
+ */
+static esp_err_t http_router_submit(http_router_job_t *job)
+{
+    // the httpd task is the only producer, so a free slot stays free
+    if (uxQueueSpacesAvailable(router_job_queue) == 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = httpd_req_async_handler_begin(job->req, &job->req);
+    if (err == ESP_OK)
+    {
+        xQueueSend(router_job_queue, job, 0);
+    }
+    return err;
+}
+
+/*
+ * Starts the worker tasks of the slow routes.
+ */
+static esp_err_t http_router_start_workers(void)
+{
+    if (router_job_queue != NULL)
+    {
+        return ESP_OK;
+    }
+
+    router_job_queue = xQueueCreate(HTTP_ROUTER_WORKER_QUEUE_LEN, sizeof(http_router_job_t));
+    if (router_job_queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < HTTP_ROUTER_WORKERS; i++)
+    {
+        if (xTaskCreatePinnedToCore(&http_router_worker,
+                                    "http_router_worker",
+                                    HTTP_ROUTER_WORKER_STACK_SIZE,
+                                    NULL,
+                                    HTTP_ROUTER_WORKER_PRIORITY,
+                                    NULL,
+                                    HTTP_ROUTER_WORKER_CORE_ID) != pdPASS)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Single URI handler of the server, looks the route up and calls its handler,
+ * or hands the request over to a worker for the slow routes.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return the handler result, ESP_FAIL to close the connection
+ */
+static esp_err_t http_router_dispatch(httpd_req_t *req)
+{
+    size_t path_len = strcspn(req->uri, "?#");
+    bool path_found;
+    size_t index = http_router_find(req->method, req->uri, path_len, &path_found);
+
+    if (index == router_route_count)
+    {
+        ESP_LOGW(TAG, "http_router_dispatch: no route for %s %.*s",
+                 http_method_str(req->method), (int)path_len, req->uri);
+        return httpd_resp_send_err(req, path_found ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+    }
+
+    const http_route_t *route = router_routes[index];
+
+    // Refuse large bodies up front rather than draining them on the httpd task
+    if (!(route->flags & HTTP_ROUTE_STREAMING) && req->content_len > HTTP_ROUTER_MAX_BODY_LEN)
+    {
+        ESP_LOGW(TAG, "http_router_dispatch: %s body of %u bytes refused", route->path, (unsigned)req->content_len);
+        taskENTER_CRITICAL(&router_stats_mux);
+        router_stats[index].rejected++;
+        taskEXIT_CRITICAL(&router_stats_mux);
+        httpd_resp_set_status(req, "413 Content Too Large");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_FAIL;
+    }
+
+    if (!http_router_enter(index))
+    {
+        ESP_LOGW(TAG, "http_router_dispatch: %s busy", route->path);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    http_router_job_t job = {.req = req,
+                             .index = index,
+                             .start_us = esp_timer_get_time(),
+                             .bytes_out_start = http_router_bytes_out(req)};
+
+    if (!(route->flags & HTTP_ROUTE_SLOW))
+    {
+        return http_router_call(index, req, job.start_us, job.bytes_out_start);
+    }
+
+    if (http_router_submit(&job) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "http_router_dispatch: no worker for %s", route->path);
+        taskENTER_CRITICAL(&router_stats_mux);
+        router_stats[index].in_flight--;
+        router_stats[index].rejected++;
+        taskEXIT_CRITICAL(&router_stats_mux);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Checks whether a method was already seen among the first routes.
+ * @param count number of routes to check
+ */
+static bool http_router_method_seen(httpd_method_t method, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (router_routes[i]->method == method)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t http_router_add_routes(const http_route_t *routes, size_t count)
+{
+    if (router_registered)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const http_route_t **grown = realloc(router_routes, (router_route_count + count) * sizeof(*router_routes));
+    if (grown == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    router_routes = grown;
+    for (size_t i = 0; i < count; i++)
+    {
+        router_routes[router_route_count++] = &routes[i];
+    }
+
+    return ESP_OK;
+}
+
+size_t http_router_uri_handler_count(void)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < router_route_count; i++)
+    {
+        if (!http_router_method_seen(router_routes[i]->method, i))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+esp_err_t http_router_register(httpd_handle_t server)
+{
+    router_stats = calloc(router_route_count, sizeof(*router_stats));
+    if (router_stats == NULL || http_router_start_workers() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_router_register: no memory for the router");
+        return ESP_ERR_NO_MEM;
+    }
+
+    qsort(router_routes, router_route_count, sizeof(*router_routes), http_router_compare);
+    router_registered = true;
+
+    for (size_t i = 0; i < router_route_count; i++)
+    {
+        if (i > 0 && http_router_compare(&router_routes[i - 1], &router_routes[i]) == 0)
+        {
+            ESP_LOGW(TAG, "http_router_register: duplicate route %s", router_routes[i]->path);
+        }
+
+        // one wildcard URI handler per method serves every route
+        if (http_router_method_seen(router_routes[i]->method, i))
+        {
+            continue;
+        }
+
+        httpd_uri_t dispatcher = {.uri = "/*",
+                                  .method = router_routes[i]->method,
+                                  .handler = http_router_dispatch,
+                                  .user_ctx = NULL};
+        esp_err_t err = httpd_register_uri_handler(server, &dispatcher);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "http_router_register: error %s registering the dispatcher", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    ESP_LOGI(TAG, "http_router_register: %u routes", (unsigned)router_route_count);
+    return ESP_OK;
+}
+
+esp_err_t http_router_session_open(httpd_handle_t hd, int sockfd)
+{
+    http_router_session_t *session = calloc(1, sizeof(*session));
+    if (session == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_sess_set_transport_ctx(hd, sockfd, session, free);
+    return httpd_sess_set_send_override(hd, sockfd, http_router_send);
+}
+
+void http_router_write_stats(json_writer_t *json, const char *key)
+{
+    json_writer_begin_array(json, key);
+    for (size_t i = 0; i < router_route_count; i++)
+    {
+        http_route_stats_t stats;
+
+        // copy, so the lock is not held while the JSON is sent
+        taskENTER_CRITICAL(&router_stats_mux);
+        stats = router_stats[i];
+        taskEXIT_CRITICAL(&router_stats_mux);
+
+        json_writer_begin_object(json, NULL);
+        json_writer_string(json, "path", router_routes[i]->path);
+        json_writer_string(json, "method", http_method_str(router_routes[i]->method));
+        json_writer_int(json, "count", stats.count);
+        json_writer_int(json, "errors", stats.errors);
+        json_writer_int(json, "rejected", stats.rejected);
+        json_writer_int(json, "in_flight", stats.in_flight);
+        json_writer_int(json, "max_in_flight", stats.max_in_flight);
+        json_writer_int(json, "bytes_in", (int64_t)stats.bytes_in);
+        json_writer_int(json, "bytes_out", (int64_t)stats.bytes_out);
+        json_writer_int(json, "max_latency_us", stats.max_latency_us);
+        json_writer_begin_array(json, "latency_hist");
+        for (size_t bucket = 0; bucket < HTTP_ROUTER_LATENCY_BUCKETS; bucket++)
+        {
+            json_writer_int(json, NULL, stats.latency_hist[bucket]);
+        }
+        json_writer_end_array(json);
+        json_writer_end_object(json);
+    }
+    json_writer_end_array(json);
+}
+
+const http_route_t *http_router_lookup(httpd_method_t method, const char *uri)
+{
+    bool path_found;
+    size_t index = http_router_find(method, uri, strcspn(uri, "?#"), &path_found);
+
+    return index < router_route_count ? router_routes[index] : NULL;
+}
+
+void http_router_reset(void)
+{
+    free(router_stats);
+    router_stats = NULL;
+    free(router_routes);
+    router_routes = NULL;
+    router_route_count = 0;
+    router_registered = false;
+}
@@ -22,11 +22,24 @@
 #include "esp_partition.h"
 #include "esp_system.h"
 #include "esp_wifi_types_generic.h"
+#include "event_bus.h"
 #include "freertos/idf_additions.h"
 #include "http_parser.h"
+#include "http_router.h"
+#include "http_server_ws.h"
+#include "json_writer.h"
+#include "multipart.h"
+#include "ota_decoder.h"
+#include "ota_session.h"
+#include "ota_writer.h"
 #include "lwip/ip4_addr.h"
 #include "portmacro.h"
 #include "sntp_time_sync.h"
+#include "web_assets.h"
+#include "web_cache.h"
+#include "wifi_link.h"
+#include "wifi_power.h"
+#include "wifi_scan.h"
 
 // Firmware update status
 static int g_fw_update_status = OTA_UPDATE_PENDING;
@@ -40,11 +53,8 @@ static httpd_handle_t http_server_handle = NULL;
 // HTTP server monitor handle
 static TaskHandle_t task_http_server_monitor = NULL;
 
-// Queue handle used to manipulae main queue of events
-static QueueHandle_t http_server_monitor_queue_handle;
-
-// Wifi connect status
-static int g_wifi_connect_status = NONE;
+// Event bus subscriber of the monitor, kept when the server is stopped
+static event_bus_subscriber_t *http_server_monitor_subscriber;
 
 // Local time status
 static bool g_is_local_time_set = false;
@@ -58,21 +68,6 @@ const esp_timer_create_args_t fw_update_reset_args = {.callback = &http_server_f
                                                       .name = "fw_update_reset"};
 esp_timer_handle_t fw_update_reset;
 
-extern const uint8_t jquery_3_3_1_min_js_start[] asm("_binary_jquery_3_3_1_min_js_start");
-extern const uint8_t jquery_3_3_1_min_js_end[] asm("_binary_jquery_3_3_1_min_js_end");
-
-extern const uint8_t index_html_start[] asm("_binary_index_html_start");
-extern const uint8_t index_html_end[] asm("_binary_index_html_end");
-
-extern const uint8_t app_css_start[] asm("_binary_app_css_start");
-extern const uint8_t app_css_end[] asm("_binary_app_css_end");
-
-extern const uint8_t app_js_start[] asm("_binary_app_js_start");
-extern const uint8_t app_js_end[] asm("_binary_app_js_end");
-
-extern const uint8_t app_favicon_ico_start[] asm("_binary_favicon_ico_start");
-extern const uint8_t app_favicon_ico_end[] asm("_binary_favicon_ico_end");
-
 /*
  * Check g_fw_update_status and creates the fw_update_reset timer if the
  * g_fw_update_status is true
@@ -94,53 +89,69 @@ static void http_server_fw_update_reset_timer(void)
     }
 }
 
+/*
+ * Finishes a JSON document written into a buffer and sends it as the response.
+ * @param req http request to respond to
+ * @param json writer initialized without flush callback
+ * @return ESP_OK on success, otherwise the send error
+ */
+static esp_err_t http_server_send_json(httpd_req_t *req, json_writer_t *json)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    if (json_writer_finish(json) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_send_json: JSON response does not fit the buffer");
+        return httpd_resp_send_500(req);
+    }
+
+    return httpd_resp_send(req, json->buf, json_writer_length(json));
+}
+
+/*
+ * json_writer flush callback, sends the JSON text as a response chunk.
+ * @param ctx http request to respond to
+ */
+static esp_err_t http_server_json_chunk_flush(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
 /*
  * HTTP server monitor task used to track events of http server
  * @param pvParameters parameter which can be passed to the task.
  */
 static void http_server_monitor(void *parameter)
 {
-    http_server_queue_message_t msg;
+    event_bus_event_t event;
     for (;;)
     {
-        if (xQueueReceive(http_server_monitor_queue_handle, &msg, portMAX_DELAY))
+        if (event_bus_receive(http_server_monitor_subscriber, &event, portMAX_DELAY))
         {
-            switch (msg.msgID)
+            switch (event.id)
             {
-            case HTTP_MSG_WIFI_CONNECT_INIT:
-                ESP_LOGI(TAG, "HTTP_MSG_WIFI_CONNECT_INIT");
-                g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECTING;
-                break;
-
-            case HTTP_MSG_WIFI_CONNECT_SUCCESS:
-                ESP_LOGI(TAG, "HTTP_MSG_WIFI_CONNECT_SUCCESS");
-                g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECT_SUCCESS;
-                break;
-
-            case HTTP_MSG_WIFI_CONNECT_FAIL:
-                ESP_LOGI(TAG, "HTTP_MSG_WIFI_CONNECT_FAIL");
-                g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECT_FAIL;
+            case EVENT_BUS_WIFI_STATE_CHANGED:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_STATE_CHANGED");
+                http_server_ws_notify(HTTP_WS_TOPIC_WIFI_STATUS);
                 break;
 
-            case HTTP_MSG_OTA_UPDATE_SUCCESSFULL:
-                ESP_LOGI(TAG, "HTTP_MSG_OTA_UPDATE_SUCCESSFULL");
-                g_fw_update_status = OTA_UPDATE_SUCCESSFUL;
-                http_server_fw_update_reset_timer();
+            case EVENT_BUS_OTA_RESULT:
+                ESP_LOGI(TAG, "EVENT_BUS_OTA_RESULT: %s", event.data.ota_result.success ? "successful" : "failed");
+                if (event.data.ota_result.success)
+                {
+                    g_fw_update_status = OTA_UPDATE_SUCCESSFUL;
+                    http_server_fw_update_reset_timer();
+                }
+                else
+                {
+                    g_fw_update_status = OTA_UPDATE_FAILED;
+                }
                 break;
 
-            case HTTP_MSG_OTA_UPDATE_FAILED:
-                ESP_LOGI(TAG, "HTTP_MSG_OTA_UPDATE_FAILED");
-                g_fw_update_status = OTA_UPDATE_FAILED;
-                break;
-
-            case HTTP_MSG_WIFI_USER_DISCONNECT:
-                ESP_LOGI(TAG, "HTTP_MSG_WIFI_USER_DISCONNECT");
-                g_fw_update_status = HTTP_WIFI_STATUS_DISCONNECTED;
-                break;
-
-            case HTTP_TIME_SERVICE_INITIALIZED:
-                ESP_LOGI(TAG, "HTTP_TIME_SERVICE_INITIALIZED");
+            case EVENT_BUS_TIME_SYNCED:
+                ESP_LOGI(TAG, "EVENT_BUS_TIME_SYNCED");
                 g_is_local_time_set = true;
+                http_server_ws_notify(HTTP_WS_TOPIC_LOCAL_TIME);
                 break;
 
             default:
@@ -151,92 +162,140 @@ static void http_server_monitor(void *parameter)
 }
 
 /*
- * Jquery get handler requested when accessing the web page.
- * @param req http request for which the uri needs to be handled
- * @return ESP_OK
+ * Generic web asset handler, serves an entry of the generated web asset table.
+ * The encoded (gzip) bytes are sent when the client accepts the encoding,
+ * otherwise the minified plain bytes are sent. The ETag, Cache-Control and
+ * 304 Not Modified decisions are made by web_cache_respond.
+ * @param req http request for which the uri needs to be handled, user_ctx
+ * points to the web_asset_t to send
+ * @return ESP_OK on success, otherwise the httpd_resp_send error
  */
-static esp_err_t http_server_jquery_handler(httpd_req_t *req)
+static esp_err_t http_server_web_asset_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "jquery requested");
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req, (const char *)jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
-    return ESP_OK;
-}
+    const web_asset_t *asset = (const web_asset_t *)req->user_ctx;
+    char accept_encoding[64];
+    char query[48];
+    char if_none_match[128];
+    web_cache_response_t response;
+
+    ESP_LOGI(TAG, "%s requested", asset->path);
+
+    // absent headers, or too long for the buffers, are passed as NULL
+    bool has_accept_encoding =
+        httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding)) == ESP_OK;
+    bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+    bool has_if_none_match =
+        httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK;
+
+    web_cache_respond(asset,
+                      has_accept_encoding ? accept_encoding : NULL,
+                      has_query ? query : NULL,
+                      has_if_none_match ? if_none_match : NULL,
+                      &response);
+
+    httpd_resp_set_hdr(req, "ETag", response.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", response.cache_control);
+    if (asset->encoding != NULL)
+    {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
 
-/*
- * Sends index.html page.
- * @param req http request for which the uri needs to be handled
- * @return ESP_OK
- */
-static esp_err_t http_server_index_html_handler(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "index.html requested");
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
-    return ESP_OK;
-}
+    if (response.not_modified)
+    {
+        ESP_LOGI(TAG, "%s not modified", asset->path);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
 
-/*
- * App.css get handler.
- * @param req http request for which the uri needs to be handled
- * @return ESP_OK
- */
-static esp_err_t http_server_app_css_handler(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "app.css requested");
-    httpd_resp_set_type(req, "text/css");
-    httpd_resp_send(req, (const char *)app_css_start, app_css_end - app_css_start);
-    return ESP_OK;
+    httpd_resp_set_type(req, asset->mime_type);
+    if (response.encoded)
+    {
+        httpd_resp_set_hdr(req, "Content-Encoding", asset->encoding);
+        return httpd_resp_send(req, (const char *)asset->data, asset->data_len);
+    }
+
+    return httpd_resp_send(req, (const char *)asset->identity_data, asset->identity_len);
 }
 
 /*
- * App.js get handler.
- * @param req http request for which the uri needs to be handled
- * @return ESP_OK
+ * multipart_parser callback, decodes the file part into the update partition.
+ * The update is started on the first file byte.
+ * @param ctx update partition
+ * @param data uploaded bytes, a plain, zlib compressed or delta image
+ * @param len length of data
+ * @return ESP_OK or the ota_decoder error
  */
-static esp_err_t http_server_app_js_handler(httpd_req_t *req)
+static esp_err_t http_server_OTA_write(void *ctx, const char *data, size_t len)
 {
-    ESP_LOGI(TAG, "app.js requested");
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req, (const char *)app_js_start, app_js_end - app_js_start);
-    return ESP_OK;
+    const esp_partition_t *update_partition = ctx;
+
+    if (!ota_decoder_is_active())
+    {
+        // the partition is overwritten, a resumable session cannot continue
+        ota_session_discard();
+        esp_err_t err = ota_decoder_begin(update_partition);
+        if (err != ESP_OK)
+        {
+            printf("http_server_OTA_update_handler: Error with OTA begin, cancelling "
+                   "OTA\r\n");
+            return err;
+        }
+    }
+
+    return ota_decoder_write(data, len);
 }
 
 /*
- * Favicon ico get handler.
- * @param req http request for which the uri needs to be handled
- * @return ESP_OK
+ * Publishes the result of a firmware update, picked up by the monitor.
+ * @param success true if the new image is set to boot
  */
-static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req)
+static void http_server_ota_result(bool success)
 {
-    ESP_LOGI(TAG, "favicon.ico requested");
-    httpd_resp_set_type(req, "image/x-icon");
-    httpd_resp_send(req, (const char *)app_favicon_ico_start, app_favicon_ico_end - app_favicon_ico_start);
-    return ESP_OK;
+    event_bus_event_t event = {.id = EVENT_BUS_OTA_RESULT};
+    event.data.ota_result.success = success;
+    event_bus_publish(&event);
 }
 
 /*
- * Recieves the bin file from web page and handles firmware update.
+ * Recieves the bin file from web page and handles firmware update. The
+ * multipart/form-data body is parsed as it arrives and only the bytes of the
+ * file part are handed over to the ota_writer pipeline, so the next chunks
+ * are received while the previous ones are written to flash. The file may be
+ * compressed or a delta, see ota_decoder.h.
  * @param req http request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, ESP_FAIL to close the connection on a receive error
  */
 static esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
 {
-    esp_ota_handle_t ota_handle;
-
     char ota_buff[1024];
+    char content_type[HTTP_SERVER_CONTENT_TYPE_MAX_LEN];
     int content_length = req->content_len;
     int content_received = 0;
     int recv_len;
-    bool is_req_body_started = false;
     bool flash_successful = false;
+    multipart_parser_t multipart;
+    esp_err_t err;
 
     const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
 
-    do
+    err = httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+    if (err == ESP_OK)
+    {
+        err = multipart_parser_init(&multipart, content_type, http_server_OTA_write, (void *)update_partition);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_OTA_update_handler: not a multipart/form-data upload");
+        http_server_ota_result(false);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+    }
+
+    printf("http_server_OTA_update_handler: OTA file size: %d\r\n", content_length);
+
+    while (content_received < content_length && err == ESP_OK)
     {
         // Read the data for the request
-        if ((recv_len = httpd_req_recv(req, ota_buff, MIN(content_length, sizeof(ota_buff)))) < 0)
+        if ((recv_len = httpd_req_recv(req, ota_buff, MIN(content_length - content_received, sizeof(ota_buff)))) <= 0)
         {
             // Check if timeout occurred
             if (recv_len == HTTPD_SOCK_ERR_TIMEOUT)
@@ -245,51 +304,22 @@ static esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
                 continue; ///> Retry receiving if timeout occurred
             }
             ESP_LOGI(TAG, "http_server_OTA_update_handler: OTA other Error %d", recv_len);
+            ota_decoder_abort();
+            http_server_ota_result(false);
             return ESP_FAIL;
         }
         printf("http_server_OTA_update_handler: OTA RX: %d of %d\r", content_received, content_length);
 
-        // Is this the first data we are receiving
-        // If so, it will have the information in the header that we need.
-        if (!is_req_body_started)
-        {
-            is_req_body_started = true;
-
-            // Get the location of the .bin file content (remove the web form data)
-            char *body_start_p = strstr(ota_buff, "\r\n\r\n") + 4;
-            int body_part_len = recv_len - (body_start_p - ota_buff);
-
-            printf("http_server_OTA_update_handler: OTA file size: %d\r\n", content_length);
-
-            esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
-            if (err != ESP_OK)
-            {
-                printf("http_server_OTA_update_handler: Error with OTA begin, cancelling "
-                       "OTA\r\n");
-                return ESP_FAIL;
-            }
-            else
-            {
-                printf("http_server_OTA_update_handler: Writing to partition subtype %d "
-                       "at offset 0x%lx\r\n",
-                       update_partition->subtype,
-                       update_partition->address);
-            }
-
-            // Write this first part of the data
-            esp_ota_write(ota_handle, body_start_p, body_part_len);
-            content_received += body_part_len;
-        }
-        else
-        {
-            // Write OTA data
-            esp_ota_write(ota_handle, ota_buff, recv_len);
-            content_received += recv_len;
-        }
+        err = multipart_parser_feed(&multipart, ota_buff, recv_len);
+        content_received += recv_len;
+    }
 
-    } while (recv_len > 0 && content_received < content_length);
+    if (err == ESP_OK)
+    {
+        err = multipart_parser_finish(&multipart);
+    }
 
-    if (esp_ota_end(ota_handle) == ESP_OK)
+    if (err == ESP_OK && ota_decoder_end() == ESP_OK)
     {
         // Lets update the partition
         if (esp_ota_set_boot_partition(update_partition) == ESP_OK)
@@ -309,23 +339,227 @@ static esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
     }
     else
     {
-        ESP_LOGI(TAG, "http_server_OTA_update_handler: esp_ota_end ERROR!!!");
+        ota_decoder_abort();
+        ESP_LOGI(TAG, "http_server_OTA_update_handler: OTA upload ERROR %s!!!", esp_err_to_name(err));
     }
 
     // We won't update the global variables throughout the file, so send the
     // message about the status
     if (flash_successful)
     {
-        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_SUCCESSFULL);
+        http_server_ota_result(true);
     }
     else
     {
-        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        http_server_ota_result(false);
     }
 
     return ESP_OK;
 }
 
+/*
+ * Gets a query parameter of the request.
+ * @param req HTTP request carrying the query string
+ * @param key parameter name
+ * @param value filled with the value
+ * @param size size of value
+ * @return true if the parameter is present
+ */
+static bool http_server_get_query_value(httpd_req_t *req, const char *key, char *value, size_t size)
+{
+    char query[96];
+
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+           httpd_query_key_value(query, key, value, size) == ESP_OK;
+}
+
+/*
+ * Gets the id query parameter of an OTA session request.
+ * @return true if the id is present and valid
+ */
+static bool http_server_OTA_session_id(httpd_req_t *req, uint32_t *id)
+{
+    char value[12];
+    char *end;
+
+    if (!http_server_get_query_value(req, "id", value, sizeof(value)))
+    {
+        return false;
+    }
+
+    *id = strtoul(value, &end, 16);
+    return end != value && *end == '\0';
+}
+
+/*
+ * Responds with the state of an OTA session.
+ * @param req HTTP request to respond to
+ * @param info session state
+ * @param complete whether the image was received and activated
+ */
+static esp_err_t http_server_send_OTA_session(httpd_req_t *req, const ota_session_info_t *info, bool complete)
+{
+    char sessionJSON[96];
+    char id[9];
+    json_writer_t json;
+
+    snprintf(id, sizeof(id), "%08lx", (unsigned long)info->id);
+
+    json_writer_init(&json, sessionJSON, sizeof(sessionJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_string(&json, "id", id);
+    json_writer_int(&json, "offset", info->offset);
+    json_writer_int(&json, "size", info->size);
+    json_writer_bool(&json, "complete", complete);
+    json_writer_end_object(&json);
+
+    return http_server_send_json(req, &json);
+}
+
+/*
+ * Opens a resumable OTA session, POST /OTAsession?size=<bytes>&sha256=<hex>.
+ * A session already open for the same image is resumed, the response offset
+ * tells the client where to continue.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_OTA_session_open_handler(httpd_req_t *req)
+{
+    char size_str[12];
+    char sha256_hex[OTA_SESSION_SHA256_LEN * 2 + 1];
+    uint8_t sha256[OTA_SESSION_SHA256_LEN];
+    ota_session_info_t info;
+
+    if (!http_server_get_query_value(req, "size", size_str, sizeof(size_str)) ||
+        !http_server_get_query_value(req, "sha256", sha256_hex, sizeof(sha256_hex)) ||
+        !ota_session_parse_sha256(sha256_hex, sha256))
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "size and sha256 are required");
+    }
+
+    esp_err_t err = ota_session_open(OTA_SESSION_CHANNEL_HTTP, strtoul(size_str, NULL, 10), sha256, &info);
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "An update is running", HTTPD_RESP_USE_STRLEN);
+    }
+    if (err != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "The image does not fit the update partition");
+    }
+
+    return http_server_send_OTA_session(req, &info, false);
+}
+
+/*
+ * Gets the offset of a resumable OTA session, GET /OTAsession?id=<id>.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_OTA_session_get_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    ota_session_info_t info;
+
+    if (!http_server_OTA_session_id(req, &id) || ota_session_get(id, &info) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown OTA session");
+    }
+
+    return http_server_send_OTA_session(req, &info, false);
+}
+
+/*
+ * Receives a range of the image of a resumable OTA session,
+ * PUT /OTAsession?id=<id> with Content-Range: bytes <first>-<last>/<size>.
+ * The range must start at the session offset, otherwise 416 is sent with the
+ * offset to continue from. When the connection drops the bytes received so
+ * far are kept, and the last range activates the image once its SHA-256
+ * matches the one the session was opened with.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, ESP_FAIL to close the connection on a receive error
+ */
+static esp_err_t http_server_OTA_session_put_handler(httpd_req_t *req)
+{
+    char ota_buff[1024];
+    char content_range[64];
+    unsigned long first, last, total;
+    uint32_t id;
+    ota_session_info_t info;
+    bool complete;
+    int recv_len;
+
+    if (!http_server_OTA_session_id(req, &id) || ota_session_get(id, &info) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown OTA session");
+    }
+
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", content_range, sizeof(content_range)) != ESP_OK ||
+        sscanf(content_range, "bytes %lu-%lu/%lu", &first, &last, &total) != 3 || last < first ||
+        last - first + 1 != req->content_len || total != info.size || last >= total)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Content-Range");
+    }
+
+    esp_err_t err = ota_session_write_begin(id, first);
+    if (err == ESP_ERR_INVALID_ARG)
+    {
+        httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        return http_server_send_OTA_session(req, &info, false);
+    }
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "An update is running", HTTPD_RESP_USE_STRLEN);
+    }
+    if (err != ESP_OK)
+    {
+        http_server_ota_result(false);
+        return httpd_resp_send_500(req);
+    }
+
+    size_t remaining = req->content_len;
+    while (remaining > 0 && err == ESP_OK)
+    {
+        if ((recv_len = httpd_req_recv(req, ota_buff, MIN(remaining, sizeof(ota_buff)))) <= 0)
+        {
+            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                continue;
+            }
+            // the received bytes are kept, the client resumes from the session offset
+            ESP_LOGI(TAG, "http_server_OTA_session_put_handler: connection lost, error %d", recv_len);
+            ota_session_write_end(&complete);
+            return ESP_FAIL;
+        }
+
+        err = ota_session_write(ota_buff, recv_len);
+        remaining -= recv_len;
+    }
+
+    if (err == ESP_OK)
+    {
+        ota_session_get(id, &info);
+    }
+    esp_err_t end_err = ota_session_write_end(&complete);
+    err = err != ESP_OK ? err : end_err;
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_OTA_session_put_handler: OTA upload ERROR %s!!!", esp_err_to_name(err));
+        http_server_ota_result(false);
+        return httpd_resp_send_err(req,
+                                   HTTPD_400_BAD_REQUEST,
+                                   err == ESP_ERR_INVALID_CRC ? "SHA-256 mismatch" : "Invalid image");
+    }
+
+    if (complete)
+    {
+        http_server_ota_result(true);
+    }
+    return http_server_send_OTA_session(req, &info, complete);
+}
+
 /*
  * OTA status handler responds with the first update status after the OTA update
  * is started and responds with the compile time/date when the page is first
@@ -336,17 +570,16 @@ static esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
 esp_err_t http_server_OTA_status_handler(httpd_req_t *req)
 {
     char otaJSON[100];
-    sprintf(otaJSON,
-            "{\"ota_update_status\":%d,\"compile_time\":\"%s\",\"compile_date\":"
-            "\"%s\"}",
-            g_fw_update_status,
-            __TIME__,
-            __DATE__);
+    json_writer_t json;
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, otaJSON, strlen(otaJSON));
+    json_writer_init(&json, otaJSON, sizeof(otaJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_int(&json, "ota_update_status", g_fw_update_status);
+    json_writer_string(&json, "compile_time", __TIME__);
+    json_writer_string(&json, "compile_date", __DATE__);
+    json_writer_end_object(&json);
 
-    return ESP_OK;
+    return http_server_send_json(req, &json);
 }
 
 /*
@@ -358,10 +591,15 @@ static esp_err_t http_server_get_dht_sensor_readings_json_handler(httpd_req_t *r
 {
     ESP_LOGI(TAG, "/dhtSensor.json requested");
     char dhtSensorJSON[100];
-    sprintf(dhtSensorJSON, "{\"temp\":\"%.1f\",\"humidity\":\"%.1f\"}", temperature, humidity);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, dhtSensorJSON, strlen(dhtSensorJSON));
-    return ESP_OK;
+    json_writer_t json;
+
+    json_writer_init(&json, dhtSensorJSON, sizeof(dhtSensorJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_fixed_string(&json, "temp", temperature, 1);
+    json_writer_fixed_string(&json, "humidity", humidity, 1);
+    json_writer_end_object(&json);
+
+    return http_server_send_json(req, &json);
 }
 
 /*
@@ -376,48 +614,85 @@ static esp_err_t http_server_wifi_connect_json_handler(httpd_req_t *req)
     size_t len_ssid = 0, len_pass = 0;
     char *ssid_str = NULL, *pass_str = NULL;
 
-    // get ssid
+    // get ssid, required
     len_ssid = httpd_req_get_hdr_value_len(req, "my-connect-ssid") + 1;
     if (len_ssid > 1)
     {
         ssid_str = malloc(len_ssid);
-        if (httpd_req_get_hdr_value_str(req, "my-connect-ssid", ssid_str, len_ssid) == ESP_OK)
+        if (ssid_str != NULL && httpd_req_get_hdr_value_str(req, "my-connect-ssid", ssid_str, len_ssid) == ESP_OK)
         {
             ESP_LOGI(TAG,
                      "http_server_wifi_connect_json_handler: found header => "
                      "my-connect_ssid: %s",
                      ssid_str);
         }
+        else
+        {
+            free(ssid_str);
+            ssid_str = NULL;
+        }
     }
-    else
+    if (ssid_str == NULL)
     {
         ESP_LOGE(TAG, "http_server_wifi_connect_json_handler: my-connect-ssid not found");
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "my-connect-ssid is required");
     }
 
-    // get password
+    // get password, absent for an open network
     len_pass = httpd_req_get_hdr_value_len(req, "my-connect-pwd") + 1;
     if (len_pass > 1)
     {
         pass_str = malloc(len_pass);
-        if (httpd_req_get_hdr_value_str(req, "my-connect-pwd", pass_str, len_pass) == ESP_OK)
+        if (pass_str != NULL && httpd_req_get_hdr_value_str(req, "my-connect-pwd", pass_str, len_pass) == ESP_OK)
         {
             ESP_LOGI(TAG,
                      "http_server_wifi_connect_json_handler: found header => "
                      "my-connect-pwd: %s",
                      pass_str);
         }
+        else
+        {
+            free(pass_str);
+            pass_str = NULL;
+        }
     }
-    else
+    if (pass_str == NULL)
+    {
+        ESP_LOGI(TAG, "http_server_wifi_connect_json_handler: my-connect-pwd not found, open network");
+    }
+
+    // optional priority among the known networks
+    event_bus_event_t event = {.id = EVENT_BUS_WIFI_CONNECT_HTTP};
+    char priority_str[4];
+    if (httpd_req_get_hdr_value_len(req, "my-connect-priority") > 0)
     {
-        ESP_LOGE(TAG, "http_server_wifi_connect_json_handler: my-connect-pass not found");
+        // a value too long for the buffer is rejected, not taken as absent
+        char *end = priority_str;
+        long priority = -1;
+        if (httpd_req_get_hdr_value_str(req, "my-connect-priority", priority_str, sizeof(priority_str)) == ESP_OK)
+        {
+            priority = strtol(priority_str, &end, 10);
+        }
+        if (end == priority_str || *end != '\0' || priority < 0 || priority > UINT8_MAX)
+        {
+            free(ssid_str);
+            free(pass_str);
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "my-connect-priority is 0 to 255");
+        }
+        event.data.connect_http.has_priority = true;
+        event.data.connect_http.priority = (uint8_t)priority;
     }
 
-    // update wifi network configuration
+    // update wifi network configuration, the known networks are kept
     wifi_config_t *wifi_config = wifi_get_config();
     memset(wifi_config, 0x00, sizeof(wifi_config_t));
-    memcpy(wifi_config->sta.ssid, ssid_str, len_ssid);
-    memcpy(wifi_config->sta.password, pass_str, len_pass);
-    wifi_app_send_message(WIFI_APP_MSG_CONNECTING_HTTP_SERVER);
+    // the fields are not NUL terminated when full, longer values are cut
+    memcpy(wifi_config->sta.ssid, ssid_str, MIN(len_ssid - 1, sizeof(wifi_config->sta.ssid)));
+    if (pass_str != NULL)
+    {
+        memcpy(wifi_config->sta.password, pass_str, MIN(len_pass - 1, sizeof(wifi_config->sta.password)));
+    }
+    event_bus_publish(&event);
 
     free(ssid_str);
     free(pass_str);
@@ -425,6 +700,60 @@ static esp_err_t http_server_wifi_connect_json_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/*
+ * wifiScan.json handler responds with the cached scan results, strongest
+ * first. Stale results start a background scan and are still returned, so the
+ * handler never waits for the radio; "scanning" tells the page to ask again.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK on success, otherwise the httpd_resp_send_chunk error
+ */
+static esp_err_t http_server_wifi_scan_json_handler(httpd_req_t *req)
+{
+    char scanJSON[HTTP_SERVER_JSON_CHUNK_SIZE];
+    json_writer_t json;
+    wifi_scan_result_t *results;
+    uint32_t age_ms;
+    bool scanning;
+
+    ESP_LOGI(TAG, "/wifiScan.json requested");
+
+    results = malloc(sizeof(wifi_scan_result_t) * WIFI_SCAN_MAX_APS);
+    if (results == NULL)
+    {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    size_t count = wifi_scan_get(results, WIFI_SCAN_MAX_APS, &age_ms, &scanning);
+
+    httpd_resp_set_type(req, "application/json");
+    json_writer_init(&json, scanJSON, sizeof(scanJSON), http_server_json_chunk_flush, req);
+    json_writer_begin_object(&json, NULL);
+    json_writer_bool(&json, "scanning", scanning);
+    if (age_ms == UINT32_MAX)
+    {
+        json_writer_null(&json, "age_ms");
+    }
+    else
+    {
+        json_writer_int(&json, "age_ms", age_ms);
+    }
+    json_writer_begin_array(&json, "aps");
+    for (size_t i = 0; i < count; i++)
+    {
+        json_writer_begin_object(&json, NULL);
+        json_writer_string(&json, "ssid", results[i].ssid);
+        json_writer_int(&json, "rssi", results[i].rssi);
+        json_writer_int(&json, "channel", results[i].channel);
+        json_writer_bool(&json, "open", results[i].authmode == WIFI_AUTH_OPEN);
+        json_writer_end_object(&json);
+    }
+    json_writer_end_array(&json);
+    json_writer_end_object(&json);
+    free(results);
+
+    esp_err_t err = json_writer_finish(&json);
+    return err == ESP_OK ? httpd_resp_send_chunk(req, NULL, 0) : err;
+}
+
 /*
  * wifiConnectStatus handler updates the connection status for the webpage
  * @param req HTTP request for which the uri needs to be handled
@@ -434,10 +763,14 @@ static esp_err_t http_server_wifi_connect_status_json_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "/wifiConnectStatus");
     char statusJSON[100];
-    sprintf(statusJSON, "{\"wifi_connect_status\":%d}", g_wifi_connect_status);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, statusJSON, strlen(statusJSON));
-    return ESP_OK;
+    json_writer_t json;
+
+    json_writer_init(&json, statusJSON, sizeof(statusJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_int(&json, "wifi_connect_status", http_server_get_wifi_connect_status());
+    json_writer_end_object(&json);
+
+    return http_server_send_json(req, &json);
 }
 
 /*
@@ -450,41 +783,39 @@ static esp_err_t http_server_wifi_connect_info_json_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "/wifiConnectInfo.json requested");
     char ipInfoJSON[300];
-    memset(ipInfoJSON, 0, sizeof(ipInfoJSON));
+    json_writer_t json;
 
     char ip[IP4ADDR_STRLEN_MAX];
     char netmask[IP4ADDR_STRLEN_MAX];
     char gateway[IP4ADDR_STRLEN_MAX];
+    wifi_link_info_t link;
 
-    if (g_wifi_connect_status == HTTP_WIFI_STATUS_CONNECT_SUCCESS)
+    wifi_link_get(&link);
+    if (http_server_get_wifi_connect_status() == HTTP_WIFI_STATUS_CONNECT_SUCCESS && link.has_ip)
     {
-        ESP_LOGI(TAG, "http_server_wifi_connect_info_json_handler: validating input");
-        wifi_ap_record_t wifi_data;
-        ESP_ERROR_CHECK(esp_wifi_sta_get_ap_info(&wifi_data));
-        char *ssid = (char *)wifi_data.ssid;
+        char *ssid = (char *)link.ssid;
 
-        esp_netif_ip_info_t ip_info;
-        ESP_ERROR_CHECK(esp_netif_get_ip_info(esp_netif_sta, &ip_info));
-        esp_ip4addr_ntoa(&ip_info.ip, ip, IP4ADDR_STRLEN_MAX);
-        esp_ip4addr_ntoa(&ip_info.netmask, netmask, IP4ADDR_STRLEN_MAX);
-        esp_ip4addr_ntoa(&ip_info.gw, gateway, IP4ADDR_STRLEN_MAX);
+        esp_ip4addr_ntoa(&link.ip_info.ip, ip, IP4ADDR_STRLEN_MAX);
+        esp_ip4addr_ntoa(&link.ip_info.netmask, netmask, IP4ADDR_STRLEN_MAX);
+        esp_ip4addr_ntoa(&link.ip_info.gw, gateway, IP4ADDR_STRLEN_MAX);
 
-        sprintf(ipInfoJSON,
-                "{\"ip\":\"%s\",\"netmask\":\"%s\",\"gw\":\"%s\",\"ap\":\"%s\"}",
-                ip,
-                netmask,
-                gateway,
-                ssid);
-    }
-    else
-    {
-        ESP_LOGE(TAG,
-                 "http_server_wifi_connect_info_json_handler: connect status not "
-                 "successfull");
+        json_writer_init(&json, ipInfoJSON, sizeof(ipInfoJSON), NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_string(&json, "ip", ip);
+        json_writer_string(&json, "netmask", netmask);
+        json_writer_string(&json, "gw", gateway);
+        json_writer_string_n(&json, "ap", ssid, MAX_SSID_LENGTH);
+        json_writer_end_object(&json);
+
+        return http_server_send_json(req, &json);
     }
 
+    ESP_LOGE(TAG,
+             "http_server_wifi_connect_info_json_handler: connect status not "
+             "successfull");
+
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, ipInfoJSON, strlen(ipInfoJSON));
+    httpd_resp_send(req, NULL, 0);
     return ESP_OK;
 }
 
@@ -497,10 +828,62 @@ static esp_err_t http_server_wifi_connect_info_json_handler(httpd_req_t *req)
 static esp_err_t http_server_wifi_disconnect_json_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "wifiDisconnect.json requested");
-    wifi_app_send_message(WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT);
+    event_bus_post(EVENT_BUS_WIFI_USER_DISCONNECT);
     return ESP_OK;
 }
 
+/*
+ * powerProfile.json handler responds with the power profile in use and the
+ * modeled radio on time, energy and latency of every profile, a POST selects
+ * the profile given by the profile query parameter first.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK on success, otherwise the httpd_resp_send error
+ */
+static esp_err_t http_server_power_profile_json_handler(httpd_req_t *req)
+{
+    char powerJSON[512];
+    char name[16];
+    json_writer_t json;
+    wifi_power_profile_e profile;
+    wifi_power_report_t report;
+
+    ESP_LOGI(TAG, "powerProfile.json requested");
+
+    if (req->method == HTTP_POST)
+    {
+        if (!http_server_get_query_value(req, "profile", name, sizeof(name)) ||
+            !wifi_power_parse_profile(name, &profile))
+        {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "profile is performance, balanced or low-power");
+        }
+        wifi_power_set_profile(profile);
+    }
+
+    wifi_power_get_report(&report);
+
+    json_writer_init(&json, powerJSON, sizeof(powerJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_string(&json, "profile", wifi_power_profile_name(report.profile));
+    json_writer_bool(&json, "awake", report.awake);
+    json_writer_bool(&json, "http_busy", report.busy & (1 << WIFI_POWER_BUSY_HTTP));
+    json_writer_bool(&json, "ota_busy", report.busy & (1 << WIFI_POWER_BUSY_OTA));
+    json_writer_int(&json, "elapsed_ms", report.elapsed_ms);
+    json_writer_int(&json, "tx_count", report.tx_count);
+    json_writer_begin_object(&json, "profiles");
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        json_writer_begin_object(&json, wifi_power_profile_name(i));
+        json_writer_int(&json, "radio_on_ms", report.profiles[i].radio_on_ms);
+        json_writer_int(&json, "energy_mj", report.profiles[i].energy_mj);
+        json_writer_int(&json, "latency_ms", report.profiles[i].latency_ms);
+        json_writer_end_object(&json);
+    }
+    json_writer_end_object(&json);
+    json_writer_end_object(&json);
+
+    return http_server_send_json(req, &json);
+}
+
 /*
  * localTime.json responds with local time
  * @param req HTTP request for which the uri needs to be handled
@@ -509,15 +892,21 @@ static esp_err_t http_server_wifi_disconnect_json_handler(httpd_req_t *req)
 static esp_err_t http_server_get_local_time_json_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "localTime.json requested");
-    char localTimeJSON[100] = {0};
+    char localTimeJSON[100];
+    json_writer_t json;
 
     if (g_is_local_time_set)
     {
-        sprintf(localTimeJSON, "{\"time\":\"%s\"}", sntp_time_sync_get_time());
+        json_writer_init(&json, localTimeJSON, sizeof(localTimeJSON), NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_string(&json, "time", sntp_time_sync_get_time());
+        json_writer_end_object(&json);
+
+        return http_server_send_json(req, &json);
     }
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, localTimeJSON, strlen(localTimeJSON));
+    httpd_resp_send(req, NULL, 0);
     return ESP_OK;
 }
 
@@ -531,17 +920,451 @@ static esp_err_t http_server_get_ap_ssid_json_handler(httpd_req_t *req)
     ESP_LOGI(TAG, "/apSSID.json requested");
 
     char ssidJSON[50];
+    json_writer_t json;
+    wifi_config_t wifi_config = {0};
 
-    wifi_config_t *wifi_config = wifi_get_config();
-    esp_wifi_get_config(ESP_IF_WIFI_AP, wifi_config);
-    char *ssid = (char *)wifi_config->ap.ssid;
+    esp_wifi_get_config(ESP_IF_WIFI_AP, &wifi_config);
+
+    json_writer_init(&json, ssidJSON, sizeof(ssidJSON), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_string_n(&json, "ssid", (const char *)wifi_config.ap.ssid, sizeof(wifi_config.ap.ssid));
+    json_writer_end_object(&json);
+
+    return http_server_send_json(req, &json);
+}
+
+/*
+ * Field names accepted by the /status.json field mask
+ */
+static const struct
+{
+    const char *name;
+    uint32_t field;
+} http_server_status_fields[] = {
+    {"ssid", HTTP_STATUS_FIELD_SSID},
+    {"ota", HTTP_STATUS_FIELD_OTA},
+    {"wifi", HTTP_STATUS_FIELD_WIFI_STATUS},
+    {"conn", HTTP_STATUS_FIELD_CONNECT_INFO},
+    {"dht", HTTP_STATUS_FIELD_DHT_SENSOR},
+    {"time", HTTP_STATUS_FIELD_LOCAL_TIME},
+};
+
+/*
+ * Parses the fields query parameter of /status.json, e.g. ?fields=dht,time
+ * @param req HTTP request carrying the query string
+ * @return bit mask of http_server_status_field_e, all fields when no mask is given
+ */
+static uint32_t http_server_status_parse_fields(httpd_req_t *req)
+{
+    char query[96];
+    char fields[80];
+    uint32_t mask = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "fields", fields, sizeof(fields)) != ESP_OK)
+    {
+        return HTTP_STATUS_FIELD_ALL;
+    }
+
+    char *save_ptr = NULL;
+    for (char *name = strtok_r(fields, ",", &save_ptr); name != NULL; name = strtok_r(NULL, ",", &save_ptr))
+    {
+        for (size_t i = 0; i < sizeof(http_server_status_fields) / sizeof(http_server_status_fields[0]); i++)
+        {
+            if (strcmp(name, http_server_status_fields[i].name) == 0)
+            {
+                mask |= http_server_status_fields[i].field;
+            }
+        }
+    }
+
+    return mask;
+}
+
+/*
+ * Takes a snapshot of the requested state, all values are read back to back
+ * before anything is formatted so the response is coherent.
+ * @param fields bit mask of http_server_status_field_e
+ * @param status snapshot to fill
+ */
+static void http_server_status_take_snapshot(uint32_t fields, http_server_status_snapshot_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    status->fields = fields;
+    status->wifi_connect_status = http_server_get_wifi_connect_status();
+    status->fw_update_status = g_fw_update_status;
+    status->temperature = temperature;
+    status->humidity = humidity;
+
+    if (fields & HTTP_STATUS_FIELD_SSID)
+    {
+        wifi_config_t ap_config;
+        if (esp_wifi_get_config(ESP_IF_WIFI_AP, &ap_config) == ESP_OK)
+        {
+            memcpy(status->ap_ssid, ap_config.ap.ssid, MAX_SSID_LENGTH);
+        }
+    }
+
+    if ((fields & HTTP_STATUS_FIELD_CONNECT_INFO) && status->wifi_connect_status == HTTP_WIFI_STATUS_CONNECT_SUCCESS)
+    {
+        wifi_link_info_t link;
+        wifi_link_get(&link);
+        if (link.has_ip)
+        {
+            status->connected = true;
+            memcpy(status->sta_ssid, link.ssid, MAX_SSID_LENGTH);
+            esp_ip4addr_ntoa(&link.ip_info.ip, status->ip, IP4ADDR_STRLEN_MAX);
+            esp_ip4addr_ntoa(&link.ip_info.netmask, status->netmask, IP4ADDR_STRLEN_MAX);
+            esp_ip4addr_ntoa(&link.ip_info.gw, status->gateway, IP4ADDR_STRLEN_MAX);
+        }
+    }
 
-    sprintf(ssidJSON, "{\"ssid\":\"%s\"}", ssid);
+    if ((fields & HTTP_STATUS_FIELD_LOCAL_TIME) && g_is_local_time_set)
+    {
+        status->time_set = true;
+        strlcpy(status->local_time, sntp_time_sync_get_time(), sizeof(status->local_time));
+    }
+}
+
+/*
+ * Writes a status snapshot as a JSON object.
+ * @param status snapshot to write
+ * @param json writer, HTTP_STATUS_JSON_MAX_LEN fits every field when writing
+ * into a buffer
+ */
+static void http_server_status_write(const http_server_status_snapshot_t *status, json_writer_t *json)
+{
+    json_writer_begin_object(json, NULL);
+    if (status->fields & HTTP_STATUS_FIELD_SSID)
+    {
+        json_writer_string(json, "ssid", status->ap_ssid);
+    }
+    if (status->fields & HTTP_STATUS_FIELD_OTA)
+    {
+        json_writer_begin_object(json, "ota");
+        json_writer_int(json, "ota_update_status", status->fw_update_status);
+        json_writer_string(json, "compile_time", __TIME__);
+        json_writer_string(json, "compile_date", __DATE__);
+        json_writer_end_object(json);
+    }
+    if (status->fields & HTTP_STATUS_FIELD_WIFI_STATUS)
+    {
+        json_writer_int(json, "wifi_connect_status", status->wifi_connect_status);
+    }
+    if ((status->fields & HTTP_STATUS_FIELD_CONNECT_INFO) && status->connected)
+    {
+        json_writer_begin_object(json, "conn");
+        json_writer_string(json, "ip", status->ip);
+        json_writer_string(json, "netmask", status->netmask);
+        json_writer_string(json, "gw", status->gateway);
+        json_writer_string(json, "ap", status->sta_ssid);
+        json_writer_end_object(json);
+    }
+    if (status->fields & HTTP_STATUS_FIELD_DHT_SENSOR)
+    {
+        json_writer_begin_object(json, "dht");
+        json_writer_fixed_string(json, "temp", status->temperature, 1);
+        json_writer_fixed_string(json, "humidity", status->humidity, 1);
+        json_writer_end_object(json);
+    }
+    if ((status->fields & HTTP_STATUS_FIELD_LOCAL_TIME) && status->time_set)
+    {
+        json_writer_string(json, "time", status->local_time);
+    }
+    json_writer_end_object(json);
+}
+
+/*
+ * status.json handler responds with one coherent snapshot of the AP SSID, OTA
+ * status, wifi connection status and info, DHT sensor readings and local
+ * time. A subset can be requested with ?fields=ssid,ota,wifi,conn,dht,time
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_get_status_json_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "/status.json requested");
+
+    http_server_status_snapshot_t status;
+    char statusJSON[HTTP_STATUS_JSON_MAX_LEN];
+    json_writer_t json;
+
+    http_server_status_take_snapshot(http_server_status_parse_fields(req), &status);
+
+    json_writer_init(&json, statusJSON, sizeof(statusJSON), NULL, NULL);
+    http_server_status_write(&status, &json);
+
+    return http_server_send_json(req, &json);
+}
+
+/*
+ * Sends a page with the initial state spliced in, e.g. index.html. The embedded
+ * bytes are streamed in chunks around the splice offset and a small inline
+ * script holding the status snapshot is written straight to the response
+ * through a json_writer in between, so the first paint shows real data without
+ * any further request and the page is never copied to RAM. The page changes
+ * with the state, so its route is not cacheable and goes out with no-store,
+ * the versioned assets it references stay immutable.
+ * @param req http request for which the uri needs to be handled, user_ctx
+ * points to the web_asset_t to send
+ * @return ESP_OK on success, otherwise the httpd_resp_send_chunk error
+ */
+static esp_err_t http_server_spliced_page_handler(httpd_req_t *req)
+{
+    const web_asset_t *asset = (const web_asset_t *)req->user_ctx;
+    const char *page = (const char *)asset->identity_data;
+    http_server_status_snapshot_t status;
+    char stateJSON[HTTP_SERVER_JSON_CHUNK_SIZE];
+    json_writer_t json;
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "%s requested", asset->path);
+
+    http_server_status_take_snapshot(HTTP_STATUS_FIELD_ALL, &status);
+    json_writer_init(&json, stateJSON, sizeof(stateJSON), http_server_json_chunk_flush, req);
+
+    httpd_resp_set_type(req, asset->mime_type);
+
+    err = httpd_resp_send_chunk(req, page, asset->splice_offset);
+    if (err == ESP_OK)
+    {
+        err = httpd_resp_sendstr_chunk(req, "<script>window.initialState=");
+    }
+    if (err == ESP_OK)
+    {
+        http_server_status_write(&status, &json);
+        err = json_writer_finish(&json);
+    }
+    if (err == ESP_OK)
+    {
+        err = httpd_resp_sendstr_chunk(req, "</script>");
+    }
+    if (err == ESP_OK)
+    {
+        err = httpd_resp_send_chunk(req, page + asset->splice_offset, asset->identity_len - asset->splice_offset);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_spliced_page_handler: error %s sending %s", esp_err_to_name(err), asset->path);
+        return err;
+    }
+
+    // terminate the chunked response
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/*
+ * debug/http.json handler responds with the metrics of every route: request
+ * count, bytes in and out, concurrency and latency histogram, with the
+ * throughput of the last OTA update, the wifi time to reconnect, the SoftAP
+ * on/off time, the wifi connection state with its last transitions, the
+ * link quality with the last disconnect reasons and the event bus lanes.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK on success, otherwise the httpd_resp_send_chunk error
+ */
+static esp_err_t http_server_get_debug_http_json_handler(httpd_req_t *req)
+{
+    char debugJSON[HTTP_SERVER_JSON_CHUNK_SIZE];
+    json_writer_t json;
+    ota_writer_stats_t ota_stats;
+    wifi_reconnect_stats_t reconnect_stats;
+    wifi_ap_stats_t ap_stats;
+    wifi_state_machine_t state;
+    wifi_link_info_t link;
+    event_bus_lane_stats_t bus_stats[EVENT_BUS_LANE_COUNT];
+    static const char *const bus_lanes[EVENT_BUS_LANE_COUNT] = {"high", "normal", "low"};
+    int64_t now_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "/debug/http.json requested");
+
+    ota_writer_get_stats(&ota_stats);
+    wifi_get_reconnect_stats(&reconnect_stats);
+    wifi_get_ap_stats(&ap_stats);
+    wifi_get_state(&state);
+    wifi_link_get(&link);
+    event_bus_get_stats(bus_stats);
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, ssidJSON, strlen(ssidJSON));
+    json_writer_init(&json, debugJSON, sizeof(debugJSON), http_server_json_chunk_flush, req);
+    json_writer_begin_object(&json, NULL);
+    json_writer_int(&json, "latency_min_us", HTTP_ROUTER_LATENCY_MIN_US);
+    http_router_write_stats(&json, "routes");
+    json_writer_begin_object(&json, "ota");
+    json_writer_int(&json, "bytes_written", ota_stats.bytes_written);
+    json_writer_int(&json, "elapsed_ms", ota_stats.elapsed_ms);
+    json_writer_int(&json, "kbytes_per_s", ota_stats.kbytes_per_s);
+    json_writer_int(&json, "producer_stall_ms", ota_stats.producer_stall_ms);
+    json_writer_int(&json, "writer_stall_ms", ota_stats.writer_stall_ms);
+    json_writer_end_object(&json);
+    json_writer_begin_object(&json, "reconnect");
+    json_writer_int(&json, "disconnects", reconnect_stats.disconnects);
+    json_writer_int(&json, "reconnects", reconnect_stats.reconnects);
+    json_writer_int(&json, "attempts", reconnect_stats.attempts);
+    json_writer_int(&json, "last_ms", reconnect_stats.last_ms);
+    json_writer_int(&json, "max_ms", reconnect_stats.max_ms);
+    json_writer_int(&json, "avg_ms",
+                    reconnect_stats.reconnects ? reconnect_stats.total_ms / reconnect_stats.reconnects : 0);
+    json_writer_end_object(&json);
+    json_writer_begin_object(&json, "softap");
+    json_writer_bool(&json, "enabled", ap_stats.enabled);
+    json_writer_int(&json, "clients", ap_stats.clients);
+    json_writer_int(&json, "on_ms", ap_stats.on_ms);
+    json_writer_int(&json, "off_ms", ap_stats.off_ms);
+    json_writer_end_object(&json);
+    json_writer_begin_object(&json, "wifi_state");
+    json_writer_string(&json, "state", wifi_state_name(state.state));
+    json_writer_int(&json, "in_state_ms", (now_us - state.entered_us) / 1000);
+    json_writer_int(&json, "connects", state.metrics.connects);
+    json_writer_int(&json, "last_connect_ms", state.metrics.last_connect_ms);
+    json_writer_int(&json, "max_connect_ms", state.metrics.max_connect_ms);
+    json_writer_int(&json, "last_ip_ms", state.metrics.last_ip_ms);
+    json_writer_int(&json, "max_ip_ms", state.metrics.max_ip_ms);
+    json_writer_int(&json, "outages", state.metrics.outages);
+    json_writer_int(&json, "flaps", state.metrics.flaps);
+    json_writer_int(&json, "last_outage_ms", state.metrics.last_outage_ms);
+    json_writer_int(&json, "max_outage_ms", state.metrics.max_outage_ms);
+    json_writer_int(&json, "outage_ms", wifi_state_outage_ms(&state, now_us));
+    json_writer_begin_array(&json, "transitions");
+    for (uint32_t i = state.transitions > WIFI_STATE_HISTORY_LEN ? state.transitions - WIFI_STATE_HISTORY_LEN : 0;
+         i < state.transitions;
+         i++)
+    {
+        const wifi_state_transition_t *transition = &state.history[i % WIFI_STATE_HISTORY_LEN];
+
+        json_writer_begin_object(&json, NULL);
+        json_writer_int(&json, "t_ms", transition->timestamp_us / 1000);
+        json_writer_string(&json, "from", wifi_state_name(transition->from));
+        json_writer_string(&json, "to", wifi_state_name(transition->to));
+        json_writer_string(&json, "event", wifi_state_event_name(transition->event));
+        json_writer_end_object(&json);
+    }
+    json_writer_end_array(&json);
+    json_writer_end_object(&json);
+    json_writer_begin_object(&json, "link");
+    json_writer_bool(&json, "associated", link.associated);
+    json_writer_int(&json, "channel", link.channel);
+    json_writer_int(&json, "rssi", link.rssi);
+    json_writer_int(&json, "rssi_avg", link.rssi_avg);
+    json_writer_int(&json, "rssi_min", link.rssi_min);
+    json_writer_int(&json, "rssi_max", link.rssi_max);
+    json_writer_int(&json, "samples", link.samples);
+    json_writer_int(&json, "disconnects", link.disconnects);
+    json_writer_begin_array(&json, "disconnect_reasons");
+    for (uint32_t i = link.disconnects > WIFI_LINK_REASON_HISTORY_LEN ? link.disconnects - WIFI_LINK_REASON_HISTORY_LEN
+                                                                      : 0;
+         i < link.disconnects;
+         i++)
+    {
+        const wifi_link_disconnect_t *disconnect = &link.history[i % WIFI_LINK_REASON_HISTORY_LEN];
 
-    return ESP_OK;
+        json_writer_begin_object(&json, NULL);
+        json_writer_int(&json, "t_ms", disconnect->timestamp_us / 1000);
+        json_writer_int(&json, "reason", disconnect->reason);
+        json_writer_int(&json, "rssi", disconnect->rssi);
+        json_writer_end_object(&json);
+    }
+    json_writer_end_array(&json);
+    json_writer_end_object(&json);
+    json_writer_begin_object(&json, "event_bus");
+    for (size_t i = 0; i < EVENT_BUS_LANE_COUNT; i++)
+    {
+        const event_bus_lane_stats_t *lane = &bus_stats[i];
+
+        json_writer_begin_object(&json, bus_lanes[i]);
+        json_writer_int(&json, "published", lane->published);
+        json_writer_int(&json, "delivered", lane->delivered);
+        json_writer_int(&json, "dropped", lane->dropped);
+        json_writer_int(&json, "coalesced", lane->coalesced);
+        json_writer_int(&json, "depth", lane->depth);
+        json_writer_int(&json, "max_depth", lane->max_depth);
+        json_writer_int(&json, "max_latency_us", lane->max_latency_us);
+        json_writer_int(&json, "avg_latency_us", lane->delivered ? lane->total_latency_us / lane->delivered : 0);
+        json_writer_end_object(&json);
+    }
+    json_writer_end_object(&json);
+    json_writer_end_object(&json);
+
+    esp_err_t err = json_writer_finish(&json);
+    return err == ESP_OK ? httpd_resp_send_chunk(req, NULL, 0) : err;
+}
+
+/*
+ * Routes of the http server, the web assets are added from the generated
+ * asset table.
+ */
+static const http_route_t http_server_routes[] = {
+    {.path = "/OTAupdate",
+     .method = HTTP_POST,
+     .handler = http_server_OTA_update_handler,
+     .flags = HTTP_ROUTE_STREAMING | HTTP_ROUTE_SLOW,
+     .max_concurrent = 1},
+    {.path = "/OTAsession", .method = HTTP_POST, .handler = http_server_OTA_session_open_handler},
+    {.path = "/OTAsession", .method = HTTP_GET, .handler = http_server_OTA_session_get_handler},
+    {.path = "/OTAsession",
+     .method = HTTP_PUT,
+     .handler = http_server_OTA_session_put_handler,
+     .flags = HTTP_ROUTE_STREAMING | HTTP_ROUTE_SLOW,
+     .max_concurrent = 1},
+    {.path = "/OTAstatus", .method = HTTP_POST, .handler = http_server_OTA_status_handler},
+    {.path = "/dhtSensor.json", .method = HTTP_GET, .handler = http_server_get_dht_sensor_readings_json_handler},
+    {.path = "/wifiConnect.json", .method = HTTP_POST, .handler = http_server_wifi_connect_json_handler},
+    {.path = "/wifiScan.json", .method = HTTP_GET, .handler = http_server_wifi_scan_json_handler},
+    {.path = "/wifiConnectStatus", .method = HTTP_POST, .handler = http_server_wifi_connect_status_json_handler},
+    {.path = "/wifiConnectInfo.json", .method = HTTP_GET, .handler = http_server_wifi_connect_info_json_handler},
+    {.path = "/wifiDisconnect.json", .method = HTTP_DELETE, .handler = http_server_wifi_disconnect_json_handler},
+    {.path = "/powerProfile.json", .method = HTTP_GET, .handler = http_server_power_profile_json_handler},
+    {.path = "/powerProfile.json", .method = HTTP_POST, .handler = http_server_power_profile_json_handler},
+    {.path = "/localTime.json", .method = HTTP_GET, .handler = http_server_get_local_time_json_handler},
+    {.path = "/apSSID.json", .method = HTTP_GET, .handler = http_server_get_ap_ssid_json_handler},
+    {.path = "/status.json", .method = HTTP_GET, .handler = http_server_get_status_json_handler},
+    {.path = "/debug/http.json", .method = HTTP_GET, .handler = http_server_get_debug_http_json_handler},
+};
+
+/*
+ * Adds the route table and one route per web asset to the router.
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+static esp_err_t http_server_add_routes(void)
+{
+    // one route per asset plus the root page, kept for the lifetime of the firmware
+    static http_route_t *asset_routes = NULL;
+    static size_t asset_route_count = 0;
+
+    if (asset_routes == NULL)
+    {
+        asset_routes = calloc(web_assets_count + 1, sizeof(http_route_t));
+        if (asset_routes == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+
+        for (size_t i = 0; i < web_assets_count; i++)
+        {
+            http_route_t route = {.path = web_assets[i].path,
+                                  .method = HTTP_GET,
+                                  .handler = web_assets[i].splice_offset < 0 ? http_server_web_asset_handler
+                                                                             : http_server_spliced_page_handler,
+                                  .user_ctx = (void *)&web_assets[i],
+                                  .flags = web_assets[i].splice_offset < 0 ? HTTP_ROUTE_CACHEABLE : 0};
+            asset_routes[asset_route_count++] = route;
+
+            // index.html is also the root page
+            if (strcmp(web_assets[i].path, "/index.html") == 0)
+            {
+                route.path = "/";
+                asset_routes[asset_route_count++] = route;
+            }
+        }
+    }
+
+    http_router_reset();
+
+    esp_err_t err = http_router_add_routes(http_server_routes, sizeof(http_server_routes) / sizeof(http_server_routes[0]));
+    if (err == ESP_OK)
+    {
+        err = http_router_add_routes(asset_routes, asset_route_count);
+    }
+    return err;
 }
 
 /*
@@ -553,6 +1376,20 @@ static httpd_handle_t http_server_configure(void)
     // generate defaul configuration
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
+    if (http_server_add_routes() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_configure: no memory for the route table");
+        return NULL;
+    }
+
+    // the monitor receives what was published while the server was stopped
+    if (http_server_monitor_subscriber == NULL)
+    {
+        http_server_monitor_subscriber = event_bus_subscribe(EVENT_BUS_BIT(EVENT_BUS_WIFI_STATE_CHANGED) |
+                                                             EVENT_BUS_BIT(EVENT_BUS_OTA_RESULT) |
+                                                             EVENT_BUS_BIT(EVENT_BUS_TIME_SYNCED));
+    }
+
     // Create http server monitor task
     xTaskCreatePinnedToCore(&http_server_monitor,
                             "http_server_monitor",
@@ -562,13 +1399,12 @@ static httpd_handle_t http_server_configure(void)
                             &task_http_server_monitor,
                             HTTP_SERVER_TASK_CORE_ID);
 
-    // Create message queue
-    http_server_monitor_queue_handle = xQueueCreate(3, sizeof(http_server_queue_message_t));
-
     config.core_id = HTTP_SERVER_TASK_CORE_ID;
     config.task_priority = HTTP_SERVER_TASK_PRIORITY;
     config.stack_size = HTTP_SERVER_TASK_STACK_SIZE;
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = http_router_uri_handler_count() + HTTP_SERVER_WS_URI_HANDLERS;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.open_fn = http_router_session_open;
     config.recv_wait_timeout = 10; // seconds
     config.send_wait_timeout = 10; // seconds
 
@@ -582,89 +1418,10 @@ static httpd_handle_t http_server_configure(void)
     if (httpd_start(&http_server_handle, &config) == ESP_OK)
     {
         ESP_LOGI(TAG, "http_server_configure: registering URI handlers");
-        httpd_uri_t jquery_js = {.uri = "/jquery-3.3.1.min.js",
-                                 .method = HTTP_GET,
-                                 .handler = http_server_jquery_handler,
-                                 .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &jquery_js);
 
-        httpd_uri_t index_html = {.uri = "/",
-                                  .method = HTTP_GET,
-                                  .handler = http_server_index_html_handler,
-                                  .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &index_html);
-
-        httpd_uri_t app_css = {.uri = "/app.css",
-                               .method = HTTP_GET,
-                               .handler = http_server_app_css_handler,
-                               .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &app_css);
-
-        httpd_uri_t app_js = {.uri = "/app.js",
-                              .method = HTTP_GET,
-                              .handler = http_server_app_js_handler,
-                              .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &app_js);
-
-        httpd_uri_t favicon_ico = {.uri = "/favicon.ico",
-                                   .method = HTTP_GET,
-                                   .handler = http_server_favicon_ico_handler,
-                                   .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &favicon_ico);
-
-        httpd_uri_t OTA_update = {.uri = "/OTAupdate",
-                                  .method = HTTP_POST,
-                                  .handler = http_server_OTA_update_handler,
-                                  .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &OTA_update);
-
-        httpd_uri_t OTA_status = {.uri = "/OTAstatus",
-                                  .method = HTTP_POST,
-                                  .handler = http_server_OTA_status_handler,
-                                  .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &OTA_status);
-
-        httpd_uri_t dht_sensor_json = {.uri = "/dhtSensor.json",
-                                       .method = HTTP_GET,
-                                       .handler = http_server_get_dht_sensor_readings_json_handler,
-                                       .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &dht_sensor_json);
-
-        httpd_uri_t wifi_connect_json = {.uri = "/wifiConnect.json",
-                                         .method = HTTP_POST,
-                                         .handler = http_server_wifi_connect_json_handler,
-                                         .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &wifi_connect_json);
-
-        httpd_uri_t wifi_connect_status_json = {.uri = "/wifiConnectStatus",
-                                                .method = HTTP_POST,
-                                                .handler = http_server_wifi_connect_status_json_handler,
-                                                .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &wifi_connect_status_json);
-
-        httpd_uri_t wifi_connect_info_json = {.uri = "/wifiConnectInfo.json",
-                                              .method = HTTP_GET,
-                                              .handler = http_server_wifi_connect_info_json_handler,
-                                              .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &wifi_connect_info_json);
-
-        httpd_uri_t wifi_disconnect_json = {.uri = "/wifiDisconnect.json",
-                                            .method = HTTP_DELETE,
-                                            .handler = http_server_wifi_disconnect_json_handler,
-                                            .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &wifi_disconnect_json);
-
-        httpd_uri_t local_time_json = {.uri = "/localTime.json",
-                                       .method = HTTP_GET,
-                                       .handler = http_server_get_local_time_json_handler,
-                                       .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &local_time_json);
-
-        httpd_uri_t ap_ssid_json = {.uri = "/apSSID.json",
-                                    .method = HTTP_GET,
-                                    .handler = http_server_get_ap_ssid_json_handler,
-                                    .user_ctx = NULL};
-        httpd_register_uri_handler(http_server_handle, &ap_ssid_json);
+        // the WebSocket endpoint is matched before the router wildcards
+        http_server_ws_register(http_server_handle);
+        http_router_register(http_server_handle);
 
         return http_server_handle;
     }
@@ -672,11 +1429,33 @@ static httpd_handle_t http_server_configure(void)
     return NULL;
 }
 
-BaseType_t http_server_monitor_send_message(http_server_message_e msgID)
+int http_server_get_wifi_connect_status(void)
+{
+    wifi_state_machine_t state;
+
+    wifi_get_state(&state);
+    switch (state.state)
+    {
+    case WIFI_STATE_CONNECTING:
+        // a known network connecting at boot was not asked for from the page
+        return state.origin == WIFI_STATE_ORIGIN_HTTP ? HTTP_WIFI_STATUS_CONNECTING : NONE;
+    case WIFI_STATE_CONNECTED:
+        return HTTP_WIFI_STATUS_CONNECT_SUCCESS;
+    case WIFI_STATE_RECONNECTING:
+        return HTTP_WIFI_STATUS_CONNECTING;
+    case WIFI_STATE_FAILED:
+        return HTTP_WIFI_STATUS_CONNECT_FAIL;
+    case WIFI_STATE_DISCONNECTING:
+    case WIFI_STATE_DISCONNECTED:
+        return HTTP_WIFI_STATUS_DISCONNECTED;
+    default:
+        return NONE;
+    }
+}
+
+bool http_server_is_local_time_set(void)
 {
-    http_server_queue_message_t msg;
-    msg.msgID = msgID;
-    return xQueueSend(http_server_monitor_queue_handle, &msg, portMAX_DELAY);
+    return g_is_local_time_set;
 }
 
 void start_http_server(void)
@@ -689,8 +1468,9 @@ void start_http_server(void)
 
 void stop_http_server(void)
 {
-    if (http_server_handle == NULL)
+    if (http_server_handle != NULL)
     {
+        http_server_ws_unregister();
         httpd_stop(http_server_handle);
         ESP_LOGI(TAG, "http_server_stop: stopping http server");
         http_server_handle = NULL;
@@ -0,0 +1,400 @@
+#include "http_server_ws.h"
+
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dht11.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "http_server.h"
+#include "json_writer.h"
+#include "lwip/sockets.h"
+#include "portmacro.h"
+#include "sntp_time_sync.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "http_server_ws";
+
+/*
+ * Subscribed client, fd is -1 when the slot is free
+ */
+typedef struct http_server_ws_client {
+    int fd;
+    uint32_t pending_topics; // topics changed since the last frame
+    bool send_queued;        // a send is queued on the httpd task
+    uint8_t missed;          // frames dropped in a row on a full send buffer
+} http_server_ws_client_t;
+
+// http server the endpoint is registered on
+static httpd_handle_t ws_server_handle = NULL;
+
+// Subscribed clients, guarded by ws_clients_mux
+static http_server_ws_client_t ws_clients[HTTP_SERVER_WS_MAX_CLIENTS] = {
+    [0 ... HTTP_SERVER_WS_MAX_CLIENTS - 1] = {.fd = -1},
+};
+static portMUX_TYPE ws_clients_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Local time update timer
+static esp_timer_handle_t ws_clock_timer = NULL;
+
+/*
+ * Runs the local time updates only while a client is subscribed.
+ */
+static void http_server_ws_update_clock(void)
+{
+    bool subscribed = false;
+
+    if (ws_clock_timer == NULL)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&ws_clients_mux);
+    for (int i = 0; i < HTTP_SERVER_WS_MAX_CLIENTS; i++)
+    {
+        subscribed |= ws_clients[i].fd >= 0;
+    }
+    taskEXIT_CRITICAL(&ws_clients_mux);
+
+    if (subscribed && !esp_timer_is_active(ws_clock_timer))
+    {
+        esp_timer_start_periodic(ws_clock_timer, HTTP_SERVER_WS_CLOCK_PERIOD_US);
+    }
+    else if (!subscribed && esp_timer_is_active(ws_clock_timer))
+    {
+        esp_timer_stop(ws_clock_timer);
+    }
+}
+
+/*
+ * Adds a client to the subscribers, the whole state is sent to it first.
+ * @param fd socket of the client
+ * @return true if a free slot was found
+ */
+static bool http_server_ws_add_client(int fd)
+{
+    int slot = -1;
+
+    taskENTER_CRITICAL(&ws_clients_mux);
+    for (int i = 0; i < HTTP_SERVER_WS_MAX_CLIENTS; i++)
+    {
+        if (ws_clients[i].fd == fd)
+        {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && ws_clients[i].fd < 0)
+        {
+            slot = i;
+        }
+    }
+
+    if (slot >= 0)
+    {
+        ws_clients[slot].fd = fd;
+        ws_clients[slot].pending_topics = 0;
+        ws_clients[slot].send_queued = false;
+        ws_clients[slot].missed = 0;
+    }
+    taskEXIT_CRITICAL(&ws_clients_mux);
+
+    http_server_ws_update_clock();
+
+    return slot >= 0;
+}
+
+/*
+ * Removes a client from the subscribers.
+ * @param fd socket of the client
+ */
+static void http_server_ws_remove_client(int fd)
+{
+    taskENTER_CRITICAL(&ws_clients_mux);
+    for (int i = 0; i < HTTP_SERVER_WS_MAX_CLIENTS; i++)
+    {
+        if (ws_clients[i].fd == fd)
+        {
+            ws_clients[i].fd = -1;
+            ws_clients[i].pending_topics = 0;
+            ws_clients[i].send_queued = false;
+        }
+    }
+    taskEXIT_CRITICAL(&ws_clients_mux);
+
+    http_server_ws_update_clock();
+}
+
+/*
+ * Drops a client that is gone or fell behind and closes its session.
+ * @param fd socket of the client
+ */
+static void http_server_ws_drop_client(int fd)
+{
+    http_server_ws_remove_client(fd);
+    httpd_sess_trigger_close(ws_server_handle, fd);
+}
+
+/*
+ * Builds the JSON telemetry frame for the given topics from the latest state.
+ * @param topics bit mask of http_server_ws_topic_e
+ * @param buf output buffer
+ * @param size size of buf
+ * @return length of the frame
+ */
+static size_t http_server_ws_build_frame(uint32_t topics, char *buf, size_t size)
+{
+    json_writer_t json;
+
+    json_writer_init(&json, buf, size, NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    if (topics & HTTP_WS_TOPIC_DHT_SENSOR)
+    {
+        json_writer_fixed_string(&json, "temp", temperature, 1);
+        json_writer_fixed_string(&json, "humidity", humidity, 1);
+    }
+    if ((topics & HTTP_WS_TOPIC_LOCAL_TIME) && http_server_is_local_time_set())
+    {
+        json_writer_string(&json, "time", sntp_time_sync_get_time());
+    }
+    if (topics & HTTP_WS_TOPIC_WIFI_STATUS)
+    {
+        json_writer_int(&json, "wifi_connect_status", http_server_get_wifi_connect_status());
+    }
+    json_writer_end_object(&json);
+
+    if (json_writer_finish(&json) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_ws_build_frame: frame does not fit the buffer");
+        json_writer_init(&json, buf, size, NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_end_object(&json);
+        json_writer_finish(&json);
+    }
+
+    return json_writer_length(&json);
+}
+
+/*
+ * Sends the pending topics to one client, runs on the httpd task through
+ * httpd_queue_work. The frame is sent without blocking so a stalled client
+ * never holds up the other requests: when its send buffer is full the frame
+ * is dropped and its topics are sent with the next one, after
+ * HTTP_SERVER_WS_MAX_MISSED drops in a row, or a partly sent frame, the
+ * client is closed.
+ * @param arg client slot index
+ */
+static void http_server_ws_send_work(void *arg)
+{
+    int slot = (int)(intptr_t)arg;
+    // text frame header, unmasked, with a 16 bit length
+    char frame_buf[4 + HTTP_SERVER_WS_FRAME_MAX_LEN];
+    size_t payload_len;
+    size_t header_len;
+    uint32_t topics;
+    int fd;
+    int sent;
+
+    taskENTER_CRITICAL(&ws_clients_mux);
+    fd = ws_clients[slot].fd;
+    topics = ws_clients[slot].pending_topics;
+    ws_clients[slot].pending_topics = 0;
+    ws_clients[slot].send_queued = false;
+    taskEXIT_CRITICAL(&ws_clients_mux);
+
+    if (fd < 0 || topics == 0 || ws_server_handle == NULL)
+    {
+        return;
+    }
+
+    // Client went away without a close frame
+    if (httpd_ws_get_fd_info(ws_server_handle, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+    {
+        ESP_LOGI(TAG, "http_server_ws_send_work: client %d gone", fd);
+        http_server_ws_remove_client(fd);
+        return;
+    }
+
+    payload_len = http_server_ws_build_frame(topics, frame_buf + 4, HTTP_SERVER_WS_FRAME_MAX_LEN);
+    if (payload_len < 126)
+    {
+        header_len = 2;
+        frame_buf[2] = (char)0x81; // FIN, text
+        frame_buf[3] = (char)payload_len;
+    }
+    else
+    {
+        header_len = 4;
+        frame_buf[0] = (char)0x81;
+        frame_buf[1] = 126;
+        frame_buf[2] = (char)(payload_len >> 8);
+        frame_buf[3] = (char)(payload_len & 0xff);
+    }
+
+    sent = httpd_socket_send(ws_server_handle,
+                             fd,
+                             frame_buf + 4 - header_len,
+                             header_len + payload_len,
+                             MSG_DONTWAIT);
+
+    if (sent == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+        bool drop;
+
+        // nothing was sent, the topics go out with the next frame
+        taskENTER_CRITICAL(&ws_clients_mux);
+        if (ws_clients[slot].fd == fd)
+        {
+            ws_clients[slot].pending_topics |= topics;
+        }
+        drop = ++ws_clients[slot].missed >= HTTP_SERVER_WS_MAX_MISSED;
+        taskEXIT_CRITICAL(&ws_clients_mux);
+
+        if (drop)
+        {
+            ESP_LOGW(TAG, "http_server_ws_send_work: client %d fell behind, dropping it", fd);
+            http_server_ws_drop_client(fd);
+        }
+    }
+    else if (sent != (int)(header_len + payload_len))
+    {
+        ESP_LOGW(TAG, "http_server_ws_send_work: send to client %d failed, dropping it", fd);
+        http_server_ws_drop_client(fd);
+    }
+    else
+    {
+        taskENTER_CRITICAL(&ws_clients_mux);
+        ws_clients[slot].missed = 0;
+        taskEXIT_CRITICAL(&ws_clients_mux);
+    }
+}
+
+/*
+ * Periodic local time update.
+ * @param arg unused
+ */
+static void http_server_ws_clock_callback(void *arg)
+{
+    if (http_server_is_local_time_set())
+    {
+        http_server_ws_notify(HTTP_WS_TOPIC_LOCAL_TIME);
+    }
+}
+
+/*
+ * /ws handler, subscribes the client once the handshake is done. Frames sent
+ * by the client are not used and only drained.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, ESP_FAIL to close the connection
+ */
+static esp_err_t http_server_ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET)
+    {
+        if (!http_server_ws_add_client(fd))
+        {
+            ESP_LOGW(TAG, "/ws: subscriber limit reached, rejecting client %d", fd);
+            return ESP_FAIL;
+        }
+
+        ESP_LOGI(TAG, "/ws: client %d subscribed", fd);
+        http_server_ws_notify(HTTP_WS_TOPIC_ALL);
+        return ESP_OK;
+    }
+
+    uint8_t rx_buf[HTTP_SERVER_WS_RX_MAX_LEN];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+
+    // Get the frame length first
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK || frame.len > sizeof(rx_buf))
+    {
+        http_server_ws_remove_client(fd);
+        return ESP_FAIL;
+    }
+
+    frame.payload = rx_buf;
+    err = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (err != ESP_OK || frame.type == HTTPD_WS_TYPE_CLOSE)
+    {
+        http_server_ws_remove_client(fd);
+    }
+
+    return err;
+}
+
+void http_server_ws_register(httpd_handle_t server)
+{
+    ws_server_handle = server;
+
+    httpd_uri_t ws = {.uri = "/ws",
+                      .method = HTTP_GET,
+                      .handler = http_server_ws_handler,
+                      .user_ctx = NULL,
+                      .is_websocket = true};
+    httpd_register_uri_handler(server, &ws);
+
+    // started with the first subscriber
+    if (ws_clock_timer == NULL)
+    {
+        const esp_timer_create_args_t ws_clock_timer_args = {.callback = &http_server_ws_clock_callback,
+                                                             .arg = NULL,
+                                                             .dispatch_method = ESP_TIMER_TASK,
+                                                             .name = "ws_clock"};
+        ESP_ERROR_CHECK(esp_timer_create(&ws_clock_timer_args, &ws_clock_timer));
+    }
+}
+
+void http_server_ws_unregister(void)
+{
+    ws_server_handle = NULL;
+
+    // the sessions are closed with the server
+    taskENTER_CRITICAL(&ws_clients_mux);
+    for (int i = 0; i < HTTP_SERVER_WS_MAX_CLIENTS; i++)
+    {
+        ws_clients[i].fd = -1;
+        ws_clients[i].pending_topics = 0;
+        ws_clients[i].send_queued = false;
+    }
+    taskEXIT_CRITICAL(&ws_clients_mux);
+
+    http_server_ws_update_clock();
+}
+
+void http_server_ws_notify(uint32_t topics)
+{
+    if (ws_server_handle == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < HTTP_SERVER_WS_MAX_CLIENTS; i++)
+    {
+        bool queue_send = false;
+
+        taskENTER_CRITICAL(&ws_clients_mux);
+        if (ws_clients[i].fd >= 0)
+        {
+            ws_clients[i].pending_topics |= topics;
+            queue_send = !ws_clients[i].send_queued;
+            ws_clients[i].send_queued = true;
+        }
+        taskEXIT_CRITICAL(&ws_clients_mux);
+
+        // One send per client is queued at most, a slow client only ever
+        // receives the latest state
+        if (queue_send && httpd_queue_work(ws_server_handle, http_server_ws_send_work, (void *)(intptr_t)i) != ESP_OK)
+        {
+            taskENTER_CRITICAL(&ws_clients_mux);
+            ws_clients[i].send_queued = false;
+            taskEXIT_CRITICAL(&ws_clients_mux);
+        }
+    }
+}
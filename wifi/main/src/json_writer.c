@@ -0,0 +1,339 @@
+#include "json_writer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+
+// Powers of ten for the fixed-point formatting
+static const uint32_t json_writer_pow10[JSON_WRITER_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+/*
+ * Appends raw bytes, flushing to the sink whenever the buffer is full.
+ * @param w writer
+ * @param data bytes to append
+ * @param len length of data
+ */
+static void json_writer_put(json_writer_t *w, const char *data, size_t len)
+{
+    while (w->err == ESP_OK && len > 0)
+    {
+        size_t space = w->size - w->len;
+        if (space == 0)
+        {
+            if (w->flush == NULL)
+            {
+                w->err = ESP_ERR_INVALID_SIZE;
+                return;
+            }
+
+            w->err = w->flush(w->flush_ctx, w->buf, w->len);
+            w->len = 0;
+            continue;
+        }
+
+        size_t n = len < space ? len : space;
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        w->total_len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/*
+ * Appends one character.
+ */
+static void json_writer_put_char(json_writer_t *w, char c)
+{
+    json_writer_put(w, &c, 1);
+}
+
+/*
+ * Appends an unsigned integer in decimal.
+ * @param value integer to write
+ * @param min_digits left padded with zeros up to this number of digits
+ */
+static void json_writer_put_uint(json_writer_t *w, uint64_t value, uint8_t min_digits)
+{
+    char digits[20];
+    size_t n = 0;
+
+    do
+    {
+        digits[sizeof(digits) - 1 - n] = (char)('0' + value % 10);
+        value /= 10;
+        n++;
+    } while (value > 0 || n < min_digits);
+
+    json_writer_put(w, digits + sizeof(digits) - n, n);
+}
+
+/*
+ * Appends a quoted, escaped string.
+ * @param value string, stops at the first NUL
+ * @param len max length of value
+ */
+static void json_writer_put_string(json_writer_t *w, const char *value, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run_start = 0;
+    size_t i;
+
+    json_writer_put_char(w, '"');
+    for (i = 0; i < len && value[i] != '\0'; i++)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c != '<')
+        {
+            continue;
+        }
+
+        // flush the run of plain characters before the escape
+        json_writer_put(w, value + run_start, i - run_start);
+        run_start = i + 1;
+
+        switch (c)
+        {
+        case '"':
+            json_writer_put(w, "\\\"", 2);
+            break;
+        case '\\':
+            json_writer_put(w, "\\\\", 2);
+            break;
+        case '\n':
+            json_writer_put(w, "\\n", 2);
+            break;
+        case '\r':
+            json_writer_put(w, "\\r", 2);
+            break;
+        case '\t':
+            json_writer_put(w, "\\t", 2);
+            break;
+        default:
+        {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+            json_writer_put(w, escape, sizeof(escape));
+            break;
+        }
+        }
+    }
+    json_writer_put(w, value + run_start, i - run_start);
+    json_writer_put_char(w, '"');
+}
+
+/*
+ * Starts a member, writes the separating comma and the key when given.
+ * @param key member name, NULL inside arrays
+ */
+static void json_writer_member(json_writer_t *w, const char *key)
+{
+    uint32_t depth_bit = 1u << w->depth;
+
+    if (w->has_members & depth_bit)
+    {
+        json_writer_put_char(w, ',');
+    }
+    w->has_members |= depth_bit;
+
+    if (key != NULL)
+    {
+        json_writer_put_string(w, key, SIZE_MAX);
+        json_writer_put_char(w, ':');
+    }
+}
+
+/*
+ * Opens an object or array.
+ */
+static void json_writer_open(json_writer_t *w, const char *key, char bracket)
+{
+    if (w->depth >= JSON_WRITER_MAX_DEPTH)
+    {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    json_writer_member(w, key);
+    json_writer_put_char(w, bracket);
+    w->depth++;
+    w->has_members &= ~(1u << w->depth);
+}
+
+/*
+ * Closes an object or array.
+ */
+static void json_writer_close(json_writer_t *w, char bracket)
+{
+    if (w->depth == 0)
+    {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    w->depth--;
+    json_writer_put_char(w, bracket);
+}
+
+/*
+ * Appends a fixed-point number without printf, a number that cannot be
+ * written is a bare null even when quoted.
+ * @param quoted write the number as a string, e.g. "21.5"
+ */
+static void json_writer_put_fixed(json_writer_t *w, float value, uint8_t decimals, bool quoted)
+{
+    if (decimals > JSON_WRITER_MAX_DECIMALS)
+    {
+        decimals = JSON_WRITER_MAX_DECIMALS;
+    }
+
+    // the scaled magnitude must fit in a uint64_t (below 2^64), NaN fails the
+    // comparison and is caught with infinity
+    uint32_t scale = json_writer_pow10[decimals];
+    double scaled = fabs((double)value) * scale + 0.5;
+    if (!(scaled < 18446744073709551616.0))
+    {
+        json_writer_put(w, "null", 4);
+        return;
+    }
+
+    bool negative = value < 0;
+    uint64_t magnitude = (uint64_t)scaled;
+
+    if (quoted)
+    {
+        json_writer_put_char(w, '"');
+    }
+    if (negative && magnitude != 0)
+    {
+        json_writer_put_char(w, '-');
+    }
+
+    json_writer_put_uint(w, magnitude / scale, 1);
+    if (decimals > 0)
+    {
+        json_writer_put_char(w, '.');
+        json_writer_put_uint(w, magnitude % scale, decimals);
+    }
+    if (quoted)
+    {
+        json_writer_put_char(w, '"');
+    }
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_writer_flush_t flush, void *flush_ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->flush = flush;
+    w->flush_ctx = flush_ctx;
+    w->err = ESP_OK;
+
+    // keep room for the NUL terminator when writing into buf only
+    w->size = (flush == NULL && size > 0) ? size - 1 : size;
+    if (w->size == 0)
+    {
+        w->buf = NULL;
+        w->err = ESP_ERR_INVALID_SIZE;
+    }
+}
+
+void json_writer_begin_object(json_writer_t *w, const char *key)
+{
+    json_writer_open(w, key, '{');
+}
+
+void json_writer_end_object(json_writer_t *w)
+{
+    json_writer_close(w, '}');
+}
+
+void json_writer_begin_array(json_writer_t *w, const char *key)
+{
+    json_writer_open(w, key, '[');
+}
+
+void json_writer_end_array(json_writer_t *w)
+{
+    json_writer_close(w, ']');
+}
+
+void json_writer_string(json_writer_t *w, const char *key, const char *value)
+{
+    json_writer_string_n(w, key, value, SIZE_MAX);
+}
+
+void json_writer_string_n(json_writer_t *w, const char *key, const char *value, size_t len)
+{
+    json_writer_member(w, key);
+    json_writer_put_string(w, value != NULL ? value : "", len);
+}
+
+void json_writer_int(json_writer_t *w, const char *key, int64_t value)
+{
+    json_writer_member(w, key);
+    if (value < 0)
+    {
+        json_writer_put_char(w, '-');
+        json_writer_put_uint(w, (uint64_t)(-(value + 1)) + 1, 1);
+    }
+    else
+    {
+        json_writer_put_uint(w, (uint64_t)value, 1);
+    }
+}
+
+void json_writer_fixed(json_writer_t *w, const char *key, float value, uint8_t decimals)
+{
+    json_writer_member(w, key);
+    json_writer_put_fixed(w, value, decimals, false);
+}
+
+void json_writer_fixed_string(json_writer_t *w, const char *key, float value, uint8_t decimals)
+{
+    json_writer_member(w, key);
+    json_writer_put_fixed(w, value, decimals, true);
+}
+
+void json_writer_bool(json_writer_t *w, const char *key, bool value)
+{
+    json_writer_member(w, key);
+    json_writer_put(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_writer_null(json_writer_t *w, const char *key)
+{
+    json_writer_member(w, key);
+    json_writer_put(w, "null", 4);
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->depth != 0)
+    {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+
+    if (w->flush == NULL)
+    {
+        if (w->buf != NULL)
+        {
+            w->buf[w->len] = '\0';
+        }
+    }
+    else if (w->err == ESP_OK && w->len > 0)
+    {
+        w->err = w->flush(w->flush_ctx, w->buf, w->len);
+        w->len = 0;
+    }
+
+    return w->err;
+}
+
+size_t json_writer_length(const json_writer_t *w)
+{
+    return w->total_len;
+}
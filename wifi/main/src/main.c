@@ -5,17 +5,26 @@
 #include "aws_iot.h"
 #include "dht11.h"
 #include "esp_err.h"
+#include "event_bus.h"
 #include "nvs.h"
+#include "ota_pull.h"
 #include "sntp_time_sync.h"
 #include "wifi_reset_button.h"
 
 static char TAG[] = "main";
 
-void wifi_connected_events(void)
+/*
+ * Starts the services depending on the network, on each EVENT_BUS_WIFI_CONNECTED,
+ * the ones already running are left alone.
+ * @param event received event
+ * @param ctx unused
+ */
+static void wifi_connected_events(const event_bus_event_t *event, void *ctx)
 {
     ESP_LOGI(TAG, "wifi application connected");
     sntp_time_sync_task_start();
     aws_iot_start();
+    ota_pull_start();
 }
 
 void app_main(void)
@@ -29,11 +38,11 @@ void app_main(void)
 
     ESP_ERROR_CHECK(ret);
 
+    ESP_ERROR_CHECK(event_bus_subscribe_callback(EVENT_BUS_BIT(EVENT_BUS_WIFI_CONNECTED), &wifi_connected_events, NULL));
+
     wifi_app_start();
 
     wifi_reset_button_config();
 
     DHT11_task_start();
-
-    wifi_set_callback(&wifi_connected_events);
 }
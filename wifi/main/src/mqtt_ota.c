@@ -0,0 +1,411 @@
+#include "mqtt_ota.h"
+
+#include <cJSON.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_iot_mqtt_client_interface.h"
+#include "esp_err.h"
+#include "esp_system.h"
+#include "json_writer.h"
+#include "ota_session.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "mqtt_ota";
+
+/*
+ * Job being received. The callbacks run inside aws_iot_mqtt_yield on the
+ * aws_iot task, as does mqtt_ota_poll, so no locking is needed.
+ */
+typedef struct mqtt_ota_job {
+    char id[MQTT_OTA_JOB_ID_MAX_LEN];
+    uint32_t token;          // ota_session id, echoed in the chunks
+    uint32_t size;
+    uint32_t chunk_base;     // offset the job started or resumed at, chunks are aligned on it
+    uint32_t write_offset;   // next byte written to the session
+    uint32_t request_offset; // next chunk to request
+    uint8_t filled;          // bit mask of the window slots holding a chunk
+    uint8_t *window;         // MQTT_OTA_WINDOW chunks received ahead of write_offset
+    int64_t start_us;
+    int64_t progress_us;     // last chunk received
+    uint32_t received;       // bytes received, duplicates included
+    esp_err_t err;
+} mqtt_ota_job_t;
+
+static mqtt_ota_job_t mqtt_ota_job;
+static bool mqtt_ota_active = false;
+
+// Job notified and not started yet, it is started by mqtt_ota_poll
+static mqtt_ota_job_t mqtt_ota_pending;
+static uint8_t mqtt_ota_pending_sha256[OTA_SESSION_SHA256_LEN];
+static bool mqtt_ota_has_pending = false;
+
+/*
+ * Publishes a JSON message.
+ */
+static void mqtt_ota_publish(AWS_IoT_Client *client, const char *topic, json_writer_t *json, QoS qos)
+{
+    IoT_Publish_Message_Params params = {0};
+
+    if (json_writer_finish(json) != ESP_OK)
+    {
+        return;
+    }
+
+    params.qos = qos;
+    params.payload = json->buf;
+    params.payloadLen = json_writer_length(json);
+
+    IoT_Error_t rc = aws_iot_mqtt_publish(client, topic, strlen(topic), &params);
+    if (rc != SUCCESS)
+    {
+        ESP_LOGW(TAG, "mqtt_ota_publish: %s error %d", topic, rc);
+    }
+}
+
+/*
+ * Reports the job result on the status topic.
+ */
+static void mqtt_ota_publish_status(AWS_IoT_Client *client, const char *job, const char *status, uint32_t offset, esp_err_t err)
+{
+    char payload[160];
+    json_writer_t json;
+
+    json_writer_init(&json, payload, sizeof(payload), NULL, NULL);
+    json_writer_begin_object(&json, NULL);
+    json_writer_string(&json, "job", job);
+    json_writer_string(&json, "status", status);
+    json_writer_int(&json, "offset", offset);
+    json_writer_string(&json, "error", esp_err_to_name(err));
+    json_writer_end_object(&json);
+
+    // QOS1 so the result is delivered before a reboot
+    mqtt_ota_publish(client, MQTT_OTA_TOPIC_STATUS, &json, QOS1);
+}
+
+/*
+ * Gets the length of the chunk at an offset, the last one is shorter.
+ */
+static uint32_t mqtt_ota_chunk_len(uint32_t offset)
+{
+    uint32_t left = mqtt_ota_job.size - offset;
+
+    return left < MQTT_OTA_CHUNK_SIZE ? left : MQTT_OTA_CHUNK_SIZE;
+}
+
+/*
+ * Gets the window slot of the chunk at an offset.
+ */
+static uint8_t mqtt_ota_slot(uint32_t offset)
+{
+    return ((offset - mqtt_ota_job.chunk_base) / MQTT_OTA_CHUNK_SIZE) % MQTT_OTA_WINDOW;
+}
+
+/*
+ * Writes a chunk to the session and moves the window.
+ */
+static void mqtt_ota_write(const uint8_t *data, uint32_t len)
+{
+    if (mqtt_ota_job.err == ESP_OK)
+    {
+        mqtt_ota_job.err = ota_session_write(data, len);
+    }
+    mqtt_ota_job.write_offset += len;
+}
+
+/*
+ * Notify callback, keeps the job for mqtt_ota_poll.
+ */
+static void mqtt_ota_notify_handler(AWS_IoT_Client *client,
+                                    char *topic,
+                                    uint16_t topic_len,
+                                    IoT_Publish_Message_Params *params,
+                                    void *data)
+{
+    cJSON *root = cJSON_ParseWithLength(params->payload, params->payloadLen);
+    cJSON *job = cJSON_GetObjectItem(root, "job");
+    cJSON *size = cJSON_GetObjectItem(root, "size");
+    cJSON *sha256 = cJSON_GetObjectItem(root, "sha256");
+
+    if (cJSON_IsString(job) && strlen(job->valuestring) < MQTT_OTA_JOB_ID_MAX_LEN && cJSON_IsNumber(size) &&
+        size->valuedouble > 0 && cJSON_IsString(sha256) &&
+        ota_session_parse_sha256(sha256->valuestring, mqtt_ota_pending_sha256))
+    {
+        // a job already being received is not started over
+        if (!mqtt_ota_active || strcmp(mqtt_ota_job.id, job->valuestring) != 0)
+        {
+            memset(&mqtt_ota_pending, 0, sizeof(mqtt_ota_pending));
+            strcpy(mqtt_ota_pending.id, job->valuestring);
+            mqtt_ota_pending.size = (uint32_t)size->valuedouble;
+            mqtt_ota_has_pending = true;
+            ESP_LOGI(TAG, "mqtt_ota_notify_handler: job %s, %lu bytes", job->valuestring, (unsigned long)mqtt_ota_pending.size);
+        }
+    }
+    else
+    {
+        ESP_LOGW(TAG, "mqtt_ota_notify_handler: invalid job %.*s", (int)params->payloadLen, (char *)params->payload);
+    }
+
+    cJSON_Delete(root);
+}
+
+/*
+ * Data callback, writes the chunk if it is the next one, otherwise keeps it
+ * in the window until the chunks before it arrive.
+ */
+static void mqtt_ota_data_handler(AWS_IoT_Client *client,
+                                  char *topic,
+                                  uint16_t topic_len,
+                                  IoT_Publish_Message_Params *params,
+                                  void *data)
+{
+    const uint8_t *payload = params->payload;
+
+    if (!mqtt_ota_active || params->payloadLen < MQTT_OTA_CHUNK_HEADER_LEN)
+    {
+        return;
+    }
+
+    uint32_t token = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    uint32_t offset = payload[4] | (payload[5] << 8) | (payload[6] << 16) | ((uint32_t)payload[7] << 24);
+    uint32_t len = params->payloadLen - MQTT_OTA_CHUNK_HEADER_LEN;
+    payload += MQTT_OTA_CHUNK_HEADER_LEN;
+
+    // stale, duplicated or unexpected chunks are dropped
+    if (token != mqtt_ota_job.token || offset < mqtt_ota_job.write_offset ||
+        offset >= mqtt_ota_job.write_offset + MQTT_OTA_WINDOW * MQTT_OTA_CHUNK_SIZE ||
+        (offset - mqtt_ota_job.chunk_base) % MQTT_OTA_CHUNK_SIZE != 0 || offset >= mqtt_ota_job.size ||
+        len != mqtt_ota_chunk_len(offset))
+    {
+        return;
+    }
+
+    mqtt_ota_job.received += len;
+    mqtt_ota_job.progress_us = esp_timer_get_time();
+
+    uint8_t slot = mqtt_ota_slot(offset);
+    if (offset != mqtt_ota_job.write_offset)
+    {
+        memcpy(mqtt_ota_job.window + slot * MQTT_OTA_CHUNK_SIZE, payload, len);
+        mqtt_ota_job.filled |= 1 << slot;
+        return;
+    }
+
+    mqtt_ota_write(payload, len);
+    mqtt_ota_job.filled &= ~(1 << slot);
+
+    // the chunks received ahead follow
+    while (mqtt_ota_job.write_offset < mqtt_ota_job.size)
+    {
+        slot = mqtt_ota_slot(mqtt_ota_job.write_offset);
+        if (!(mqtt_ota_job.filled & (1 << slot)))
+        {
+            break;
+        }
+        mqtt_ota_job.filled &= ~(1 << slot);
+        mqtt_ota_write(mqtt_ota_job.window + slot * MQTT_OTA_CHUNK_SIZE, mqtt_ota_chunk_len(mqtt_ota_job.write_offset));
+    }
+}
+
+/*
+ * Ends the job, pausing the session if the image is incomplete so a later
+ * notification resumes it.
+ */
+static void mqtt_ota_finish(AWS_IoT_Client *client)
+{
+    bool complete = false;
+
+    esp_err_t err = ota_session_write_end(&complete);
+    err = mqtt_ota_job.err != ESP_OK ? mqtt_ota_job.err : err;
+
+    free(mqtt_ota_job.window);
+    mqtt_ota_job.window = NULL;
+    mqtt_ota_active = false;
+
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - mqtt_ota_job.start_us) / 1000);
+    ESP_LOGI(TAG,
+             "mqtt_ota_finish: job %s, %lu of %lu bytes, %lu bytes received in %lu ms (%lu KB/s)",
+             mqtt_ota_job.id,
+             (unsigned long)mqtt_ota_job.write_offset,
+             (unsigned long)mqtt_ota_job.size,
+             (unsigned long)mqtt_ota_job.received,
+             (unsigned long)elapsed_ms,
+             (unsigned long)(elapsed_ms > 0 ? (uint64_t)mqtt_ota_job.received * 1000 / 1024 / elapsed_ms : 0));
+
+    if (complete)
+    {
+        mqtt_ota_publish_status(client, mqtt_ota_job.id, "SUCCEEDED", mqtt_ota_job.write_offset, ESP_OK);
+        ESP_LOGI(TAG, "mqtt_ota_finish: rebooting into the new image");
+        esp_restart();
+    }
+
+    mqtt_ota_publish_status(client,
+                            mqtt_ota_job.id,
+                            err == ESP_OK ? "PAUSED" : "FAILED",
+                            mqtt_ota_job.write_offset,
+                            err);
+}
+
+/*
+ * Starts the pending job, resuming the session if it was paused.
+ */
+static void mqtt_ota_start(AWS_IoT_Client *client)
+{
+    ota_session_info_t info;
+
+    mqtt_ota_has_pending = false;
+    if (mqtt_ota_active)
+    {
+        mqtt_ota_finish(client);
+    }
+
+    // a retained job for the image already running is done, not downloaded again
+    if (ota_session_is_running_image(mqtt_ota_pending.size, mqtt_ota_pending_sha256))
+    {
+        ESP_LOGI(TAG, "mqtt_ota_start: job %s is the running image", mqtt_ota_pending.id);
+        mqtt_ota_publish_status(client, mqtt_ota_pending.id, "SUCCEEDED", mqtt_ota_pending.size, ESP_OK);
+        return;
+    }
+
+    esp_err_t err = ota_session_open(OTA_SESSION_CHANNEL_MQTT, mqtt_ota_pending.size, mqtt_ota_pending_sha256, &info);
+    if (err == ESP_OK)
+    {
+        err = ota_session_write_begin(info.id, info.offset);
+    }
+    if (err == ESP_OK)
+    {
+        mqtt_ota_pending.window = malloc(MQTT_OTA_WINDOW * MQTT_OTA_CHUNK_SIZE);
+        if (mqtt_ota_pending.window == NULL)
+        {
+            bool complete;
+            ota_session_write_end(&complete);
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "mqtt_ota_start: job %s not started, error %s", mqtt_ota_pending.id, esp_err_to_name(err));
+        mqtt_ota_publish_status(client, mqtt_ota_pending.id, "FAILED", 0, err);
+        return;
+    }
+
+    mqtt_ota_job = mqtt_ota_pending;
+    mqtt_ota_job.token = info.id;
+    mqtt_ota_job.chunk_base = info.offset;
+    mqtt_ota_job.write_offset = info.offset;
+    mqtt_ota_job.request_offset = info.offset;
+    mqtt_ota_job.start_us = esp_timer_get_time();
+    mqtt_ota_job.progress_us = mqtt_ota_job.start_us;
+    mqtt_ota_job.err = ESP_OK;
+    mqtt_ota_active = true;
+
+    ESP_LOGI(TAG,
+             "mqtt_ota_start: job %s from %lu of %lu bytes",
+             mqtt_ota_job.id,
+             (unsigned long)info.offset,
+             (unsigned long)info.size);
+}
+
+/*
+ * Requests the chunks of the window not requested yet.
+ */
+static void mqtt_ota_request(AWS_IoT_Client *client)
+{
+    char payload[160];
+    json_writer_t json;
+    uint32_t window_end = mqtt_ota_job.write_offset + MQTT_OTA_WINDOW * MQTT_OTA_CHUNK_SIZE;
+
+    while (mqtt_ota_job.request_offset < mqtt_ota_job.size && mqtt_ota_job.request_offset < window_end)
+    {
+        uint32_t offset = mqtt_ota_job.request_offset;
+        mqtt_ota_job.request_offset += MQTT_OTA_CHUNK_SIZE;
+
+        if (offset != mqtt_ota_job.write_offset && (mqtt_ota_job.filled & (1 << mqtt_ota_slot(offset))))
+        {
+            continue;
+        }
+
+        json_writer_init(&json, payload, sizeof(payload), NULL, NULL);
+        json_writer_begin_object(&json, NULL);
+        json_writer_string(&json, "job", mqtt_ota_job.id);
+        json_writer_int(&json, "token", mqtt_ota_job.token);
+        json_writer_int(&json, "offset", offset);
+        json_writer_int(&json, "len", mqtt_ota_chunk_len(offset));
+        json_writer_end_object(&json);
+        mqtt_ota_publish(client, MQTT_OTA_TOPIC_REQUEST, &json, QOS0);
+    }
+}
+
+esp_err_t mqtt_ota_subscribe(AWS_IoT_Client *client)
+{
+    IoT_Error_t rc = aws_iot_mqtt_subscribe(client,
+                                            MQTT_OTA_TOPIC_NOTIFY,
+                                            strlen(MQTT_OTA_TOPIC_NOTIFY),
+                                            QOS1,
+                                            mqtt_ota_notify_handler,
+                                            NULL);
+    if (rc == SUCCESS)
+    {
+        rc = aws_iot_mqtt_subscribe(client,
+                                    MQTT_OTA_TOPIC_DATA,
+                                    strlen(MQTT_OTA_TOPIC_DATA),
+                                    QOS0,
+                                    mqtt_ota_data_handler,
+                                    NULL);
+    }
+    if (rc != SUCCESS)
+    {
+        ESP_LOGE(TAG, "mqtt_ota_subscribe: error %d", rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void mqtt_ota_poll(AWS_IoT_Client *client)
+{
+    if (mqtt_ota_has_pending)
+    {
+        mqtt_ota_start(client);
+    }
+
+    if (!mqtt_ota_active)
+    {
+        return;
+    }
+
+    if (mqtt_ota_job.err != ESP_OK || mqtt_ota_job.write_offset >= mqtt_ota_job.size)
+    {
+        mqtt_ota_finish(client);
+        return;
+    }
+
+    // lost requests or chunks, request the window again
+    if (esp_timer_get_time() - mqtt_ota_job.progress_us > MQTT_OTA_REQUEST_TIMEOUT_MS * 1000LL)
+    {
+        ESP_LOGW(TAG, "mqtt_ota_poll: no chunk for %d ms, requesting from %lu again",
+                 MQTT_OTA_REQUEST_TIMEOUT_MS,
+                 (unsigned long)mqtt_ota_job.write_offset);
+        mqtt_ota_reconnected();
+    }
+
+    mqtt_ota_request(client);
+}
+
+void mqtt_ota_reconnected(void)
+{
+    if (mqtt_ota_active)
+    {
+        mqtt_ota_job.request_offset = mqtt_ota_job.write_offset;
+        mqtt_ota_job.progress_us = esp_timer_get_time();
+    }
+}
+
+bool mqtt_ota_is_active(void)
+{
+    return mqtt_ota_active;
+}
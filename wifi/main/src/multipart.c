@@ -0,0 +1,291 @@
+#include "multipart.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_err.h"
+
+/*
+ * Passes bytes of the body on when they belong to a file part.
+ */
+static void multipart_parser_emit(multipart_parser_t *p, const char *data, size_t len)
+{
+    if (len == 0 || p->err != ESP_OK || p->state != MULTIPART_STATE_BODY || !p->part_has_file)
+    {
+        return;
+    }
+
+    p->err = p->on_file_data(p->ctx, data, len);
+    p->file_len += len;
+}
+
+/*
+ * Releases every byte consumed so far except the ones held back as a possible
+ * delimiter. Held bytes always equal the first match_len bytes of the
+ * delimiter, so those carried over from previous chunks are released from the
+ * delimiter string and never need a copy.
+ * @param data current chunk
+ * @param consumed bytes of the chunk consumed so far
+ * @param run_start first byte of the chunk not released yet, updated
+ */
+static void multipart_parser_release(multipart_parser_t *p, const char *data, size_t consumed, size_t *run_start)
+{
+    size_t pending = consumed - *run_start;
+
+    if (p->match_len <= pending)
+    {
+        multipart_parser_emit(p, p->delimiter, p->carry_len);
+        multipart_parser_emit(p, data + *run_start, pending - p->match_len);
+        *run_start = consumed - p->match_len;
+        p->carry_len = 0;
+    }
+    else
+    {
+        // every byte of the chunk is held, and the last of the carried ones
+        uint8_t still_carried = p->match_len - pending;
+        multipart_parser_emit(p, p->delimiter, p->carry_len - still_carried);
+        p->carry_len = still_carried;
+    }
+}
+
+/*
+ * Scans for the next delimiter, memchr skips to the candidates.
+ * @param i first byte of the chunk to scan
+ * @param run_start first byte of the chunk not released yet, updated
+ * @return index of the byte after the delimiter, or len
+ */
+static size_t multipart_parser_search(multipart_parser_t *p, const char *data, size_t len, size_t i, size_t *run_start)
+{
+    while (i < len)
+    {
+        if (p->match_len == 0)
+        {
+            const char *candidate = memchr(data + i, p->delimiter[0], len - i);
+            if (candidate == NULL)
+            {
+                return len;
+            }
+            i = candidate - data;
+        }
+
+        char c = data[i++];
+        while (p->match_len > 0 && c != p->delimiter[p->match_len])
+        {
+            p->match_len = p->failure[p->match_len];
+        }
+        if (c == p->delimiter[p->match_len])
+        {
+            p->match_len++;
+        }
+
+        if (p->match_len == p->delimiter_len)
+        {
+            // everything before the delimiter is released, the delimiter is dropped
+            multipart_parser_release(p, data, i, run_start);
+            p->match_len = 0;
+            p->carry_len = 0;
+            *run_start = i;
+            p->state = MULTIPART_STATE_DELIMITER_END;
+            p->delimiter_end = '\0';
+            return i;
+        }
+    }
+
+    return len;
+}
+
+/*
+ * Parses the character following a delimiter.
+ */
+static void multipart_parser_delimiter_end(multipart_parser_t *p, char c)
+{
+    if (p->delimiter_end == '\0')
+    {
+        if (c == '-' || c == '\r')
+        {
+            p->delimiter_end = c;
+        }
+        else if (c != ' ' && c != '\t') // transport padding
+        {
+            p->state = MULTIPART_STATE_ERROR;
+        }
+    }
+    else if (p->delimiter_end == '-' && c == '-')
+    {
+        p->state = MULTIPART_STATE_DONE;
+    }
+    else if (p->delimiter_end == '\r' && c == '\n')
+    {
+        p->state = MULTIPART_STATE_HEADERS;
+        p->header_len = 0;
+        p->part_has_file = false;
+    }
+    else
+    {
+        p->state = MULTIPART_STATE_ERROR;
+    }
+}
+
+/*
+ * Parses a character of the part headers.
+ * @return true when the blank line ending the headers is reached
+ */
+static bool multipart_parser_header(multipart_parser_t *p, char c)
+{
+    if (c == '\r')
+    {
+        return false;
+    }
+
+    if (c != '\n')
+    {
+        if (p->header_len < MULTIPART_HEADER_LINE_MAX_LEN - 1)
+        {
+            p->header_line[p->header_len++] = c;
+        }
+        return false;
+    }
+
+    if (p->header_len == 0)
+    {
+        return true;
+    }
+
+    p->header_line[p->header_len] = '\0';
+    p->header_len = 0;
+    if (strncasecmp(p->header_line, "Content-Disposition:", 20) == 0 && strstr(p->header_line, "filename=") != NULL)
+    {
+        p->part_has_file = true;
+    }
+    return false;
+}
+
+esp_err_t multipart_parser_init(multipart_parser_t *p,
+                                const char *content_type,
+                                multipart_data_cb_t on_file_data,
+                                void *ctx)
+{
+    memset(p, 0, sizeof(*p));
+    p->on_file_data = on_file_data;
+    p->ctx = ctx;
+    p->err = ESP_OK;
+
+    // parameter names are case insensitive
+    const char *boundary = content_type;
+    while (boundary != NULL && *boundary != '\0' && strncasecmp(boundary, "boundary=", 9) != 0)
+    {
+        boundary++;
+    }
+    if (boundary == NULL || *boundary == '\0')
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    boundary += 9;
+    size_t boundary_len;
+    if (*boundary == '"')
+    {
+        boundary++;
+        boundary_len = strcspn(boundary, "\"");
+    }
+    else
+    {
+        boundary_len = strcspn(boundary, "; \t");
+    }
+
+    if (boundary_len == 0 || boundary_len > MULTIPART_BOUNDARY_MAX_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(p->delimiter, "\r\n--", 4);
+    memcpy(p->delimiter + 4, boundary, boundary_len);
+    p->delimiter_len = boundary_len + 4;
+
+    // failure[k] is the longest proper prefix of the delimiter which is also a
+    // suffix of its first k bytes
+    uint8_t k = 0;
+    for (uint8_t q = 1; q < p->delimiter_len; q++)
+    {
+        while (k > 0 && p->delimiter[q] != p->delimiter[k])
+        {
+            k = p->failure[k];
+        }
+        if (p->delimiter[q] == p->delimiter[k])
+        {
+            k++;
+        }
+        p->failure[q + 1] = k;
+    }
+
+    // the body starts with the first delimiter without its leading CRLF
+    p->state = MULTIPART_STATE_PREAMBLE;
+    p->match_len = 2;
+    p->carry_len = 2;
+
+    return ESP_OK;
+}
+
+esp_err_t multipart_parser_feed(multipart_parser_t *p, const char *data, size_t len)
+{
+    size_t i = 0;
+    size_t run_start = 0;
+
+    while (i < len && p->err == ESP_OK)
+    {
+        switch (p->state)
+        {
+        case MULTIPART_STATE_PREAMBLE:
+        case MULTIPART_STATE_BODY:
+            i = multipart_parser_search(p, data, len, i, &run_start);
+            break;
+
+        case MULTIPART_STATE_DELIMITER_END:
+            multipart_parser_delimiter_end(p, data[i++]);
+            break;
+
+        case MULTIPART_STATE_HEADERS:
+            if (multipart_parser_header(p, data[i++]))
+            {
+                p->state = MULTIPART_STATE_BODY;
+                p->file_seen |= p->part_has_file;
+                run_start = i;
+            }
+            break;
+
+        case MULTIPART_STATE_DONE:
+            i = len;
+            break;
+
+        case MULTIPART_STATE_ERROR:
+            p->err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+    }
+
+    // release what cannot be part of a delimiter split over the next chunk
+    if (p->state == MULTIPART_STATE_PREAMBLE || p->state == MULTIPART_STATE_BODY)
+    {
+        multipart_parser_release(p, data, len, &run_start);
+        p->carry_len = p->match_len;
+    }
+
+    if (p->state == MULTIPART_STATE_ERROR && p->err == ESP_OK)
+    {
+        p->err = ESP_ERR_INVALID_RESPONSE;
+    }
+    return p->err;
+}
+
+esp_err_t multipart_parser_finish(const multipart_parser_t *p)
+{
+    if (p->err != ESP_OK)
+    {
+        return p->err;
+    }
+
+    return (p->state == MULTIPART_STATE_DONE && p->file_seen) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
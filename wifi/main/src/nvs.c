@@ -18,146 +18,202 @@ static const char TAG[] = "NVS";
 // NVS name space for station mode credentials
 const char app_nvs_sta_creds_namespace[] = "stacreds";
 
-esp_err_t app_nvs_save_sta_creds(void)
+// NVS name space for the last successful station connection
+const char app_nvs_sta_cache_namespace[] = "stacache";
+
+// NVS name space for the resumable OTA session
+const char app_nvs_ota_session_namespace[] = "otasession";
+
+esp_err_t app_nvs_save_sta_networks(const app_nvs_sta_network_t *networks, size_t count)
 {
     nvs_handle handle;
     esp_err_t esp_err;
 
-    ESP_LOGI(TAG, "app_nvs_save_sta_creds: saving station mode credentials to flash");
-
-    wifi_config_t *wifi_sta_config = wifi_get_config();
-    if (wifi_sta_config)
-    {
-        esp_err = nvs_open(app_nvs_sta_creds_namespace, NVS_READWRITE, &handle);
-        if (esp_err != ESP_OK)
-        {
-            ESP_LOGE(TAG, "app_nvs_save_sta_creds: error (%s) opening NVS handle", esp_err_to_name(esp_err));
-            return esp_err;
-        }
-
-        // set SSID
-        esp_err = nvs_set_blob(handle, "ssid", wifi_sta_config->sta.ssid, MAX_SSID_LENGTH);
-        if (esp_err != ESP_OK)
-        {
-            ESP_LOGE(TAG, "app_nvs_save_sta_creds: error (%s) setting SSID to NVS", esp_err_to_name(esp_err));
-            return esp_err;
-        }
-
-        // set password
-        esp_err = nvs_set_blob(handle, "password", wifi_sta_config->sta.password, MAX_PASSWORD_LENGTH);
-        if (esp_err != ESP_OK)
-        {
-            ESP_LOGE(TAG, "app_nvs_save_sta_creds: error (%s) setting password to NVS", esp_err_to_name(esp_err));
-            return esp_err;
-        }
-
-        // commit credentials to nvs
+    ESP_LOGI(TAG, "app_nvs_save_sta_networks: saving %u station networks to flash", (unsigned)count);
+
+    esp_err = nvs_open(app_nvs_sta_creds_namespace, NVS_READWRITE, &handle);
+    if (esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_networks: error (%s) opening NVS handle", esp_err_to_name(esp_err));
+        return esp_err;
+    }
+
+    // the single pair of earlier firmware is now part of the list
+    nvs_erase_key(handle, "ssid");
+    nvs_erase_key(handle, "password");
+
+    esp_err = nvs_set_blob(handle, "networks", networks, count * sizeof(*networks));
+    if (esp_err == ESP_OK)
+    {
         esp_err = nvs_commit(handle);
-        if (esp_err != ESP_OK)
-        {
-            ESP_LOGE(TAG, "app_nvs_save_sta_creds: error (%s) commiting credentials to NVS", esp_err_to_name(esp_err));
-            return esp_err;
-        }
+    }
+    nvs_close(handle);
+
+    if (esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_networks: error (%s) saving the station networks", esp_err_to_name(esp_err));
+    }
+    return esp_err;
+}
+
+size_t app_nvs_load_sta_networks(app_nvs_sta_network_t *networks, size_t max)
+{
+    nvs_handle handle;
+    size_t size = max * sizeof(*networks);
+
+    ESP_LOGI(TAG, "app_nvs_load_sta_networks: loading station networks from flash");
+    if (nvs_open(app_nvs_sta_creds_namespace, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return 0;
+    }
 
+    memset(networks, 0, max * sizeof(*networks));
+    if (nvs_get_blob(handle, "networks", networks, &size) == ESP_OK)
+    {
+        nvs_close(handle);
+        return size / sizeof(*networks);
+    }
+
+    // credentials of earlier firmware
+    size_t ssid_size = sizeof(networks->ssid);
+    size_t password_size = sizeof(networks->password);
+    if (max == 0 || nvs_get_blob(handle, "ssid", networks->ssid, &ssid_size) != ESP_OK ||
+        nvs_get_blob(handle, "password", networks->password, &password_size) != ESP_OK || networks->ssid[0] == '\0')
+    {
         nvs_close(handle);
-        ESP_LOGI(TAG,
-                 "app_nvs_save_sta_creds: wrote wifi_sta_config: ssid: %s password: %s",
-                 wifi_sta_config->sta.ssid,
-                 wifi_sta_config->sta.password);
+        memset(networks, 0, max * sizeof(*networks));
+        return 0;
     }
 
-    ESP_LOGI(TAG, "app_nvs_save_sta_creds: return ESP_OK");
-    return ESP_OK;
+    nvs_close(handle);
+    ESP_LOGI(TAG, "app_nvs_load_sta_networks: found saved ssid: %.32s", networks->ssid);
+    return 1;
 }
 
-bool app_nvs_load_sta_creds(void)
+esp_err_t app_nvs_save_sta_cache(const app_nvs_sta_cache_t *cache)
 {
     nvs_handle handle;
     esp_err_t esp_err;
 
-    ESP_LOGI(TAG, "app_nvs_load_sta_creds: loading wifi credentials from flash");
-    if (nvs_open(app_nvs_sta_creds_namespace, NVS_READONLY, &handle) == ESP_OK)
-    {
-        wifi_config_t *wifi_sta_config = wifi_get_config();
-        if (wifi_sta_config == NULL)
-        {
-            wifi_sta_config = (wifi_config_t *)malloc(sizeof(wifi_config_t));
-        }
-        memset(wifi_sta_config, 0x00, sizeof(wifi_config_t));
-
-        // Allocate buffer
-        size_t wifi_config_size = sizeof(wifi_config_t);
-        uint8_t *wifi_config_buff = (uint8_t *)malloc(sizeof(uint8_t) * wifi_config_size);
-        memset(wifi_config_buff, 0x00, sizeof(wifi_config_size));
-
-        // Load ssid
-        wifi_config_size = sizeof(wifi_sta_config->sta.ssid);
-        esp_err = nvs_get_blob(handle, "ssid", wifi_config_buff, &wifi_config_size);
-        if (esp_err != ESP_OK)
-        {
-            free(wifi_config_buff);
-            ESP_LOGI(TAG, "app_nvs_load_sta_creds: (%s) no station ssid found in nvs\n", esp_err_to_name(esp_err));
-            return false;
-        }
-        memcpy(wifi_sta_config->sta.ssid, wifi_config_buff, wifi_config_size);
-
-        // Load password
-        wifi_config_size = sizeof(wifi_sta_config->sta.password);
-        esp_err = nvs_get_blob(handle, "password", wifi_config_buff, &wifi_config_size);
-        if (esp_err != ESP_OK)
-        {
-            free(wifi_config_buff);
-            ESP_LOGI(TAG, "app_nvs_load_sta_creds: (%s) no station password found in nvs\n", esp_err_to_name(esp_err));
-            return false;
-        }
-        memcpy(wifi_sta_config->sta.password, wifi_config_buff, wifi_config_size);
-
-        free(wifi_config_buff);
-        nvs_close(handle);
-        ESP_LOGI(TAG,
-                 "app_nvs_load_sta_creds: found ssid: %s password: %s",
-                 wifi_sta_config->sta.ssid,
-                 wifi_sta_config->sta.password);
-        return wifi_sta_config->sta.ssid[0] != '\0';
+    esp_err = nvs_open(app_nvs_sta_cache_namespace, NVS_READWRITE, &handle);
+    if (esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_cache: error (%s) opening NVS handle", esp_err_to_name(esp_err));
+        return esp_err;
     }
-    else
+
+    esp_err = nvs_set_blob(handle, "cache", cache, sizeof(*cache));
+    if (esp_err == ESP_OK)
+    {
+        esp_err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_cache: error (%s) saving the station cache", esp_err_to_name(esp_err));
+    }
+    return esp_err;
+}
+
+bool app_nvs_load_sta_cache(app_nvs_sta_cache_t *cache)
+{
+    nvs_handle handle;
+    size_t cache_size = sizeof(*cache);
+
+    if (nvs_open(app_nvs_sta_cache_namespace, NVS_READONLY, &handle) != ESP_OK)
     {
         return false;
     }
+
+    esp_err_t esp_err = nvs_get_blob(handle, "cache", cache, &cache_size);
+    nvs_close(handle);
+
+    return esp_err == ESP_OK && cache_size == sizeof(*cache);
 }
 
-esp_err_t app_nvs_clear_sta_creds(void)
+esp_err_t app_nvs_clear_sta_cache(void)
 {
     nvs_handle handle;
     esp_err_t esp_err;
-    ESP_LOGI(TAG,
-             "app_nvs_clear_sta_creds: clearing wifi station mode credentials "
-             "from flash");
 
-    esp_err = nvs_open(app_nvs_sta_creds_namespace, NVS_READWRITE, &handle);
+    esp_err = nvs_open(app_nvs_sta_cache_namespace, NVS_READWRITE, &handle);
     if (esp_err != ESP_OK)
     {
-        ESP_LOGE(TAG, "app_nvs_clear_sta_creds: error %s opening nvs handle\n", esp_err_to_name(esp_err));
+        ESP_LOGE(TAG, "app_nvs_clear_sta_cache: error %s opening nvs handle", esp_err_to_name(esp_err));
         return esp_err;
     }
 
-    // erase credentials
     esp_err = nvs_erase_all(handle);
+    if (esp_err == ESP_OK)
+    {
+        esp_err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    return esp_err;
+}
+
+esp_err_t app_nvs_save_ota_session(const app_nvs_ota_session_t *session)
+{
+    nvs_handle handle;
+    esp_err_t esp_err;
+
+    esp_err = nvs_open(app_nvs_ota_session_namespace, NVS_READWRITE, &handle);
     if (esp_err != ESP_OK)
     {
-        ESP_LOGE(TAG, "app_nvs_clear_sta_creds: error %s erasing station mode credentials\n", esp_err_to_name(esp_err));
+        ESP_LOGE(TAG, "app_nvs_save_ota_session: error (%s) opening NVS handle", esp_err_to_name(esp_err));
         return esp_err;
     }
 
-    // commit clearing credentials from nvs
-    esp_err = nvs_commit(handle);
+    esp_err = nvs_set_blob(handle, "session", session, sizeof(*session));
+    if (esp_err == ESP_OK)
+    {
+        esp_err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_ota_session: error (%s) saving the OTA session", esp_err_to_name(esp_err));
+    }
+    return esp_err;
+}
+
+bool app_nvs_load_ota_session(app_nvs_ota_session_t *session)
+{
+    nvs_handle handle;
+    size_t session_size = sizeof(*session);
+
+    if (nvs_open(app_nvs_ota_session_namespace, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    esp_err_t esp_err = nvs_get_blob(handle, "session", session, &session_size);
+    nvs_close(handle);
+
+    return esp_err == ESP_OK && session_size == sizeof(*session);
+}
+
+esp_err_t app_nvs_clear_ota_session(void)
+{
+    nvs_handle handle;
+    esp_err_t esp_err;
+
+    esp_err = nvs_open(app_nvs_ota_session_namespace, NVS_READWRITE, &handle);
     if (esp_err != ESP_OK)
     {
-        ESP_LOGE(TAG, "app_nvs_clear_sta_creds: error %s NVS commit\n", esp_err_to_name(esp_err));
+        ESP_LOGE(TAG, "app_nvs_clear_ota_session: error %s opening nvs handle", esp_err_to_name(esp_err));
         return esp_err;
     }
 
+    esp_err = nvs_erase_all(handle);
+    if (esp_err == ESP_OK)
+    {
+        esp_err = nvs_commit(handle);
+    }
     nvs_close(handle);
-    ESP_LOGI(TAG, "app_nvs_clear_sta_creds: returned ESP_OK");
-    return ESP_OK;
+
+    return esp_err;
 }
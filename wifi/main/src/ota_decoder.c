@@ -0,0 +1,432 @@
+#include "ota_decoder.h"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_app_format.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"
+#include "ota_writer.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "ota_decoder";
+
+// Buffer the running partition is read through for the delta copies
+#define OTA_DECODER_COPY_BUFFER_SIZE 4096
+
+/*
+ * Delta parser states
+ */
+typedef enum ota_delta_state {
+    OTA_DELTA_STATE_HEADER = 0,
+    OTA_DELTA_STATE_OP,
+    OTA_DELTA_STATE_INSERT,
+} ota_delta_state_e;
+
+// Set between ota_decoder_begin and ota_decoder_end or ota_decoder_abort
+static bool ota_decoder_active = false;
+
+// Format of the upload, and of the inflated bytes when it is a zlib stream
+static ota_decoder_format_e ota_format;
+static ota_decoder_format_e ota_inner_format;
+
+// Uploaded and decoded byte counts, logged at the end
+static uint32_t ota_bytes_in;
+static uint32_t ota_bytes_out;
+
+// Inflate state, tinfl from the ROM writes into a circular dictionary of
+// TINFL_LZ_DICT_SIZE bytes, so no more RAM is needed whatever the image size
+static tinfl_decompressor *ota_inflator = NULL;
+static uint8_t *ota_dict = NULL;
+static size_t ota_dict_ofs;
+static bool ota_inflate_done;
+
+// Delta state, the header and operation headers are collected in ota_delta_buf
+// as they may be split over several chunks
+static ota_delta_state_e ota_delta_state;
+static uint8_t ota_delta_buf[sizeof(ota_delta_header_t)];
+static size_t ota_delta_buf_len;
+static uint32_t ota_delta_source_size;
+static uint32_t ota_delta_target_size;
+static uint32_t ota_delta_insert_left;
+static const esp_partition_t *ota_source_partition = NULL;
+static uint8_t *ota_copy_buf = NULL;
+
+/*
+ * Reads a little endian integer.
+ */
+static uint32_t ota_decoder_get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Tells the format from the first byte, the delta magic is checked once its
+ * header is complete.
+ */
+static ota_decoder_format_e ota_decoder_detect(uint8_t first, bool inflated)
+{
+    if (first == ESP_IMAGE_HEADER_MAGIC)
+    {
+        return OTA_DECODER_FORMAT_IMAGE;
+    }
+    if (first == OTA_DELTA_MAGIC[0])
+    {
+        return OTA_DECODER_FORMAT_DELTA;
+    }
+    // zlib header with the deflate method, only the outer stream may be compressed
+    if (!inflated && (first & 0x0f) == 8)
+    {
+        return OTA_DECODER_FORMAT_ZLIB;
+    }
+    return OTA_DECODER_FORMAT_UNKNOWN;
+}
+
+/*
+ * Hashes the bytes of the running partition the delta was made against.
+ * @return ESP_OK if they match the digest of the delta header
+ */
+static esp_err_t ota_decoder_check_source(const ota_delta_header_t *header)
+{
+    mbedtls_sha256_context sha256;
+    uint8_t digest[32];
+    esp_err_t err = ESP_OK;
+
+    ota_source_partition = esp_ota_get_running_partition();
+    if (ota_source_partition == NULL || header->source_size > ota_source_partition->size)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    for (uint32_t pos = 0; pos < header->source_size && err == ESP_OK; pos += OTA_DECODER_COPY_BUFFER_SIZE)
+    {
+        size_t len = MIN(OTA_DECODER_COPY_BUFFER_SIZE, header->source_size - pos);
+        err = esp_partition_read(ota_source_partition, pos, ota_copy_buf, len);
+        if (err == ESP_OK)
+        {
+            mbedtls_sha256_update(&sha256, ota_copy_buf, len);
+        }
+    }
+    mbedtls_sha256_finish(&sha256, digest);
+    mbedtls_sha256_free(&sha256);
+
+    if (err == ESP_OK && memcmp(digest, header->source_sha256, sizeof(digest)) != 0)
+    {
+        ESP_LOGE(TAG, "ota_decoder_check_source: the delta was made against another image");
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    return err;
+}
+
+/*
+ * Copies a range of the running partition to the update.
+ */
+static esp_err_t ota_decoder_copy(uint32_t offset, uint32_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    if (offset > ota_delta_source_size || len > ota_delta_source_size - offset)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    while (len > 0 && err == ESP_OK)
+    {
+        size_t n = MIN(len, OTA_DECODER_COPY_BUFFER_SIZE);
+        err = esp_partition_read(ota_source_partition, offset, ota_copy_buf, n);
+        if (err == ESP_OK)
+        {
+            err = ota_writer_write(ota_copy_buf, n);
+        }
+        offset += n;
+        len -= n;
+    }
+
+    return err;
+}
+
+/*
+ * Collects a header of the delta split over several chunks.
+ * @param need header length
+ * @return true once the need bytes are in ota_delta_buf
+ */
+static bool ota_decoder_collect(const uint8_t **data, size_t *len, size_t need)
+{
+    size_t n = MIN(*len, need - ota_delta_buf_len);
+
+    memcpy(ota_delta_buf + ota_delta_buf_len, *data, n);
+    ota_delta_buf_len += n;
+    *data += n;
+    *len -= n;
+
+    if (ota_delta_buf_len < need)
+    {
+        return false;
+    }
+    ota_delta_buf_len = 0;
+    return true;
+}
+
+/*
+ * Applies the next bytes of a delta.
+ */
+static esp_err_t ota_decoder_delta(const uint8_t *data, size_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    while (len > 0 && err == ESP_OK)
+    {
+        switch (ota_delta_state)
+        {
+        case OTA_DELTA_STATE_HEADER:
+            if (ota_decoder_collect(&data, &len, sizeof(ota_delta_header_t)))
+            {
+                ota_delta_header_t header;
+                memcpy(&header, ota_delta_buf, sizeof(header));
+                if (memcmp(header.magic, OTA_DELTA_MAGIC, OTA_DELTA_MAGIC_LEN) != 0)
+                {
+                    return ESP_ERR_NOT_SUPPORTED;
+                }
+                ota_delta_source_size = header.source_size;
+                ota_delta_target_size = header.target_size;
+                err = ota_decoder_check_source(&header);
+                ota_delta_state = OTA_DELTA_STATE_OP;
+            }
+            break;
+
+        case OTA_DELTA_STATE_OP:
+            if (ota_decoder_collect(&data, &len, OTA_DELTA_OP_HEADER_LEN))
+            {
+                uint32_t offset = ota_decoder_get_u32(ota_delta_buf + 1);
+                uint32_t op_len = ota_decoder_get_u32(ota_delta_buf + 5);
+
+                if (op_len > ota_delta_target_size - ota_bytes_out)
+                {
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+
+                if (ota_delta_buf[0] == OTA_DELTA_OP_COPY)
+                {
+                    err = ota_decoder_copy(offset, op_len);
+                    ota_bytes_out += op_len;
+                }
+                else if (ota_delta_buf[0] == OTA_DELTA_OP_INSERT && offset == 0)
+                {
+                    ota_delta_insert_left = op_len;
+                    ota_delta_state = op_len > 0 ? OTA_DELTA_STATE_INSERT : OTA_DELTA_STATE_OP;
+                }
+                else
+                {
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+            }
+            break;
+
+        case OTA_DELTA_STATE_INSERT:
+        {
+            size_t n = MIN(len, ota_delta_insert_left);
+            err = ota_writer_write(data, n);
+            ota_bytes_out += n;
+            ota_delta_insert_left -= n;
+            data += n;
+            len -= n;
+            if (ota_delta_insert_left == 0)
+            {
+                ota_delta_state = OTA_DELTA_STATE_OP;
+            }
+            break;
+        }
+        }
+    }
+
+    return err;
+}
+
+/*
+ * Passes decoded bytes to the image writer or the delta parser.
+ * @param inflated whether the bytes come out of the zlib stream
+ */
+static esp_err_t ota_decoder_output(const uint8_t *data, size_t len, bool inflated)
+{
+    ota_decoder_format_e *format = inflated ? &ota_inner_format : &ota_format;
+
+    if (len == 0)
+    {
+        return ESP_OK;
+    }
+
+    if (*format == OTA_DECODER_FORMAT_UNKNOWN)
+    {
+        *format = ota_decoder_detect(data[0], inflated);
+        ESP_LOGI(TAG, "ota_decoder_output: %s format %d", inflated ? "inflated" : "upload", *format);
+
+        if (*format == OTA_DECODER_FORMAT_ZLIB)
+        {
+            ota_inflator = malloc(sizeof(tinfl_decompressor));
+            ota_dict = malloc(TINFL_LZ_DICT_SIZE);
+            if (ota_inflator == NULL || ota_dict == NULL)
+            {
+                return ESP_ERR_NO_MEM;
+            }
+            tinfl_init(ota_inflator);
+            ota_dict_ofs = 0;
+            ota_inflate_done = false;
+        }
+        else if (*format == OTA_DECODER_FORMAT_DELTA)
+        {
+            ota_copy_buf = malloc(OTA_DECODER_COPY_BUFFER_SIZE);
+            if (ota_copy_buf == NULL)
+            {
+                return ESP_ERR_NO_MEM;
+            }
+            ota_delta_state = OTA_DELTA_STATE_HEADER;
+            ota_delta_buf_len = 0;
+        }
+    }
+
+    switch (*format)
+    {
+    case OTA_DECODER_FORMAT_IMAGE:
+        ota_bytes_out += len;
+        return ota_writer_write(data, len);
+
+    case OTA_DECODER_FORMAT_DELTA:
+        return ota_decoder_delta(data, len);
+
+    case OTA_DECODER_FORMAT_ZLIB:
+        break;
+
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // inflate into the circular dictionary and pass each run of output on
+    tinfl_status status = TINFL_STATUS_HAS_MORE_OUTPUT;
+    while (!ota_inflate_done && (len > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT))
+    {
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - ota_dict_ofs;
+
+        status = tinfl_decompress(ota_inflator,
+                                               data,
+                                               &in_bytes,
+                                               ota_dict,
+                                               ota_dict + ota_dict_ofs,
+                                               &out_bytes,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+
+        esp_err_t err = ota_decoder_output(ota_dict + ota_dict_ofs, out_bytes, true);
+        ota_dict_ofs = (ota_dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            ESP_LOGE(TAG, "ota_decoder_output: inflate error %d", status);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        ota_inflate_done = status == TINFL_STATUS_DONE;
+    }
+
+    // bytes after the end of the zlib stream are not part of the image
+    return len > 0 ? ESP_ERR_INVALID_RESPONSE : ESP_OK;
+}
+
+/*
+ * Frees the decoder buffers.
+ */
+static void ota_decoder_release(void)
+{
+    free(ota_inflator);
+    free(ota_dict);
+    free(ota_copy_buf);
+    ota_inflator = NULL;
+    ota_dict = NULL;
+    ota_copy_buf = NULL;
+    ota_decoder_active = false;
+}
+
+esp_err_t ota_decoder_begin(const esp_partition_t *partition)
+{
+    esp_err_t err = ota_writer_begin(partition, 0);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    ota_format = OTA_DECODER_FORMAT_UNKNOWN;
+    ota_inner_format = OTA_DECODER_FORMAT_UNKNOWN;
+    ota_bytes_in = 0;
+    ota_bytes_out = 0;
+    ota_decoder_active = true;
+    return ESP_OK;
+}
+
+esp_err_t ota_decoder_write(const void *data, size_t len)
+{
+    if (!ota_decoder_active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_bytes_in += len;
+    return ota_decoder_output(data, len, false);
+}
+
+esp_err_t ota_decoder_end(void)
+{
+    if (!ota_decoder_active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_decoder_format_e format = ota_format == OTA_DECODER_FORMAT_ZLIB ? ota_inner_format : ota_format;
+    bool complete = ota_format != OTA_DECODER_FORMAT_ZLIB || ota_inflate_done;
+    if (format == OTA_DECODER_FORMAT_DELTA)
+    {
+        complete = complete && ota_delta_state == OTA_DELTA_STATE_OP && ota_delta_buf_len == 0 &&
+                   ota_bytes_out == ota_delta_target_size;
+    }
+
+    ESP_LOGI(TAG,
+             "ota_decoder_end: %lu bytes uploaded, %lu bytes image",
+             (unsigned long)ota_bytes_in,
+             (unsigned long)ota_bytes_out);
+    ota_decoder_release();
+
+    if (!complete)
+    {
+        ESP_LOGE(TAG, "ota_decoder_end: the upload is truncated");
+        ota_writer_abort();
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ota_writer_end();
+}
+
+void ota_decoder_abort(void)
+{
+    if (ota_decoder_active)
+    {
+        ota_decoder_release();
+        ota_writer_abort();
+    }
+}
+
+bool ota_decoder_is_active(void)
+{
+    return ota_decoder_active;
+}
@@ -0,0 +1,336 @@
+#include "ota_pull.h"
+
+#include <cJSON.h>
+#include <ctype.h>
+#include <esp_crt_bundle.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ota_session.h"
+#include "tasks_common.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "ota_pull";
+
+// Manifest polling task handle
+static TaskHandle_t task_ota_pull = NULL;
+
+/*
+ * Opens a GET request.
+ * @param url resource
+ * @param range Range header value, NULL for the whole resource
+ * @param content_length set to the response Content-Length
+ * @return client to read the body from and clean up, NULL on error
+ */
+static esp_http_client_handle_t ota_pull_open(const char *url, const char *range, int64_t *content_length)
+{
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = OTA_PULL_TIMEOUT_MS,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .keep_alive_enable = true,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL)
+    {
+        return NULL;
+    }
+
+    if (range != NULL)
+    {
+        esp_http_client_set_header(client, "Range", range);
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK)
+    {
+        *content_length = esp_http_client_fetch_headers(client);
+        if (*content_length < 0)
+        {
+            err = ESP_FAIL;
+        }
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ota_pull_open: GET %s failed, error %s", url, esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+
+    return client;
+}
+
+/*
+ * Fetches and parses the manifest.
+ * @param manifest filled with the manifest
+ * @return ESP_OK, ESP_FAIL if it cannot be fetched, ESP_ERR_INVALID_RESPONSE
+ * if it is not a valid manifest
+ */
+static esp_err_t ota_pull_fetch_manifest(ota_pull_manifest_t *manifest)
+{
+    char body[OTA_PULL_MANIFEST_MAX_LEN];
+    int64_t content_length;
+    int len = 0;
+    int n;
+
+    esp_http_client_handle_t client = ota_pull_open(OTA_PULL_MANIFEST_URL, NULL, &content_length);
+    if (client == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    int status = esp_http_client_get_status_code(client);
+    while (len < (int)sizeof(body) - 1 && (n = esp_http_client_read(client, body + len, sizeof(body) - 1 - len)) > 0)
+    {
+        len += n;
+    }
+    body[len] = '\0';
+    esp_http_client_cleanup(client);
+
+    if (status != 200)
+    {
+        ESP_LOGE(TAG, "ota_pull_fetch_manifest: HTTP status %d", status);
+        return ESP_FAIL;
+    }
+
+    cJSON *root = cJSON_Parse(body);
+    cJSON *version = cJSON_GetObjectItem(root, "version");
+    cJSON *size = cJSON_GetObjectItem(root, "size");
+    cJSON *sha256 = cJSON_GetObjectItem(root, "sha256");
+    cJSON *url = cJSON_GetObjectItem(root, "url");
+
+    esp_err_t err = ESP_ERR_INVALID_RESPONSE;
+    if (cJSON_IsString(version) && cJSON_IsNumber(size) && size->valuedouble > 0 && cJSON_IsString(sha256) &&
+        cJSON_IsString(url) && ota_session_parse_sha256(sha256->valuestring, manifest->sha256) &&
+        strlen(version->valuestring) < sizeof(manifest->version) && strlen(url->valuestring) < sizeof(manifest->url))
+    {
+        strcpy(manifest->version, version->valuestring);
+        strcpy(manifest->url, url->valuestring);
+        manifest->size = (uint32_t)size->valuedouble;
+        err = ESP_OK;
+    }
+    cJSON_Delete(root);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ota_pull_fetch_manifest: invalid manifest");
+    }
+    return err;
+}
+
+/*
+ * Downloads the image from the session offset to the end with a ranged GET.
+ * A server ignoring the Range header answers 200 with the whole image, the
+ * bytes already received are then skipped.
+ * @param url image url
+ * @param info session, the offset is where the download starts
+ * @param buf download buffer of OTA_PULL_BUFFER_SIZE bytes
+ * @param received incremented with the bytes received
+ * @return ESP_OK, ESP_FAIL on a network error worth another attempt, or the
+ * ota_session error
+ */
+static esp_err_t ota_pull_download(const char *url, const ota_session_info_t *info, char *buf, uint32_t *received)
+{
+    char range[32];
+    int64_t content_length;
+    esp_err_t err = ESP_OK;
+    int n;
+
+    snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)info->offset);
+    esp_http_client_handle_t client = ota_pull_open(url, range, &content_length);
+    if (client == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    int status = esp_http_client_get_status_code(client);
+    uint32_t skip = status == 200 ? info->offset : 0;
+    if (status != 200 && status != 206)
+    {
+        ESP_LOGE(TAG, "ota_pull_download: HTTP status %d", status);
+        esp_http_client_cleanup(client);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    ESP_LOGI(TAG,
+             "ota_pull_download: %s from %lu, status %d",
+             url,
+             (unsigned long)info->offset,
+             status);
+
+    while (err == ESP_OK && (n = esp_http_client_read(client, buf, OTA_PULL_BUFFER_SIZE)) > 0)
+    {
+        uint32_t discard = skip < (uint32_t)n ? skip : (uint32_t)n;
+        skip -= discard;
+        *received += n;
+        err = ota_session_write(buf + discard, n - discard);
+    }
+
+    if (err == ESP_OK && (n < 0 || !esp_http_client_is_complete_data_received(client)))
+    {
+        ESP_LOGI(TAG, "ota_pull_download: connection lost");
+        err = ESP_FAIL;
+    }
+
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+/*
+ * Checks the manifest and updates the firmware when it lists a newer version.
+ */
+static void ota_pull_check(void)
+{
+    const esp_app_desc_t *app = esp_app_get_description();
+    ota_pull_manifest_t manifest;
+    ota_session_info_t info;
+    bool complete = false;
+    uint32_t received = 0;
+    esp_err_t err;
+
+    int64_t start_us = esp_timer_get_time();
+    if (ota_pull_fetch_manifest(&manifest) != ESP_OK)
+    {
+        return;
+    }
+
+    if (ota_pull_version_compare(manifest.version, app->version) <= 0)
+    {
+        ESP_LOGI(TAG, "ota_pull_check: version %s is up to date (manifest %s)", app->version, manifest.version);
+        return;
+    }
+
+    err = ota_session_open(OTA_SESSION_CHANNEL_PULL, manifest.size, manifest.sha256, &info);
+    if (err == ESP_OK)
+    {
+        err = ota_session_write_begin(info.id, info.offset);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ota_pull_check: cannot start the update, error %s", esp_err_to_name(err));
+        return;
+    }
+
+    ESP_LOGI(TAG,
+             "ota_pull_check: updating %s -> %s, %lu of %lu bytes already received",
+             app->version,
+             manifest.version,
+             (unsigned long)info.offset,
+             (unsigned long)info.size);
+
+    char *buf = malloc(OTA_PULL_BUFFER_SIZE);
+    err = buf != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+
+    // each attempt continues from the session offset, only network errors are retried
+    int64_t download_us = esp_timer_get_time();
+    for (int attempt = 0; attempt < OTA_PULL_MAX_ATTEMPTS && (err == ESP_OK || err == ESP_FAIL) && info.offset < info.size;
+         attempt++)
+    {
+        err = ota_pull_download(manifest.url, &info, buf, &received);
+        ota_session_get(info.id, &info);
+    }
+    download_us = esp_timer_get_time() - download_us;
+    free(buf);
+
+    // an incomplete image is paused, the next check resumes it
+    esp_err_t end_err = ota_session_write_end(&complete);
+    err = err == ESP_OK ? end_err : err;
+
+    uint32_t download_ms = (uint32_t)(download_us / 1000);
+    ESP_LOGI(TAG,
+             "ota_pull_check: received %lu bytes in %lu ms (%lu KB/s), %lu of %lu bytes written",
+             (unsigned long)received,
+             (unsigned long)download_ms,
+             (unsigned long)(download_ms > 0 ? (uint64_t)received * 1000 / 1024 / download_ms : 0),
+             (unsigned long)info.offset,
+             (unsigned long)info.size);
+
+    if (!complete)
+    {
+        ESP_LOGE(TAG, "ota_pull_check: update not completed, error %s", esp_err_to_name(err));
+        return;
+    }
+
+    ESP_LOGI(TAG,
+             "ota_pull_check: version %s ready, rebooting %lu ms after the manifest check",
+             manifest.version,
+             (unsigned long)((esp_timer_get_time() - start_us) / 1000));
+    esp_restart();
+}
+
+/*
+ * Manifest polling task.
+ * @param pvParameters parameter which can be passed to the task
+ */
+static void ota_pull_task(void *pvParameters)
+{
+    for (;;)
+    {
+        ota_pull_check();
+        vTaskDelay(pdMS_TO_TICKS(OTA_PULL_INTERVAL_MS));
+    }
+}
+
+void ota_pull_start(void)
+{
+    if (task_ota_pull == NULL)
+    {
+        xTaskCreatePinnedToCore(&ota_pull_task,
+                                "ota_pull",
+                                OTA_PULL_TASK_STACK_SIZE,
+                                NULL,
+                                OTA_PULL_TASK_PRIORITY,
+                                &task_ota_pull,
+                                OTA_PULL_TASK_CORE_ID);
+    }
+}
+
+int ota_pull_version_compare(const char *a, const char *b)
+{
+    // skip a prefix such as v, then compare the dot separated numbers, a
+    // suffix such as -rc1 or the -12-gabcdef of git describe is ignored
+    while (*a != '\0' && !isdigit((unsigned char)*a))
+    {
+        a++;
+    }
+    while (*b != '\0' && !isdigit((unsigned char)*b))
+    {
+        b++;
+    }
+
+    for (;;)
+    {
+        bool a_has = isdigit((unsigned char)*a);
+        bool b_has = isdigit((unsigned char)*b);
+        if (!a_has || !b_has)
+        {
+            // 1.2.1 is newer than 1.2
+            return a_has - b_has;
+        }
+
+        char *a_end;
+        char *b_end;
+        unsigned long a_num = strtoul(a, &a_end, 10);
+        unsigned long b_num = strtoul(b, &b_end, 10);
+        if (a_num != b_num)
+        {
+            return a_num > b_num ? 1 : -1;
+        }
+
+        // anything but a dot ends the version
+        a = *a_end == '.' ? a_end + 1 : a_end + strlen(a_end);
+        b = *b_end == '.' ? b_end + 1 : b_end + strlen(b_end);
+    }
+}
@@ -0,0 +1,565 @@
+#include "ota_session.h"
+
+#include <ctype.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
+#include "ota_writer.h"
+#include "portmacro.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "ota_session";
+
+// Flash sector size, the offset restored after a reboot is rounded down to it
+#define OTA_SESSION_SECTOR_SIZE 4096
+
+// Open session, its offset is the next image byte expected. Guarded by
+// ota_session_mux as the offset is read by the status requests while the
+// upload request writes it.
+static app_nvs_ota_session_t ota_session;
+static bool ota_session_is_open = false;
+static portMUX_TYPE ota_session_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Claimed under ota_session_mux by an open, and from ota_session_write_begin
+// to ota_session_write_end, so two channels never both pass the busy check
+static bool ota_session_claimed = false;
+
+// Set between ota_session_write_begin and ota_session_write_end
+static bool ota_session_writing = false;
+
+// esp_timer time of the last open or write of the session
+static int64_t ota_session_active_us;
+
+static const char *const ota_session_channel_names[] = {
+    [OTA_SESSION_CHANNEL_HTTP] = "http",
+    [OTA_SESSION_CHANNEL_MQTT] = "mqtt",
+    [OTA_SESSION_CHANNEL_PULL] = "pull",
+};
+
+// Running digest of the image bytes before the offset. It survives a dropped
+// connection, after a reboot it is rebuilt from the bytes already in flash.
+static mbedtls_sha256_context ota_sha256;
+static bool ota_sha256_live = false;
+
+// Image offset the ota_writer was started at, and the offset last saved to nvs
+static uint32_t ota_write_start;
+static uint32_t ota_checkpoint;
+
+/*
+ * Claims the session for an open or a write.
+ * @return true if claimed, false while another call holds it
+ */
+static bool ota_session_claim(void)
+{
+    bool claimed;
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    claimed = !ota_session_claimed;
+    ota_session_claimed = true;
+    taskEXIT_CRITICAL(&ota_session_mux);
+
+    return claimed;
+}
+
+/*
+ * Releases the claim of ota_session_claim.
+ */
+static void ota_session_release(void)
+{
+    taskENTER_CRITICAL(&ota_session_mux);
+    ota_session_claimed = false;
+    taskEXIT_CRITICAL(&ota_session_mux);
+}
+
+/*
+ * Gets the name of a channel, for logs.
+ */
+static const char *ota_session_channel_name(uint8_t channel)
+{
+    return channel <= OTA_SESSION_CHANNEL_PULL ? ota_session_channel_names[channel] : "unknown";
+}
+
+/*
+ * Saves the session to nvs with the given offset.
+ */
+static void ota_session_save(uint32_t offset)
+{
+    app_nvs_ota_session_t saved;
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    saved = ota_session;
+    taskEXIT_CRITICAL(&ota_session_mux);
+
+    saved.offset = offset;
+    app_nvs_save_ota_session(&saved);
+    ota_checkpoint = offset;
+}
+
+/*
+ * Closes the session and forgets it, the partition is left as it is.
+ */
+static void ota_session_close(void)
+{
+    if (ota_sha256_live)
+    {
+        mbedtls_sha256_free(&ota_sha256);
+        ota_sha256_live = false;
+    }
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    ota_session_is_open = false;
+    taskEXIT_CRITICAL(&ota_session_mux);
+
+    app_nvs_clear_ota_session();
+}
+
+/*
+ * Restores the session saved before a reboot. Only the bytes up to the last
+ * sector boundary are trusted: the rest of that sector may hold bytes written
+ * after the checkpoint, and esp_ota_resume erases it again only when the
+ * offset is sector aligned.
+ * @param partition update partition
+ */
+static void ota_session_restore(const esp_partition_t *partition)
+{
+    app_nvs_ota_session_t saved;
+
+    if (!app_nvs_load_ota_session(&saved))
+    {
+        return;
+    }
+
+    if (saved.partition_address != partition->address || saved.size > partition->size || saved.offset > saved.size)
+    {
+        ESP_LOGI(TAG, "ota_session_restore: saved session does not match the update partition");
+        app_nvs_clear_ota_session();
+        return;
+    }
+
+    saved.offset -= saved.offset % OTA_SESSION_SECTOR_SIZE;
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    ota_session = saved;
+    ota_session_is_open = true;
+    taskEXIT_CRITICAL(&ota_session_mux);
+    ota_session_active_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG,
+             "ota_session_restore: %s session %08lx resumes at %lu of %lu",
+             ota_session_channel_name(saved.channel),
+             (unsigned long)saved.id,
+             (unsigned long)saved.offset,
+             (unsigned long)saved.size);
+}
+
+/*
+ * Hashes the first bytes of a partition.
+ * @param sha256 started digest, updated
+ * @param partition partition
+ * @param len bytes to hash
+ * @return ESP_OK, ESP_ERR_NO_MEM or the flash read error
+ */
+static esp_err_t ota_session_hash_partition(mbedtls_sha256_context *sha256,
+                                            const esp_partition_t *partition,
+                                            uint32_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    if (len == 0)
+    {
+        return ESP_OK;
+    }
+
+    uint8_t *buf = malloc(OTA_SESSION_SECTOR_SIZE);
+    if (buf == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t pos = 0; pos < len && err == ESP_OK; pos += OTA_SESSION_SECTOR_SIZE)
+    {
+        size_t n = MIN(OTA_SESSION_SECTOR_SIZE, len - pos);
+        err = esp_partition_read(partition, pos, buf, n);
+        if (err == ESP_OK)
+        {
+            mbedtls_sha256_update(sha256, buf, n);
+        }
+    }
+    free(buf);
+
+    return err;
+}
+
+/*
+ * Starts the running digest and hashes the bytes already written to flash.
+ * @param partition update partition
+ * @param offset image bytes in flash
+ * @return ESP_OK, ESP_ERR_NO_MEM or the flash read error
+ */
+static esp_err_t ota_session_rehash(const esp_partition_t *partition, uint32_t offset)
+{
+    mbedtls_sha256_init(&ota_sha256);
+    mbedtls_sha256_starts(&ota_sha256, 0);
+    ota_sha256_live = true;
+
+    return ota_session_hash_partition(&ota_sha256, partition, offset);
+}
+
+/*
+ * Gets the partition the session writes to.
+ * @return the update partition, or NULL if it is not the one of the session
+ */
+static const esp_partition_t *ota_session_partition(void)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+
+    return partition != NULL && partition->address == ota_session.partition_address ? partition : NULL;
+}
+
+/*
+ * Resumes the session of the image or opens a new one, called with the
+ * session claimed.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if another channel's session is in
+ * the way
+ */
+static esp_err_t ota_session_select(const esp_partition_t *partition,
+                                    ota_session_channel_e channel,
+                                    uint32_t size,
+                                    const uint8_t sha256[OTA_SESSION_SHA256_LEN])
+{
+    if (!ota_session_is_open)
+    {
+        ota_session_restore(partition);
+    }
+
+    if (ota_session_is_open && ota_session.size == size &&
+        memcmp(ota_session.sha256, sha256, OTA_SESSION_SHA256_LEN) == 0)
+    {
+        ota_session_active_us = esp_timer_get_time();
+        return ESP_OK;
+    }
+
+    if (ota_session_is_open)
+    {
+        int64_t idle_s = (esp_timer_get_time() - ota_session_active_us) / 1000000;
+        if (ota_session.channel != channel && idle_s < OTA_SESSION_IDLE_TIMEOUT_S)
+        {
+            ESP_LOGW(TAG,
+                     "ota_session_open: %s session %08lx paused at %lu of %lu, %s upload rejected",
+                     ota_session_channel_name(ota_session.channel),
+                     (unsigned long)ota_session.id,
+                     (unsigned long)ota_session.offset,
+                     (unsigned long)ota_session.size,
+                     ota_session_channel_name(channel));
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        ESP_LOGI(TAG,
+                 "ota_session_open: %s session %08lx replaced, idle %lld s",
+                 ota_session_channel_name(ota_session.channel),
+                 (unsigned long)ota_session.id,
+                 (long long)idle_s);
+        ota_session_close();
+    }
+
+    app_nvs_ota_session_t created = {
+        .id = esp_random() | 1,
+        .size = size,
+        .offset = 0,
+        .partition_address = partition->address,
+        .channel = channel,
+    };
+    memcpy(created.sha256, sha256, OTA_SESSION_SHA256_LEN);
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    ota_session = created;
+    ota_session_is_open = true;
+    taskEXIT_CRITICAL(&ota_session_mux);
+    ota_session_active_us = esp_timer_get_time();
+
+    ota_session_save(0);
+    ESP_LOGI(TAG,
+             "ota_session_open: %s session %08lx for %lu bytes",
+             ota_session_channel_name(channel),
+             (unsigned long)created.id,
+             (unsigned long)size);
+    return ESP_OK;
+}
+
+esp_err_t ota_session_open(ota_session_channel_e channel,
+                           uint32_t size,
+                           const uint8_t sha256[OTA_SESSION_SHA256_LEN],
+                           ota_session_info_t *info)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    esp_err_t err;
+
+    if (!ota_session_claim())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (ota_writer_is_active())
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else if (partition == NULL || size == 0 || size > partition->size)
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        err = ota_session_select(partition, channel, size, sha256);
+    }
+
+    if (err == ESP_OK)
+    {
+        err = ota_session_get(ota_session.id, info);
+    }
+    ota_session_release();
+    return err;
+}
+
+esp_err_t ota_session_get(uint32_t id, ota_session_info_t *info)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    if (ota_session_is_open && ota_session.id == id)
+    {
+        info->id = ota_session.id;
+        info->size = ota_session.size;
+        info->offset = ota_session.offset;
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&ota_session_mux);
+
+    return err;
+}
+
+/*
+ * Starts the ota_writer at the session offset, called with the session
+ * claimed.
+ */
+static esp_err_t ota_session_write_start(uint32_t id, uint32_t offset)
+{
+    if (!ota_session_is_open || ota_session.id != id)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (offset != ota_session.offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const esp_partition_t *partition = ota_session_partition();
+    if (partition == NULL)
+    {
+        // the boot partition changed since the session was opened
+        ota_session_close();
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (!ota_sha256_live)
+    {
+        err = ota_session_rehash(partition, offset);
+    }
+    if (err == ESP_OK)
+    {
+        err = ota_writer_begin(partition, offset);
+    }
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+        // another upload holds the writer, the session stays as it is
+        return err;
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ota_session_write_begin: error %s", esp_err_to_name(err));
+        ota_session_close();
+        return err;
+    }
+
+    ota_session_writing = true;
+    ota_session_active_us = esp_timer_get_time();
+    ota_write_start = offset;
+    ota_checkpoint = offset;
+    return ESP_OK;
+}
+
+esp_err_t ota_session_write_begin(uint32_t id, uint32_t offset)
+{
+    if (!ota_session_claim())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ota_session_write_start(id, offset);
+    if (err != ESP_OK)
+    {
+        ota_session_release();
+    }
+    return err;
+}
+
+esp_err_t ota_session_write(const void *data, size_t len)
+{
+    ota_writer_stats_t stats;
+
+    if (!ota_session_writing)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (len > ota_session.size - ota_session.offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = ota_writer_write(data, len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    mbedtls_sha256_update(&ota_sha256, data, len);
+
+    taskENTER_CRITICAL(&ota_session_mux);
+    ota_session.offset += len;
+    taskEXIT_CRITICAL(&ota_session_mux);
+
+    // only the bytes the flash writer has programmed can be resumed after a reboot
+    ota_writer_get_stats(&stats);
+    uint32_t committed = ota_write_start + stats.bytes_written;
+    if (committed - ota_checkpoint >= OTA_SESSION_CHECKPOINT_SIZE)
+    {
+        ota_session_save(committed);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ota_session_write_end(bool *complete)
+{
+    uint8_t digest[OTA_SESSION_SHA256_LEN];
+    esp_err_t err;
+
+    *complete = false;
+    if (!ota_session_writing)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ota_session_writing = false;
+
+    if (ota_session.offset < ota_session.size)
+    {
+        err = ota_writer_pause();
+        if (err == ESP_OK)
+        {
+            ota_session_save(ota_session.offset);
+            ota_session_active_us = esp_timer_get_time();
+            ESP_LOGI(TAG,
+                     "ota_session_write_end: session %08lx paused at %lu of %lu",
+                     (unsigned long)ota_session.id,
+                     (unsigned long)ota_session.offset,
+                     (unsigned long)ota_session.size);
+            ota_session_release();
+            return ESP_OK;
+        }
+    }
+    else
+    {
+        err = ota_writer_end();
+        if (err == ESP_OK)
+        {
+            mbedtls_sha256_finish(&ota_sha256, digest);
+            if (memcmp(digest, ota_session.sha256, OTA_SESSION_SHA256_LEN) != 0)
+            {
+                err = ESP_ERR_INVALID_CRC;
+            }
+        }
+        if (err == ESP_OK)
+        {
+            err = esp_ota_set_boot_partition(ota_session_partition());
+        }
+        *complete = err == ESP_OK;
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ota_session_write_end: session %08lx failed, error %s", (unsigned long)ota_session.id, esp_err_to_name(err));
+    }
+    ota_session_close();
+    ota_session_release();
+    return err;
+}
+
+void ota_session_discard(void)
+{
+    if (ota_session_claim())
+    {
+        ota_session_close();
+        ota_session_release();
+    }
+}
+
+bool ota_session_is_running_image(uint32_t size, const uint8_t sha256[OTA_SESSION_SHA256_LEN])
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    mbedtls_sha256_context ctx;
+    uint8_t digest[OTA_SESSION_SHA256_LEN];
+
+    if (running == NULL || size == 0 || size > running->size)
+    {
+        return false;
+    }
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    esp_err_t err = ota_session_hash_partition(&ctx, running, size);
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "ota_session_is_running_image: error %s", esp_err_to_name(err));
+        return false;
+    }
+    return memcmp(digest, sha256, OTA_SESSION_SHA256_LEN) == 0;
+}
+
+bool ota_session_parse_sha256(const char *hex, uint8_t sha256[OTA_SESSION_SHA256_LEN])
+{
+    if (strlen(hex) != OTA_SESSION_SHA256_LEN * 2)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < OTA_SESSION_SHA256_LEN; i++)
+    {
+        unsigned int byte;
+        if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+            sscanf(hex + 2 * i, "%2x", &byte) != 1)
+        {
+            return false;
+        }
+        sha256[i] = byte;
+    }
+    return true;
+}
@@ -0,0 +1,369 @@
+#include "ota_writer.h"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/idf_additions.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "portmacro.h"
+#include "tasks_common.h"
+#include "wifi_power.h"
+
+// TAG used for ESP serial console messages
+static const char TAG[] = "ota_writer";
+
+// Buffer index of the end blocks telling the flash writer how the update ends
+#define OTA_WRITER_END_INDEX 0
+#define OTA_WRITER_PAUSE_INDEX 0xfe
+#define OTA_WRITER_ABORT_INDEX 0xff
+
+/*
+ * Filled buffer handed over to the flash writer, len 0 ends the update
+ */
+typedef struct ota_writer_block {
+    uint8_t index;
+    uint16_t len;
+} ota_writer_block_t;
+
+// Ring buffers, OTA_WRITER_BUFFER_COUNT sectors allocated for the update only
+static uint8_t *ota_buffers = NULL;
+
+// Indexes of the free buffers, and the filled blocks waiting for the flash writer
+static QueueHandle_t ota_free_queue = NULL;
+static QueueHandle_t ota_full_queue = NULL;
+
+// Given by the flash writer once the update is ended or cancelled
+static SemaphoreHandle_t ota_done_semaphore = NULL;
+
+// Buffer being filled by the receiver
+static uint8_t ota_fill_index;
+static size_t ota_fill_len;
+static bool ota_fill_active = false;
+
+// Partition being updated, NULL when no update is running. Set by
+// ota_writer_begin under ota_writer_mux, so of two updates starting together
+// only one claims the writer.
+static const esp_partition_t *ota_partition = NULL;
+static portMUX_TYPE ota_writer_mux = portMUX_INITIALIZER_UNLOCKED;
+static size_t ota_resume_offset = 0;
+
+// First error of the flash writer, read by the receiver to stop early
+static volatile esp_err_t ota_writer_err = ESP_OK;
+
+// Statistics, guarded by ota_stats_mux
+static ota_writer_stats_t ota_stats;
+static int64_t ota_start_us;
+static portMUX_TYPE ota_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Flash writer task, writes the filled buffers in order and returns them to
+ * the free queue. esp_ota_begin is called with OTA_WITH_SEQUENTIAL_WRITES so
+ * each sector is erased right before it is programmed, instead of the whole
+ * partition being erased up front. A paused update is continued with
+ * esp_ota_resume, and paused by releasing the handle with esp_ota_abort,
+ * which leaves the flash untouched.
+ * @param param unused
+ */
+static void ota_writer_task(void *param)
+{
+    esp_ota_handle_t ota_handle = 0;
+    ota_writer_block_t block;
+    uint8_t end_index = OTA_WRITER_END_INDEX;
+
+    esp_err_t err = ota_resume_offset == 0
+                        ? esp_ota_begin(ota_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle)
+                        : esp_ota_resume(ota_partition, OTA_WITH_SEQUENTIAL_WRITES, ota_resume_offset, &ota_handle);
+    bool begun = err == ESP_OK;
+    if (!begun)
+    {
+        ESP_LOGE(TAG, "ota_writer_task: esp_ota_begin error %s", esp_err_to_name(err));
+        ota_writer_err = err;
+    }
+
+    for (;;)
+    {
+        int64_t wait_start_us = esp_timer_get_time();
+        xQueueReceive(ota_full_queue, &block, portMAX_DELAY);
+        uint32_t wait_ms = (uint32_t)((esp_timer_get_time() - wait_start_us) / 1000);
+
+        if (block.len == 0)
+        {
+            end_index = block.index;
+            break;
+        }
+
+        // after an error the buffers are only drained so the receiver never blocks
+        if (err == ESP_OK)
+        {
+            err = esp_ota_write(ota_handle, ota_buffers + block.index * OTA_WRITER_BUFFER_SIZE, block.len);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "ota_writer_task: esp_ota_write error %s", esp_err_to_name(err));
+                ota_writer_err = err;
+            }
+        }
+        xQueueSend(ota_free_queue, &block.index, 0);
+
+        taskENTER_CRITICAL(&ota_stats_mux);
+        ota_stats.writer_stall_ms += wait_ms;
+        ota_stats.bytes_written += err == ESP_OK ? block.len : 0;
+        taskEXIT_CRITICAL(&ota_stats_mux);
+    }
+
+    if (begun)
+    {
+        if (err != ESP_OK || end_index != OTA_WRITER_END_INDEX)
+        {
+            esp_ota_abort(ota_handle);
+        }
+        else if ((err = esp_ota_end(ota_handle)) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "ota_writer_task: esp_ota_end error %s", esp_err_to_name(err));
+            ota_writer_err = err;
+        }
+    }
+
+    xSemaphoreGive(ota_done_semaphore);
+    vTaskDelete(NULL);
+}
+
+/*
+ * Releases the writer claimed by ota_writer_begin.
+ */
+static void ota_writer_release(void)
+{
+    taskENTER_CRITICAL(&ota_writer_mux);
+    ota_partition = NULL;
+    taskEXIT_CRITICAL(&ota_writer_mux);
+}
+
+/*
+ * Hands a block over to the flash writer.
+ */
+static void ota_writer_submit(uint8_t index, uint16_t len)
+{
+    ota_writer_block_t block = {.index = index, .len = len};
+
+    // never blocks, there are at most OTA_WRITER_BUFFER_COUNT blocks and one end block
+    xQueueSend(ota_full_queue, &block, portMAX_DELAY);
+}
+
+/*
+ * Ends the flash writer task and releases the ring.
+ * @param end_index OTA_WRITER_END_INDEX, OTA_WRITER_PAUSE_INDEX or OTA_WRITER_ABORT_INDEX
+ */
+static void ota_writer_finish(uint8_t end_index)
+{
+    bool cancel = end_index == OTA_WRITER_ABORT_INDEX;
+
+    if (ota_fill_active)
+    {
+        if (cancel || ota_fill_len == 0)
+        {
+            xQueueSend(ota_free_queue, &ota_fill_index, 0);
+        }
+        else
+        {
+            ota_writer_submit(ota_fill_index, ota_fill_len);
+        }
+        ota_fill_active = false;
+    }
+
+    ota_writer_submit(end_index, 0);
+    xSemaphoreTake(ota_done_semaphore, portMAX_DELAY);
+
+    taskENTER_CRITICAL(&ota_stats_mux);
+    ota_stats.elapsed_ms = (uint32_t)((esp_timer_get_time() - ota_start_us) / 1000);
+    ota_stats.kbytes_per_s =
+        ota_stats.elapsed_ms > 0 ? (uint32_t)((uint64_t)ota_stats.bytes_written * 1000 / 1024 / ota_stats.elapsed_ms) : 0;
+    taskEXIT_CRITICAL(&ota_stats_mux);
+
+    ESP_LOGI(TAG,
+             "ota_writer_finish: %lu bytes in %lu ms (%lu KB/s), receiver stalled %lu ms, flash writer stalled %lu ms",
+             (unsigned long)ota_stats.bytes_written,
+             (unsigned long)ota_stats.elapsed_ms,
+             (unsigned long)ota_stats.kbytes_per_s,
+             (unsigned long)ota_stats.producer_stall_ms,
+             (unsigned long)ota_stats.writer_stall_ms);
+
+    free(ota_buffers);
+    ota_buffers = NULL;
+    ota_writer_release();
+    wifi_power_busy_end(WIFI_POWER_BUSY_OTA);
+}
+
+esp_err_t ota_writer_begin(const esp_partition_t *partition, size_t offset)
+{
+    bool busy;
+
+    taskENTER_CRITICAL(&ota_writer_mux);
+    busy = ota_partition != NULL;
+    if (!busy)
+    {
+        ota_partition = partition;
+    }
+    taskEXIT_CRITICAL(&ota_writer_mux);
+
+    if (busy)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (ota_free_queue == NULL)
+    {
+        ota_free_queue = xQueueCreate(OTA_WRITER_BUFFER_COUNT, sizeof(uint8_t));
+        ota_full_queue = xQueueCreate(OTA_WRITER_BUFFER_COUNT + 1, sizeof(ota_writer_block_t));
+        ota_done_semaphore = xSemaphoreCreateBinary();
+        if (ota_free_queue == NULL || ota_full_queue == NULL || ota_done_semaphore == NULL)
+        {
+            ota_writer_release();
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ota_buffers = malloc(OTA_WRITER_BUFFER_COUNT * OTA_WRITER_BUFFER_SIZE);
+    if (ota_buffers == NULL)
+    {
+        ota_writer_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    xQueueReset(ota_free_queue);
+    xQueueReset(ota_full_queue);
+    for (uint8_t i = 0; i < OTA_WRITER_BUFFER_COUNT; i++)
+    {
+        xQueueSend(ota_free_queue, &i, 0);
+    }
+
+    taskENTER_CRITICAL(&ota_stats_mux);
+    memset(&ota_stats, 0, sizeof(ota_stats));
+    ota_start_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&ota_stats_mux);
+
+    ota_resume_offset = offset;
+    ota_writer_err = ESP_OK;
+    ota_fill_active = false;
+
+    if (xTaskCreatePinnedToCore(&ota_writer_task,
+                                "ota_writer",
+                                OTA_WRITER_TASK_STACK_SIZE,
+                                NULL,
+                                OTA_WRITER_TASK_PRIORITY,
+                                NULL,
+                                OTA_WRITER_TASK_CORE_ID) != pdPASS)
+    {
+        free(ota_buffers);
+        ota_buffers = NULL;
+        ota_writer_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG,
+             "ota_writer_begin: writing to partition subtype %d at offset 0x%lx, image offset %u",
+             partition->subtype,
+             (unsigned long)partition->address,
+             (unsigned)offset);
+    wifi_power_busy_begin(WIFI_POWER_BUSY_OTA);
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_write(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    if (ota_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (len > 0 && ota_writer_err == ESP_OK)
+    {
+        if (!ota_fill_active)
+        {
+            int64_t wait_start_us = esp_timer_get_time();
+            xQueueReceive(ota_free_queue, &ota_fill_index, portMAX_DELAY);
+            uint32_t wait_ms = (uint32_t)((esp_timer_get_time() - wait_start_us) / 1000);
+
+            taskENTER_CRITICAL(&ota_stats_mux);
+            ota_stats.producer_stall_ms += wait_ms;
+            taskEXIT_CRITICAL(&ota_stats_mux);
+
+            ota_fill_len = 0;
+            ota_fill_active = true;
+        }
+
+        size_t n = MIN(len, OTA_WRITER_BUFFER_SIZE - ota_fill_len);
+        memcpy(ota_buffers + ota_fill_index * OTA_WRITER_BUFFER_SIZE + ota_fill_len, bytes, n);
+        ota_fill_len += n;
+        bytes += n;
+        len -= n;
+
+        if (ota_fill_len == OTA_WRITER_BUFFER_SIZE)
+        {
+            ota_writer_submit(ota_fill_index, OTA_WRITER_BUFFER_SIZE);
+            ota_fill_active = false;
+        }
+    }
+
+    return ota_writer_err;
+}
+
+esp_err_t ota_writer_end(void)
+{
+    if (ota_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_writer_finish(OTA_WRITER_END_INDEX);
+    return ota_writer_err;
+}
+
+esp_err_t ota_writer_pause(void)
+{
+    if (ota_partition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_writer_finish(OTA_WRITER_PAUSE_INDEX);
+    return ota_writer_err;
+}
+
+void ota_writer_abort(void)
+{
+    if (ota_partition != NULL)
+    {
+        ota_writer_finish(OTA_WRITER_ABORT_INDEX);
+    }
+}
+
+bool ota_writer_is_active(void)
+{
+    return ota_partition != NULL;
+}
+
+void ota_writer_get_stats(ota_writer_stats_t *stats)
+{
+    taskENTER_CRITICAL(&ota_stats_mux);
+    *stats = ota_stats;
+    if (ota_partition != NULL)
+    {
+        stats->elapsed_ms = (uint32_t)((esp_timer_get_time() - ota_start_us) / 1000);
+        stats->kbytes_per_s =
+            stats->elapsed_ms > 0 ? (uint32_t)((uint64_t)stats->bytes_written * 1000 / 1024 / stats->elapsed_ms) : 0;
+    }
+    taskEXIT_CRITICAL(&ota_stats_mux);
+}
@@ -9,8 +9,8 @@
 #include <string.h>
 #include <time.h>
 
+#include "event_bus.h"
 #include "freertos/idf_additions.h"
-#include "http_server.h"
 #include "portmacro.h"
 #include "tasks_common.h"
 #include "wifi.h"
@@ -20,6 +20,9 @@ static const char TAG[] = "sntp_time_sync";
 // sntp operating mode status
 static bool sntp_op_mode_set = false;
 
+// sntp time sync task handle, started once
+static TaskHandle_t task_sntp_time_sync = NULL;
+
 /*
  * initialize sntp service
  */
@@ -36,8 +39,9 @@ static void sntp_time_sync_init_sntp()
     sntp_setservername(0, "pool.ntp.org");
     sntp_init();
 
-    // let http_server know sntp is initialized
-    http_server_monitor_send_message(HTTP_TIME_SERVICE_INITIALIZED);
+    // let the subscribers, the http_server among them, know sntp is
+    // initialized
+    event_bus_post(EVENT_BUS_TIME_SYNCED);
 }
 
 /*
@@ -80,13 +84,17 @@ static void sntp_time_sync(void *pvparam)
 
 void sntp_time_sync_task_start(void)
 {
-    xTaskCreatePinnedToCore(&sntp_time_sync,
-                            "sntp_time_sync",
-                            SNTP_TIME_SYNC_STACK_SIZE,
-                            NULL,
-                            SNTP_TIME_SYNC_PRIORITY,
-                            NULL,
-                            SNTP_TIME_SYNC_CORE_ID);
+    // called on each connection, the task keeps running across outages
+    if (task_sntp_time_sync == NULL)
+    {
+        xTaskCreatePinnedToCore(&sntp_time_sync,
+                                "sntp_time_sync",
+                                SNTP_TIME_SYNC_STACK_SIZE,
+                                NULL,
+                                SNTP_TIME_SYNC_PRIORITY,
+                                &task_sntp_time_sync,
+                                SNTP_TIME_SYNC_CORE_ID);
+    }
 }
 
 char *sntp_time_sync_get_time(void)
@@ -0,0 +1,90 @@
+#include "web_cache.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "web_assets.h"
+
+/*
+ * Checks whether the client accepts the given content encoding.
+ * @param accept_encoding Accept-Encoding header, NULL when absent
+ * @param encoding content encoding to look for, e.g. "gzip"
+ * @return true if the encoding is listed and not refused with q=0
+ */
+static bool web_cache_accepts_encoding(const char *accept_encoding, const char *encoding)
+{
+    const char *token = accept_encoding != NULL ? strstr(accept_encoding, encoding) : NULL;
+
+    if (token == NULL)
+    {
+        return false;
+    }
+
+    // "gzip;q=0" means the client explicitly refuses the encoding
+    token += strlen(encoding);
+    return strncmp(token, ";q=0", 4) != 0 || token[4] == '.';
+}
+
+/*
+ * Checks whether the request URL carries the current version of the asset,
+ * e.g. /app.js?v=<hash>, as referenced by the generated index.html.
+ * @param query URL query string, NULL when absent
+ * @param hash asset hash
+ * @return true if the v query parameter matches the asset hash
+ */
+static bool web_cache_is_versioned(const char *query, const char *hash)
+{
+    size_t hash_len = strlen(hash);
+
+    while (query != NULL && *query != '\0')
+    {
+        size_t len = strcspn(query, "&");
+
+        if (strncmp(query, "v=", 2) == 0)
+        {
+            return len - 2 == hash_len && strncmp(query + 2, hash, hash_len) == 0;
+        }
+        query += len;
+        query += *query == '&';
+    }
+    return false;
+}
+
+/*
+ * Checks the If-None-Match header of the request against an ETag.
+ * @param if_none_match If-None-Match header, NULL when absent
+ * @param etag quoted ETag of the representation about to be sent
+ * @return true if the client already holds this representation
+ */
+static bool web_cache_etag_matches(const char *if_none_match, const char *etag)
+{
+    if (if_none_match == NULL)
+    {
+        return false;
+    }
+
+    return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
+}
+
+void web_cache_respond(const web_asset_t *asset,
+                       const char *accept_encoding,
+                       const char *query,
+                       const char *if_none_match,
+                       web_cache_response_t *response)
+{
+    response->encoded = asset->encoding != NULL && web_cache_accepts_encoding(accept_encoding, asset->encoding);
+
+    if (response->encoded)
+    {
+        snprintf(response->etag, sizeof(response->etag), "\"%s-%s\"", asset->hash, asset->encoding);
+    }
+    else
+    {
+        snprintf(response->etag, sizeof(response->etag), "\"%s\"", asset->hash);
+    }
+
+    response->cache_control =
+        web_cache_is_versioned(query, asset->hash) ? WEB_CACHE_CONTROL_IMMUTABLE : WEB_CACHE_CONTROL_REVALIDATE;
+    response->not_modified = web_cache_etag_matches(if_none_match, response->etag);
+}
@@ -2,36 +2,49 @@
 
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
-#include <freertos/event_groups.h>
 #include <freertos/task.h>
 #include <lwip/netdb.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "esp_event.h"
 #include "esp_event_base.h"
 #include "esp_interface.h"
 #include "esp_log_level.h"
 #include "esp_netif.h"
+#include "esp_netif_net_stack.h"
 #include "esp_netif_types.h"
 #include "esp_wifi_default.h"
 #include "esp_wifi_types_generic.h"
+#include "event_bus.h"
 #include "freertos/idf_additions.h"
 #include "http_server.h"
+#include "lwip/dhcp.h"
 #include "lwip/sockets.h"
 #include "nvs.h"
 #include "portmacro.h"
 #include "rgb_led.h"
 #include "tasks_common.h"
+#include "wifi_event.h"
+#include "wifi_link.h"
+#include "wifi_networks.h"
+#include "wifi_power.h"
+#include "wifi_reconnect.h"
+#include "wifi_scan.h"
+#include "wifi_state.h"
 
 // TAG used for serial console messages
 static const char TAG[] = "wifi_app";
 
-// Queue handle used to manipulate the main queue of events
-static QueueHandle_t wifi_app_queue_handle;
+// Event bus subscriber of the wifi app task
+static event_bus_subscriber_t *wifi_app_subscriber;
 
 // netif objects for the station and access point
 esp_netif_t *esp_netif_sta = NULL;
@@ -42,22 +55,38 @@ esp_netif_t *esp_netif_ap = NULL;
  */
 wifi_config_t *wifi_config = NULL;
 
+// Timer of the next connection attempt, the scheduler is in wifi_event.c
+static esp_timer_handle_t wifi_reconnect_timer;
+
 /*
- * Used to track number of retries when connection attempt fails
+ * Fast reconnect: the last successful connection, whether its cached lease
+ * replaces DHCP, the timer handing the lease back to DHCP and whether the
+ * boot to GOT_IP latency was logged
  */
-static int g_retry_number;
+static app_nvs_sta_cache_t wifi_sta_cache;
+static volatile bool wifi_sta_static_lease;
+static esp_timer_handle_t wifi_sta_lease_timer;
+static bool wifi_sta_boot_latency_logged;
 
 /*
- * Wifi app event group handle and status bits
+ * SoftAP lifecycle: the timer switching it off after GOT_IP, its state, the
+ * clients connected to it and its on/off time, guarded by the lock
  */
-static EventGroupHandle_t wifi_event_group;
-const int WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT = BIT0;
-const int WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT = BIT1;
-const int WIFI_APP_USER_REQUESTED_STA_DISONNECT_BIT = BIT2;
-const int WIFI_APP_STA_CONNECTED_GOT_IP_BIT = BIT3;
+static esp_timer_handle_t wifi_ap_timer;
+static bool wifi_ap_enabled = true;
+static volatile uint8_t wifi_ap_clients;
+static int64_t wifi_ap_changed_us;
+static int64_t wifi_ap_on_us;
+static int64_t wifi_ap_off_us;
+static portMUX_TYPE wifi_ap_lock = portMUX_INITIALIZER_UNLOCKED;
 
-// wifi callback
-static wifi_connected_event_callback_t wifi_connected_event_cb;
+/*
+ * Known networks: failed attempts on the network being tried, and the
+ * priority given from the http server to the network being connected, if any
+ */
+static uint8_t wifi_network_failures;
+static bool wifi_network_has_priority;
+static uint8_t wifi_network_priority;
 
 /*
  * WIFI application event handler
@@ -72,6 +101,10 @@ static void wifi_app_event_handler(void *arg, esp_event_base_t event_base, int32
     {
         switch (event_id)
         {
+        case WIFI_EVENT_SCAN_DONE:
+            ESP_LOGI(TAG, "WIFI_EVENT_SCAN_DONE");
+            wifi_scan_done(((const wifi_event_sta_scan_done_t *)event_data)->status == 0);
+            break;
         case WIFI_EVENT_AP_START:
             ESP_LOGI(TAG, "WIFI_EVENT_AP_START");
             break;
@@ -80,44 +113,33 @@ static void wifi_app_event_handler(void *arg, esp_event_base_t event_base, int32
             break;
         case WIFI_EVENT_AP_STACONNECTED:
             ESP_LOGI(TAG, "WIFI_EVENT_AP_STACONNECTED");
+            wifi_ap_clients++;
             break;
         case WIFI_EVENT_AP_STADISCONNECTED:
             ESP_LOGI(TAG, "WIFI_EVENT_AP_STADISCONNECTED");
+            if (wifi_ap_clients > 0)
+            {
+                wifi_ap_clients--;
+            }
             break;
         case WIFI_EVENT_STA_START:
             ESP_LOGI(TAG, "WIFI_EVENT_STA_START");
             break;
         case WIFI_EVENT_STA_CONNECTED:
-            ESP_LOGI(TAG, "WIFI_EVENT_STA_CONNECTED");
-            break;
-        case WIFI_EVENT_STA_DISCONNECTED:
-            ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
-            wifi_event_sta_disconnected_t *wifi_event_sta_disconnected =
-                (wifi_event_sta_disconnected_t *)malloc(sizeof(wifi_event_sta_disconnected_t));
-            *wifi_event_sta_disconnected = *((wifi_event_sta_disconnected_t *)event_data);
-            printf("WIFI_EVENT_STA_DISCONNECTED, reason code %d\n", wifi_event_sta_disconnected->reason);
-            if (g_retry_number < MAX_CONNECTION_RETRIES)
-            {
-                esp_wifi_connect();
-                g_retry_number += 1;
-            }
-            else
+            if (wifi_sta_static_lease)
             {
-                wifi_app_send_message(WIFI_APP_MSG_STA_DISCONNECTED);
+                // setting the address once associated posts IP_EVENT_STA_GOT_IP
+                esp_netif_dns_info_t dns = {.ip.type = ESP_IPADDR_TYPE_V4};
+                dns.ip.u_addr.ip4.addr = wifi_sta_cache.dns;
+                esp_netif_set_ip_info(esp_netif_sta, &wifi_sta_cache.ip_info);
+                esp_netif_set_dns_info(esp_netif_sta, ESP_NETIF_DNS_MAIN, &dns);
             }
             break;
         }
     }
-    else if (event_base == IP_EVENT)
-    {
-        switch (event_id)
-        {
-        case IP_EVENT_STA_GOT_IP:
-            ESP_LOGI(TAG, "IP_EVENT_STA_GOT_IP");
-            wifi_app_send_message(WIFI_APP_MSG_STA_CONNECTED_GOT_IP);
-            break;
-        }
-    }
+
+    // the link events go to the wifi app task by value
+    wifi_event_from_driver(event_base, event_id, event_data);
 }
 
 /*
@@ -192,7 +214,377 @@ void wifi_app_soft_ap_config(void)
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config));
     ESP_ERROR_CHECK(esp_wifi_set_bandwidth(WIFI_IF_AP, WIFI_AP_BANDWIDTH));
-    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_STA_POWER_SAVE));
+}
+
+/*
+ * Reconnect timer callback, the attempt is made from the wifi app task
+ * @param arg unused
+ */
+static void wifi_reconnect_timer_cb(void *arg)
+{
+    event_bus_post(EVENT_BUS_WIFI_STA_RECONNECT);
+}
+
+/*
+ * Connection attempt asked by wifi_event.c
+ */
+static void wifi_reconnect_now(void)
+{
+    esp_wifi_connect();
+}
+
+/*
+ * Arms the reconnect timer, a pending attempt is replaced.
+ * @param delay_ms delay of the attempt
+ */
+static void wifi_reconnect_start(uint32_t delay_ms)
+{
+    esp_timer_stop(wifi_reconnect_timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(wifi_reconnect_timer, (uint64_t)delay_ms * 1000));
+}
+
+/*
+ * Stops the pending attempt.
+ */
+static void wifi_reconnect_stop(void)
+{
+    esp_timer_stop(wifi_reconnect_timer);
+}
+
+/*
+ * SoftAP timer callback, the AP is switched off from the wifi app task
+ * @param arg unused
+ */
+static void wifi_ap_timer_cb(void *arg)
+{
+    event_bus_post(EVENT_BUS_WIFI_AP_STOP);
+}
+
+/*
+ * Records a SoftAP state change in the on/off time.
+ * @param enabled new state
+ */
+static void wifi_ap_set_state(bool enabled)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&wifi_ap_lock);
+    if (wifi_ap_enabled)
+    {
+        wifi_ap_on_us += now_us - wifi_ap_changed_us;
+    }
+    else
+    {
+        wifi_ap_off_us += now_us - wifi_ap_changed_us;
+    }
+    wifi_ap_changed_us = now_us;
+    wifi_ap_enabled = enabled;
+    taskEXIT_CRITICAL(&wifi_ap_lock);
+
+    wifi_power_ap_changed(enabled);
+}
+
+/*
+ * Switches the SoftAP off once the station has an IP and nobody uses the AP,
+ * the radio then stays on the station channel.
+ */
+static void wifi_ap_stop(void)
+{
+    if (!wifi_ap_enabled || wifi_event_get_state() != WIFI_STATE_CONNECTED)
+    {
+        return;
+    }
+
+    if (wifi_ap_clients > 0)
+    {
+        ESP_LOGI(TAG, "wifi_ap_stop: %u clients connected, keeping the SoftAP", wifi_ap_clients);
+        esp_timer_start_once(wifi_ap_timer, (uint64_t)WIFI_AP_OFF_DELAY_MS * 1000);
+        return;
+    }
+
+    if (esp_wifi_set_mode(WIFI_MODE_STA) == ESP_OK)
+    {
+        ESP_LOGI(TAG, "wifi_ap_stop: SoftAP off, station only");
+        wifi_ap_set_state(false);
+    }
+}
+
+/*
+ * Brings the SoftAP back on the station channel, so the radio does not
+ * switch between two channels once the station reconnects.
+ */
+static void wifi_ap_start(void)
+{
+    wifi_config_t ap_config;
+    uint8_t primary = 0;
+    wifi_second_chan_t second;
+
+    esp_timer_stop(wifi_ap_timer);
+    if (wifi_ap_enabled)
+    {
+        return;
+    }
+
+    // the channel of the access point the station was last connected to
+    primary = wifi_sta_cache.channel;
+    if (primary == 0 && (esp_wifi_get_channel(&primary, &second) != ESP_OK || primary == 0))
+    {
+        primary = WIFI_AP_CHANNEL;
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+    if (esp_wifi_get_config(ESP_IF_WIFI_AP, &ap_config) == ESP_OK)
+    {
+        ap_config.ap.channel = primary;
+        esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config);
+    }
+    wifi_ap_set_state(true);
+    ESP_LOGI(TAG, "wifi_ap_start: SoftAP on channel %u", primary);
+}
+
+/*
+ * Checks whether the wall clock was set, it survives software resets such as
+ * the reboot after an OTA update but not a power cycle.
+ * @param now current time
+ */
+static bool wifi_sta_cache_clock_valid(time_t now)
+{
+    struct tm time_info;
+
+    localtime_r(&now, &time_info);
+    return time_info.tm_year >= (2023 - 1900);
+}
+
+/*
+ * Lease timer callback, hands the address back to the DHCP client half way
+ * through the cached lease.
+ * @param arg unused
+ */
+static void wifi_sta_lease_timer_cb(void *arg)
+{
+    ESP_LOGI(TAG, "wifi_sta_lease_timer_cb: renewing the cached lease through DHCP");
+    wifi_sta_static_lease = false;
+    esp_netif_dhcpc_start(esp_netif_sta);
+}
+
+/*
+ * Stops using the cached lease and restarts the DHCP client.
+ */
+static void wifi_sta_cache_release_lease(void)
+{
+    if (wifi_sta_static_lease)
+    {
+        esp_timer_stop(wifi_sta_lease_timer);
+        wifi_sta_static_lease = false;
+        esp_netif_dhcpc_start(esp_netif_sta);
+    }
+}
+
+/*
+ * Reads the lease the DHCP server granted the station, runs in the lwIP
+ * context through esp_netif_tcpip_exec.
+ * @param ctx uint32_t receiving the lease in seconds
+ * @return ESP_OK, ESP_ERR_NOT_FOUND when the DHCP client holds no lease
+ */
+static esp_err_t wifi_sta_dhcp_lease_get(void *ctx)
+{
+    struct netif *netif = esp_netif_get_netif_impl(esp_netif_sta);
+    struct dhcp *dhcp = netif != NULL ? netif_dhcp_data(netif) : NULL;
+
+    if (dhcp == NULL || dhcp->state != DHCP_STATE_BOUND || dhcp->t0_timeout == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *(uint32_t *)ctx = (uint32_t)dhcp->t0_timeout * DHCP_COARSE_TIMER_SECS;
+    return ESP_OK;
+}
+
+/*
+ * Prepares a directed connect from the last successful connection to the
+ * saved network: its BSSID and channel skip the all channel scan, and its
+ * lease, when known and still in its first half, skips DHCP.
+ */
+static void wifi_sta_cache_apply(void)
+{
+    wifi_config_t *config = wifi_get_config();
+    time_t now = time(NULL);
+
+    if (!app_nvs_load_sta_cache(&wifi_sta_cache) ||
+        memcmp(wifi_sta_cache.ssid, config->sta.ssid, sizeof(wifi_sta_cache.ssid)) != 0)
+    {
+        ESP_LOGI(TAG, "wifi_sta_cache_apply: no cached connection, full scan");
+        memset(&wifi_sta_cache, 0, sizeof(wifi_sta_cache));
+        return;
+    }
+
+    config->sta.bssid_set = true;
+    memcpy(config->sta.bssid, wifi_sta_cache.bssid, sizeof(config->sta.bssid));
+    config->sta.channel = wifi_sta_cache.channel;
+    config->sta.scan_method = WIFI_FAST_SCAN;
+
+    // without the lease of the server the DHCP client runs, it asks for the
+    // cached address with CONFIG_LWIP_DHCP_RESTORE_LAST_IP
+    int64_t renew_s = wifi_sta_cache.lease_expires - wifi_sta_cache.lease_s / 2 - now;
+    if (wifi_sta_cache.lease_s != 0 && wifi_sta_cache.lease_expires != 0 && wifi_sta_cache_clock_valid(now) &&
+        renew_s > 0)
+    {
+        esp_netif_dhcpc_stop(esp_netif_sta);
+        wifi_sta_static_lease = true;
+        esp_timer_start_once(wifi_sta_lease_timer, (uint64_t)renew_s * 1000000);
+    }
+
+    ESP_LOGI(TAG,
+             "wifi_sta_cache_apply: directed connect on channel %u, %s",
+             wifi_sta_cache.channel,
+             wifi_sta_static_lease ? "cached lease" : "DHCP");
+}
+
+/*
+ * Falls back to the all channel scan and DHCP after a directed connect
+ * failed, e.g. the access point moved to another channel.
+ */
+static void wifi_sta_cache_fallback(void)
+{
+    wifi_config_t *config = wifi_get_config();
+
+    if (!config->sta.bssid_set)
+    {
+        return;
+    }
+
+    ESP_LOGW(TAG, "wifi_sta_cache_fallback: directed connect failed, full scan");
+    config->sta.bssid_set = false;
+    config->sta.channel = 0;
+    config->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    esp_wifi_set_config(ESP_IF_WIFI_STA, config);
+    wifi_sta_cache_release_lease();
+}
+
+/*
+ * Saves the connection in use when it differs from the cached one, with the
+ * lease read from the DHCP client. A lease is saved again once half of it
+ * has passed so the flash is rarely written.
+ * @param ip_info address from IP_EVENT_STA_GOT_IP
+ */
+static void wifi_sta_cache_update(const esp_netif_ip_info_t *ip_info)
+{
+    app_nvs_sta_cache_t cache;
+    wifi_link_info_t link;
+    esp_netif_dns_info_t dns;
+    time_t now = time(NULL);
+    uint32_t lease_s = 0;
+
+    wifi_link_get(&link);
+    if (!link.associated)
+    {
+        return;
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    memcpy(cache.ssid, wifi_get_config()->sta.ssid, sizeof(cache.ssid));
+    memcpy(cache.bssid, link.bssid, sizeof(cache.bssid));
+    cache.channel = link.channel;
+    cache.ip_info = *ip_info;
+    if (esp_netif_get_dns_info(esp_netif_sta, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK)
+    {
+        cache.dns = dns.ip.u_addr.ip4.addr;
+    }
+    if (wifi_sta_static_lease)
+    {
+        cache.lease_s = wifi_sta_cache.lease_s;
+        cache.lease_expires = wifi_sta_cache.lease_expires;
+    }
+    else if (wifi_sta_cache_clock_valid(now) && esp_netif_tcpip_exec(wifi_sta_dhcp_lease_get, &lease_s) == ESP_OK)
+    {
+        cache.lease_s = lease_s;
+        cache.lease_expires = (int64_t)now + lease_s;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "wifi_sta_cache_update: lease unknown, the next connect runs DHCP");
+    }
+
+    if (memcmp(&cache, &wifi_sta_cache, offsetof(app_nvs_sta_cache_t, lease_expires)) == 0 &&
+        (cache.lease_expires == 0 || cache.lease_expires < wifi_sta_cache.lease_expires + cache.lease_s / 2))
+    {
+        return;
+    }
+
+    if (app_nvs_save_sta_cache(&cache) == ESP_OK)
+    {
+        wifi_sta_cache = cache;
+    }
+}
+
+/*
+ * Ranks the known networks in range from the scan service, which reuses its
+ * cached results when fresh. Hidden networks do not show up in a scan, so
+ * when none is seen every known network is ranked by priority and history.
+ * @return number of ranked networks
+ */
+static size_t wifi_sta_scan_networks(void)
+{
+    wifi_scan_result_t *results = malloc(sizeof(wifi_scan_result_t) * WIFI_SCAN_MAX_APS);
+    size_t ranked = 0;
+
+    if (results != NULL)
+    {
+        size_t count = wifi_scan_wait(results, WIFI_SCAN_MAX_APS);
+        ranked = count > 0 ? wifi_networks_rank(results, count) : 0;
+        free(results);
+    }
+
+    return ranked > 0 ? ranked : wifi_networks_rank(NULL, 0);
+}
+
+/*
+ * Selects the network to connect to on boot: the network of the cached
+ * connection when it is known, as it needs no scan, otherwise the best
+ * ranked known network.
+ * @return true if a network was copied to the station config
+ */
+static bool wifi_sta_select_network(void)
+{
+    app_nvs_sta_cache_t cache;
+    size_t count = wifi_networks_load();
+
+    if (count == 0)
+    {
+        return false;
+    }
+
+    if (!(app_nvs_load_sta_cache(&cache) && wifi_networks_select(cache.ssid)))
+    {
+        if (count == 1)
+        {
+            wifi_networks_rank(NULL, 0);
+        }
+        else
+        {
+            wifi_sta_scan_networks();
+        }
+    }
+
+    return wifi_networks_next(wifi_get_config());
+}
+
+/*
+ * Moves on to the next ranked network after WIFI_NETWORKS_ATTEMPTS failed
+ * attempts, scanning and ranking again once all were tried.
+ */
+static void wifi_sta_next_network(void)
+{
+    wifi_config_t *config = wifi_get_config();
+
+    if (!wifi_networks_next(config))
+    {
+        wifi_sta_scan_networks();
+        wifi_networks_next(config);
+    }
+
+    ESP_LOGI(TAG, "wifi_sta_next_network: trying %.32s", config->sta.ssid);
+    config->sta.listen_interval = wifi_power_listen_interval();
+    esp_wifi_set_config(ESP_IF_WIFI_STA, config);
 }
 
 /*
@@ -200,18 +592,115 @@ void wifi_app_soft_ap_config(void)
  */
 static void wifi_connect_sta(void)
 {
+    wifi_get_config()->sta.listen_interval = wifi_power_listen_interval();
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_get_config()));
     ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
+/*
+ * The link went down, the page must stay reachable while the station is down
+ */
+static void wifi_sta_link_lost(void)
+{
+    wifi_ap_start();
+}
+
+/*
+ * An attempt failed before GOT_IP: a failed directed connect falls back to
+ * the full scan and known networks move on to the next ranked one.
+ * @param origin origin of the credentials tried
+ */
+static void wifi_sta_attempt_failed(wifi_state_origin_e origin)
+{
+    wifi_sta_cache_fallback();
+
+    if (origin != WIFI_STATE_ORIGIN_HTTP && ++wifi_network_failures >= WIFI_NETWORKS_ATTEMPTS)
+    {
+        wifi_network_failures = 0;
+        wifi_sta_next_network();
+    }
+}
+
+/*
+ * The station got an IP: the lease is cached, the SoftAP switched off later
+ * and the network saved with the known ones.
+ * @param event the EVENT_BUS_WIFI_STA_GOT_IP event
+ * @param origin origin of the credentials that connected
+ */
+static void wifi_sta_connected(const event_bus_event_t *event, wifi_state_origin_e origin)
+{
+    if (!wifi_sta_boot_latency_logged)
+    {
+        wifi_sta_boot_latency_logged = true;
+        ESP_LOGI(TAG,
+                 "wifi_sta_connected: boot to GOT_IP %lld ms, %s, %s",
+                 event->timestamp_us / 1000,
+                 wifi_get_config()->sta.bssid_set ? "directed connect" : "full scan",
+                 wifi_sta_static_lease ? "cached lease" : "DHCP");
+    }
+    wifi_sta_cache_update(&event->data.sta_got_ip.ip_info);
+
+    if (WIFI_AP_OFF_DELAY_MS > 0 && wifi_ap_enabled)
+    {
+        esp_timer_stop(wifi_ap_timer);
+        esp_timer_start_once(wifi_ap_timer, (uint64_t)WIFI_AP_OFF_DELAY_MS * 1000);
+    }
+
+    rgb_led_wifi_connected();
+
+    // a network from the http server is added to the known ones with its
+    // priority, a known one becomes the last success
+    wifi_networks_connected(wifi_get_config(),
+                            origin == WIFI_STATE_ORIGIN_HTTP && wifi_network_has_priority,
+                            origin == WIFI_STATE_ORIGIN_HTTP ? wifi_network_priority : 0);
+    wifi_network_failures = 0;
+}
+
+// Side effects of the link events handled by wifi_event.c
+static const wifi_event_actions_t wifi_app_event_actions = {
+    .connect = wifi_reconnect_now,
+    .retry_start = wifi_reconnect_start,
+    .retry_stop = wifi_reconnect_stop,
+    .link_lost = wifi_sta_link_lost,
+    .attempt_failed = wifi_sta_attempt_failed,
+    .connected = wifi_sta_connected,
+};
+
 /*
  * Main task for the wifi application
  * @param pvParameters parameter which can be passed to the task
  */
 static void wifi_app_task(void *pvParamters)
 {
-    wifi_app_queue_message_t msg;
-    EventBits_t event_bits;
+    event_bus_event_t event;
+
+    // reconnect scheduler
+    const esp_timer_create_args_t reconnect_timer_args = {
+        .callback = &wifi_reconnect_timer_cb,
+        .name = "wifi_reconnect",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&reconnect_timer_args, &wifi_reconnect_timer));
+
+    // hands a cached lease back to DHCP
+    const esp_timer_create_args_t lease_timer_args = {
+        .callback = &wifi_sta_lease_timer_cb,
+        .name = "wifi_sta_lease",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&lease_timer_args, &wifi_sta_lease_timer));
+
+    // switches the SoftAP off after GOT_IP
+    const esp_timer_create_args_t ap_timer_args = {
+        .callback = &wifi_ap_timer_cb,
+        .name = "wifi_ap",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&ap_timer_args, &wifi_ap_timer));
+    wifi_ap_changed_us = esp_timer_get_time();
+
+    // scan service, completed from the event handler
+    wifi_scan_init();
+
+    // link quality sampler, fed from the event handler
+    wifi_link_init();
 
     // initialize event handler
     wifi_app_event_handler_init();
@@ -222,143 +711,103 @@ static void wifi_app_task(void *pvParamters)
     // SoftAP config
     wifi_app_soft_ap_config();
 
+    // modem sleep of the default power profile
+    wifi_power_init();
+
     // start wifi
     ESP_ERROR_CHECK(esp_wifi_start());
 
     // send first event message
-    wifi_app_send_message(WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS);
+    event_bus_post(EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS);
 
     for (;;)
     {
-        if (xQueueReceive(wifi_app_queue_handle, &msg, portMAX_DELAY))
+        if (event_bus_receive(wifi_app_subscriber, &event, portMAX_DELAY))
         {
-            switch (msg.msgID)
+            switch (event.id)
             {
-            case WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS");
-                if (app_nvs_load_sta_creds())
+            case EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS");
+                if (wifi_sta_select_network())
                 {
                     ESP_LOGI(TAG, "wifi_app_task: loaded station configuration");
+                    wifi_event_dispatch(WIFI_STATE_EV_CONNECT_SAVED, event.timestamp_us);
+                    wifi_sta_cache_apply();
                     wifi_connect_sta();
-                    xEventGroupSetBits(wifi_event_group, WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT);
                 }
                 else
                 {
                     ESP_LOGI(TAG, "wifi_app_task: unable to load station configuration");
                 }
 
-                wifi_app_send_message(WIFI_APP_MSG_START_HTTP_SERVER);
+                event_bus_post(EVENT_BUS_WIFI_START_HTTP_SERVER);
                 break;
 
-            case WIFI_APP_MSG_START_HTTP_SERVER:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_START_HTTP_SERVER");
+            case EVENT_BUS_WIFI_START_HTTP_SERVER:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_START_HTTP_SERVER");
                 start_http_server();
                 rgb_led_http_server_started();
                 break;
 
-            case WIFI_APP_MSG_CONNECTING_HTTP_SERVER:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_CONNECTING_HTTP_SERVER");
-                xEventGroupSetBits(wifi_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
+            case EVENT_BUS_WIFI_CONNECT_HTTP:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_CONNECT_HTTP");
+                wifi_event_dispatch(WIFI_STATE_EV_CONNECT_HTTP, event.timestamp_us);
+
+                // new credentials start with a fresh retry count, a full
+                // scan and DHCP
+                wifi_event_cancel_reconnect();
+                wifi_sta_cache_release_lease();
+                wifi_network_failures = 0;
+                wifi_network_has_priority = event.data.connect_http.has_priority;
+                wifi_network_priority = event.data.connect_http.priority;
 
                 // attemp connection
                 wifi_connect_sta();
-
-                // set retries to 0
-                g_retry_number = 0;
-
-                // let http_server_know of connection attempt
-                http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_INIT);
-
                 break;
 
-            case WIFI_APP_MSG_STA_CONNECTED_GOT_IP:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_STA_CONNECTED_GOT_IP");
-                xEventGroupSetBits(wifi_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
-
-                rgb_led_wifi_connected();
-                http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_SUCCESS);
-                event_bits = xEventGroupGetBits(wifi_event_group);
-                if (event_bits & WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT)
-                { // Save sta creds
-                    // only if
-                    // connecting from
-                    // the http server
-                    // (not loaded from
-                    // nvs)
-                    xEventGroupClearBits(wifi_event_group,
-                                         WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT); // clear bits
-                }
-                else
-                {
-                    app_nvs_save_sta_creds();
-                }
-
-                if (event_bits & WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT)
-                {
-                    xEventGroupClearBits(wifi_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
-                }
-
-                // check for callback
-                if (wifi_connected_event_cb)
-                {
-                    wifi_call_callback();
-                }
-
+            case EVENT_BUS_WIFI_STA_CONNECTED:
+            case EVENT_BUS_WIFI_STA_GOT_IP:
+            case EVENT_BUS_WIFI_STA_DISCONNECTED:
+            case EVENT_BUS_WIFI_STA_RECONNECT:
+                wifi_event_handle(&event);
                 break;
 
-            case WIFI_APP_MSG_STA_DISCONNECTED:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED");
-                event_bits = xEventGroupGetBits(wifi_event_group);
-                if (event_bits & WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT)
-                {
-                    ESP_LOGI(TAG,
-                             "WIFI_APP_MSG_STA_DISCONNECTED: attemp using saved "
-                             "credentials");
-                    xEventGroupClearBits(wifi_event_group, WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT);
-                    app_nvs_clear_sta_creds();
-                }
-                else if (event_bits & WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT)
-                {
-                    ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: attemp from http server");
-                    xEventGroupClearBits(wifi_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
-                    http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
-                }
-                else if (event_bits & WIFI_APP_USER_REQUESTED_STA_DISONNECT_BIT)
-                {
-                    ESP_LOGI(TAG,
-                             "WIFI_APP_USER_REQUESTED_STA_DISONNECT_BIT: user "
-                             "requested disonnection");
-                    xEventGroupClearBits(wifi_event_group, WIFI_APP_USER_REQUESTED_STA_DISONNECT_BIT);
-                    http_server_monitor_send_message(HTTP_MSG_WIFI_USER_DISCONNECT);
-                }
-                else
-                {
-                    ESP_LOGI(TAG,
-                             "WIFI_APP_MSG_STA_DISCONNECTED: attempt failed, check "
-                             "access point");
-                    // adust case, keep trying to connect, etc
-                }
+            case EVENT_BUS_WIFI_AP_STOP:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_AP_STOP");
+                wifi_ap_stop();
+                break;
 
-                if (event_bits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT)
+            case EVENT_BUS_WIFI_RESET_BUTTON:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_RESET_BUTTON");
+                // a switched off SoftAP is brought back first, a second press
+                // disconnects and forgets the network
+                if (!wifi_ap_enabled)
                 {
-                    xEventGroupClearBits(wifi_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
+                    wifi_ap_start();
+                    if (WIFI_AP_OFF_DELAY_MS > 0)
+                    {
+                        esp_timer_start_once(wifi_ap_timer, (uint64_t)WIFI_AP_OFF_DELAY_MS * 1000);
+                    }
+                    break;
                 }
+                // fall through
 
-                break;
-
-            case WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT:
-                ESP_LOGI(TAG, "WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT");
-                event_bits = xEventGroupGetBits(wifi_event_group);
-                if (event_bits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT)
+            case EVENT_BUS_WIFI_USER_DISCONNECT:
+                ESP_LOGI(TAG, "EVENT_BUS_WIFI_USER_DISCONNECT");
+                // a station still retrying is stopped as well
+                if (wifi_event_dispatch(WIFI_STATE_EV_USER_DISCONNECT, event.timestamp_us))
                 {
-                    xEventGroupSetBits(wifi_event_group, WIFI_APP_USER_REQUESTED_STA_DISONNECT_BIT);
-                    g_retry_number = MAX_CONNECTION_RETRIES;
+                    wifi_event_cancel_reconnect();
+                    wifi_sta_cache_release_lease();
                     ESP_ERROR_CHECK(esp_wifi_disconnect());
-                    app_nvs_clear_sta_creds();
+                    wifi_networks_forget(wifi_get_config()->sta.ssid);
+                    app_nvs_clear_sta_cache();
+                    memset(&wifi_sta_cache, 0, sizeof(wifi_sta_cache));
                     // rename to a more meaninful name when there is not a wifi
                     // connection
                     rgb_led_http_server_started();
                 }
+                break;
 
             default:
                 break;
@@ -367,20 +816,34 @@ static void wifi_app_task(void *pvParamters)
     }
 }
 
-BaseType_t wifi_app_send_message(wifi_app_message_e msgID)
+void wifi_get_ap_stats(wifi_ap_stats_t *stats)
 {
-    wifi_app_queue_message_t msg;
-    msg.msgID = msgID;
-    return xQueueSend(wifi_app_queue_handle, &msg, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&wifi_ap_lock);
+    stats->enabled = wifi_ap_enabled;
+    stats->on_ms = (wifi_ap_on_us + (wifi_ap_enabled ? now_us - wifi_ap_changed_us : 0)) / 1000;
+    stats->off_ms = (wifi_ap_off_us + (wifi_ap_enabled ? 0 : now_us - wifi_ap_changed_us)) / 1000;
+    taskEXIT_CRITICAL(&wifi_ap_lock);
+    stats->clients = wifi_ap_clients;
 }
 
-int8_t wifi_get_rssi(void)
+void wifi_get_state(wifi_state_machine_t *state)
+{
+    wifi_event_get_state_machine(state);
+}
+
+void wifi_get_reconnect_stats(wifi_reconnect_stats_t *stats)
 {
-    wifi_ap_record_t wifi_data;
+    wifi_event_get_reconnect_stats(stats);
+}
 
-    ESP_ERROR_CHECK(esp_wifi_sta_get_ap_info(&wifi_data));
+int8_t wifi_get_rssi(void)
+{
+    wifi_link_info_t link;
 
-    return wifi_data.rssi;
+    wifi_link_get(&link);
+    return link.rssi;
 }
 
 void wifi_app_start(void)
@@ -393,11 +856,21 @@ void wifi_app_start(void)
     wifi_config = (wifi_config_t *)malloc(sizeof(wifi_config_t));
     memset(wifi_config, 0, sizeof(wifi_config_t));
 
-    // create message queue
-    wifi_app_queue_handle = xQueueCreate(3, sizeof(wifi_app_queue_message_t));
-
-    // create wifi app event group
-    wifi_event_group = xEventGroupCreate();
+    // subscribe before the task starts, so nothing published by the http
+    // server or the reset button once this returns is missed
+    wifi_app_subscriber = event_bus_subscribe(EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_CONNECTED) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_GOT_IP) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_DISCONNECTED) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_CONNECT_HTTP) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_USER_DISCONNECT) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_RESET_BUTTON) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_LOAD_SAVED_CREDENTIALS) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_START_HTTP_SERVER) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_RECONNECT) |
+                                              EVENT_BUS_BIT(EVENT_BUS_WIFI_AP_STOP));
+
+    // connection state machine and reconnect scheduler
+    wifi_event_init(&wifi_app_event_actions, esp_random(), esp_timer_get_time());
 
     // start wifi app task
     xTaskCreatePinnedToCore(&wifi_app_task,
@@ -413,13 +886,3 @@ wifi_config_t *wifi_get_config(void)
 {
     return wifi_config;
 }
-
-void wifi_set_callback(wifi_connected_event_callback_t cb)
-{
-    wifi_connected_event_cb = cb;
-}
-
-void wifi_call_callback(void)
-{
-    wifi_connected_event_cb();
-}
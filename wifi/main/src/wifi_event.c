@@ -0,0 +1,302 @@
+#include "wifi_event.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_netif_types.h"
+#include "esp_wifi_types_generic.h"
+#include "event_bus.h"
+#include "portmacro.h"
+#include "wifi_link.h"
+#include "wifi_reconnect.h"
+#include "wifi_state.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "wifi_event";
+
+// Side effects of the link events, set by wifi_event_init
+static const wifi_event_actions_t *wifi_event_actions;
+
+/*
+ * Reconnect scheduler of the station and the lock guarding the statistics
+ * read from other tasks
+ */
+static wifi_reconnect_t wifi_event_reconnect;
+static portMUX_TYPE wifi_event_reconnect_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Station connection state, the one source of truth for the wifi app task,
+ * the http server and the connection metrics. Only the wifi app task feeds
+ * it, the lock guards the copies taken by other tasks.
+ */
+static wifi_state_machine_t wifi_event_state;
+static portMUX_TYPE wifi_event_state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void wifi_event_init(const wifi_event_actions_t *actions, uint32_t seed, int64_t now_us)
+{
+    wifi_event_actions = actions;
+    wifi_reconnect_init(&wifi_event_reconnect, seed);
+    wifi_state_init(&wifi_event_state, now_us);
+}
+
+bool wifi_event_from_driver(esp_event_base_t event_base, int32_t event_id, const void *event_data)
+{
+    event_bus_event_t event = {0};
+
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        ESP_LOGI(TAG, "WIFI_EVENT_STA_CONNECTED");
+        wifi_link_associated(event_data);
+        event.id = EVENT_BUS_WIFI_STA_CONNECTED;
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        const wifi_event_sta_disconnected_t *disconnected = event_data;
+        ESP_LOGI(TAG,
+                 "WIFI_EVENT_STA_DISCONNECTED, reason code %d, rssi %d",
+                 disconnected->reason,
+                 disconnected->rssi);
+        wifi_link_disconnected(disconnected->reason, disconnected->rssi);
+        event.id = EVENT_BUS_WIFI_STA_DISCONNECTED;
+        event.data.sta_disconnected.reason = disconnected->reason;
+        event.data.sta_disconnected.rssi = disconnected->rssi;
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        ESP_LOGI(TAG, "IP_EVENT_STA_GOT_IP");
+        event.id = EVENT_BUS_WIFI_STA_GOT_IP;
+        event.data.sta_got_ip.ip_info = ((const ip_event_got_ip_t *)event_data)->ip_info;
+        wifi_link_got_ip(&event.data.sta_got_ip.ip_info);
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP)
+    {
+        ESP_LOGI(TAG, "IP_EVENT_STA_LOST_IP");
+        wifi_link_lost_ip();
+        return false;
+    }
+    else
+    {
+        return false;
+    }
+
+    event_bus_publish(&event);
+    return true;
+}
+
+bool wifi_event_dispatch(wifi_state_event_e event, int64_t now_us)
+{
+    wifi_state_transition_t transition;
+    bool taken;
+
+    taskENTER_CRITICAL(&wifi_event_state_lock);
+    taken = wifi_state_dispatch(&wifi_event_state, event, now_us, &transition);
+    taskEXIT_CRITICAL(&wifi_event_state_lock);
+
+    if (!taken)
+    {
+        ESP_LOGD(TAG,
+                 "wifi_event_dispatch: %s ignored in %s",
+                 wifi_state_event_name(event),
+                 wifi_state_name(wifi_event_state.state));
+        return false;
+    }
+
+    if (transition.from != transition.to || transition.origin != wifi_event_state.origin)
+    {
+        ESP_LOGI(TAG,
+                 "wifi_event_dispatch: %s -> %s on %s",
+                 wifi_state_name(transition.from),
+                 wifi_state_name(transition.to),
+                 wifi_state_event_name(event));
+        event_bus_post(EVENT_BUS_WIFI_STATE_CHANGED);
+    }
+    return true;
+}
+
+void wifi_event_cancel_reconnect(void)
+{
+    wifi_event_actions->retry_stop();
+    taskENTER_CRITICAL(&wifi_event_reconnect_lock);
+    wifi_reconnect_reset(&wifi_event_reconnect);
+    taskEXIT_CRITICAL(&wifi_event_reconnect_lock);
+}
+
+/*
+ * Schedules the next connection attempt after a disconnect or a failed
+ * attempt. Credentials from the http server give up after
+ * MAX_CONNECTION_RETRIES, anything that connected before never does.
+ * @param event the EVENT_BUS_WIFI_STA_DISCONNECTED event, disconnects it
+ * coalesced count as failed attempts so the backoff grows with each of them
+ */
+static void wifi_event_schedule_reconnect(const event_bus_event_t *event)
+{
+    uint32_t delay_ms = 0;
+    uint32_t attempt;
+
+    taskENTER_CRITICAL(&wifi_event_reconnect_lock);
+    for (uint32_t i = 0; i <= event->coalesced; i++)
+    {
+        delay_ms = wifi_reconnect_on_disconnect(&wifi_event_reconnect, event->timestamp_us);
+    }
+    attempt = wifi_event_reconnect.attempt;
+    taskEXIT_CRITICAL(&wifi_event_reconnect_lock);
+
+    if (wifi_event_state.state == WIFI_STATE_CONNECTING && wifi_event_state.origin == WIFI_STATE_ORIGIN_HTTP &&
+        attempt > MAX_CONNECTION_RETRIES)
+    {
+        ESP_LOGI(TAG, "EVENT_BUS_WIFI_STA_DISCONNECTED: attemp from http server");
+        wifi_event_dispatch(WIFI_STATE_EV_GIVE_UP, event->timestamp_us);
+        wifi_event_cancel_reconnect();
+        return;
+    }
+
+    if (attempt == MAX_CONNECTION_RETRIES + 1)
+    {
+        ESP_LOGW(TAG,
+                 "wifi_event_schedule_reconnect: %lu attempts failed, check access point, retrying in the "
+                 "background",
+                 (unsigned long)MAX_CONNECTION_RETRIES);
+    }
+
+    ESP_LOGI(TAG,
+             "wifi_event_schedule_reconnect: attempt %lu in %lu ms",
+             (unsigned long)attempt,
+             (unsigned long)delay_ms);
+    if (delay_ms == 0)
+    {
+        wifi_event_actions->connect();
+    }
+    else
+    {
+        wifi_event_actions->retry_start(delay_ms);
+    }
+}
+
+/*
+ * The station got an IP: the outage ends and the rest of the wifi app
+ * follows, the services depending on the network are started by the
+ * subscribers of EVENT_BUS_WIFI_CONNECTED.
+ * @param event the EVENT_BUS_WIFI_STA_GOT_IP event
+ */
+static void wifi_event_got_ip(const event_bus_event_t *event)
+{
+    wifi_reconnect_stats_t reconnect_stats;
+    wifi_state_origin_e origin = wifi_event_state.origin;
+
+    ESP_LOGI(TAG, "EVENT_BUS_WIFI_STA_GOT_IP, ip " IPSTR, IP2STR(&event->data.sta_got_ip.ip_info.ip));
+
+    // e.g. an address obtained while the user disconnects
+    if (!wifi_event_dispatch(WIFI_STATE_EV_GOT_IP, event->timestamp_us))
+    {
+        return;
+    }
+
+    wifi_event_actions->retry_stop();
+    taskENTER_CRITICAL(&wifi_event_reconnect_lock);
+    wifi_reconnect_on_connected(&wifi_event_reconnect, event->timestamp_us);
+    reconnect_stats = wifi_event_reconnect.stats;
+    taskEXIT_CRITICAL(&wifi_event_reconnect_lock);
+    if (reconnect_stats.reconnects > 0)
+    {
+        ESP_LOGI(TAG,
+                 "EVENT_BUS_WIFI_STA_GOT_IP: reconnected in %lu ms, %lu reconnects, max %lu ms",
+                 (unsigned long)reconnect_stats.last_ms,
+                 (unsigned long)reconnect_stats.reconnects,
+                 (unsigned long)reconnect_stats.max_ms);
+    }
+
+    wifi_event_actions->connected(event, origin);
+    event_bus_post(EVENT_BUS_WIFI_CONNECTED);
+}
+
+/*
+ * The link went down, or an attempt failed: the next one is scheduled
+ * unless the user asked for it.
+ * @param event the EVENT_BUS_WIFI_STA_DISCONNECTED event
+ */
+static void wifi_event_link_down(const event_bus_event_t *event)
+{
+    wifi_state_e state = wifi_event_state.state;
+
+    ESP_LOGI(TAG,
+             "EVENT_BUS_WIFI_STA_DISCONNECTED, reason %u, rssi %d, %u coalesced",
+             event->data.sta_disconnected.reason,
+             event->data.sta_disconnected.rssi,
+             event->coalesced);
+
+    wifi_event_actions->link_lost();
+
+    // nothing to retry when idle, failed or disconnected
+    if (!wifi_event_dispatch(WIFI_STATE_EV_LINK_DOWN, event->timestamp_us))
+    {
+        return;
+    }
+
+    if (state == WIFI_STATE_DISCONNECTING)
+    {
+        ESP_LOGI(TAG, "EVENT_BUS_WIFI_STA_DISCONNECTED: user requested disonnection");
+        return;
+    }
+
+    // a lost link first retries the same access point
+    if (state != WIFI_STATE_CONNECTED)
+    {
+        wifi_event_actions->attempt_failed(wifi_event_state.origin);
+    }
+
+    // saved credentials are kept, the scheduler retries them until the
+    // access point is back
+    wifi_event_schedule_reconnect(event);
+}
+
+void wifi_event_handle(const event_bus_event_t *event)
+{
+    switch (event->id)
+    {
+    case EVENT_BUS_WIFI_STA_CONNECTED:
+        ESP_LOGI(TAG, "EVENT_BUS_WIFI_STA_CONNECTED");
+        wifi_event_dispatch(WIFI_STATE_EV_ASSOCIATED, event->timestamp_us);
+        break;
+
+    case EVENT_BUS_WIFI_STA_GOT_IP:
+        wifi_event_got_ip(event);
+        break;
+
+    case EVENT_BUS_WIFI_STA_DISCONNECTED:
+        wifi_event_link_down(event);
+        break;
+
+    case EVENT_BUS_WIFI_STA_RECONNECT:
+        ESP_LOGI(TAG, "EVENT_BUS_WIFI_STA_RECONNECT");
+        if (wifi_event_state.state == WIFI_STATE_CONNECTING || wifi_event_state.state == WIFI_STATE_RECONNECTING)
+        {
+            wifi_event_actions->connect();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+wifi_state_e wifi_event_get_state(void)
+{
+    return wifi_event_state.state;
+}
+
+void wifi_event_get_state_machine(wifi_state_machine_t *state)
+{
+    taskENTER_CRITICAL(&wifi_event_state_lock);
+    *state = wifi_event_state;
+    taskEXIT_CRITICAL(&wifi_event_state_lock);
+}
+
+void wifi_event_get_reconnect_stats(wifi_reconnect_stats_t *stats)
+{
+    taskENTER_CRITICAL(&wifi_event_reconnect_lock);
+    *stats = wifi_event_reconnect.stats;
+    taskEXIT_CRITICAL(&wifi_event_reconnect_lock);
+}
@@ -0,0 +1,177 @@
+#include "wifi_link.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "portmacro.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "wifi_link";
+
+// Link information, written by the sampler and the event handler under the
+// lock, read without it: the sequence is odd while an update is in progress
+// and readers copy again until they saw the same even sequence before and
+// after their copy
+static wifi_link_info_t wifi_link_info;
+static volatile uint32_t wifi_link_seq;
+static portMUX_TYPE wifi_link_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// RSSI average in 1/16 dB, seeded by the first sample of an association
+static int32_t wifi_link_rssi_x16;
+
+static esp_timer_handle_t wifi_link_timer;
+
+/*
+ * Starts an update, readers retry until wifi_link_update_end.
+ */
+static void wifi_link_update_begin(void)
+{
+    taskENTER_CRITICAL(&wifi_link_lock);
+    __atomic_store_n(&wifi_link_seq, wifi_link_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * Publishes an update.
+ */
+static void wifi_link_update_end(void)
+{
+    __atomic_store_n(&wifi_link_seq, wifi_link_seq + 1, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL(&wifi_link_lock);
+}
+
+/*
+ * Adds an RSSI sample, called between wifi_link_update_begin and end.
+ * @param rssi sample
+ * @param now_us time of the sample
+ */
+static void wifi_link_add_sample(int8_t rssi, int64_t now_us)
+{
+    if (wifi_link_info.samples == 0)
+    {
+        wifi_link_rssi_x16 = rssi * 16;
+        wifi_link_info.rssi_min = rssi;
+        wifi_link_info.rssi_max = rssi;
+    }
+    else
+    {
+        wifi_link_rssi_x16 += (rssi * 16 - wifi_link_rssi_x16) / (1 << WIFI_LINK_EWMA_SHIFT);
+        if (rssi < wifi_link_info.rssi_min)
+        {
+            wifi_link_info.rssi_min = rssi;
+        }
+        if (rssi > wifi_link_info.rssi_max)
+        {
+            wifi_link_info.rssi_max = rssi;
+        }
+    }
+
+    wifi_link_info.rssi = rssi;
+    wifi_link_info.rssi_avg = (int8_t)(wifi_link_rssi_x16 / 16);
+    wifi_link_info.samples++;
+    wifi_link_info.sampled_us = now_us;
+}
+
+/*
+ * Sampler timer callback, reads the RSSI of the access point off the hot
+ * path of the readers.
+ * @param arg unused
+ */
+static void wifi_link_timer_cb(void *arg)
+{
+    wifi_ap_record_t ap_info;
+
+    // fails while the station is not associated
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+    {
+        return;
+    }
+
+    wifi_link_update_begin();
+    if (wifi_link_info.associated)
+    {
+        wifi_link_add_sample(ap_info.rssi, esp_timer_get_time());
+    }
+    wifi_link_update_end();
+}
+
+void wifi_link_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &wifi_link_timer_cb,
+        .name = "wifi_link",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wifi_link_timer));
+}
+
+void wifi_link_associated(const wifi_event_sta_connected_t *event)
+{
+    size_t ssid_len = event->ssid_len < MAX_SSID_LEN ? event->ssid_len : MAX_SSID_LEN;
+
+    wifi_link_update_begin();
+    wifi_link_info.associated = true;
+    memset(wifi_link_info.ssid, 0, sizeof(wifi_link_info.ssid));
+    memcpy(wifi_link_info.ssid, event->ssid, ssid_len);
+    memcpy(wifi_link_info.bssid, event->bssid, sizeof(wifi_link_info.bssid));
+    wifi_link_info.channel = event->channel;
+    wifi_link_info.samples = 0;
+    wifi_link_update_end();
+
+    // first sample right away, then periodically
+    wifi_link_timer_cb(NULL);
+    esp_timer_stop(wifi_link_timer);
+    esp_timer_start_periodic(wifi_link_timer, (uint64_t)WIFI_LINK_SAMPLE_MS * 1000);
+}
+
+void wifi_link_got_ip(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_link_update_begin();
+    wifi_link_info.has_ip = true;
+    wifi_link_info.ip_info = *ip_info;
+    wifi_link_update_end();
+}
+
+void wifi_link_lost_ip(void)
+{
+    wifi_link_update_begin();
+    wifi_link_info.has_ip = false;
+    memset(&wifi_link_info.ip_info, 0, sizeof(wifi_link_info.ip_info));
+    wifi_link_update_end();
+}
+
+void wifi_link_disconnected(uint16_t reason, int8_t rssi)
+{
+    esp_timer_stop(wifi_link_timer);
+
+    wifi_link_update_begin();
+    wifi_link_disconnect_t *entry = &wifi_link_info.history[wifi_link_info.disconnects % WIFI_LINK_REASON_HISTORY_LEN];
+    entry->timestamp_us = esp_timer_get_time();
+    entry->reason = reason;
+    entry->rssi = rssi;
+    wifi_link_info.disconnects++;
+    wifi_link_info.associated = false;
+    wifi_link_info.has_ip = false;
+    memset(&wifi_link_info.ip_info, 0, sizeof(wifi_link_info.ip_info));
+    wifi_link_update_end();
+
+    ESP_LOGD(TAG, "wifi_link_disconnected: reason %u, rssi %d", reason, rssi);
+}
+
+void wifi_link_get(wifi_link_info_t *info)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = __atomic_load_n(&wifi_link_seq, __ATOMIC_ACQUIRE);
+        memcpy(info, (const void *)&wifi_link_info, sizeof(*info));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&wifi_link_seq, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,259 @@
+#include "wifi_networks.h"
+
+#include <esp_log.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "nvs.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "wifi_networks";
+
+// Known networks, only used from the wifi app task
+static app_nvs_sta_network_t wifi_networks[APP_NVS_MAX_STA_NETWORKS];
+static size_t wifi_networks_count;
+
+// Ranked networks, as indexes into wifi_networks, and the next one to try
+static uint8_t wifi_networks_order[APP_NVS_MAX_STA_NETWORKS];
+static size_t wifi_networks_order_count;
+static size_t wifi_networks_order_next;
+
+/*
+ * Compares a known network SSID with another SSID, either may be NUL padded
+ * or use all 32 bytes.
+ */
+static bool wifi_networks_ssid_equal(const uint8_t *a, const uint8_t *b)
+{
+    size_t len = strnlen((const char *)a, sizeof(wifi_networks[0].ssid));
+
+    return len == strnlen((const char *)b, sizeof(wifi_networks[0].ssid)) && memcmp(a, b, len) == 0;
+}
+
+/*
+ * Finds a known network.
+ * @return its index, or -1
+ */
+static int wifi_networks_find(const uint8_t *ssid)
+{
+    for (size_t i = 0; i < wifi_networks_count; i++)
+    {
+        if (wifi_networks_ssid_equal(wifi_networks[i].ssid, ssid))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Gets the sequence number of the last successful connection.
+ */
+static uint32_t wifi_networks_last_seq(void)
+{
+    uint32_t last_seq = 0;
+
+    for (size_t i = 0; i < wifi_networks_count; i++)
+    {
+        if (wifi_networks[i].last_success_seq > last_seq)
+        {
+            last_seq = wifi_networks[i].last_success_seq;
+        }
+    }
+    return last_seq;
+}
+
+size_t wifi_networks_load(void)
+{
+    wifi_networks_count = app_nvs_load_sta_networks(wifi_networks, APP_NVS_MAX_STA_NETWORKS);
+    wifi_networks_order_count = 0;
+    wifi_networks_order_next = 0;
+
+    ESP_LOGI(TAG, "wifi_networks_load: %u known networks", (unsigned)wifi_networks_count);
+    return wifi_networks_count;
+}
+
+esp_err_t wifi_networks_connected(const wifi_config_t *config, bool set_priority, uint8_t priority)
+{
+    uint32_t last_seq = wifi_networks_last_seq();
+    int index = wifi_networks_find(config->sta.ssid);
+    app_nvs_sta_network_t *network;
+    struct tm time_info;
+    time_t now = time(NULL);
+
+    if (index >= 0)
+    {
+        network = &wifi_networks[index];
+        if (network->last_success_seq == last_seq && network->last_success_seq != 0 &&
+            memcmp(network->password, config->sta.password, sizeof(network->password)) == 0 &&
+            (!set_priority || network->priority == priority))
+        {
+            return ESP_OK;
+        }
+        if (set_priority && network->priority != priority)
+        {
+            ESP_LOGI(TAG,
+                     "wifi_networks_connected: %.32s priority %u -> %u",
+                     network->ssid,
+                     network->priority,
+                     priority);
+            network->priority = priority;
+        }
+    }
+    else
+    {
+        if (wifi_networks_count < APP_NVS_MAX_STA_NETWORKS)
+        {
+            index = wifi_networks_count++;
+        }
+        else
+        {
+            // evict the least preferred, lowest priority then oldest success
+            index = 0;
+            for (size_t i = 1; i < wifi_networks_count; i++)
+            {
+                if (wifi_networks[i].priority < wifi_networks[index].priority ||
+                    (wifi_networks[i].priority == wifi_networks[index].priority &&
+                     wifi_networks[i].last_success_seq < wifi_networks[index].last_success_seq))
+                {
+                    index = i;
+                }
+            }
+            ESP_LOGI(TAG, "wifi_networks_connected: store full, forgetting %.32s", wifi_networks[index].ssid);
+        }
+
+        network = &wifi_networks[index];
+        memset(network, 0, sizeof(*network));
+        memcpy(network->ssid, config->sta.ssid, sizeof(network->ssid));
+        network->priority = priority;
+        ESP_LOGI(TAG, "wifi_networks_connected: added %.32s, priority %u", network->ssid, priority);
+    }
+
+    memcpy(network->password, config->sta.password, sizeof(network->password));
+    network->last_success_seq = last_seq + 1;
+    localtime_r(&now, &time_info);
+    network->last_success = time_info.tm_year >= (2023 - 1900) ? (int64_t)now : 0;
+
+    // the ranking refers to indexes that may have changed
+    wifi_networks_order_count = 0;
+    wifi_networks_order_next = 0;
+
+    return app_nvs_save_sta_networks(wifi_networks, wifi_networks_count);
+}
+
+esp_err_t wifi_networks_forget(const uint8_t *ssid)
+{
+    int index = wifi_networks_find(ssid);
+
+    if (index < 0)
+    {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "wifi_networks_forget: %.32s", wifi_networks[index].ssid);
+    memmove(&wifi_networks[index],
+            &wifi_networks[index + 1],
+            (wifi_networks_count - index - 1) * sizeof(wifi_networks[0]));
+    wifi_networks_count--;
+    wifi_networks_order_count = 0;
+    wifi_networks_order_next = 0;
+
+    return app_nvs_save_sta_networks(wifi_networks, wifi_networks_count);
+}
+
+size_t wifi_networks_rank(const wifi_scan_result_t *results, size_t count)
+{
+    int32_t scores[APP_NVS_MAX_STA_NETWORKS];
+    uint32_t last_seq = wifi_networks_last_seq();
+
+    wifi_networks_order_count = 0;
+    wifi_networks_order_next = 0;
+
+    for (size_t i = 0; i < wifi_networks_count; i++)
+    {
+        const app_nvs_sta_network_t *network = &wifi_networks[i];
+        int32_t score = 0;
+
+        if (results != NULL)
+        {
+            // results hold the strongest access point of each SSID
+            bool seen = false;
+            for (size_t j = 0; j < count && !seen; j++)
+            {
+                if (wifi_networks_ssid_equal(network->ssid, (const uint8_t *)results[j].ssid))
+                {
+                    score = results[j].rssi;
+                    seen = true;
+                }
+            }
+            if (!seen)
+            {
+                continue;
+            }
+        }
+
+        score += network->priority * WIFI_NETWORKS_PRIORITY_DB;
+        if (network->last_success_seq != 0)
+        {
+            score += WIFI_NETWORKS_HISTORY_DB;
+            if (network->last_success_seq == last_seq)
+            {
+                score += WIFI_NETWORKS_LAST_SUCCESS_DB;
+            }
+        }
+
+        // insertion sort, best score first
+        size_t pos = wifi_networks_order_count++;
+        while (pos > 0 && scores[pos - 1] < score)
+        {
+            scores[pos] = scores[pos - 1];
+            wifi_networks_order[pos] = wifi_networks_order[pos - 1];
+            pos--;
+        }
+        scores[pos] = score;
+        wifi_networks_order[pos] = i;
+    }
+
+    for (size_t i = 0; i < wifi_networks_order_count; i++)
+    {
+        ESP_LOGI(TAG,
+                 "wifi_networks_rank: %u. %.32s, score %ld",
+                 (unsigned)(i + 1),
+                 wifi_networks[wifi_networks_order[i]].ssid,
+                 (long)scores[i]);
+    }
+    return wifi_networks_order_count;
+}
+
+bool wifi_networks_select(const uint8_t *ssid)
+{
+    int index = wifi_networks_find(ssid);
+
+    wifi_networks_order_count = 0;
+    wifi_networks_order_next = 0;
+    if (index < 0)
+    {
+        return false;
+    }
+
+    wifi_networks_order[0] = index;
+    wifi_networks_order_count = 1;
+    return true;
+}
+
+bool wifi_networks_next(wifi_config_t *config)
+{
+    if (wifi_networks_order_next >= wifi_networks_order_count)
+    {
+        return false;
+    }
+
+    const app_nvs_sta_network_t *network = &wifi_networks[wifi_networks_order[wifi_networks_order_next++]];
+    memset(config, 0, sizeof(*config));
+    memcpy(config->sta.ssid, network->ssid, sizeof(network->ssid));
+    memcpy(config->sta.password, network->password, sizeof(network->password));
+    return true;
+}
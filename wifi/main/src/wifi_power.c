@@ -0,0 +1,295 @@
+#include "wifi_power.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "wifi_power_model.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "wifi_power";
+
+/*
+ * Settings of a profile
+ */
+typedef struct wifi_power_profile_config {
+    const char *name;
+    wifi_ps_type_t ps;
+    uint16_t listen_interval; // beacons, used by WIFI_PS_MAX_MODEM
+    uint16_t keepalive_s;
+    bool awake_when_busy; // WIFI_PS_NONE while an activity is running
+} wifi_power_profile_config_t;
+
+static const wifi_power_profile_config_t wifi_power_profiles[WIFI_POWER_PROFILE_COUNT] = {
+    [WIFI_POWER_PERFORMANCE] = {.name = "performance", .ps = WIFI_PS_NONE, .listen_interval = 3, .keepalive_s = 10},
+    [WIFI_POWER_BALANCED] = {.name = "balanced",
+                             .ps = WIFI_PS_MIN_MODEM,
+                             .listen_interval = 3,
+                             .keepalive_s = 60,
+                             .awake_when_busy = true},
+    [WIFI_POWER_LOW_POWER] = {.name = "low-power", .ps = WIFI_PS_MAX_MODEM, .listen_interval = 10, .keepalive_s = 120},
+};
+
+// State and models, guarded by the mutex as it changes from the http, OTA,
+// MQTT and wifi tasks. The models of every profile see the same time and
+// traffic, so the report compares them.
+static SemaphoreHandle_t wifi_power_mutex;
+static esp_timer_handle_t wifi_power_hold_timer;
+static volatile wifi_power_profile_e wifi_power_profile = WIFI_POWER_PROFILE_DEFAULT;
+static uint16_t wifi_power_busy_count[WIFI_POWER_BUSY_COUNT];
+static bool wifi_power_hold;
+static bool wifi_power_ap_enabled = true;
+static bool wifi_power_ps_set;
+static wifi_ps_type_t wifi_power_ps;
+static wifi_power_model_t wifi_power_models[WIFI_POWER_PROFILE_COUNT];
+static int64_t wifi_power_updated_us;
+
+/*
+ * Gets the running activities.
+ * @return bit per wifi_power_busy_e
+ */
+static uint8_t wifi_power_busy_mask(void)
+{
+    uint8_t mask = wifi_power_hold ? 1 << WIFI_POWER_BUSY_HTTP : 0;
+
+    for (size_t i = 0; i < WIFI_POWER_BUSY_COUNT; i++)
+    {
+        if (wifi_power_busy_count[i] > 0)
+        {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+/*
+ * Gets the modem sleep mode of a profile in the current state.
+ */
+static wifi_ps_type_t wifi_power_profile_ps(wifi_power_profile_e profile)
+{
+    const wifi_power_profile_config_t *config = &wifi_power_profiles[profile];
+
+    return config->awake_when_busy && wifi_power_busy_mask() ? WIFI_PS_NONE : config->ps;
+}
+
+/*
+ * Gets the radio wake up interval of a profile in the current state.
+ * @return interval in microseconds, 0 when the radio is always on
+ */
+static uint32_t wifi_power_wake_interval_us(wifi_power_profile_e profile)
+{
+    if (wifi_power_ap_enabled)
+    {
+        return 0;
+    }
+
+    switch (wifi_power_profile_ps(profile))
+    {
+    case WIFI_PS_MIN_MODEM:
+        return WIFI_POWER_DTIM_PERIOD * WIFI_POWER_MODEL_BEACON_US;
+    case WIFI_PS_MAX_MODEM:
+        return wifi_power_profiles[profile].listen_interval * WIFI_POWER_MODEL_BEACON_US;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Accounts the time since the last update in every model, called with the
+ * mutex held before the state changes.
+ */
+static void wifi_power_update(void)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        wifi_power_model_advance(&wifi_power_models[i], wifi_power_wake_interval_us(i), now_us - wifi_power_updated_us);
+    }
+    wifi_power_updated_us = now_us;
+}
+
+/*
+ * Sets the modem sleep mode of the profile in use when it changed, called
+ * with the mutex held after the state changed.
+ */
+static void wifi_power_apply(void)
+{
+    wifi_ps_type_t ps = wifi_power_profile_ps(wifi_power_profile);
+
+    if (wifi_power_ps_set && ps == wifi_power_ps)
+    {
+        return;
+    }
+
+    esp_err_t err = esp_wifi_set_ps(ps);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "wifi_power_apply: error %s", esp_err_to_name(err));
+        return;
+    }
+    wifi_power_ps_set = true;
+    wifi_power_ps = ps;
+    ESP_LOGD(TAG, "wifi_power_apply: modem sleep %d", ps);
+}
+
+/*
+ * Hold timer callback, the radio may sleep again after the last request
+ * @param arg unused
+ */
+static void wifi_power_hold_timer_cb(void *arg)
+{
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    wifi_power_hold = false;
+    wifi_power_apply();
+    xSemaphoreGive(wifi_power_mutex);
+}
+
+void wifi_power_init(void)
+{
+    const esp_timer_create_args_t hold_timer_args = {
+        .callback = &wifi_power_hold_timer_cb,
+        .name = "wifi_power_hold",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&hold_timer_args, &wifi_power_hold_timer));
+
+    wifi_power_mutex = xSemaphoreCreateMutex();
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        wifi_power_model_init(&wifi_power_models[i]);
+    }
+    wifi_power_updated_us = esp_timer_get_time();
+
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_apply();
+    xSemaphoreGive(wifi_power_mutex);
+
+    ESP_LOGI(TAG, "wifi_power_init: profile %s", wifi_power_profiles[wifi_power_profile].name);
+}
+
+esp_err_t wifi_power_set_profile(wifi_power_profile_e profile)
+{
+    if (profile >= WIFI_POWER_PROFILE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    wifi_power_profile = profile;
+    wifi_power_apply();
+    xSemaphoreGive(wifi_power_mutex);
+
+    ESP_LOGI(TAG, "wifi_power_set_profile: %s", wifi_power_profiles[profile].name);
+    return ESP_OK;
+}
+
+wifi_power_profile_e wifi_power_get_profile(void)
+{
+    return wifi_power_profile;
+}
+
+const char *wifi_power_profile_name(wifi_power_profile_e profile)
+{
+    return profile < WIFI_POWER_PROFILE_COUNT ? wifi_power_profiles[profile].name : NULL;
+}
+
+bool wifi_power_parse_profile(const char *name, wifi_power_profile_e *profile)
+{
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        if (strcmp(name, wifi_power_profiles[i].name) == 0)
+        {
+            *profile = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t wifi_power_listen_interval(void)
+{
+    return wifi_power_profiles[wifi_power_profile].listen_interval;
+}
+
+uint16_t wifi_power_keepalive_s(void)
+{
+    return wifi_power_profiles[wifi_power_profile].keepalive_s;
+}
+
+void wifi_power_busy_begin(wifi_power_busy_e busy)
+{
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    wifi_power_busy_count[busy]++;
+    wifi_power_apply();
+    xSemaphoreGive(wifi_power_mutex);
+}
+
+void wifi_power_busy_end(wifi_power_busy_e busy)
+{
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    if (wifi_power_busy_count[busy] > 0)
+    {
+        wifi_power_busy_count[busy]--;
+    }
+    if (busy == WIFI_POWER_BUSY_HTTP && wifi_power_busy_count[busy] == 0)
+    {
+        // stays awake for the next request, restarted by each request
+        wifi_power_hold = true;
+        esp_timer_stop(wifi_power_hold_timer);
+        esp_timer_start_once(wifi_power_hold_timer, (uint64_t)WIFI_POWER_BUSY_HOLD_MS * 1000);
+    }
+    wifi_power_apply();
+    xSemaphoreGive(wifi_power_mutex);
+}
+
+void wifi_power_tx(void)
+{
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        wifi_power_model_tx(&wifi_power_models[i], wifi_power_wake_interval_us(i));
+    }
+    xSemaphoreGive(wifi_power_mutex);
+}
+
+void wifi_power_ap_changed(bool enabled)
+{
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    wifi_power_ap_enabled = enabled;
+    xSemaphoreGive(wifi_power_mutex);
+}
+
+void wifi_power_get_report(wifi_power_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+
+    xSemaphoreTake(wifi_power_mutex, portMAX_DELAY);
+    wifi_power_update();
+    report->profile = wifi_power_profile;
+    report->awake = wifi_power_wake_interval_us(wifi_power_profile) == 0;
+    report->busy = wifi_power_busy_mask();
+    report->elapsed_ms = (uint32_t)(wifi_power_models[0].elapsed_us / 1000);
+    report->tx_count = wifi_power_models[0].tx_count;
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        const wifi_power_model_t *m = &wifi_power_models[i];
+
+        report->profiles[i].radio_on_ms = (uint32_t)(m->radio_on_us / 1000);
+        report->profiles[i].energy_mj = wifi_power_model_energy_mj(m);
+        report->profiles[i].latency_ms = wifi_power_model_latency_ms(m);
+    }
+    xSemaphoreGive(wifi_power_mutex);
+}
@@ -0,0 +1,55 @@
+#include "wifi_power_model.h"
+
+#include <stdint.h>
+#include <string.h>
+
+void wifi_power_model_init(wifi_power_model_t *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+void wifi_power_model_advance(wifi_power_model_t *m, uint32_t wake_interval_us, uint64_t elapsed_us)
+{
+    m->elapsed_us += elapsed_us;
+
+    if (wake_interval_us == 0)
+    {
+        m->radio_on_us += elapsed_us;
+        m->residual_us = 0;
+        return;
+    }
+
+    uint64_t span_us = m->residual_us + elapsed_us;
+    uint64_t wakeups = span_us / wake_interval_us;
+
+    m->wakeups += (uint32_t)wakeups;
+    m->radio_on_us += wakeups * WIFI_POWER_MODEL_BEACON_RX_US;
+    m->residual_us = (uint32_t)(span_us % wake_interval_us);
+    m->latency_us_x_us += (uint64_t)(wake_interval_us / 2) * elapsed_us;
+}
+
+void wifi_power_model_tx(wifi_power_model_t *m, uint32_t wake_interval_us)
+{
+    m->tx_count++;
+
+    // an awake receiver is already counted
+    if (wake_interval_us != 0)
+    {
+        m->radio_on_us += WIFI_POWER_MODEL_TX_US;
+    }
+}
+
+uint32_t wifi_power_model_energy_mj(const wifi_power_model_t *m)
+{
+    uint64_t radio_on_us = m->radio_on_us < m->elapsed_us ? m->radio_on_us : m->elapsed_us;
+    uint64_t asleep_us = m->elapsed_us - radio_on_us;
+
+    // uA * us = pC, uC * mV = nJ
+    uint64_t charge_pc = radio_on_us * WIFI_POWER_MODEL_RX_MA * 1000 + asleep_us * WIFI_POWER_MODEL_SLEEP_MA * 1000;
+    return (uint32_t)(charge_pc / 1000000 * WIFI_POWER_MODEL_SUPPLY_MV / 1000000);
+}
+
+uint32_t wifi_power_model_latency_ms(const wifi_power_model_t *m)
+{
+    return m->elapsed_us ? (uint32_t)(m->latency_us_x_us / m->elapsed_us / 1000) : 0;
+}
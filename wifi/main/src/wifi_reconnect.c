@@ -0,0 +1,81 @@
+#include "wifi_reconnect.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Gets the next pseudo random number, xorshift32.
+ */
+static uint32_t wifi_reconnect_random(wifi_reconnect_t *r)
+{
+    uint32_t x = r->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    r->rng = x;
+    return x;
+}
+
+void wifi_reconnect_init(wifi_reconnect_t *r, uint32_t seed)
+{
+    memset(r, 0, sizeof(*r));
+    r->rng = seed != 0 ? seed : 0x2545f491;
+}
+
+uint32_t wifi_reconnect_on_disconnect(wifi_reconnect_t *r, int64_t now_us)
+{
+    if (r->disconnected_us == 0)
+    {
+        r->disconnected_us = now_us != 0 ? now_us : 1;
+        r->stats.disconnects++;
+    }
+
+    uint32_t attempt = r->attempt++;
+    r->stats.attempts++;
+
+    // the first retry is immediate, most drops are transient
+    if (attempt == 0)
+    {
+        return 0;
+    }
+
+    // the shift stays in range, the cap is reached long before
+    uint32_t delay = WIFI_RECONNECT_MAX_MS;
+    if (attempt - 1 < 24)
+    {
+        uint64_t backoff = (uint64_t)WIFI_RECONNECT_BASE_MS << (attempt - 1);
+        if (backoff < WIFI_RECONNECT_MAX_MS)
+        {
+            delay = (uint32_t)backoff;
+        }
+    }
+
+    // equal jitter, between half the delay and the delay
+    return delay / 2 + wifi_reconnect_random(r) % (delay / 2 + 1);
+}
+
+void wifi_reconnect_on_connected(wifi_reconnect_t *r, int64_t now_us)
+{
+    if (r->disconnected_us != 0)
+    {
+        uint32_t elapsed_ms = (uint32_t)((now_us - r->disconnected_us) / 1000);
+
+        r->stats.reconnects++;
+        r->stats.last_ms = elapsed_ms;
+        r->stats.total_ms += elapsed_ms;
+        if (elapsed_ms > r->stats.max_ms)
+        {
+            r->stats.max_ms = elapsed_ms;
+        }
+    }
+
+    wifi_reconnect_reset(r);
+}
+
+void wifi_reconnect_reset(wifi_reconnect_t *r)
+{
+    r->attempt = 0;
+    r->disconnected_us = 0;
+}
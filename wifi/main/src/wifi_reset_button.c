@@ -7,12 +7,12 @@
 #include <freertos/task.h>
 
 #include "esp_attr.h"
+#include "event_bus.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
 #include "hal/gpio_types.h"
 #include "portmacro.h"
 #include "tasks_common.h"
-#include "wifi.h"
 
 static const char TAG[] = "wifi_reset_button";
 
@@ -31,7 +31,8 @@ void IRAM_ATTR wifi_reset_button_isr_handler(void *arg)
 
 /*
  * wifi reset button react to a boot event by sending a msg to
- * the wifi application to disconnect from wifi and clear the saved credentials.
+ * the wifi application to bring back the SoftAP when it was switched off,
+ * otherwise to disconnect from wifi and forget the network.
  * @param pvParam parameter to pass to task
  */
 void wifi_reset_button_task(void *pvParam)
@@ -42,8 +43,8 @@ void wifi_reset_button_task(void *pvParam)
         {
             ESP_LOGI(TAG, "WIFI RESET BUTTON INTERRUPT OCCURRED");
 
-            // send message to disconnect wifi and clear credentials.
-            wifi_app_send_message(WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT);
+            // send message to restore the SoftAP or disconnect wifi
+            event_bus_post(EVENT_BUS_WIFI_RESET_BUTTON);
             vTaskDelay(2000 / portTICK_PERIOD_MS);
         }
     }
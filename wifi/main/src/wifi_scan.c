@@ -0,0 +1,213 @@
+#include "wifi_scan.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+
+// TAG used for serial console messages
+static const char TAG[] = "wifi_scan";
+
+// Scan state bits, the lock makes starting a scan atomic between the http
+// server and the wifi app task
+static EventGroupHandle_t wifi_scan_event_group;
+static portMUX_TYPE wifi_scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool wifi_scan_running;
+static const int WIFI_SCAN_RUNNING_BIT = BIT0;
+static const int WIFI_SCAN_DONE_BIT = BIT1;
+
+// Cached results, guarded by the mutex
+static SemaphoreHandle_t wifi_scan_mutex;
+static wifi_scan_result_t wifi_scan_results[WIFI_SCAN_MAX_APS];
+static size_t wifi_scan_count;
+static int64_t wifi_scan_updated_us;
+
+/*
+ * Marks the scan as finished and wakes the tasks waiting for it.
+ */
+static void wifi_scan_finish(void)
+{
+    xEventGroupClearBits(wifi_scan_event_group, WIFI_SCAN_RUNNING_BIT);
+    taskENTER_CRITICAL(&wifi_scan_lock);
+    wifi_scan_running = false;
+    taskEXIT_CRITICAL(&wifi_scan_lock);
+    xEventGroupSetBits(wifi_scan_event_group, WIFI_SCAN_DONE_BIT);
+}
+
+void wifi_scan_init(void)
+{
+    wifi_scan_event_group = xEventGroupCreate();
+    wifi_scan_mutex = xSemaphoreCreateMutex();
+}
+
+esp_err_t wifi_scan_start(void)
+{
+    bool running;
+
+    taskENTER_CRITICAL(&wifi_scan_lock);
+    running = wifi_scan_running;
+    wifi_scan_running = true;
+    taskEXIT_CRITICAL(&wifi_scan_lock);
+
+    if (running)
+    {
+        return ESP_OK;
+    }
+
+    xEventGroupClearBits(wifi_scan_event_group, WIFI_SCAN_DONE_BIT);
+    xEventGroupSetBits(wifi_scan_event_group, WIFI_SCAN_RUNNING_BIT);
+
+    esp_err_t err = esp_wifi_scan_start(NULL, false);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "wifi_scan_start: error %s", esp_err_to_name(err));
+        wifi_scan_finish();
+    }
+    return err;
+}
+
+void wifi_scan_done(bool success)
+{
+    // off the small event loop stack, only this task writes it
+    static wifi_scan_result_t results[WIFI_SCAN_MAX_APS];
+    uint16_t ap_count = WIFI_SCAN_MAX_APS;
+    wifi_ap_record_t *aps = NULL;
+    size_t count = 0;
+
+    if (success)
+    {
+        aps = malloc(sizeof(wifi_ap_record_t) * ap_count);
+    }
+    if (aps == NULL || esp_wifi_scan_get_ap_records(&ap_count, aps) != ESP_OK)
+    {
+        // frees the results of the driver
+        esp_wifi_clear_ap_list();
+        free(aps);
+        ESP_LOGW(TAG, "wifi_scan_done: scan failed, keeping the cached results");
+        wifi_scan_finish();
+        return;
+    }
+
+    for (uint16_t i = 0; i < ap_count; i++)
+    {
+        const wifi_ap_record_t *ap = &aps[i];
+        size_t pos;
+
+        // hidden networks have no SSID to offer
+        if (ap->ssid[0] == '\0')
+        {
+            continue;
+        }
+
+        // keep the strongest access point of each SSID
+        for (pos = 0; pos < count; pos++)
+        {
+            if (strncmp(results[pos].ssid, (const char *)ap->ssid, sizeof(results[pos].ssid)) == 0)
+            {
+                break;
+            }
+        }
+        if (pos < count)
+        {
+            if (ap->rssi <= results[pos].rssi)
+            {
+                continue;
+            }
+            memmove(&results[pos], &results[pos + 1], (count - pos - 1) * sizeof(results[0]));
+            count--;
+        }
+
+        // insertion sort, strongest first
+        pos = count++;
+        while (pos > 0 && results[pos - 1].rssi < ap->rssi)
+        {
+            results[pos] = results[pos - 1];
+            pos--;
+        }
+        memcpy(results[pos].ssid, ap->ssid, sizeof(results[pos].ssid));
+        results[pos].ssid[sizeof(results[pos].ssid) - 1] = '\0';
+        results[pos].rssi = ap->rssi;
+        results[pos].channel = ap->primary;
+        results[pos].authmode = ap->authmode;
+    }
+    free(aps);
+
+    xSemaphoreTake(wifi_scan_mutex, portMAX_DELAY);
+    memcpy(wifi_scan_results, results, count * sizeof(results[0]));
+    wifi_scan_count = count;
+    wifi_scan_updated_us = esp_timer_get_time();
+    xSemaphoreGive(wifi_scan_mutex);
+
+    ESP_LOGI(TAG, "wifi_scan_done: %u access points, %u networks", ap_count, (unsigned)count);
+    wifi_scan_finish();
+}
+
+/*
+ * Copies the cached results.
+ * @return number of results copied
+ */
+static size_t wifi_scan_copy(wifi_scan_result_t *results, size_t max, int64_t *updated_us)
+{
+    xSemaphoreTake(wifi_scan_mutex, portMAX_DELAY);
+    size_t count = wifi_scan_count < max ? wifi_scan_count : max;
+    memcpy(results, wifi_scan_results, count * sizeof(results[0]));
+    *updated_us = wifi_scan_updated_us;
+    xSemaphoreGive(wifi_scan_mutex);
+
+    return count;
+}
+
+size_t wifi_scan_get(wifi_scan_result_t *results, size_t max, uint32_t *age_ms, bool *scanning)
+{
+    int64_t updated_us;
+    size_t count = wifi_scan_copy(results, max, &updated_us);
+    int64_t age_us = esp_timer_get_time() - updated_us;
+
+    if (updated_us == 0 || age_us > (int64_t)WIFI_SCAN_TTL_MS * 1000)
+    {
+        wifi_scan_start();
+    }
+
+    *age_ms = updated_us == 0 ? UINT32_MAX : (uint32_t)(age_us / 1000);
+    *scanning = (xEventGroupGetBits(wifi_scan_event_group) & WIFI_SCAN_RUNNING_BIT) != 0;
+    return count;
+}
+
+size_t wifi_scan_wait(wifi_scan_result_t *results, size_t max)
+{
+    int64_t updated_us;
+    size_t count = wifi_scan_copy(results, max, &updated_us);
+
+    if (updated_us != 0 && esp_timer_get_time() - updated_us <= (int64_t)WIFI_SCAN_TTL_MS * 1000)
+    {
+        return count;
+    }
+
+    if (wifi_scan_start() != ESP_OK)
+    {
+        return 0;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(wifi_scan_event_group,
+                                           WIFI_SCAN_DONE_BIT,
+                                           pdFALSE,
+                                           pdTRUE,
+                                           pdMS_TO_TICKS(WIFI_SCAN_TIMEOUT_MS));
+    if (!(bits & WIFI_SCAN_DONE_BIT))
+    {
+        ESP_LOGW(TAG, "wifi_scan_wait: timed out");
+        return 0;
+    }
+
+    count = wifi_scan_copy(results, max, &updated_us);
+    return esp_timer_get_time() - updated_us <= (int64_t)WIFI_SCAN_TTL_MS * 1000 ? count : 0;
+}
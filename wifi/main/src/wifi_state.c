@@ -0,0 +1,206 @@
+#include "wifi_state.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Matches every state in the transition table
+#define WIFI_STATE_ANY WIFI_STATE_COUNT
+
+/*
+ * Row of the transition table
+ */
+typedef struct wifi_state_row {
+    uint8_t state; // wifi_state_e, or WIFI_STATE_ANY
+    uint8_t event; // wifi_state_event_e
+    uint8_t next;  // wifi_state_e
+} wifi_state_row_t;
+
+/*
+ * Transition table, the first matching row is taken. Anything missing is
+ * ignored, e.g. a late GOT_IP while disconnecting.
+ */
+static const wifi_state_row_t wifi_state_table[] = {
+    // new credentials from the http server replace whatever was going on
+    {WIFI_STATE_ANY, WIFI_STATE_EV_CONNECT_HTTP, WIFI_STATE_CONNECTING},
+
+    {WIFI_STATE_IDLE, WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_CONNECTING},
+    {WIFI_STATE_FAILED, WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_CONNECTING},
+    {WIFI_STATE_DISCONNECTED, WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_CONNECTING},
+
+    {WIFI_STATE_CONNECTING, WIFI_STATE_EV_ASSOCIATED, WIFI_STATE_CONNECTING},
+    {WIFI_STATE_CONNECTING, WIFI_STATE_EV_GOT_IP, WIFI_STATE_CONNECTED},
+    {WIFI_STATE_CONNECTING, WIFI_STATE_EV_LINK_DOWN, WIFI_STATE_CONNECTING},
+    {WIFI_STATE_CONNECTING, WIFI_STATE_EV_GIVE_UP, WIFI_STATE_FAILED},
+    {WIFI_STATE_CONNECTING, WIFI_STATE_EV_USER_DISCONNECT, WIFI_STATE_DISCONNECTING},
+
+    // a new address from DHCP
+    {WIFI_STATE_CONNECTED, WIFI_STATE_EV_GOT_IP, WIFI_STATE_CONNECTED},
+    {WIFI_STATE_CONNECTED, WIFI_STATE_EV_LINK_DOWN, WIFI_STATE_RECONNECTING},
+    {WIFI_STATE_CONNECTED, WIFI_STATE_EV_USER_DISCONNECT, WIFI_STATE_DISCONNECTING},
+
+    {WIFI_STATE_RECONNECTING, WIFI_STATE_EV_ASSOCIATED, WIFI_STATE_RECONNECTING},
+    {WIFI_STATE_RECONNECTING, WIFI_STATE_EV_GOT_IP, WIFI_STATE_CONNECTED},
+    {WIFI_STATE_RECONNECTING, WIFI_STATE_EV_LINK_DOWN, WIFI_STATE_RECONNECTING},
+    {WIFI_STATE_RECONNECTING, WIFI_STATE_EV_USER_DISCONNECT, WIFI_STATE_DISCONNECTING},
+
+    {WIFI_STATE_DISCONNECTING, WIFI_STATE_EV_LINK_DOWN, WIFI_STATE_DISCONNECTED},
+};
+
+static const char *const wifi_state_names[WIFI_STATE_COUNT] = {
+    [WIFI_STATE_IDLE] = "idle",
+    [WIFI_STATE_CONNECTING] = "connecting",
+    [WIFI_STATE_CONNECTED] = "connected",
+    [WIFI_STATE_RECONNECTING] = "reconnecting",
+    [WIFI_STATE_FAILED] = "failed",
+    [WIFI_STATE_DISCONNECTING] = "disconnecting",
+    [WIFI_STATE_DISCONNECTED] = "disconnected",
+};
+
+static const char *const wifi_state_event_names[WIFI_STATE_EV_COUNT] = {
+    [WIFI_STATE_EV_CONNECT_SAVED] = "connect_saved",
+    [WIFI_STATE_EV_CONNECT_HTTP] = "connect_http",
+    [WIFI_STATE_EV_ASSOCIATED] = "associated",
+    [WIFI_STATE_EV_GOT_IP] = "got_ip",
+    [WIFI_STATE_EV_LINK_DOWN] = "link_down",
+    [WIFI_STATE_EV_GIVE_UP] = "give_up",
+    [WIFI_STATE_EV_USER_DISCONNECT] = "user_disconnect",
+};
+
+/*
+ * Converts a duration to milliseconds, clamped to 0 for a clock going back.
+ */
+static uint32_t wifi_state_ms(int64_t from_us, int64_t to_us)
+{
+    return to_us > from_us ? (uint32_t)((to_us - from_us) / 1000) : 0;
+}
+
+void wifi_state_init(wifi_state_machine_t *sm, int64_t now_us)
+{
+    memset(sm, 0, sizeof(*sm));
+    sm->state = WIFI_STATE_IDLE;
+    sm->origin = WIFI_STATE_ORIGIN_NONE;
+    sm->entered_us = now_us;
+}
+
+bool wifi_state_dispatch(wifi_state_machine_t *sm,
+                         wifi_state_event_e event,
+                         int64_t now_us,
+                         wifi_state_transition_t *transition)
+{
+    const wifi_state_row_t *row = NULL;
+    wifi_state_metrics_t *metrics = &sm->metrics;
+
+    for (size_t i = 0; i < sizeof(wifi_state_table) / sizeof(wifi_state_table[0]) && row == NULL; i++)
+    {
+        if ((wifi_state_table[i].state == sm->state || wifi_state_table[i].state == WIFI_STATE_ANY) &&
+            wifi_state_table[i].event == event)
+        {
+            row = &wifi_state_table[i];
+        }
+    }
+    if (row == NULL)
+    {
+        return false;
+    }
+
+    wifi_state_e from = sm->state;
+    wifi_state_e to = row->next;
+    wifi_state_transition_t record = {
+        .timestamp_us = now_us, .from = from, .to = to, .event = event, .origin = sm->origin};
+
+    switch (event)
+    {
+    case WIFI_STATE_EV_CONNECT_SAVED:
+    case WIFI_STATE_EV_CONNECT_HTTP:
+        sm->origin = event == WIFI_STATE_EV_CONNECT_HTTP ? WIFI_STATE_ORIGIN_HTTP : WIFI_STATE_ORIGIN_SAVED;
+        sm->attempt_us = now_us;
+        sm->associated_us = 0;
+        break;
+
+    case WIFI_STATE_EV_ASSOCIATED:
+        if (sm->associated_us == 0)
+        {
+            sm->associated_us = now_us;
+            metrics->last_connect_ms = wifi_state_ms(sm->attempt_us, now_us);
+            if (metrics->last_connect_ms > metrics->max_connect_ms)
+            {
+                metrics->max_connect_ms = metrics->last_connect_ms;
+            }
+        }
+        break;
+
+    case WIFI_STATE_EV_GOT_IP:
+        if (from != WIFI_STATE_CONNECTED)
+        {
+            metrics->connects++;
+            metrics->last_ip_ms = wifi_state_ms(sm->attempt_us, now_us);
+            if (metrics->last_ip_ms > metrics->max_ip_ms)
+            {
+                metrics->max_ip_ms = metrics->last_ip_ms;
+            }
+        }
+        break;
+
+    case WIFI_STATE_EV_LINK_DOWN:
+        sm->associated_us = 0;
+        if (from == WIFI_STATE_CONNECTED)
+        {
+            // the network connected, so it is never given up on
+            sm->origin = WIFI_STATE_ORIGIN_SAVED;
+            sm->attempt_us = now_us;
+            sm->outage_us = now_us;
+            metrics->outages++;
+            if (wifi_state_ms(sm->entered_us, now_us) < WIFI_STATE_FLAP_MS)
+            {
+                metrics->flaps++;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // an outage ends with the next GOT_IP, or when the user gives up on it
+    if (sm->outage_us != 0 && to != WIFI_STATE_RECONNECTING)
+    {
+        metrics->last_outage_ms = wifi_state_ms(sm->outage_us, now_us);
+        metrics->total_outage_ms += metrics->last_outage_ms;
+        if (metrics->last_outage_ms > metrics->max_outage_ms)
+        {
+            metrics->max_outage_ms = metrics->last_outage_ms;
+        }
+        sm->outage_us = 0;
+    }
+
+    if (to != from)
+    {
+        sm->state = to;
+        sm->entered_us = now_us;
+    }
+
+    sm->history[sm->transitions % WIFI_STATE_HISTORY_LEN] = record;
+    sm->transitions++;
+    if (transition != NULL)
+    {
+        *transition = record;
+    }
+    return true;
+}
+
+uint64_t wifi_state_outage_ms(const wifi_state_machine_t *sm, int64_t now_us)
+{
+    return sm->metrics.total_outage_ms + (sm->outage_us != 0 ? wifi_state_ms(sm->outage_us, now_us) : 0);
+}
+
+const char *wifi_state_name(wifi_state_e state)
+{
+    return state < WIFI_STATE_COUNT ? wifi_state_names[state] : "unknown";
+}
+
+const char *wifi_state_event_name(wifi_state_event_e event)
+{
+    return event < WIFI_STATE_EV_COUNT ? wifi_state_event_names[event] : "unknown";
+}
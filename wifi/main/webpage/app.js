@@ -4,22 +4,33 @@
 var seconds = null;
 var otaTimerVar = null;
 var wifiConnectInterval = null;
+var telemetrySocket = null;
+var pollingStarted = false;
+var wifiConnectPending = false;
+var wifiScanTimer = null;
 
 /**
  * Initialize functions here.
  */
 $(document).ready(function() {
-    getSSID();
-    getUpdateStatus();
-    startDHTSensorInterval();
-    startLocalTimeInterval();
-    getConnectInfo();
+    // The server splices the initial state into index.html, only fetch it
+    // when it is missing
+    if (window.initialState) {
+        showStatus(window.initialState);
+    }
+    else {
+        getStatus();
+    }
+    startTelemetry();
     $("#connect_wifi").on("click", function() {
         checkCredentials();
     });
     $("#disconnect_wifi").on("click", function() {
         disconnectWifi();
     });
+    $("#connect_ssid").on("focus", function() {
+        getWifiScan();
+    });
 });
 
 /**
@@ -32,6 +43,28 @@ function getFileInfo() {
     document.getElementById("file_info").innerHTML = "<h4>File: " + file.name + "<br>" + "Size: " + file.size + " bytes</h4>";
 }
 
+/**
+ * Gets the whole device status in one request and updates the web page.
+ */
+function getStatus() {
+    $.getJSON('/status.json', showStatus);
+}
+
+/**
+ * Updates the web page with a device status snapshot.
+ */
+function showStatus(data) {
+    $("#ap_ssid").text(data["ssid"]);
+    showFirmwareInfo(data["ota"]);
+    handleTelemetry(data["dht"]);
+    if ("time" in data) {
+        $("#local_time").text(data["time"]);
+    }
+    if ("conn" in data) {
+        showConnectInfo(data["conn"]);
+    }
+}
+
 /**
  * Handles the firmware update.
  */
@@ -80,21 +113,26 @@ function getUpdateStatus() {
     xhr.send('ota_update_status');
 
     if (xhr.readyState == 4 && xhr.status == 200) {
-        var response = JSON.parse(xhr.responseText);
-
-        document.getElementById("latest_firmware").innerHTML = response.compile_date + " - " + response.compile_time
+        showFirmwareInfo(JSON.parse(xhr.responseText));
+    }
+}
 
-        // If flashing was complete it will return a 1, else -1
-        // A return of 0 is just for information on the Latest Firmware request
-        if (response.ota_update_status == 1) {
-            // Set the countdown timer time
-            seconds = 10;
-            // Start the countdown timer
-            otaRebootTimer();
-        }
-        else if (response.ota_update_status == -1) {
-            document.getElementById("ota_update_status").innerHTML = "!!! Upload Error !!!";
-        }
+/**
+ * Shows the firmware compile date and the firmware update status.
+ */
+function showFirmwareInfo(response) {
+    document.getElementById("latest_firmware").innerHTML = response.compile_date + " - " + response.compile_time
+
+    // If flashing was complete it will return a 1, else -1
+    // A return of 0 is just for information on the Latest Firmware request
+    if (response.ota_update_status == 1) {
+        // Set the countdown timer time
+        seconds = 10;
+        // Start the countdown timer
+        otaRebootTimer();
+    }
+    else if (response.ota_update_status == -1) {
+        document.getElementById("ota_update_status").innerHTML = "!!! Upload Error !!!";
     }
 }
 
@@ -123,6 +161,26 @@ function getDHTSensorValues() {
     });
 }
 
+/**
+ * Gets the networks in range for the SSID suggestions. The device answers
+ * from its scan cache and scans in the background when it is stale, so ask
+ * again shortly while it is scanning.
+ */
+function getWifiScan() {
+    $.getJSON('/wifiScan.json', function(data) {
+        var list = $("#ssid_list");
+        list.empty();
+        $.each(data["aps"], function(i, ap) {
+            list.append($("<option>").attr("value", ap["ssid"]).text(ap["rssi"] + " dBm, channel " + ap["channel"]));
+        });
+
+        clearTimeout(wifiScanTimer);
+        if (data["scanning"]) {
+            wifiScanTimer = setTimeout(getWifiScan, 2000);
+        }
+    });
+}
+
 /**
  * Sets the interval for getting the updated DHT22 sensor values.
  */
@@ -130,6 +188,56 @@ function startDHTSensorInterval() {
     setInterval(getDHTSensorValues, 5000);
 }
 
+/**
+ * Opens the telemetry push channel, falls back to polling when WebSockets
+ * are not available or the channel closes.
+ */
+function startTelemetry() {
+    if (!("WebSocket" in window)) {
+        startPolling();
+        return;
+    }
+
+    telemetrySocket = new WebSocket("ws://" + window.location.host + "/ws");
+    telemetrySocket.onmessage = function(event) {
+        handleTelemetry(JSON.parse(event.data));
+    };
+    telemetrySocket.onclose = function() {
+        telemetrySocket = null;
+        startPolling();
+        if (wifiConnectPending && wifiConnectInterval == null) {
+            startWifiConnectStatusInterval();
+        }
+    };
+}
+
+/**
+ * Updates the web page with the topics of a telemetry frame.
+ */
+function handleTelemetry(data) {
+    if ("temp" in data) {
+        $("#temperature_reading").text(data["temp"]);
+        $("#humidity_reading").text(data["humidity"]);
+    }
+    if ("time" in data) {
+        $("#local_time").text(data["time"]);
+    }
+    if ("wifi_connect_status" in data && wifiConnectPending) {
+        showWifiConnectStatus(data["wifi_connect_status"]);
+    }
+}
+
+/**
+ * Starts polling the sensor values and local time, used without push channel.
+ */
+function startPolling() {
+    if (!pollingStarted) {
+        pollingStarted = true;
+        startDHTSensorInterval();
+        startLocalTimeInterval();
+    }
+}
+
 /**
  * Clears the connection status interval.
  */
@@ -151,18 +259,26 @@ function getWifiConnectStatus() {
 
     if (xhr.readyState == 4 && xhr.status == 200) {
         var response = JSON.parse(xhr.responseText);
+        showWifiConnectStatus(response.wifi_connect_status);
+    }
+}
 
-        document.getElementById("wifi_connect_status").innerHTML = "Connecting...";
+/**
+ * Shows the WiFi connection status of a pending connection attempt.
+ */
+function showWifiConnectStatus(status) {
+    document.getElementById("wifi_connect_status").innerHTML = "Connecting...";
 
-        if (response.wifi_connect_status == 2) {
-            document.getElementById("wifi_connect_status").innerHTML = "<h4 class='rd'>Failed to Connect. Please check your AP credentials and compatibility</h4>";
-            stopWifiConnectStatusInterval();
-        }
-        else if (response.wifi_connect_status == 3) {
-            document.getElementById("wifi_connect_status").innerHTML = "<h4 class='gr'>Connection Success!</h4>";
-            stopWifiConnectStatusInterval();
-            getConnectInfo();
-        }
+    if (status == 2) {
+        document.getElementById("wifi_connect_status").innerHTML = "<h4 class='rd'>Failed to Connect. Please check your AP credentials and compatibility</h4>";
+        wifiConnectPending = false;
+        stopWifiConnectStatusInterval();
+    }
+    else if (status == 3) {
+        document.getElementById("wifi_connect_status").innerHTML = "<h4 class='gr'>Connection Success!</h4>";
+        wifiConnectPending = false;
+        stopWifiConnectStatusInterval();
+        getConnectInfo();
     }
 }
 
@@ -180,17 +296,31 @@ function connectWifi() {
     // Get the SSID and password
     selectedSSID = $("#connect_ssid").val();
     pwd = $("#connect_pass").val();
+    priority = $("#connect_priority").val();
+
+    // a blank priority keeps that of a known network
+    var headers = { 'my-connect-ssid': selectedSSID, 'my-connect-pwd': pwd };
+    if (priority !== "") {
+        headers['my-connect-priority'] = priority;
+    }
 
     $.ajax({
         url: '/wifiConnect.json',
         dataType: 'json',
         method: 'POST',
         cache: false,
-        headers: { 'my-connect-ssid': selectedSSID, 'my-connect-pwd': pwd },
+        headers: headers,
         data: { 'timestamp': Date.now() }
     });
 
-    startWifiConnectStatusInterval();
+    // The status is pushed through the telemetry channel when it is open
+    wifiConnectPending = true;
+    if (telemetrySocket == null) {
+        startWifiConnectStatusInterval();
+    }
+    else {
+        document.getElementById("wifi_connect_status").innerHTML = "Connecting...";
+    }
 }
 
 /**
@@ -238,21 +368,26 @@ function showPassword() {
  * Gets the connection information for displaying on the web page.
  */
 function getConnectInfo() {
-    $.getJSON('/wifiConnectInfo.json', function(data) {
-        $("#connected_ap_label").html("Connected to: ");
-        $("#connected_ap").text(data["ap"]);
+    $.getJSON('/wifiConnectInfo.json', showConnectInfo);
+}
 
-        $("#ip_address_label").html("IP Address: ");
-        $("#wifi_connect_ip").text(data["ip"]);
+/**
+ * Shows the connection information on the web page.
+ */
+function showConnectInfo(data) {
+    $("#connected_ap_label").html("Connected to: ");
+    $("#connected_ap").text(data["ap"]);
 
-        $("#netmask_label").html("Netmask: ");
-        $("#wifi_connect_netmask").text(data["netmask"]);
+    $("#ip_address_label").html("IP Address: ");
+    $("#wifi_connect_ip").text(data["ip"]);
 
-        $("#gateway_label").html("Gateway: ");
-        $("#wifi_connect_gw").text(data["gw"]);
+    $("#netmask_label").html("Netmask: ");
+    $("#wifi_connect_netmask").text(data["netmask"]);
 
-        document.getElementById('disconnect_wifi').style.display = 'block';
-    });
+    $("#gateway_label").html("Gateway: ");
+    $("#wifi_connect_gw").text(data["gw"]);
+
+    document.getElementById('disconnect_wifi').style.display = 'block';
 }
 
 /**
@@ -0,0 +1,59 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Minimal assertions for the host tests, a failed check is reported and
+ * counted, HOST_TEST_RESULT() is the exit code of main.
+ */
+static int host_test_failures;
+
+#define HOST_CHECK(cond)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                 \
+            host_test_failures++;                                                                                      \
+        }                                                                                                              \
+    } while (0)
+
+#define HOST_CHECK_EQ(a, b)                                                                                            \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        long long a_ = (long long)(a);                                                                                 \
+        long long b_ = (long long)(b);                                                                                 \
+        if (a_ != b_)                                                                                                  \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, a_, b_);             \
+            host_test_failures++;                                                                                      \
+        }                                                                                                              \
+    } while (0)
+
+#define HOST_TEST_RESULT() (host_test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+/*
+ * Deterministic pseudo random numbers, so a failure can be replayed.
+ */
+static unsigned long host_test_seed = 1;
+
+static inline unsigned long host_test_rand(void)
+{
+    host_test_seed = host_test_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned long)(host_test_seed >> 33);
+}
+
+/*
+ * Monotonic time for the benchmarks.
+ */
+static inline double host_test_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif // !HOST_TEST_H
@@ -0,0 +1,8 @@
+#ifndef HOST_STUB_ESP_APP_FORMAT_H
+#define HOST_STUB_ESP_APP_FORMAT_H
+
+// esp_app_format.h of ESP-IDF
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+
+#endif // !HOST_STUB_ESP_APP_FORMAT_H
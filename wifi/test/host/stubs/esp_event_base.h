@@ -0,0 +1,10 @@
+#ifndef HOST_STUB_ESP_EVENT_BASE_H
+#define HOST_STUB_ESP_EVENT_BASE_H
+
+// esp_event_base.h of ESP-IDF, the bases are defined by the host tests
+
+typedef const char *esp_event_base_t;
+
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
+
+#endif // !HOST_STUB_ESP_EVENT_BASE_H
@@ -0,0 +1,32 @@
+#ifndef HOST_STUB_ESP_LOG_H
+#define HOST_STUB_ESP_LOG_H
+
+// esp_log.h of ESP-IDF, errors and warnings go to stderr, the rest is dropped
+// but the format is still checked
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static inline void __attribute__((format(printf, 3, 4)))
+host_stub_log(char level, const char *tag, const char *format, ...)
+{
+    va_list args;
+
+    if (level != 'E' && level != 'W')
+    {
+        return;
+    }
+    va_start(args, format);
+    fprintf(stderr, "%c (%s) ", level, tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+#define ESP_LOGE(tag, format, ...) host_stub_log('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) host_stub_log('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) host_stub_log('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) host_stub_log('D', tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) host_stub_log('V', tag, format, ##__VA_ARGS__)
+
+#endif // !HOST_STUB_ESP_LOG_H
@@ -0,0 +1,39 @@
+#ifndef HOST_STUB_ESP_NETIF_TYPES_H
+#define HOST_STUB_ESP_NETIF_TYPES_H
+
+// esp_netif_types.h of ESP-IDF, the station address and its events
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_event_base.h"
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr)                                                                                                 \
+    ((const uint8_t *)(ipaddr))[0], ((const uint8_t *)(ipaddr))[1], ((const uint8_t *)(ipaddr))[2],                    \
+        ((const uint8_t *)(ipaddr))[3]
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    void *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+#endif // !HOST_STUB_ESP_NETIF_TYPES_H
@@ -0,0 +1,13 @@
+#ifndef HOST_STUB_ESP_OTA_OPS_H
+#define HOST_STUB_ESP_OTA_OPS_H
+
+// esp_ota_ops.h of ESP-IDF, the test provides the partitions
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+#endif // !HOST_STUB_ESP_OTA_OPS_H
@@ -0,0 +1,10 @@
+#ifndef HOST_STUB_ESP_RANDOM_H
+#define HOST_STUB_ESP_RANDOM_H
+
+// esp_random.h of ESP-IDF, the test provides the generator
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif // !HOST_STUB_ESP_RANDOM_H
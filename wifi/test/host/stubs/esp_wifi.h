@@ -0,0 +1,11 @@
+#ifndef HOST_STUB_ESP_WIFI_H
+#define HOST_STUB_ESP_WIFI_H
+
+// esp_wifi.h of ESP-IDF
+
+#include "esp_err.h"
+#include "esp_wifi_types_generic.h"
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+
+#endif // !HOST_STUB_ESP_WIFI_H
@@ -0,0 +1,47 @@
+#ifndef HOST_STUB_ESP_WIFI_TYPES_GENERIC_H
+#define HOST_STUB_ESP_WIFI_TYPES_GENERIC_H
+
+// esp_wifi_types_generic.h of ESP-IDF, the fields the modules read
+
+#include <stdint.h>
+
+#include "esp_event_base.h"
+
+#define MAX_SSID_LEN 32
+
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+
+typedef enum {
+    WIFI_EVENT_WIFI_READY = 0,
+    WIFI_EVENT_SCAN_DONE,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t channel;
+    int authmode;
+    uint16_t aid;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint16_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+#endif // !HOST_STUB_ESP_WIFI_TYPES_GENERIC_H
@@ -0,0 +1,17 @@
+#ifndef HOST_STUB_FREERTOS_H
+#define HOST_STUB_FREERTOS_H
+
+// FreeRTOS.h of ESP-IDF, the tests define the kernel functions they reach
+
+#include <stdint.h>
+
+#include "portmacro.h"
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#endif // !HOST_STUB_FREERTOS_H
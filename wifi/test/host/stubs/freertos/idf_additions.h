@@ -0,0 +1,8 @@
+#ifndef HOST_STUB_IDF_ADDITIONS_H
+#define HOST_STUB_IDF_ADDITIONS_H
+
+// idf_additions.h of ESP-IDF
+
+#include "freertos/FreeRTOS.h"
+
+#endif // !HOST_STUB_IDF_ADDITIONS_H
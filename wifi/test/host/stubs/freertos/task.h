@@ -0,0 +1,21 @@
+#ifndef HOST_STUB_FREERTOS_TASK_H
+#define HOST_STUB_FREERTOS_TASK_H
+
+// task.h of FreeRTOS
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *param);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *param,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id);
+
+#endif // !HOST_STUB_FREERTOS_TASK_H
@@ -0,0 +1,16 @@
+#ifndef HOST_STUB_HTTP_PARSER_H
+#define HOST_STUB_HTTP_PARSER_H
+
+// http_parser.h of ESP-IDF, the methods keep their values
+
+enum http_method {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_HEAD = 2,
+    HTTP_POST = 3,
+    HTTP_PUT = 4,
+};
+
+const char *http_method_str(enum http_method m);
+
+#endif // !HOST_STUB_HTTP_PARSER_H
@@ -0,0 +1,38 @@
+#ifndef HOST_STUB_MBEDTLS_SHA256_H
+#define HOST_STUB_MBEDTLS_SHA256_H
+
+// The mbedtls SHA-256 calls of the modules under test, over OpenSSL
+
+#include <openssl/evp.h>
+
+typedef struct mbedtls_sha256_context {
+    EVP_MD_CTX *ctx;
+} mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *sha256)
+{
+    sha256->ctx = EVP_MD_CTX_new();
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *sha256, int is224)
+{
+    return EVP_DigestInit_ex(sha256->ctx, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *sha256, const unsigned char *input, size_t len)
+{
+    return EVP_DigestUpdate(sha256->ctx, input, len) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *sha256, unsigned char output[32])
+{
+    return EVP_DigestFinal_ex(sha256->ctx, output, NULL) == 1 ? 0 : -1;
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *sha256)
+{
+    EVP_MD_CTX_free(sha256->ctx);
+    sha256->ctx = NULL;
+}
+
+#endif // !HOST_STUB_MBEDTLS_SHA256_H
@@ -0,0 +1,82 @@
+#ifndef HOST_STUB_MINIZ_H
+#define HOST_STUB_MINIZ_H
+
+// The tinfl calls of the modules under test, over zlib. The statuses follow
+// tinfl and the output must stay inside the TINFL_LZ_DICT_SIZE circular
+// buffer starting at out_buf_start, as the ROM inflater requires.
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum tinfl_status {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct tinfl_decompressor {
+    z_stream z;
+    int state; // 0 before the first call, 1 inflating, 2 done or failed
+} tinfl_decompressor;
+
+#define tinfl_init(r) ((r)->state = 0)
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r,
+                                            const uint8_t *in_buf_next,
+                                            size_t *in_buf_size,
+                                            uint8_t *out_buf_start,
+                                            uint8_t *out_buf_next,
+                                            size_t *out_buf_size,
+                                            uint32_t flags)
+{
+    assert(flags & TINFL_FLAG_PARSE_ZLIB_HEADER);
+    assert(out_buf_next >= out_buf_start && out_buf_next + *out_buf_size <= out_buf_start + TINFL_LZ_DICT_SIZE);
+
+    if (r->state == 0)
+    {
+        memset(&r->z, 0, sizeof(r->z));
+        if (inflateInit(&r->z) != Z_OK)
+        {
+            return TINFL_STATUS_FAILED;
+        }
+        r->state = 1;
+    }
+    else if (r->state == 2)
+    {
+        *in_buf_size = 0;
+        *out_buf_size = 0;
+        return TINFL_STATUS_FAILED;
+    }
+
+    r->z.next_in = (Bytef *)in_buf_next;
+    r->z.avail_in = *in_buf_size;
+    r->z.next_out = out_buf_next;
+    r->z.avail_out = *out_buf_size;
+    int ret = inflate(&r->z, Z_NO_FLUSH);
+    *in_buf_size -= r->z.avail_in;
+    *out_buf_size -= r->z.avail_out;
+
+    if (ret == Z_STREAM_END || (ret != Z_OK && ret != Z_BUF_ERROR))
+    {
+        inflateEnd(&r->z);
+        r->state = 2;
+        return ret == Z_STREAM_END ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+    if (r->z.avail_out == 0)
+    {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    return (flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
+
+#endif // !HOST_STUB_MINIZ_H
@@ -0,0 +1,24 @@
+#ifndef HOST_STUB_PORTMACRO_H
+#define HOST_STUB_PORTMACRO_H
+
+// portmacro.h of the ESP-IDF FreeRTOS port. The host tests are single
+// threaded, so the critical sections do nothing.
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 10
+
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // !HOST_STUB_PORTMACRO_H
@@ -0,0 +1,284 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "http_router.h"
+#include "wifi_power.h"
+
+// Route table sizes of the benchmark
+static const size_t bench_sizes[] = {10, 50, 200};
+#define BENCH_MAX_ROUTES 200
+#define BENCH_LOOKUPS 2000000
+
+/*
+ * The IDF functions the router calls, only registration is reached by the
+ * lookups, the rest are never called.
+ */
+static int registered_handlers;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    registered_handlers++;
+    return ESP_OK;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    static int queue;
+    return (QueueHandle_t)&queue;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *param,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    abort();
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+    abort();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    abort();
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    abort();
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    abort();
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    abort();
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    abort();
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    abort();
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    abort();
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    abort();
+}
+
+void *httpd_sess_get_transport_ctx(httpd_handle_t handle, int sockfd)
+{
+    abort();
+}
+
+void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    abort();
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
+{
+    abort();
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    abort();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    abort();
+}
+
+void wifi_power_busy_begin(wifi_power_busy_e reason)
+{
+    abort();
+}
+
+void wifi_power_busy_end(wifi_power_busy_e reason)
+{
+    abort();
+}
+
+const char *http_method_str(enum http_method m)
+{
+    abort();
+}
+
+static esp_err_t test_handler(httpd_req_t *req)
+{
+    return ESP_OK;
+}
+
+/*
+ * Routes shaped like the firmware's: JSON endpoints, some with a POST as
+ * well, and versioned web assets.
+ */
+static char route_paths[BENCH_MAX_ROUTES][48];
+static http_route_t routes[BENCH_MAX_ROUTES];
+
+static size_t test_make_routes(size_t count)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; n < count; i++)
+    {
+        if (i % 3 == 2)
+        {
+            snprintf(route_paths[i],
+                     sizeof(route_paths[i]),
+                     "/assets/app%03zu.%08x.js",
+                     i,
+                     (unsigned)(i * 2654435761u));
+        }
+        else
+        {
+            snprintf(route_paths[i], sizeof(route_paths[i]), "/api/endpoint%03zu.json", i);
+        }
+        routes[n++] = (http_route_t){.path = route_paths[i], .method = HTTP_GET, .handler = test_handler};
+        if (i % 4 == 0 && n < count)
+        {
+            routes[n++] = (http_route_t){.path = route_paths[i], .method = HTTP_POST, .handler = test_handler};
+        }
+    }
+    return n;
+}
+
+/*
+ * What httpd does without the router: every URI handler in registration
+ * order, matched on the method and the whole path.
+ */
+static const http_route_t *linear_lookup(const http_route_t *table,
+                                         size_t count,
+                                         httpd_method_t method,
+                                         const char *uri)
+{
+    size_t len = strcspn(uri, "?#");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (table[i].method == method && strlen(table[i].path) == len && strncmp(table[i].path, uri, len) == 0)
+        {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Every route is found, with or without a query string, and nothing else.
+ */
+static void test_lookup(size_t count)
+{
+    char uri[96];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        HOST_CHECK(http_router_lookup(routes[i].method, routes[i].path) == &routes[i]);
+        snprintf(uri, sizeof(uri), "%s?v=1234#top", routes[i].path);
+        HOST_CHECK(http_router_lookup(routes[i].method, uri) == &routes[i]);
+
+        // prefix and extension of a route path
+        snprintf(uri, sizeof(uri), "%s", routes[i].path);
+        uri[strlen(uri) - 1] = '\0';
+        HOST_CHECK(http_router_lookup(routes[i].method, uri) == NULL);
+        snprintf(uri, sizeof(uri), "%sx", routes[i].path);
+        HOST_CHECK(http_router_lookup(routes[i].method, uri) == NULL);
+        HOST_CHECK(http_router_lookup(HTTP_PUT, routes[i].path) == NULL);
+    }
+    HOST_CHECK(http_router_lookup(HTTP_GET, "/") == NULL);
+    HOST_CHECK(http_router_lookup(HTTP_GET, "") == NULL);
+    HOST_CHECK(http_router_lookup(HTTP_GET, "/zzz") == NULL);
+}
+
+/*
+ * Lookups of random routes and misses, through the router and the linear
+ * scan of httpd.
+ */
+static void bench_lookup(size_t count)
+{
+    static const char *uris[1024];
+    static httpd_method_t methods[1024];
+    size_t found = 0;
+    size_t linear_found = 0;
+
+    for (size_t i = 0; i < 1024; i++)
+    {
+        // one in eight is a miss
+        const http_route_t *route = &routes[host_test_rand() % count];
+        uris[i] = i % 8 == 7 ? "/api/missing.json" : route->path;
+        methods[i] = route->method;
+    }
+
+    double start = host_test_now_s();
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        found += http_router_lookup(methods[i % 1024], uris[i % 1024]) != NULL;
+    }
+    double router_s = host_test_now_s() - start;
+
+    start = host_test_now_s();
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        linear_found += linear_lookup(routes, count, methods[i % 1024], uris[i % 1024]) != NULL;
+    }
+    double linear_s = host_test_now_s() - start;
+
+    HOST_CHECK_EQ(found, linear_found);
+    printf("http_router: %3zu routes, binary search %5.1f ns, linear scan %6.1f ns per lookup on this host\n",
+           count,
+           router_s * 1e9 / BENCH_LOOKUPS,
+           linear_s * 1e9 / BENCH_LOOKUPS);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    {
+        size_t count = test_make_routes(bench_sizes[i]);
+
+        registered_handlers = 0;
+        HOST_CHECK_EQ(http_router_add_routes(routes, count), ESP_OK);
+        HOST_CHECK_EQ(http_router_uri_handler_count(), 2);
+        HOST_CHECK_EQ(http_router_register(NULL), ESP_OK);
+        // one dispatcher per method, routes cannot be added once registered
+        HOST_CHECK_EQ(registered_handlers, 2);
+        HOST_CHECK_EQ(http_router_add_routes(routes, 1), ESP_ERR_INVALID_STATE);
+
+        test_lookup(count);
+        bench_lookup(count);
+        http_router_reset();
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "json_writer.h"
+
+// Documents written by each path of the benchmark
+#define BENCH_DOCS 1000000
+
+/*
+ * Writes one fixed-point number into a fresh writer and compares the text.
+ */
+static void test_fixed(float value, uint8_t decimals, const char *expected)
+{
+    char buf[64];
+    json_writer_t w;
+
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    json_writer_fixed(&w, NULL, value, decimals);
+    HOST_CHECK_EQ(json_writer_finish(&w), ESP_OK);
+    if (strcmp(buf, expected) != 0)
+    {
+        fprintf(stderr, "fixed(%g, %u): \"%s\" != \"%s\"\n", value, decimals, buf, expected);
+        host_test_failures++;
+    }
+}
+
+static void test_fixed_point(void)
+{
+    test_fixed(21.5f, 1, "21.5");
+    test_fixed(-3.25f, 2, "-3.25");
+    test_fixed(0.05f, 1, "0.1");
+    test_fixed(-0.001f, 1, "0.0");
+    test_fixed(7.0f, 0, "7");
+    test_fixed(1.5f, 9, "1.500000");
+
+    // value * 10^decimals past 2^64
+    test_fixed(1e15f, 6, "null");
+    test_fixed(-1e15f, 6, "null");
+    test_fixed(1e15f, 0, "999999986991104");
+    test_fixed(1e19f, 0, "9999999980506447872");
+    test_fixed(2e19f, 0, "null");
+    test_fixed(NAN, 1, "null");
+    test_fixed(INFINITY, 1, "null");
+    test_fixed(-INFINITY, 0, "null");
+}
+
+static void test_strings_and_nesting(void)
+{
+    char buf[128];
+    json_writer_t w;
+
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    json_writer_begin_object(&w, NULL);
+    json_writer_string(&w, "ssid", "a\"b\\c\n<\x01");
+    json_writer_string_n(&w, "n", "abcdef", 3);
+    json_writer_begin_array(&w, "list");
+    json_writer_int(&w, NULL, INT64_MIN);
+    json_writer_bool(&w, NULL, true);
+    json_writer_null(&w, NULL);
+    json_writer_end_array(&w);
+    json_writer_end_object(&w);
+    HOST_CHECK_EQ(json_writer_finish(&w), ESP_OK);
+    HOST_CHECK(strcmp(buf,
+                      "{\"ssid\":\"a\\\"b\\\\c\\n\\u003c\\u0001\",\"n\":\"abc\","
+                      "\"list\":[-9223372036854775808,true,null]}") == 0);
+
+    // overflow without a sink, and containers left open
+    json_writer_init(&w, buf, 8, NULL, NULL);
+    json_writer_string(&w, NULL, "too long for the buffer");
+    HOST_CHECK_EQ(json_writer_finish(&w), ESP_ERR_INVALID_SIZE);
+
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    json_writer_begin_object(&w, NULL);
+    HOST_CHECK_EQ(json_writer_finish(&w), ESP_ERR_INVALID_STATE);
+}
+
+/*
+ * Collects the flushed chunks.
+ */
+typedef struct test_sink {
+    char text[256];
+    size_t len;
+    int flushes;
+} test_sink_t;
+
+static esp_err_t test_flush(void *ctx, const char *data, size_t len)
+{
+    test_sink_t *sink = ctx;
+
+    memcpy(sink->text + sink->len, data, len);
+    sink->len += len;
+    sink->flushes++;
+    return ESP_OK;
+}
+
+static void test_flush_chunks(void)
+{
+    char buf[7];
+    test_sink_t sink = {0};
+    json_writer_t w;
+
+    json_writer_init(&w, buf, sizeof(buf), test_flush, &sink);
+    json_writer_begin_object(&w, NULL);
+    json_writer_string(&w, "ip", "192.168.1.42");
+    json_writer_fixed_string(&w, "temp", 21.5f, 1);
+    // a failed sensor read
+    json_writer_fixed_string(&w, "humidity", NAN, 1);
+    json_writer_end_object(&w);
+    HOST_CHECK_EQ(json_writer_finish(&w), ESP_OK);
+
+    const char expected[] = "{\"ip\":\"192.168.1.42\",\"temp\":\"21.5\",\"humidity\":null}";
+    HOST_CHECK_EQ(sink.len, strlen(expected));
+    HOST_CHECK_EQ(json_writer_length(&w), strlen(expected));
+    HOST_CHECK(memcmp(sink.text, expected, sink.len) == 0);
+    HOST_CHECK(sink.flushes > 1);
+}
+
+/*
+ * The documents of the DHT sensor and connection info handlers, through the
+ * sprintf path they replaced and through the writer. The length is part of
+ * both, sprintf needed a strlen before httpd_resp_send.
+ */
+static void bench_sprintf_vs_writer(void)
+{
+    char buf[256];
+    volatile float temperature = 21.5f;
+    volatile float humidity = 48.0f;
+    const char *volatile ip = "192.168.1.42";
+    size_t len_sum = 0;
+
+    double start = host_test_now_s();
+    for (int i = 0; i < BENCH_DOCS; i++)
+    {
+        sprintf(buf, "{\"temp\":\"%.1f\",\"humidity\":\"%.1f\"}", temperature, humidity);
+        len_sum += strlen(buf);
+        sprintf(buf,
+                "{\"ip\":\"%s\",\"netmask\":\"%s\",\"gw\":\"%s\",\"ap\":\"%s\"}",
+                ip,
+                "255.255.255.0",
+                "192.168.1.1",
+                "home");
+        len_sum += strlen(buf);
+    }
+    double sprintf_s = host_test_now_s() - start;
+
+    size_t writer_len_sum = 0;
+    start = host_test_now_s();
+    for (int i = 0; i < BENCH_DOCS; i++)
+    {
+        json_writer_t w;
+
+        json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+        json_writer_begin_object(&w, NULL);
+        json_writer_fixed_string(&w, "temp", temperature, 1);
+        json_writer_fixed_string(&w, "humidity", humidity, 1);
+        json_writer_end_object(&w);
+        json_writer_finish(&w);
+        writer_len_sum += json_writer_length(&w);
+
+        json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+        json_writer_begin_object(&w, NULL);
+        json_writer_string(&w, "ip", ip);
+        json_writer_string(&w, "netmask", "255.255.255.0");
+        json_writer_string(&w, "gw", "192.168.1.1");
+        json_writer_string(&w, "ap", "home");
+        json_writer_end_object(&w);
+        json_writer_finish(&w);
+        writer_len_sum += json_writer_length(&w);
+    }
+    double writer_s = host_test_now_s() - start;
+
+    // same documents, same bytes
+    HOST_CHECK_EQ(writer_len_sum, len_sum);
+    printf("json_writer: sprintf+strlen %.0f ns, writer %.0f ns per document pair on this host\n",
+           sprintf_s * 1e9 / BENCH_DOCS,
+           writer_s * 1e9 / BENCH_DOCS);
+}
+
+int main(void)
+{
+    test_fixed_point();
+    test_strings_and_nesting();
+    test_flush_chunks();
+    bench_sprintf_vs_writer();
+    return HOST_TEST_RESULT();
+}
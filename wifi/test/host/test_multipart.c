@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "multipart.h"
+
+// Random bodies fed with random chunk splits
+#define TEST_BODIES 3000
+#define TEST_FILE_MAX_LEN 4096
+// Throughput benchmark
+#define BENCH_FILE_LEN (4 * 1024 * 1024)
+#define BENCH_CHUNK_MAX_LEN 1024
+
+static const char BOUNDARY[] = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+static const char CONTENT_TYPE[] = "multipart/form-data; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+/*
+ * File bytes received by the callback
+ */
+typedef struct test_sink {
+    char *data;
+    size_t len;
+    size_t size;
+} test_sink_t;
+
+static esp_err_t test_on_file_data(void *ctx, const char *data, size_t len)
+{
+    test_sink_t *sink = ctx;
+
+    if (sink->len + len > sink->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    return ESP_OK;
+}
+
+/*
+ * Appends a string to a body.
+ */
+static size_t test_append(char *body, size_t len, const char *s)
+{
+    size_t n = strlen(s);
+    memcpy(body + len, s, n);
+    return len + n;
+}
+
+/*
+ * Fills a file with random bytes seeded with prefixes of the delimiter, the
+ * bytes a parser may hold back at the end of a chunk.
+ */
+static void test_fill_file(char *file, size_t len)
+{
+    char delimiter[MULTIPART_DELIMITER_MAX_LEN + 1];
+    size_t delimiter_len = snprintf(delimiter, sizeof(delimiter), "\r\n--%s", BOUNDARY);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        file[i] = (char)host_test_rand();
+    }
+
+    for (size_t i = 0; len > 0 && i < len / 64 + 1; i++)
+    {
+        size_t at = host_test_rand() % len;
+        // a full delimiter would end the part, keep one byte short
+        size_t n = 1 + host_test_rand() % (delimiter_len - 1);
+        if (n > len - at)
+        {
+            n = len - at;
+        }
+        memcpy(file + at, delimiter, n);
+    }
+
+    // a random byte after a long prefix may complete the delimiter
+    for (char *at = file; (at = memmem(at, file + len - at, delimiter, delimiter_len)) != NULL; at++)
+    {
+        at[delimiter_len - 1] ^= 0x01;
+    }
+}
+
+/*
+ * Builds a body with a text field, the file part and an epilogue.
+ * @return body length
+ */
+static size_t test_build_body(char *body, const char *file, size_t file_len)
+{
+    size_t len = 0;
+
+    len = test_append(body, len, "preamble\r\n--");
+    len = test_append(body, len, BOUNDARY);
+    len = test_append(body, len, "\r\nContent-Disposition: form-data; name=\"note\"\r\n\r\nnot a file\r\n--");
+    len = test_append(body, len, BOUNDARY);
+    len = test_append(body,
+                      len,
+                      "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"wifi.bin\"\r\n"
+                      "Content-Type: application/octet-stream\r\n\r\n");
+    memcpy(body + len, file, file_len);
+    len += file_len;
+    len = test_append(body, len, "\r\n--");
+    len = test_append(body, len, BOUNDARY);
+    len = test_append(body, len, "--\r\nepilogue");
+    return len;
+}
+
+/*
+ * Feeds a body in random chunks of 1 to max_chunk bytes.
+ */
+static esp_err_t test_feed(multipart_parser_t *p, const char *body, size_t len, size_t max_chunk)
+{
+    size_t pos = 0;
+    esp_err_t err = ESP_OK;
+
+    while (pos < len && err == ESP_OK)
+    {
+        size_t n = 1 + host_test_rand() % max_chunk;
+        if (n > len - pos)
+        {
+            n = len - pos;
+        }
+        err = multipart_parser_feed(p, body + pos, n);
+        pos += n;
+    }
+    return err;
+}
+
+static void test_random_splits(void)
+{
+    static char file[TEST_FILE_MAX_LEN];
+    static char body[TEST_FILE_MAX_LEN + 1024];
+    static char received[TEST_FILE_MAX_LEN];
+
+    for (int i = 0; i < TEST_BODIES; i++)
+    {
+        size_t file_len = host_test_rand() % TEST_FILE_MAX_LEN;
+        // mostly small chunks, so boundaries land in every position
+        size_t max_chunk = i % 3 == 0 ? 1 + host_test_rand() % 8 : 1 + host_test_rand() % 1500;
+        test_sink_t sink = {.data = received, .size = sizeof(received)};
+        multipart_parser_t p;
+
+        test_fill_file(file, file_len);
+        size_t body_len = test_build_body(body, file, file_len);
+
+        HOST_CHECK_EQ(multipart_parser_init(&p, CONTENT_TYPE, test_on_file_data, &sink), ESP_OK);
+        HOST_CHECK_EQ(test_feed(&p, body, body_len, max_chunk), ESP_OK);
+        HOST_CHECK_EQ(multipart_parser_finish(&p), ESP_OK);
+        HOST_CHECK_EQ(sink.len, file_len);
+        HOST_CHECK(memcmp(received, file, file_len) == 0);
+        if (host_test_failures > 0)
+        {
+            fprintf(stderr, "body %d: file %zu bytes, chunks up to %zu bytes\n", i, file_len, max_chunk);
+            return;
+        }
+    }
+}
+
+static void test_truncated_and_invalid(void)
+{
+    static char file[256];
+    static char body[2048];
+    static char received[256];
+    test_sink_t sink = {.data = received, .size = sizeof(received)};
+    multipart_parser_t p;
+
+    test_fill_file(file, sizeof(file));
+    size_t body_len = test_build_body(body, file, sizeof(file));
+
+    // no closing delimiter
+    HOST_CHECK_EQ(multipart_parser_init(&p, CONTENT_TYPE, test_on_file_data, &sink), ESP_OK);
+    HOST_CHECK_EQ(test_feed(&p, body, body_len - strlen("--\r\nepilogue") - 1, 64), ESP_OK);
+    HOST_CHECK_EQ(multipart_parser_finish(&p), ESP_ERR_INVALID_SIZE);
+
+    // the closing delimiter bytes are never passed on as data
+    HOST_CHECK(sink.len <= sizeof(file));
+    HOST_CHECK(memcmp(received, file, sink.len) == 0);
+
+    // no boundary, or one too long
+    HOST_CHECK_EQ(multipart_parser_init(&p, "multipart/form-data", test_on_file_data, &sink), ESP_ERR_INVALID_ARG);
+    HOST_CHECK_EQ(multipart_parser_init(&p,
+                                        "multipart/form-data; boundary="
+                                        "0123456789012345678901234567890123456789012345678901234567890123456789X",
+                                        test_on_file_data,
+                                        &sink),
+                  ESP_ERR_INVALID_ARG);
+
+    // quoted boundary
+    sink.len = 0;
+    HOST_CHECK_EQ(multipart_parser_init(&p,
+                                        "multipart/form-data; boundary=\"----WebKitFormBoundary7MA4YWxkTrZu0gW\"",
+                                        test_on_file_data,
+                                        &sink),
+                  ESP_OK);
+    HOST_CHECK_EQ(test_feed(&p, body, body_len, 64), ESP_OK);
+    HOST_CHECK_EQ(multipart_parser_finish(&p), ESP_OK);
+    HOST_CHECK_EQ(sink.len, sizeof(file));
+}
+
+/*
+ * Parser throughput with random chunks of up to the OTA receive buffer size.
+ */
+static void bench_throughput(void)
+{
+    char *file = malloc(BENCH_FILE_LEN);
+    char *body = malloc(BENCH_FILE_LEN + 1024);
+    char *received = malloc(BENCH_FILE_LEN);
+    test_sink_t sink = {.data = received, .size = BENCH_FILE_LEN};
+    multipart_parser_t p;
+
+    test_fill_file(file, BENCH_FILE_LEN);
+    size_t body_len = test_build_body(body, file, BENCH_FILE_LEN);
+
+    double start = host_test_now_s();
+    HOST_CHECK_EQ(multipart_parser_init(&p, CONTENT_TYPE, test_on_file_data, &sink), ESP_OK);
+    HOST_CHECK_EQ(test_feed(&p, body, body_len, BENCH_CHUNK_MAX_LEN), ESP_OK);
+    HOST_CHECK_EQ(multipart_parser_finish(&p), ESP_OK);
+    double elapsed = host_test_now_s() - start;
+
+    HOST_CHECK_EQ(sink.len, BENCH_FILE_LEN);
+    printf("multipart: %d bytes in chunks of 1..%d bytes, %.1f MB/s on this host\n",
+           BENCH_FILE_LEN,
+           BENCH_CHUNK_MAX_LEN,
+           body_len / elapsed / 1e6);
+
+    free(file);
+    free(body);
+    free(received);
+}
+
+int main(void)
+{
+    test_random_splits();
+    test_truncated_and_invalid();
+    bench_throughput();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,315 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "host_test.h"
+#include "ota_decoder.h"
+#include "ota_writer.h"
+
+// Synthetic application images, the base runs on the device and the image
+// is the update; tools/ota_pack.py makes the artifacts from them
+#define TEST_BASE_LEN (256 * 1024)
+#define TEST_PARTITION_SIZE (1024 * 1024)
+// Decodes of each artifact, each with its own random chunk sizes
+#define TEST_ROUNDS 40
+
+/*
+ * The running partition the delta copies from, base image then erased flash
+ */
+static uint8_t test_flash[TEST_PARTITION_SIZE];
+static const esp_partition_t test_running = {.address = 0x10000, .size = TEST_PARTITION_SIZE, .label = "ota_0"};
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &test_running;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset > partition->size || size > partition->size - src_offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, test_flash + src_offset, size);
+    return ESP_OK;
+}
+
+/*
+ * ota_writer stub, keeps the decoded image
+ */
+static uint8_t test_written[TEST_PARTITION_SIZE];
+static size_t test_written_len;
+static bool test_writer_active;
+static bool test_writer_ended;
+
+esp_err_t ota_writer_begin(const esp_partition_t *partition, size_t offset)
+{
+    if (test_writer_active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    test_written_len = offset;
+    test_writer_active = true;
+    test_writer_ended = false;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_write(const void *data, size_t len)
+{
+    if (!test_writer_active || len > sizeof(test_written) - test_written_len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(test_written + test_written_len, data, len);
+    test_written_len += len;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_end(void)
+{
+    test_writer_active = false;
+    test_writer_ended = true;
+    return ESP_OK;
+}
+
+void ota_writer_abort(void)
+{
+    test_writer_active = false;
+}
+
+/*
+ * Fills a synthetic image: the header magic, then 16 byte "instructions"
+ * from a small set with random operands, compressible like code.
+ */
+static void test_make_base(uint8_t *image, size_t len)
+{
+    static const uint8_t opcodes[8] = {0x13, 0x33, 0x03, 0x23, 0x63, 0x6f, 0x67, 0x37};
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (i % 16 == 0)
+        {
+            image[i] = opcodes[host_test_rand() % 8];
+        }
+        else
+        {
+            image[i] = i % 4 == 0 ? (uint8_t)host_test_rand() : (uint8_t)i;
+        }
+    }
+    image[0] = 0xE9;
+}
+
+/*
+ * The update: base with a rewritten block, an insertion and a deletion.
+ * @return image length
+ */
+static size_t test_make_image(const uint8_t *base, uint8_t *image)
+{
+    size_t len = 0;
+
+    memcpy(image, base, 40000);
+    len += 40000;
+    for (int i = 0; i < 4096; i++)
+    {
+        image[len++] = (uint8_t)host_test_rand();
+    }
+    memcpy(image + len, base + 44096, 60000);
+    len += 60000;
+    memcpy(image + len, "inserted by the update", 22);
+    len += 22;
+    // 2000 bytes of the base dropped
+    memcpy(image + len, base + 106096, TEST_BASE_LEN - 106096);
+    len += TEST_BASE_LEN - 106096;
+    return len;
+}
+
+static bool test_write_file(const char *dir, const char *name, const uint8_t *data, size_t len)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL && fwrite(data, 1, len, f) == len;
+    if (f != NULL)
+    {
+        ok = fclose(f) == 0 && ok;
+    }
+    return ok;
+}
+
+/*
+ * Reads a file of the artifact directory.
+ * @return malloc'd contents, NULL if missing
+ */
+static uint8_t *test_read_file(const char *dir, const char *name, size_t *len)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: missing\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*len);
+    if (data != NULL && fread(data, 1, *len, f) != *len)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/*
+ * Uploads an artifact in random chunks of 1 to max_chunk bytes.
+ * @return the first error of ota_decoder_write, else that of ota_decoder_end
+ */
+static esp_err_t test_upload(const uint8_t *data, size_t len, size_t max_chunk)
+{
+    esp_err_t err = ota_decoder_begin(&test_running);
+    size_t pos = 0;
+
+    while (err == ESP_OK && pos < len)
+    {
+        size_t n = 1 + host_test_rand() % max_chunk;
+        if (n > len - pos)
+        {
+            n = len - pos;
+        }
+        err = ota_decoder_write(data + pos, n);
+        pos += n;
+    }
+
+    if (err != ESP_OK)
+    {
+        ota_decoder_abort();
+        return err;
+    }
+    return ota_decoder_end();
+}
+
+/*
+ * Decodes an artifact TEST_ROUNDS times and compares with the image.
+ */
+static void test_artifact(const char *name, const uint8_t *data, size_t len, const uint8_t *image, size_t image_len)
+{
+    static const size_t max_chunks[] = {7, 512, 1436, 8192};
+
+    for (int round = 0; round < TEST_ROUNDS; round++)
+    {
+        size_t max_chunk = max_chunks[round % 4];
+        int failures = host_test_failures;
+
+        HOST_CHECK_EQ(test_upload(data, len, max_chunk), ESP_OK);
+        HOST_CHECK(test_writer_ended);
+        HOST_CHECK_EQ(test_written_len, image_len);
+        HOST_CHECK(test_written_len == image_len && memcmp(test_written, image, image_len) == 0);
+        HOST_CHECK(!ota_decoder_is_active());
+        if (host_test_failures != failures)
+        {
+            fprintf(stderr, "%s: round %d, chunks up to %zu bytes\n", name, round, max_chunk);
+            return;
+        }
+    }
+}
+
+/*
+ * Corrupt, truncated and mismatched uploads are rejected and the update is
+ * aborted.
+ */
+static void test_rejected(const uint8_t *z, size_t z_len, const uint8_t *delta, size_t delta_len)
+{
+    static uint8_t buf[TEST_PARTITION_SIZE];
+
+    // truncated zlib stream
+    HOST_CHECK_EQ(test_upload(z, z_len - 10, 1024), ESP_ERR_INVALID_SIZE);
+    HOST_CHECK(!test_writer_active && !test_writer_ended);
+
+    // bytes after the end of the zlib stream
+    memcpy(buf, z, z_len);
+    buf[z_len] = 0;
+    HOST_CHECK_EQ(test_upload(buf, z_len + 1, 1024), ESP_ERR_INVALID_RESPONSE);
+    HOST_CHECK(!test_writer_active && !test_writer_ended);
+
+    // corrupt deflate data
+    memcpy(buf, z, z_len);
+    memset(buf + z_len / 2, 0xff, 64);
+    HOST_CHECK_EQ(test_upload(buf, z_len, 1024), ESP_ERR_INVALID_RESPONSE);
+
+    // unknown format
+    memset(buf, 0, 4096);
+    HOST_CHECK_EQ(test_upload(buf, 4096, 1024), ESP_ERR_NOT_SUPPORTED);
+
+    // delta made against another image than the running one
+    test_flash[1000] ^= 0xff;
+    HOST_CHECK_EQ(test_upload(delta, delta_len, 1024), ESP_ERR_INVALID_VERSION);
+    test_flash[1000] ^= 0xff;
+    HOST_CHECK(!ota_decoder_is_active() && !test_writer_active);
+}
+
+/*
+ * Writes base.bin and wifi.bin for tools/ota_pack.py.
+ */
+static int test_write_images(const char *dir)
+{
+    static uint8_t base[TEST_BASE_LEN];
+    static uint8_t image[TEST_BASE_LEN + 4096];
+
+    test_make_base(base, sizeof(base));
+    size_t image_len = test_make_image(base, image);
+
+    mkdir(dir, 0755);
+    if (!test_write_file(dir, "base.bin", base, sizeof(base)) || !test_write_file(dir, "wifi.bin", image, image_len))
+    {
+        fprintf(stderr, "%s: cannot write the images\n", dir);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--images") == 0)
+    {
+        return test_write_images(argv[2]);
+    }
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s --images <dir> | %s <dir with the ota_pack.py artifacts>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    size_t base_len = 0, image_len = 0, z_len = 0, delta_len = 0;
+    uint8_t *base = test_read_file(argv[1], "base.bin", &base_len);
+    uint8_t *image = test_read_file(argv[1], "wifi.bin", &image_len);
+    uint8_t *z = test_read_file(argv[1], "wifi.bin.z", &z_len);
+    uint8_t *delta = test_read_file(argv[1], "wifi.delta", &delta_len);
+    HOST_CHECK(base != NULL && image != NULL && z != NULL && delta != NULL);
+    if (host_test_failures > 0)
+    {
+        return HOST_TEST_RESULT();
+    }
+
+    memset(test_flash, 0xff, sizeof(test_flash));
+    memcpy(test_flash, base, base_len);
+    printf("ota_decoder: image %zu bytes, wifi.bin.z %zu bytes, wifi.delta %zu bytes\n", image_len, z_len, delta_len);
+
+    test_artifact("wifi.bin", image, image_len, image, image_len);
+    test_artifact("wifi.bin.z", z, z_len, image, image_len);
+    test_artifact("wifi.delta", delta, delta_len, image, image_len);
+    test_rejected(z, z_len, delta, delta_len);
+
+    free(base);
+    free(image);
+    free(z);
+    free(delta);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,319 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "host_test.h"
+#include "nvs.h"
+#include "ota_session.h"
+#include "ota_writer.h"
+
+#define TEST_PARTITION_SIZE (256 * 1024)
+#define TEST_IMAGE_LEN (100 * 1024)
+
+/*
+ * The running and update partitions, their flash and the boot partition set
+ */
+static uint8_t test_flash[TEST_PARTITION_SIZE];
+static uint8_t test_running_flash[TEST_PARTITION_SIZE];
+static const esp_partition_t test_running = {.address = 0x10000, .size = TEST_PARTITION_SIZE, .label = "ota_0"};
+static const esp_partition_t test_update = {.address = 0x110000, .size = TEST_PARTITION_SIZE, .label = "ota_1"};
+static const esp_partition_t *test_boot;
+static int64_t test_now_us = 1000000;
+static uint32_t test_random = 0x1234;
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &test_running;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &test_update;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    test_boot = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    memcpy(dst, (partition == &test_running ? test_running_flash : test_flash) + src_offset, size);
+    return ESP_OK;
+}
+
+uint32_t esp_random(void)
+{
+    test_random = test_random * 1103515245u + 12345u;
+    return test_random;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return test_now_us;
+}
+
+/*
+ * nvs, the saved session. A hook runs while ota_session holds its claim,
+ * standing in for another task calling in at that moment.
+ */
+static app_nvs_ota_session_t test_saved;
+static bool test_has_saved;
+static void (*test_claimed_hook)(void);
+
+esp_err_t app_nvs_save_ota_session(const app_nvs_ota_session_t *session)
+{
+    test_saved = *session;
+    test_has_saved = true;
+    return ESP_OK;
+}
+
+bool app_nvs_load_ota_session(app_nvs_ota_session_t *session)
+{
+    if (test_claimed_hook != NULL)
+    {
+        test_claimed_hook();
+    }
+    *session = test_saved;
+    return test_has_saved;
+}
+
+esp_err_t app_nvs_clear_ota_session(void)
+{
+    test_has_saved = false;
+    return ESP_OK;
+}
+
+/*
+ * ota_writer, writes straight to the flash array. test_writer_taken stands
+ * for an /OTAupdate upload holding the writer.
+ */
+static bool test_writer_active;
+static bool test_writer_taken;
+static size_t test_writer_pos;
+static size_t test_writer_start;
+
+esp_err_t ota_writer_begin(const esp_partition_t *partition, size_t offset)
+{
+    if (test_claimed_hook != NULL)
+    {
+        test_claimed_hook();
+    }
+    if (test_writer_active || test_writer_taken)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    test_writer_active = true;
+    test_writer_pos = offset;
+    test_writer_start = offset;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_write(const void *data, size_t len)
+{
+    memcpy(test_flash + test_writer_pos, data, len);
+    test_writer_pos += len;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_end(void)
+{
+    test_writer_active = false;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_pause(void)
+{
+    test_writer_active = false;
+    return ESP_OK;
+}
+
+void ota_writer_abort(void)
+{
+    test_writer_active = false;
+}
+
+bool ota_writer_is_active(void)
+{
+    return test_writer_active || test_writer_taken;
+}
+
+void ota_writer_get_stats(ota_writer_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->bytes_written = (uint32_t)(test_writer_pos - test_writer_start);
+}
+
+/*
+ * Two images, A and B
+ */
+static uint8_t image_a[TEST_IMAGE_LEN];
+static uint8_t image_b[TEST_IMAGE_LEN];
+static uint8_t sha_a[OTA_SESSION_SHA256_LEN];
+static uint8_t sha_b[OTA_SESSION_SHA256_LEN];
+
+/*
+ * Uploads len bytes of an image from the session offset, then pauses or
+ * completes.
+ * @return the error of ota_session_write_begin or ota_session_write_end
+ */
+static esp_err_t test_upload(uint32_t id, const uint8_t *image, size_t len, bool *complete)
+{
+    ota_session_info_t info;
+
+    *complete = false;
+    HOST_CHECK_EQ(ota_session_get(id, &info), ESP_OK);
+    esp_err_t err = ota_session_write_begin(id, info.offset);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    HOST_CHECK_EQ(ota_session_write(image + info.offset, len), ESP_OK);
+    return ota_session_write_end(complete);
+}
+
+/*
+ * A paused session of one channel is not replaced by another channel's
+ * image, it is resumed by any channel uploading the same image, and replaced
+ * once idle past OTA_SESSION_IDLE_TIMEOUT_S.
+ */
+static void test_channels(void)
+{
+    ota_session_info_t http;
+    ota_session_info_t info;
+    bool complete;
+
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_HTTP, TEST_IMAGE_LEN, sha_a, &http), ESP_OK);
+    HOST_CHECK_EQ(test_upload(http.id, image_a, 40000, &complete), ESP_OK);
+    HOST_CHECK(!complete);
+
+    // another image from MQTT or the manifest poll is rejected, the session is kept
+    test_now_us += 60 * 1000000LL;
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_MQTT, TEST_IMAGE_LEN, sha_b, &info), ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_PULL, TEST_IMAGE_LEN - 1, sha_a, &info), ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(ota_session_get(http.id, &info), ESP_OK);
+    HOST_CHECK_EQ(info.offset, 40000);
+    HOST_CHECK(test_has_saved && test_saved.id == http.id && test_saved.channel == OTA_SESSION_CHANNEL_HTTP);
+
+    // the same image is resumed from any channel
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_PULL, TEST_IMAGE_LEN, sha_a, &info), ESP_OK);
+    HOST_CHECK_EQ(info.id, http.id);
+    HOST_CHECK_EQ(info.offset, 40000);
+
+    // the owner replaces its own session
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_HTTP, TEST_IMAGE_LEN, sha_b, &info), ESP_OK);
+    HOST_CHECK(info.id != http.id);
+    HOST_CHECK_EQ(info.offset, 0);
+    HOST_CHECK_EQ(test_upload(info.id, image_b, 10000, &complete), ESP_OK);
+
+    // an abandoned session stops blocking the other channels
+    test_now_us += (OTA_SESSION_IDLE_TIMEOUT_S - 1) * 1000000LL;
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_MQTT, TEST_IMAGE_LEN, sha_a, &http), ESP_ERR_INVALID_STATE);
+    test_now_us += 2 * 1000000LL;
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_MQTT, TEST_IMAGE_LEN, sha_a, &http), ESP_OK);
+    HOST_CHECK_EQ(http.offset, 0);
+    HOST_CHECK_EQ(test_saved.channel, OTA_SESSION_CHANNEL_MQTT);
+
+    // completed, the digest matches and the image boots
+    HOST_CHECK_EQ(test_upload(http.id, image_a, TEST_IMAGE_LEN, &complete), ESP_OK);
+    HOST_CHECK(complete && test_boot == &test_update);
+    HOST_CHECK(!test_has_saved);
+}
+
+/*
+ * Calls made by "another task" while ota_session holds its claim: in the
+ * middle of an open, and of a write_begin.
+ */
+static ota_session_info_t test_racing_info;
+static esp_err_t test_racing_open;
+static esp_err_t test_racing_write;
+
+static void test_race(void)
+{
+    test_claimed_hook = NULL;
+    test_racing_open = ota_session_open(OTA_SESSION_CHANNEL_PULL, TEST_IMAGE_LEN, sha_a, &test_racing_info);
+    test_racing_write = ota_session_write_begin(test_racing_info.id, 0);
+    test_claimed_hook = test_race;
+}
+
+/*
+ * The busy check and the claim are one step: a second open or write_begin
+ * while a call holds the session gets ESP_ERR_INVALID_STATE, so two channels
+ * never both start writing.
+ */
+static void test_claim(void)
+{
+    ota_session_info_t info;
+    bool complete;
+
+    // during an open
+    test_claimed_hook = test_race;
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_HTTP, TEST_IMAGE_LEN, sha_b, &info), ESP_OK);
+    test_claimed_hook = NULL;
+    HOST_CHECK_EQ(test_racing_open, ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(test_racing_write, ESP_ERR_INVALID_STATE);
+
+    // during a write_begin, and while writing
+    test_claimed_hook = test_race;
+    HOST_CHECK_EQ(ota_session_write_begin(info.id, 0), ESP_OK);
+    test_claimed_hook = NULL;
+    HOST_CHECK_EQ(test_racing_open, ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(test_racing_write, ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(ota_session_write_begin(info.id, 0), ESP_ERR_INVALID_STATE);
+    HOST_CHECK_EQ(ota_session_open(OTA_SESSION_CHANNEL_HTTP, TEST_IMAGE_LEN, sha_b, &info), ESP_ERR_INVALID_STATE);
+    ota_session_discard();
+    HOST_CHECK_EQ(ota_session_write(image_b, 5000), ESP_OK);
+    HOST_CHECK_EQ(ota_session_write_end(&complete), ESP_OK);
+    HOST_CHECK_EQ(ota_session_get(info.id, &info), ESP_OK);
+    HOST_CHECK_EQ(info.offset, 5000);
+
+    // an /OTAupdate upload holds the writer, the session is kept for later
+    test_writer_taken = true;
+    HOST_CHECK_EQ(ota_session_write_begin(info.id, 5000), ESP_ERR_INVALID_STATE);
+    test_writer_taken = false;
+    HOST_CHECK_EQ(ota_session_get(info.id, &info), ESP_OK);
+    HOST_CHECK_EQ(info.offset, 5000);
+    HOST_CHECK_EQ(test_upload(info.id, image_b, TEST_IMAGE_LEN - 5000, &complete), ESP_OK);
+    HOST_CHECK(complete);
+}
+
+/*
+ * A job for the image already running is recognized from its size and
+ * digest, whatever follows the image in the partition.
+ */
+static void test_running_image(void)
+{
+    memset(test_running_flash, 0xff, sizeof(test_running_flash));
+    memcpy(test_running_flash, image_a, TEST_IMAGE_LEN);
+
+    HOST_CHECK(ota_session_is_running_image(TEST_IMAGE_LEN, sha_a));
+    HOST_CHECK(!ota_session_is_running_image(TEST_IMAGE_LEN, sha_b));
+    HOST_CHECK(!ota_session_is_running_image(TEST_IMAGE_LEN - 1, sha_a));
+    HOST_CHECK(!ota_session_is_running_image(TEST_PARTITION_SIZE + 1, sha_a));
+    HOST_CHECK(!ota_session_is_running_image(0, sha_a));
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < TEST_IMAGE_LEN; i++)
+    {
+        image_a[i] = (uint8_t)host_test_rand();
+        image_b[i] = (uint8_t)host_test_rand();
+    }
+    SHA256(image_a, TEST_IMAGE_LEN, sha_a);
+    SHA256(image_b, TEST_IMAGE_LEN, sha_b);
+
+    test_channels();
+    test_claim();
+    test_running_image();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,352 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "web_assets.h"
+#include "web_cache.h"
+
+// URLs the page loads, the root page first
+#define BROWSER_MAX_URLS 16
+#define BROWSER_URL_MAX_LEN 96
+
+/*
+ * Browser cache entry of a URL
+ */
+typedef struct browser_entry {
+    char url[BROWSER_URL_MAX_LEN];
+    char etag[WEB_ASSET_ETAG_MAX_LEN];
+    bool immutable;
+} browser_entry_t;
+
+/*
+ * Browser model: HTTP cache and the bytes of the exchanges
+ */
+typedef struct browser {
+    const char *accept_encoding; // NULL for a client without gzip
+    browser_entry_t cache[BROWSER_MAX_URLS];
+    size_t cached;
+    size_t requests;
+    size_t not_modified;
+    size_t bytes; // requests and responses, headers included
+} browser_t;
+
+static const web_asset_t *find_asset(const char *path, size_t path_len)
+{
+    if (path_len == 1 && path[0] == '/')
+    {
+        path = "/index.html";
+        path_len = strlen(path);
+    }
+    for (size_t i = 0; i < web_assets_count; i++)
+    {
+        if (strlen(web_assets[i].path) == path_len && strncmp(web_assets[i].path, path, path_len) == 0)
+        {
+            return &web_assets[i];
+        }
+    }
+    return NULL;
+}
+
+static browser_entry_t *browser_lookup(browser_t *b, const char *url)
+{
+    for (size_t i = 0; i < b->cached; i++)
+    {
+        if (strcmp(b->cache[i].url, url) == 0)
+        {
+            return &b->cache[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Answers a spliced page as http_server_spliced_page_handler does: the page
+ * with the status snapshot, chunked, no validator and no-store. The snapshot
+ * is sized like the /status.json of a connected device.
+ * @return response length, body included
+ */
+static size_t spliced_page_response(const web_asset_t *asset, char *response, size_t size)
+{
+    static const char state[] = "<script>window.initialState={\"ssid\":\"ESP32_AP\",\"ota\":{\"compile_time\":"
+                                "\"12:00:00\",\"compile_date\":\"Oct 18 2026\"},\"dht\":{\"temp\":21.5,"
+                                "\"humidity\":40.2},\"time\":\"Sun Oct 18 12:00:00 2026\",\"conn\":{\"ap\":"
+                                "\"home\",\"ip\":\"192.168.1.20\",\"netmask\":\"255.255.255.0\",\"gw\":"
+                                "\"192.168.1.1\"}}</script>";
+    size_t body_len = asset->identity_len + sizeof(state) - 1;
+
+    // the size line and CRLF of each chunk: page, script, a few of JSON, page
+    return snprintf(response,
+                    size,
+                    "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n"
+                    "Cache-Control: no-store\r\n\r\n",
+                    asset->mime_type) +
+           body_len + 8 * 8 + 5;
+}
+
+/*
+ * Loads a URL: from the cache while immutable, otherwise a request,
+ * conditional when the cache holds an ETag. The request and response are
+ * sized like those of a browser and httpd.
+ * @return the asset answered with its body, NULL when cached or 304
+ */
+static const web_asset_t *browser_get(browser_t *b, const char *url)
+{
+    char request[512];
+    char response[512];
+    browser_entry_t *entry = browser_lookup(b, url);
+    web_cache_response_t answer;
+
+    if (entry != NULL && entry->immutable)
+    {
+        return NULL;
+    }
+
+    size_t path_len = strcspn(url, "?");
+    const web_asset_t *asset = find_asset(url, path_len);
+    HOST_CHECK(asset != NULL);
+    if (asset == NULL)
+    {
+        return NULL;
+    }
+
+    size_t request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 192.168.0.1\r\n", url);
+    if (b->accept_encoding != NULL)
+    {
+        request_len += snprintf(request + request_len,
+                                sizeof(request) - request_len,
+                                "Accept-Encoding: %s\r\n",
+                                b->accept_encoding);
+    }
+    if (entry != NULL && entry->etag[0] != '\0')
+    {
+        request_len += snprintf(request + request_len,
+                                sizeof(request) - request_len,
+                                "If-None-Match: %s\r\n",
+                                entry->etag);
+    }
+    request_len += 2;
+
+    if (asset->splice_offset >= 0)
+    {
+        b->requests++;
+        b->bytes += request_len + spliced_page_response(asset, response, sizeof(response));
+        if (entry == NULL)
+        {
+            entry = &b->cache[b->cached++];
+            snprintf(entry->url, sizeof(entry->url), "%s", url);
+        }
+        return asset;
+    }
+
+    web_cache_respond(asset,
+                      b->accept_encoding,
+                      url[path_len] == '?' ? url + path_len + 1 : NULL,
+                      entry != NULL ? entry->etag : NULL,
+                      &answer);
+
+    size_t body_len = answer.not_modified ? 0 : answer.encoded ? asset->data_len : asset->identity_len;
+    size_t response_len = snprintf(response,
+                                   sizeof(response),
+                                   "HTTP/1.1 %s\r\nContent-Length: %zu\r\nETag: %s\r\nCache-Control: %s\r\n%s",
+                                   answer.not_modified ? "304 Not Modified" : "200 OK",
+                                   body_len,
+                                   answer.etag,
+                                   answer.cache_control,
+                                   asset->encoding != NULL ? "Vary: Accept-Encoding\r\n" : "");
+    if (!answer.not_modified)
+    {
+        response_len += snprintf(response + response_len,
+                                 sizeof(response) - response_len,
+                                 "Content-Type: %s\r\n",
+                                 asset->mime_type);
+        if (answer.encoded)
+        {
+            response_len += snprintf(response + response_len,
+                                     sizeof(response) - response_len,
+                                     "Content-Encoding: %s\r\n",
+                                     asset->encoding);
+        }
+    }
+    response_len += 2;
+
+    b->requests++;
+    b->not_modified += answer.not_modified;
+    b->bytes += request_len + response_len + body_len;
+
+    if (entry == NULL)
+    {
+        entry = &b->cache[b->cached++];
+        snprintf(entry->url, sizeof(entry->url), "%s", url);
+    }
+    snprintf(entry->etag, sizeof(entry->etag), "%s", answer.etag);
+    entry->immutable = strstr(answer.cache_control, "immutable") != NULL;
+    return answer.not_modified ? NULL : asset;
+}
+
+/*
+ * Loads the dashboard: the root page, then every src and href of it that is
+ * a web asset. /status.json is dynamic and not counted.
+ */
+static void browser_load(browser_t *b, const char *page_html)
+{
+    char html[16384];
+    char url[BROWSER_URL_MAX_LEN];
+
+    const web_asset_t *page = browser_get(b, "/");
+    if (page != NULL)
+    {
+        snprintf(html, sizeof(html), "%.*s", (int)page->identity_len, (const char *)page->identity_data);
+    }
+    else
+    {
+        // the cached copy, same bytes
+        snprintf(html, sizeof(html), "%s", page_html);
+    }
+
+    for (const char *p = html; (p = strpbrk(p, "sh")) != NULL; p++)
+    {
+        size_t attr = strncmp(p, "src=", 4) == 0 ? 4 : strncmp(p, "href=", 5) == 0 ? 5 : 0;
+        if (attr == 0 || (p[attr] != '"' && p[attr] != '\''))
+        {
+            continue;
+        }
+
+        const char *start = p + attr + 1;
+        size_t len = strcspn(start, "\"'");
+        snprintf(url, sizeof(url), "/%.*s", (int)len, start);
+        if (find_asset(url, strcspn(url, "?")) != NULL)
+        {
+            browser_get(b, url);
+        }
+    }
+}
+
+/*
+ * A cold dashboard load, then repeat loads: the page, spliced with the
+ * current state, is requested again and the versioned assets come from the
+ * cache without a request.
+ */
+static void test_replay(const char *accept_encoding)
+{
+    browser_t b = {.accept_encoding = accept_encoding};
+    const web_asset_t *index = find_asset("/", 1);
+    char page_html[16384];
+    size_t asset_bytes = 0;
+
+    HOST_CHECK(index != NULL && index->splice_offset >= 0);
+    if (index == NULL)
+    {
+        return;
+    }
+    snprintf(page_html, sizeof(page_html), "%.*s", (int)index->identity_len, (const char *)index->identity_data);
+    for (size_t i = 0; i < web_assets_count; i++)
+    {
+        bool encoded = accept_encoding != NULL && web_assets[i].encoding != NULL;
+        asset_bytes += encoded ? web_assets[i].data_len : web_assets[i].identity_len;
+    }
+
+    browser_load(&b, page_html);
+    size_t cold_requests = b.requests;
+    size_t cold_bytes = b.bytes;
+    // every asset is referenced by the page, the bodies dominate
+    HOST_CHECK_EQ(cold_requests, web_assets_count);
+    HOST_CHECK(cold_bytes > asset_bytes && cold_bytes < asset_bytes + web_assets_count * 512);
+    for (size_t i = 1; i < b.cached; i++)
+    {
+        HOST_CHECK(b.cache[i].immutable);
+    }
+    HOST_CHECK(!b.cache[0].immutable);
+
+    for (int load = 0; load < 10; load++)
+    {
+        browser_load(&b, page_html);
+    }
+    size_t warm_requests = (b.requests - cold_requests) / 10;
+    size_t warm_bytes = (b.bytes - cold_bytes) / 10;
+    // a single request, for the page
+    HOST_CHECK_EQ(warm_requests, 1);
+    HOST_CHECK_EQ(b.not_modified, 0);
+    HOST_CHECK(warm_bytes < index->identity_len + 1024);
+
+    printf("web_cache: %s, first load %zu requests %zu bytes, repeat load %zu request %zu bytes\n",
+           accept_encoding != NULL ? "gzip" : "identity",
+           cold_requests,
+           cold_bytes,
+           warm_requests,
+           warm_bytes);
+}
+
+static void test_decisions(void)
+{
+    const web_asset_t *asset = NULL;
+    web_cache_response_t r;
+    char etag[WEB_ASSET_ETAG_MAX_LEN];
+    char query[64];
+
+    for (size_t i = 0; i < web_assets_count && asset == NULL; i++)
+    {
+        asset = web_assets[i].encoding != NULL ? &web_assets[i] : NULL;
+    }
+    HOST_CHECK(asset != NULL);
+    if (asset == NULL)
+    {
+        return;
+    }
+
+    // encodings
+    web_cache_respond(asset, "gzip, deflate, br", NULL, NULL, &r);
+    HOST_CHECK(r.encoded && !r.not_modified);
+    snprintf(etag, sizeof(etag), "\"%s-gzip\"", asset->hash);
+    HOST_CHECK(strcmp(r.etag, etag) == 0);
+    HOST_CHECK(strcmp(r.cache_control, WEB_CACHE_CONTROL_REVALIDATE) == 0);
+    web_cache_respond(asset, "gzip;q=0, deflate", NULL, NULL, &r);
+    HOST_CHECK(!r.encoded);
+    web_cache_respond(asset, "gzip;q=0.5", NULL, NULL, &r);
+    HOST_CHECK(r.encoded);
+    web_cache_respond(asset, NULL, NULL, NULL, &r);
+    HOST_CHECK(!r.encoded);
+    snprintf(etag, sizeof(etag), "\"%s\"", asset->hash);
+    HOST_CHECK(strcmp(r.etag, etag) == 0);
+
+    // versions
+    snprintf(query, sizeof(query), "v=%s", asset->hash);
+    web_cache_respond(asset, NULL, query, NULL, &r);
+    HOST_CHECK(strcmp(r.cache_control, WEB_CACHE_CONTROL_IMMUTABLE) == 0);
+    snprintf(query, sizeof(query), "x=1&v=%s", asset->hash);
+    web_cache_respond(asset, NULL, query, NULL, &r);
+    HOST_CHECK(strcmp(r.cache_control, WEB_CACHE_CONTROL_IMMUTABLE) == 0);
+    snprintf(query, sizeof(query), "v=%s0", asset->hash);
+    web_cache_respond(asset, NULL, query, NULL, &r);
+    HOST_CHECK(strcmp(r.cache_control, WEB_CACHE_CONTROL_REVALIDATE) == 0);
+    snprintf(query, sizeof(query), "vv=%s", asset->hash);
+    web_cache_respond(asset, NULL, query, NULL, &r);
+    HOST_CHECK(strcmp(r.cache_control, WEB_CACHE_CONTROL_REVALIDATE) == 0);
+
+    // validators: the identity ETag does not validate the gzip representation
+    web_cache_respond(asset, "gzip", NULL, etag, &r);
+    HOST_CHECK(!r.not_modified);
+    web_cache_respond(asset, NULL, NULL, etag, &r);
+    HOST_CHECK(r.not_modified);
+    web_cache_respond(asset, "gzip", NULL, "*", &r);
+    HOST_CHECK(r.not_modified);
+    snprintf(query, sizeof(query), "\"0123\", \"%s-gzip\"", asset->hash);
+    web_cache_respond(asset, "gzip", NULL, query, &r);
+    HOST_CHECK(r.not_modified);
+
+    // new firmware, the asset hash changed
+    web_asset_t updated = *asset;
+    updated.hash = "0000000000000000";
+    snprintf(etag, sizeof(etag), "\"%s-gzip\"", asset->hash);
+    web_cache_respond(&updated, "gzip", NULL, etag, &r);
+    HOST_CHECK(!r.not_modified);
+}
+
+int main(void)
+{
+    test_decisions();
+    test_replay("gzip, deflate");
+    test_replay(NULL);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,357 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_netif_types.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "event_bus.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "wifi_event.h"
+#include "wifi_link.h"
+#include "wifi_reconnect.h"
+#include "wifi_state.h"
+
+// Disconnect events of the flapping access point
+#define TEST_DISCONNECTS 10000
+
+/*
+ * Heap calls of the modules under test, linked with -Wl,--wrap so every
+ * malloc and free of their objects lands here. Counting is switched on
+ * once the subscribers are set up, as on the target after boot.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static bool heap_counting;
+static size_t heap_allocs;
+static size_t heap_frees;
+
+void *__wrap_malloc(size_t size)
+{
+    heap_allocs += heap_counting;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    heap_allocs += heap_counting;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    heap_allocs += heap_counting;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    heap_frees += heap_counting && ptr != NULL;
+    __real_free(ptr);
+}
+
+// Event bases of the driver, defined by esp_event on the target
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+/*
+ * The IDF functions the event path calls, on a simulated clock. Semaphores
+ * and timers are static, created before the counting starts.
+ */
+static int64_t test_now_us = 1000000;
+static int test_semaphores[EVENT_BUS_MAX_SUBSCRIBERS];
+static size_t test_semaphore_count;
+static int test_timer;
+static int8_t test_ap_rssi = -60;
+
+int64_t esp_timer_get_time(void)
+{
+    return test_now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    *out_handle = (esp_timer_handle_t)&test_timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    ap_info->rssi = test_ap_rssi;
+    return ESP_OK;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    if (test_semaphore_count == EVENT_BUS_MAX_SUBSCRIBERS)
+    {
+        return NULL;
+    }
+    return (SemaphoreHandle_t)&test_semaphores[test_semaphore_count++];
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    *(int *)semaphore = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    int given = *(int *)semaphore;
+    *(int *)semaphore = 0;
+    return given ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *param,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    abort();
+}
+
+/*
+ * The wifi app task side: its subscriber and what wifi_event.c asked of it,
+ * and the page's subscriber which only drains now and then.
+ */
+static event_bus_subscriber_t *app_subscriber;
+static event_bus_subscriber_t *page_subscriber;
+static uint32_t app_disconnect_events;
+static uint16_t app_last_reason;
+static int8_t app_last_rssi;
+static uint32_t app_connects;
+static uint32_t app_retry_starts;
+static uint32_t app_retry_max_ms;
+static uint32_t app_links_lost;
+static uint32_t app_attempts_failed;
+static uint32_t app_connected;
+
+static void app_connect(void)
+{
+    app_connects++;
+}
+
+static void app_retry_start(uint32_t delay_ms)
+{
+    app_retry_starts++;
+    if (delay_ms > app_retry_max_ms)
+    {
+        app_retry_max_ms = delay_ms;
+    }
+}
+
+static void app_retry_stop(void)
+{
+}
+
+static void app_link_lost(void)
+{
+    app_links_lost++;
+}
+
+static void app_attempt_failed(wifi_state_origin_e origin)
+{
+    HOST_CHECK_EQ(origin, WIFI_STATE_ORIGIN_SAVED);
+    app_attempts_failed++;
+}
+
+static void app_connected_cb(const event_bus_event_t *event, wifi_state_origin_e origin)
+{
+    HOST_CHECK_EQ(event->data.sta_got_ip.ip_info.ip.addr, 0x0a00a8c0);
+    HOST_CHECK_EQ(origin, WIFI_STATE_ORIGIN_SAVED);
+    app_connected++;
+}
+
+static const wifi_event_actions_t app_actions = {
+    .connect = app_connect,
+    .retry_start = app_retry_start,
+    .retry_stop = app_retry_stop,
+    .link_lost = app_link_lost,
+    .attempt_failed = app_attempt_failed,
+    .connected = app_connected_cb,
+};
+
+/*
+ * What the driver hands wifi_app_event_handler for the station events
+ */
+static void test_driver_connected(void)
+{
+    wifi_event_sta_connected_t connected = {.ssid = "flapping", .ssid_len = 8, .channel = 6};
+
+    HOST_CHECK(wifi_event_from_driver(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected));
+}
+
+static void test_driver_got_ip(void)
+{
+    ip_event_got_ip_t got_ip = {.ip_info.ip.addr = 0x0a00a8c0};
+
+    HOST_CHECK(wifi_event_from_driver(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip));
+}
+
+static void test_driver_disconnected(uint16_t reason, int8_t rssi)
+{
+    wifi_event_sta_disconnected_t disconnected = {.reason = reason, .rssi = rssi};
+
+    HOST_CHECK(wifi_event_from_driver(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnected));
+}
+
+/*
+ * Runs the wifi app task until its lanes are empty.
+ */
+static void app_run(void)
+{
+    event_bus_event_t event;
+
+    while (event_bus_receive(app_subscriber, &event, 0))
+    {
+        if (event.id == EVENT_BUS_WIFI_STA_DISCONNECTED)
+        {
+            app_disconnect_events++;
+            app_last_reason = event.data.sta_disconnected.reason;
+            app_last_rssi = event.data.sta_disconnected.rssi;
+        }
+        wifi_event_handle(&event);
+    }
+}
+
+/*
+ * An access point dropping the station TEST_DISCONNECTS times: each outage
+ * has a few failed attempts before the link is back. The whole path, from
+ * the driver event to the state machine and the reconnect scheduler, runs
+ * without a heap call and every event arrives with its data.
+ */
+static void test_flapping(void)
+{
+    event_bus_lane_stats_t stats[EVENT_BUS_LANE_COUNT];
+    wifi_link_info_t link;
+    wifi_state_machine_t state;
+    wifi_reconnect_stats_t reconnect_stats;
+    size_t sent = 0;
+    size_t outages = 0;
+
+    app_subscriber = event_bus_subscribe(EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_CONNECTED) |
+                                         EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_GOT_IP) |
+                                         EVENT_BUS_BIT(EVENT_BUS_WIFI_STA_DISCONNECTED));
+    page_subscriber = event_bus_subscribe(EVENT_BUS_BIT(EVENT_BUS_WIFI_STATE_CHANGED));
+    HOST_CHECK(app_subscriber != NULL && page_subscriber != NULL);
+    if (app_subscriber == NULL || page_subscriber == NULL)
+    {
+        return;
+    }
+    wifi_link_init();
+    wifi_event_init(&app_actions, 1, test_now_us);
+    HOST_CHECK(wifi_event_dispatch(WIFI_STATE_EV_CONNECT_SAVED, test_now_us));
+    // neither a base nor an event of the station
+    HOST_CHECK(!wifi_event_from_driver(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, NULL));
+    HOST_CHECK(!wifi_event_from_driver("OTHER_EVENT", WIFI_EVENT_STA_CONNECTED, NULL));
+
+    heap_counting = true;
+    while (sent < TEST_DISCONNECTS)
+    {
+        test_now_us += 1000000 + host_test_rand() % 60000000;
+        test_driver_connected();
+        test_now_us += 50000;
+        test_driver_got_ip();
+        app_run();
+
+        // the outage, the first disconnect drops the link, the others are
+        // failed attempts
+        size_t failures = 1 + host_test_rand() % 3;
+        for (size_t i = 0; i < failures && sent < TEST_DISCONNECTS; i++)
+        {
+            test_now_us += 500000 + host_test_rand() % 5000000;
+            uint16_t reason = (uint16_t)(1 + host_test_rand() % 210);
+            test_ap_rssi = (int8_t)(-50 - host_test_rand() % 40);
+            test_driver_disconnected(reason, test_ap_rssi);
+            sent++;
+            // a burst of events waits for the task now and then
+            if (host_test_rand() % 4 != 0)
+            {
+                app_run();
+                HOST_CHECK_EQ(app_last_reason, reason);
+                HOST_CHECK_EQ(app_last_rssi, test_ap_rssi);
+            }
+        }
+        app_run();
+        outages++;
+
+        // the page drains its notifications once in a while
+        if (outages % 16 == 0)
+        {
+            event_bus_event_t event;
+            while (event_bus_receive(page_subscriber, &event, 0))
+            {
+            }
+        }
+    }
+    heap_counting = false;
+
+    wifi_link_get(&link);
+    event_bus_get_stats(stats);
+    wifi_event_get_state_machine(&state);
+    wifi_event_get_reconnect_stats(&reconnect_stats);
+    HOST_CHECK_EQ(heap_allocs, 0);
+    HOST_CHECK_EQ(heap_frees, 0);
+    HOST_CHECK_EQ(link.disconnects, TEST_DISCONNECTS);
+    HOST_CHECK(!link.associated && !link.has_ip);
+    // the last event arrived by value, with the data of the driver event
+    HOST_CHECK_EQ(link.history[(link.disconnects - 1) % WIFI_LINK_REASON_HISTORY_LEN].reason, app_last_reason);
+    HOST_CHECK_EQ(app_last_rssi, test_ap_rssi);
+    // bursts coalesce on the high lane, the latest disconnect counts the
+    // others so the backoff sees every one
+    HOST_CHECK_EQ(reconnect_stats.attempts, TEST_DISCONNECTS);
+    HOST_CHECK(app_disconnect_events < TEST_DISCONNECTS);
+    // each disconnect event delivered took the link down and scheduled one
+    // attempt, within the backoff cap, and each outage ended on GOT_IP
+    HOST_CHECK_EQ(app_links_lost, app_disconnect_events);
+    HOST_CHECK_EQ(app_connects + app_retry_starts, app_disconnect_events);
+    HOST_CHECK(app_retry_max_ms <= WIFI_RECONNECT_MAX_MS);
+    HOST_CHECK(app_attempts_failed > 0 && app_attempts_failed < app_disconnect_events);
+    HOST_CHECK_EQ(app_connected, outages);
+    HOST_CHECK_EQ(state.metrics.outages, outages);
+    HOST_CHECK_EQ(stats[EVENT_BUS_LANE_HIGH].dropped, 0);
+    HOST_CHECK(stats[EVENT_BUS_LANE_LOW].max_depth <= 1);
+    HOST_CHECK_EQ(state.state, WIFI_STATE_RECONNECTING);
+
+    printf("wifi_event_path: %d disconnects over %zu outages, %u events to the task, %zu heap calls\n",
+           TEST_DISCONNECTS,
+           outages,
+           app_disconnect_events,
+           heap_allocs + heap_frees);
+}
+
+int main(void)
+{
+    test_flapping();
+    return HOST_TEST_RESULT();
+}
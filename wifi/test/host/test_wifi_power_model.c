@@ -0,0 +1,174 @@
+#include <stdint.h>
+
+#include "host_test.h"
+#include "wifi_power_model.h"
+
+#define HOUR_US 3600000000ULL
+// Wake up intervals of the balanced (DTIM 1) and low-power (10 beacons) profiles
+#define DTIM_US WIFI_POWER_MODEL_BEACON_US
+#define LISTEN_10_US (10 * WIFI_POWER_MODEL_BEACON_US)
+
+/*
+ * Energy of a radio on time and a total time, in floating point.
+ */
+static double expected_energy_mj(double radio_on_us, double elapsed_us)
+{
+    double asleep_us = elapsed_us - radio_on_us;
+    double charge_mc = (radio_on_us * WIFI_POWER_MODEL_RX_MA + asleep_us * WIFI_POWER_MODEL_SLEEP_MA) / 1e6;
+    return charge_mc * WIFI_POWER_MODEL_SUPPLY_MV / 1000;
+}
+
+/*
+ * Checks the integer energy against the floating point one, the integer
+ * math truncates twice.
+ */
+static void check_energy(const wifi_power_model_t *m, double radio_on_us, double elapsed_us)
+{
+    double expected = expected_energy_mj(radio_on_us, elapsed_us);
+    uint32_t energy = wifi_power_model_energy_mj(m);
+
+    if (energy > expected + 0.5 || energy < expected - 4)
+    {
+        fprintf(stderr, "energy %u mJ, expected %.1f mJ\n", energy, expected);
+        host_test_failures++;
+    }
+}
+
+static void test_awake(void)
+{
+    wifi_power_model_t m;
+
+    wifi_power_model_init(&m);
+    wifi_power_model_advance(&m, 0, HOUR_US);
+    HOST_CHECK_EQ(m.radio_on_us, HOUR_US);
+    HOST_CHECK_EQ(m.wakeups, 0);
+    HOST_CHECK_EQ(wifi_power_model_latency_ms(&m), 0);
+    // 80 mA at 3.3 V for an hour
+    HOST_CHECK_EQ(wifi_power_model_energy_mj(&m), 950400);
+
+    // an awake receiver is already counted
+    wifi_power_model_tx(&m, 0);
+    HOST_CHECK_EQ(m.radio_on_us, HOUR_US);
+    HOST_CHECK_EQ(m.tx_count, 1);
+}
+
+static void test_modem_sleep(void)
+{
+    wifi_power_model_t m;
+    uint64_t wakeups = HOUR_US / DTIM_US;
+
+    wifi_power_model_init(&m);
+    wifi_power_model_advance(&m, DTIM_US, HOUR_US);
+    HOST_CHECK_EQ(m.wakeups, wakeups);
+    HOST_CHECK_EQ(m.radio_on_us, wakeups * WIFI_POWER_MODEL_BEACON_RX_US);
+    HOST_CHECK_EQ(m.residual_us, HOUR_US % DTIM_US);
+    // frames wait half an interval
+    HOST_CHECK_EQ(wifi_power_model_latency_ms(&m), DTIM_US / 2 / 1000);
+    check_energy(&m, (double)m.radio_on_us, (double)HOUR_US);
+
+    wifi_power_model_tx(&m, DTIM_US);
+    HOST_CHECK_EQ(m.radio_on_us, wakeups * WIFI_POWER_MODEL_BEACON_RX_US + WIFI_POWER_MODEL_TX_US);
+}
+
+/*
+ * Advancing in small steps counts the same wake ups as one large step, the
+ * time between the steps is carried over.
+ */
+static void test_steps(void)
+{
+    wifi_power_model_t once;
+    wifi_power_model_t steps;
+    uint64_t total_us = 0;
+
+    wifi_power_model_init(&steps);
+    while (total_us < HOUR_US)
+    {
+        uint64_t step_us = 1 + host_test_rand() % 250000;
+        wifi_power_model_advance(&steps, LISTEN_10_US, step_us);
+        total_us += step_us;
+    }
+    wifi_power_model_init(&once);
+    wifi_power_model_advance(&once, LISTEN_10_US, total_us);
+
+    HOST_CHECK_EQ(steps.elapsed_us, once.elapsed_us);
+    HOST_CHECK_EQ(steps.wakeups, once.wakeups);
+    HOST_CHECK_EQ(steps.radio_on_us, once.radio_on_us);
+    HOST_CHECK_EQ(steps.residual_us, once.residual_us);
+    HOST_CHECK_EQ(steps.latency_us_x_us, once.latency_us_x_us);
+}
+
+/*
+ * Half the time awake and half asleep, and a radio on time past the elapsed
+ * time (many transmissions) which is clamped.
+ */
+static void test_mixed_and_clamp(void)
+{
+    wifi_power_model_t m;
+
+    wifi_power_model_init(&m);
+    wifi_power_model_advance(&m, 0, HOUR_US / 2);
+    wifi_power_model_advance(&m, DTIM_US, HOUR_US / 2);
+    HOST_CHECK_EQ(wifi_power_model_latency_ms(&m), DTIM_US / 4 / 1000);
+    check_energy(&m, (double)m.radio_on_us, (double)HOUR_US);
+    // the wake up count restarts after the awake period
+    HOST_CHECK_EQ(m.wakeups, HOUR_US / 2 / DTIM_US);
+
+    wifi_power_model_init(&m);
+    HOST_CHECK_EQ(wifi_power_model_energy_mj(&m), 0);
+    HOST_CHECK_EQ(wifi_power_model_latency_ms(&m), 0);
+    wifi_power_model_advance(&m, DTIM_US, 1000000);
+    for (int i = 0; i < 100; i++)
+    {
+        wifi_power_model_tx(&m, DTIM_US);
+    }
+    HOST_CHECK(m.radio_on_us > m.elapsed_us);
+    check_energy(&m, 1000000, 1000000);
+}
+
+/*
+ * The three profiles over one simulated hour with a publish every 60 s,
+ * the estimates are ordered as the profiles are meant to be.
+ */
+static void test_profiles_timeline(void)
+{
+    static const struct {
+        const char *name;
+        uint32_t wake_interval_us;
+    } profiles[] = {{"performance", 0}, {"balanced", DTIM_US}, {"low-power", LISTEN_10_US}};
+    uint32_t energy[3];
+    uint32_t latency[3];
+
+    for (int p = 0; p < 3; p++)
+    {
+        wifi_power_model_t m;
+
+        wifi_power_model_init(&m);
+        for (uint64_t t = 0; t < HOUR_US; t += 60000000)
+        {
+            wifi_power_model_advance(&m, profiles[p].wake_interval_us, 60000000);
+            wifi_power_model_tx(&m, profiles[p].wake_interval_us);
+        }
+        energy[p] = wifi_power_model_energy_mj(&m);
+        latency[p] = wifi_power_model_latency_ms(&m);
+        printf("wifi_power_model: %-11s radio on %5.1f%%, %6u mJ, latency %3u ms over one hour\n",
+               profiles[p].name,
+               100.0 * m.radio_on_us / m.elapsed_us,
+               energy[p],
+               latency[p]);
+    }
+
+    HOST_CHECK(energy[0] > energy[1] && energy[1] > energy[2]);
+    HOST_CHECK(latency[0] < latency[1] && latency[1] < latency[2]);
+    // never below the sleep current alone
+    HOST_CHECK(energy[2] > (uint32_t)expected_energy_mj(0, HOUR_US));
+}
+
+int main(void)
+{
+    test_awake();
+    test_modem_sleep();
+    test_steps();
+    test_mixed_and_clamp();
+    test_profiles_timeline();
+    return HOST_TEST_RESULT();
+}
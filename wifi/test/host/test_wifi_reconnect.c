@@ -0,0 +1,156 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "host_test.h"
+#include "wifi_reconnect.h"
+
+// Outages simulated per seed
+#define TEST_OUTAGES 200
+#define TEST_SEEDS 50
+
+/*
+ * The delay before the first retry and the bounds of the following ones.
+ */
+static void test_backoff_bounds(void)
+{
+    wifi_reconnect_t r;
+
+    for (uint32_t seed = 0; seed < TEST_SEEDS; seed++)
+    {
+        wifi_reconnect_init(&r, seed);
+        HOST_CHECK_EQ(wifi_reconnect_on_disconnect(&r, 1000000), 0);
+
+        for (uint32_t attempt = 1; attempt < 100; attempt++)
+        {
+            uint64_t backoff = (uint64_t)WIFI_RECONNECT_BASE_MS << (attempt < 40 ? attempt - 1 : 40);
+            uint32_t delay = backoff < WIFI_RECONNECT_MAX_MS ? (uint32_t)backoff : WIFI_RECONNECT_MAX_MS;
+            uint32_t ms = wifi_reconnect_on_disconnect(&r, 1000000 + attempt);
+
+            // equal jitter: between half the backoff and the backoff, never past the cap
+            HOST_CHECK(ms >= delay / 2);
+            HOST_CHECK(ms <= delay);
+            HOST_CHECK(ms <= WIFI_RECONNECT_MAX_MS);
+        }
+        // never gives up
+        HOST_CHECK_EQ(r.attempt, 100);
+    }
+}
+
+/*
+ * The jitter spreads the retries of devices losing the same access point.
+ */
+static void test_jitter_spread(void)
+{
+    uint32_t min_ms = UINT32_MAX;
+    uint32_t max_ms = 0;
+    uint64_t sum_ms = 0;
+    uint32_t capped = 0;
+
+    for (uint32_t seed = 1; seed <= 1000; seed++)
+    {
+        wifi_reconnect_t r;
+        uint32_t ms = 0;
+
+        wifi_reconnect_init(&r, seed * 2654435761u);
+        for (int attempt = 0; attempt < 20; attempt++)
+        {
+            ms = wifi_reconnect_on_disconnect(&r, 1);
+        }
+        min_ms = ms < min_ms ? ms : min_ms;
+        max_ms = ms > max_ms ? ms : max_ms;
+        sum_ms += ms;
+        capped += ms == WIFI_RECONNECT_MAX_MS;
+    }
+
+    // at the cap the delays cover most of [cap / 2, cap] and average 3/4 of it
+    HOST_CHECK(min_ms < WIFI_RECONNECT_MAX_MS / 2 + WIFI_RECONNECT_MAX_MS / 20);
+    HOST_CHECK(max_ms > WIFI_RECONNECT_MAX_MS - WIFI_RECONNECT_MAX_MS / 20);
+    HOST_CHECK(sum_ms / 1000 > WIFI_RECONNECT_MAX_MS * 7 / 10);
+    HOST_CHECK(sum_ms / 1000 < WIFI_RECONNECT_MAX_MS * 8 / 10);
+    HOST_CHECK(capped < 10);
+}
+
+/*
+ * Outages of random length on a simulated clock, the recoveries take the
+ * scheduled delays and the statistics add up.
+ */
+static void test_simulated_outages(void)
+{
+    wifi_reconnect_t r;
+    int64_t now_us = 5000000;
+    uint32_t attempts = 0;
+    uint64_t total_ms = 0;
+    uint32_t max_ms = 0;
+
+    wifi_reconnect_init(&r, 42);
+    for (int outage = 0; outage < TEST_OUTAGES; outage++)
+    {
+        // the access point comes back after this many failed attempts
+        uint32_t failures = host_test_rand() % 12;
+        int64_t lost_us = now_us;
+
+        for (uint32_t i = 0; i <= failures; i++)
+        {
+            now_us += (int64_t)wifi_reconnect_on_disconnect(&r, now_us) * 1000;
+            // an attempt takes a few seconds to fail or connect
+            now_us += 2000000;
+            attempts++;
+        }
+        wifi_reconnect_on_connected(&r, now_us);
+
+        uint32_t elapsed_ms = (uint32_t)((now_us - lost_us) / 1000);
+        HOST_CHECK_EQ(r.stats.last_ms, elapsed_ms);
+        HOST_CHECK_EQ(r.attempt, 0);
+        HOST_CHECK_EQ(r.disconnected_us, 0);
+        total_ms += elapsed_ms;
+        max_ms = elapsed_ms > max_ms ? elapsed_ms : max_ms;
+
+        // connected for a while
+        now_us += (int64_t)(1 + host_test_rand() % 600) * 1000000;
+    }
+
+    HOST_CHECK_EQ(r.stats.disconnects, TEST_OUTAGES);
+    HOST_CHECK_EQ(r.stats.reconnects, TEST_OUTAGES);
+    HOST_CHECK_EQ(r.stats.attempts, attempts);
+    HOST_CHECK_EQ(r.stats.total_ms, total_ms);
+    HOST_CHECK_EQ(r.stats.max_ms, max_ms);
+    printf("wifi_reconnect: %d outages, %u attempts, average time to reconnect %llu ms, max %u ms\n",
+           TEST_OUTAGES,
+           attempts,
+           (unsigned long long)(total_ms / TEST_OUTAGES),
+           max_ms);
+}
+
+/*
+ * A reset forgets the outage but keeps the statistics, a connection without
+ * an outage is not a recovery.
+ */
+static void test_reset(void)
+{
+    wifi_reconnect_t r;
+
+    wifi_reconnect_init(&r, 0);
+    HOST_CHECK(r.rng != 0);
+    wifi_reconnect_on_connected(&r, 1000);
+    HOST_CHECK_EQ(r.stats.reconnects, 0);
+
+    wifi_reconnect_on_disconnect(&r, 0);
+    // a disconnect at time 0 still counts as an outage
+    HOST_CHECK(r.disconnected_us != 0);
+    wifi_reconnect_on_disconnect(&r, 1000);
+    wifi_reconnect_reset(&r);
+    HOST_CHECK_EQ(r.attempt, 0);
+    HOST_CHECK_EQ(r.stats.disconnects, 1);
+    HOST_CHECK_EQ(r.stats.attempts, 2);
+    HOST_CHECK_EQ(wifi_reconnect_on_disconnect(&r, 2000), 0);
+    HOST_CHECK_EQ(r.stats.disconnects, 2);
+}
+
+int main(void)
+{
+    test_backoff_bounds();
+    test_jitter_spread();
+    test_simulated_outages();
+    test_reset();
+    return HOST_TEST_RESULT();
+}
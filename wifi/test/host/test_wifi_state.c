@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "wifi_state.h"
+
+// No transition for the event in the state
+#define NONE -1
+
+/*
+ * The expected table, written out state by state
+ */
+static const int expected_next[WIFI_STATE_COUNT][WIFI_STATE_EV_COUNT] = {
+    [WIFI_STATE_IDLE] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = NONE,
+            [WIFI_STATE_EV_GOT_IP] = NONE,
+            [WIFI_STATE_EV_LINK_DOWN] = NONE,
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = NONE,
+        },
+    [WIFI_STATE_CONNECTING] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = NONE,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_GOT_IP] = WIFI_STATE_CONNECTED,
+            [WIFI_STATE_EV_LINK_DOWN] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_GIVE_UP] = WIFI_STATE_FAILED,
+            [WIFI_STATE_EV_USER_DISCONNECT] = WIFI_STATE_DISCONNECTING,
+        },
+    [WIFI_STATE_CONNECTED] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = NONE,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = NONE,
+            [WIFI_STATE_EV_GOT_IP] = WIFI_STATE_CONNECTED,
+            [WIFI_STATE_EV_LINK_DOWN] = WIFI_STATE_RECONNECTING,
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = WIFI_STATE_DISCONNECTING,
+        },
+    [WIFI_STATE_RECONNECTING] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = NONE,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = WIFI_STATE_RECONNECTING,
+            [WIFI_STATE_EV_GOT_IP] = WIFI_STATE_CONNECTED,
+            [WIFI_STATE_EV_LINK_DOWN] = WIFI_STATE_RECONNECTING,
+            // a network that connected is never given up on
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = WIFI_STATE_DISCONNECTING,
+        },
+    [WIFI_STATE_FAILED] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = NONE,
+            [WIFI_STATE_EV_GOT_IP] = NONE,
+            [WIFI_STATE_EV_LINK_DOWN] = NONE,
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = NONE,
+        },
+    [WIFI_STATE_DISCONNECTING] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = NONE,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = NONE,
+            // a late GOT_IP while disconnecting
+            [WIFI_STATE_EV_GOT_IP] = NONE,
+            [WIFI_STATE_EV_LINK_DOWN] = WIFI_STATE_DISCONNECTED,
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = NONE,
+        },
+    [WIFI_STATE_DISCONNECTED] =
+        {
+            [WIFI_STATE_EV_CONNECT_SAVED] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_CONNECT_HTTP] = WIFI_STATE_CONNECTING,
+            [WIFI_STATE_EV_ASSOCIATED] = NONE,
+            [WIFI_STATE_EV_GOT_IP] = NONE,
+            [WIFI_STATE_EV_LINK_DOWN] = NONE,
+            [WIFI_STATE_EV_GIVE_UP] = NONE,
+            [WIFI_STATE_EV_USER_DISCONNECT] = NONE,
+        },
+};
+
+/*
+ * Events leading from WIFI_STATE_IDLE to each state, ended by WIFI_STATE_EV_COUNT
+ */
+static const wifi_state_event_e path_to[WIFI_STATE_COUNT][4] = {
+    [WIFI_STATE_IDLE] = {WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_CONNECTING] = {WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_CONNECTED] = {WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_EV_GOT_IP, WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_RECONNECTING] = {WIFI_STATE_EV_CONNECT_SAVED,
+                                 WIFI_STATE_EV_GOT_IP,
+                                 WIFI_STATE_EV_LINK_DOWN,
+                                 WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_FAILED] = {WIFI_STATE_EV_CONNECT_HTTP, WIFI_STATE_EV_GIVE_UP, WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_DISCONNECTING] = {WIFI_STATE_EV_CONNECT_SAVED, WIFI_STATE_EV_USER_DISCONNECT, WIFI_STATE_EV_COUNT},
+    [WIFI_STATE_DISCONNECTED] = {WIFI_STATE_EV_CONNECT_SAVED,
+                                 WIFI_STATE_EV_USER_DISCONNECT,
+                                 WIFI_STATE_EV_LINK_DOWN,
+                                 WIFI_STATE_EV_COUNT},
+};
+
+/*
+ * Every event in every state against the expected table.
+ */
+static void test_transition_table(void)
+{
+    for (int state = 0; state < WIFI_STATE_COUNT; state++)
+    {
+        for (int event = 0; event < WIFI_STATE_EV_COUNT; event++)
+        {
+            wifi_state_machine_t sm;
+            wifi_state_transition_t t;
+            int64_t now_us = 1000000;
+
+            wifi_state_init(&sm, now_us);
+            for (int i = 0; path_to[state][i] != WIFI_STATE_EV_COUNT; i++)
+            {
+                HOST_CHECK(wifi_state_dispatch(&sm, path_to[state][i], now_us += 1000, NULL));
+            }
+            HOST_CHECK_EQ(sm.state, state);
+
+            uint32_t transitions = sm.transitions;
+            bool taken = wifi_state_dispatch(&sm, event, now_us += 1000, &t);
+            int expected = expected_next[state][event];
+            if (taken != (expected != NONE) || (taken && (int)sm.state != expected))
+            {
+                fprintf(stderr,
+                        "%s + %s: %s, expected %s\n",
+                        wifi_state_name(state),
+                        wifi_state_event_name(event),
+                        taken ? wifi_state_name(sm.state) : "ignored",
+                        expected != NONE ? wifi_state_name(expected) : "ignored");
+                host_test_failures++;
+            }
+
+            // an ignored event leaves no trace, a taken one is recorded
+            HOST_CHECK_EQ(sm.transitions, transitions + (taken ? 1 : 0));
+            if (taken)
+            {
+                HOST_CHECK_EQ(t.from, state);
+                HOST_CHECK_EQ(t.to, sm.state);
+                HOST_CHECK_EQ(t.event, event);
+                HOST_CHECK_EQ(t.timestamp_us, now_us);
+                HOST_CHECK(memcmp(&sm.history[transitions % WIFI_STATE_HISTORY_LEN], &t, sizeof(t)) == 0);
+            }
+        }
+    }
+}
+
+/*
+ * Connection times, an outage and a flap on a simulated clock.
+ */
+static void test_metrics(void)
+{
+    wifi_state_machine_t sm;
+    int64_t t0 = 10000000;
+
+    wifi_state_init(&sm, t0);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_CONNECT_SAVED, t0, NULL);
+    HOST_CHECK_EQ(sm.origin, WIFI_STATE_ORIGIN_SAVED);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_ASSOCIATED, t0 + 800000, NULL);
+    // a second association event does not move the time to associate
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_ASSOCIATED, t0 + 900000, NULL);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_GOT_IP, t0 + 1500000, NULL);
+    HOST_CHECK_EQ(sm.metrics.last_connect_ms, 800);
+    HOST_CHECK_EQ(sm.metrics.last_ip_ms, 1500);
+    HOST_CHECK_EQ(sm.metrics.connects, 1);
+
+    // DHCP renewal, not a new connection
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_GOT_IP, t0 + 3600000000LL, NULL);
+    HOST_CHECK_EQ(sm.metrics.connects, 1);
+
+    // link lost after an hour: an outage of 4 s, not a flap
+    int64_t t1 = t0 + 3700000000LL;
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, t1, NULL);
+    HOST_CHECK_EQ(sm.state, WIFI_STATE_RECONNECTING);
+    HOST_CHECK_EQ(sm.metrics.outages, 1);
+    HOST_CHECK_EQ(sm.metrics.flaps, 0);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, t1 + 1000000, NULL);
+    HOST_CHECK_EQ(wifi_state_outage_ms(&sm, t1 + 2000000), 2000);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_ASSOCIATED, t1 + 3000000, NULL);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_GOT_IP, t1 + 4000000, NULL);
+    HOST_CHECK_EQ(sm.metrics.last_outage_ms, 4000);
+    HOST_CHECK_EQ(sm.metrics.last_connect_ms, 3000);
+    HOST_CHECK_EQ(sm.metrics.last_ip_ms, 4000);
+    HOST_CHECK_EQ(sm.metrics.connects, 2);
+    HOST_CHECK_EQ(wifi_state_outage_ms(&sm, t1 + 10000000), 4000);
+
+    // lost again 10 s later: a flap, ended by the user disconnecting
+    int64_t t2 = t1 + 14000000;
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, t2, NULL);
+    HOST_CHECK_EQ(sm.metrics.flaps, 1);
+    HOST_CHECK_EQ(sm.metrics.outages, 2);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_USER_DISCONNECT, t2 + 6000000, NULL);
+    HOST_CHECK_EQ(sm.metrics.last_outage_ms, 6000);
+    HOST_CHECK_EQ(sm.metrics.total_outage_ms, 10000);
+    HOST_CHECK_EQ(sm.metrics.max_outage_ms, 6000);
+    HOST_CHECK_EQ(wifi_state_outage_ms(&sm, t2 + 60000000), 10000);
+}
+
+/*
+ * Credentials from the page give up, a network lost after connecting from
+ * the page is saved and keeps being retried.
+ */
+static void test_origin(void)
+{
+    wifi_state_machine_t sm;
+
+    wifi_state_init(&sm, 0);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_CONNECT_HTTP, 1000, NULL);
+    HOST_CHECK_EQ(sm.origin, WIFI_STATE_ORIGIN_HTTP);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, 2000, NULL);
+    HOST_CHECK_EQ(sm.origin, WIFI_STATE_ORIGIN_HTTP);
+    HOST_CHECK_EQ(sm.metrics.outages, 0);
+    HOST_CHECK(wifi_state_dispatch(&sm, WIFI_STATE_EV_GIVE_UP, 3000, NULL));
+    HOST_CHECK_EQ(sm.state, WIFI_STATE_FAILED);
+
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_CONNECT_HTTP, 4000, NULL);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_GOT_IP, 5000, NULL);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, 6000, NULL);
+    HOST_CHECK_EQ(sm.origin, WIFI_STATE_ORIGIN_SAVED);
+    HOST_CHECK(!wifi_state_dispatch(&sm, WIFI_STATE_EV_GIVE_UP, 7000, NULL));
+}
+
+/*
+ * The history keeps the last WIFI_STATE_HISTORY_LEN transitions of a long
+ * flapping sequence.
+ */
+static void test_history(void)
+{
+    wifi_state_machine_t sm;
+    int64_t now_us = 0;
+
+    wifi_state_init(&sm, now_us);
+    wifi_state_dispatch(&sm, WIFI_STATE_EV_CONNECT_SAVED, now_us += 1000, NULL);
+    for (int i = 0; i < 1000; i++)
+    {
+        wifi_state_dispatch(&sm, WIFI_STATE_EV_GOT_IP, now_us += 1000000, NULL);
+        wifi_state_dispatch(&sm, WIFI_STATE_EV_LINK_DOWN, now_us += 1000000, NULL);
+    }
+    HOST_CHECK_EQ(sm.transitions, 2001);
+    HOST_CHECK_EQ(sm.metrics.flaps, 1000);
+    HOST_CHECK_EQ(sm.metrics.outages, 1000);
+    HOST_CHECK_EQ(sm.metrics.total_outage_ms, 999 * 1000);
+
+    for (uint32_t i = 0; i < WIFI_STATE_HISTORY_LEN; i++)
+    {
+        uint32_t n = sm.transitions - WIFI_STATE_HISTORY_LEN + i;
+        const wifi_state_transition_t *t = &sm.history[n % WIFI_STATE_HISTORY_LEN];
+        // transitions 1, 3, 5... are GOT_IP, the others LINK_DOWN
+        HOST_CHECK_EQ(t->event, n % 2 ? WIFI_STATE_EV_GOT_IP : WIFI_STATE_EV_LINK_DOWN);
+        HOST_CHECK_EQ(t->timestamp_us, 1000 + (int64_t)n * 1000000);
+    }
+
+    HOST_CHECK(strcmp(wifi_state_name(WIFI_STATE_COUNT), "unknown") == 0);
+    HOST_CHECK(strcmp(wifi_state_event_name(WIFI_STATE_EV_COUNT), "unknown") == 0);
+}
+
+int main(void)
+{
+    test_transition_table();
+    test_metrics();
+    test_origin();
+    test_history();
+    return HOST_TEST_RESULT();
+}
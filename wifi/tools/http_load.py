@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""
+HTTP load check.
+
+Measures what an upload to /OTAupdate does to the page: the dashboard GETs
+are timed on an idle device, then again while an image is uploaded on
+another connection. For each phase, prints the percentiles seen by the
+client and, from the latency histograms of /debug/http.json read before
+and after it, the ones seen by the server.
+
+Usage: http_load.py [options] <image.bin>
+
+Options:
+  --host <host>        device address (192.168.0.1, the SoftAP)
+  --rounds <n>         loads of the dashboard on the idle device (20)
+  --paths <list>       comma separated paths of a load
+                       (/,/app.css,/app.js,/status.json)
+
+The upload is a real update: use the image the device runs, it restarts
+into it 8 s after the upload completes. The loaded phase loads the
+dashboard until the upload ends, whatever --rounds is.
+"""
+
+import http.client
+import json
+import os
+import sys
+import threading
+import time
+
+OPTIONS = {
+    '--host': '192.168.0.1',
+    '--rounds': '20',
+    '--paths': '/,/app.css,/app.js,/status.json',
+}
+
+BOUNDARY = '----http-load-boundary'
+PERCENTILES = (50, 90, 99)
+
+
+def parse_args(argv):
+    options = dict(OPTIONS)
+    args = []
+    i = 0
+    while i < len(argv):
+        if argv[i] in OPTIONS and i + 1 < len(argv):
+            options[argv[i]] = argv[i + 1]
+            i += 1
+        elif argv[i].startswith('--'):
+            sys.exit(__doc__)
+        else:
+            args.append(argv[i])
+        i += 1
+    if len(args) != 1:
+        sys.exit(__doc__)
+    return options, args[0]
+
+
+def get(host, path):
+    """Returns the body of path and the time to its last byte, in ms."""
+    start = time.monotonic()
+    conn = http.client.HTTPConnection(host, timeout=30)
+    try:
+        conn.request('GET', path)
+        response = conn.getresponse()
+        body = response.read()
+        if response.status != 200:
+            raise RuntimeError('GET %s: %d' % (path, response.status))
+    finally:
+        conn.close()
+    return body, (time.monotonic() - start) * 1000
+
+
+def debug_routes(host):
+    """Returns the minimum latency and the stats of each GET route."""
+    body, _ = get(host, '/debug/http.json')
+    debug = json.loads(body)
+    routes = {r['path']: r for r in debug['routes'] if r['method'] == 'GET'}
+    return debug['latency_min_us'], routes
+
+
+def upload(host, image_path, result):
+    """Posts the image to /OTAupdate as the page does, a multipart form."""
+    head = ('--%s\r\nContent-Disposition: form-data; name="file"; filename="%s"\r\n'
+            'Content-Type: application/octet-stream\r\n\r\n' % (BOUNDARY, os.path.basename(image_path))).encode()
+    tail = ('\r\n--%s--\r\n' % BOUNDARY).encode()
+    start = time.monotonic()
+    conn = http.client.HTTPConnection(host, timeout=120)
+    try:
+        with open(image_path, 'rb') as f:
+            body = head + f.read() + tail
+        conn.request('POST', '/OTAupdate', body,
+                     {'Content-Type': 'multipart/form-data; boundary=' + BOUNDARY})
+        result['status'] = conn.getresponse().status
+    except (OSError, http.client.HTTPException) as e:
+        result['status'] = str(e)
+    finally:
+        conn.close()
+    result['seconds'] = time.monotonic() - start
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, len(sorted_values) * p // 100)]
+
+
+def hist_percentile(hist, latency_min_us, p):
+    """Upper bound of the bucket holding the p-th percentile, in ms."""
+    total = sum(hist)
+    seen = 0
+    for bucket, count in enumerate(hist):
+        seen += count
+        if seen * 100 >= total * p:
+            if bucket == len(hist) - 1:
+                return '>%.1f' % ((latency_min_us << (bucket - 1)) / 1000)
+            return '<%.1f' % ((latency_min_us << bucket) / 1000)
+    return '-'
+
+
+def report(name, timings, latency_min_us, before, after):
+    print('%s:' % name)
+    for path, values in timings.items():
+        values = sorted(values)
+        client = ' '.join('p%d %.1f' % (p, percentile(values, p)) for p in PERCENTILES)
+        line = '  %-14s %4d GETs, client ms: %s, max %.1f' % (path, len(values), client, values[-1])
+        if path in before and path in after:
+            hist = [a - b for a, b in zip(after[path]['latency_hist'], before[path]['latency_hist'])]
+            if sum(hist) > 0:
+                line += ', server ms: ' + ' '.join('p%d %s' % (p, hist_percentile(hist, latency_min_us, p))
+                                                   for p in PERCENTILES)
+        print(line)
+
+
+def run_phase(host, paths, rounds=None, until=None):
+    """Loads the dashboard rounds times, or while the until thread runs."""
+    timings = {path: [] for path in paths}
+    done = 0
+    while True:
+        for path in paths:
+            _, ms = get(host, path)
+            timings[path].append(ms)
+        done += 1
+        if (until is None and done >= rounds) or (until is not None and not until.is_alive()):
+            return timings
+
+
+def main():
+    options, image_path = parse_args(sys.argv[1:])
+    host = options['--host']
+    paths = options['--paths'].split(',')
+    rounds = int(options['--rounds'])
+
+    latency_min_us, before = debug_routes(host)
+    idle = run_phase(host, paths, rounds=rounds)
+    _, after = debug_routes(host)
+    report('idle', idle, latency_min_us, before, after)
+
+    before = after
+    result = {}
+    uploader = threading.Thread(target=upload, args=(host, image_path, result))
+    uploader.start()
+    loaded = run_phase(host, paths, until=uploader)
+    _, after = debug_routes(host)
+    uploader.join()
+    report('during /OTAupdate', loaded, latency_min_us, before, after)
+    print('upload: %s in %.1f s' % (result['status'], result['seconds']))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+MQTT OTA job server.
+
+Stands in for the cloud side of the MQTT OTA channel (see
+main/include/mqtt_ota.h): publishes a retained job on the notify topic, then
+answers the chunk requests of the device until it reports the job result.
+Works with any broker, e.g. a local Mosquitto in place of AWS IoT.
+
+Usage: mqtt_ota_server.py [options] <image.bin>
+
+Options:
+  --host <host>        broker host (localhost)
+  --port <port>        broker port (1883, 8883 with --cafile)
+  --cafile <file>      CA certificate, enables TLS
+  --cert <file>        client certificate
+  --key <file>         client key
+  --thing <name>       thing name, the topic prefix (Udemy_ESP32_Test)
+  --job <id>           job id (the image SHA-256 prefix)
+  --drop <rate>        drop this fraction of the chunks, exercises the retries
+  --reorder            answer the requests of a window in reverse order
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import hashlib
+import json
+import random
+import struct
+import sys
+import time
+
+import paho.mqtt.client as mqtt
+
+OPTIONS = {
+    '--host': 'localhost',
+    '--port': None,
+    '--cafile': None,
+    '--cert': None,
+    '--key': None,
+    '--thing': 'Udemy_ESP32_Test',
+    '--job': None,
+    '--drop': '0',
+}
+
+
+def parse_args(argv):
+    options = dict(OPTIONS)
+    options['--reorder'] = False
+    args = []
+    i = 0
+    while i < len(argv):
+        if argv[i] == '--reorder':
+            options['--reorder'] = True
+        elif argv[i] in OPTIONS and i + 1 < len(argv):
+            options[argv[i]] = argv[i + 1]
+            i += 1
+        elif argv[i].startswith('--'):
+            sys.exit(__doc__)
+        else:
+            args.append(argv[i])
+        i += 1
+    if len(args) != 1:
+        sys.exit(__doc__)
+    return options, args[0]
+
+
+def main():
+    options, image_path = parse_args(sys.argv[1:])
+    with open(image_path, 'rb') as f:
+        image = f.read()
+
+    sha256 = hashlib.sha256(image).hexdigest()
+    job = options['--job'] or sha256[:16]
+    prefix = options['--thing'] + '/ota/'
+    drop = float(options['--drop'])
+    pending = []
+    state = {'done': False, 'sent': 0, 'start': None}
+
+    def on_connect(client, userdata, flags, rc, *args):
+        print('mqtt_ota_server: connected, job %s, %d bytes' % (job, len(image)))
+        client.subscribe(prefix + 'request', qos=0)
+        client.subscribe(prefix + 'status', qos=1)
+        notify = {'job': job, 'size': len(image), 'sha256': sha256}
+        client.publish(prefix + 'notify', json.dumps(notify), qos=1, retain=True)
+
+    def send(client, request):
+        offset, length, token = request['offset'], request['len'], request['token']
+        if random.random() < drop:
+            return
+        client.publish(prefix + 'data', struct.pack('<II', token, offset) + image[offset:offset + length], qos=0)
+        state['sent'] += length
+
+    def on_message(client, userdata, message):
+        payload = json.loads(message.payload)
+        if payload.get('job') != job:
+            return
+
+        if message.topic.endswith('/status'):
+            print('mqtt_ota_server: status %s at %d (%s)' % (payload['status'], payload['offset'], payload['error']))
+            if payload['status'] in ('SUCCEEDED', 'FAILED'):
+                if payload['status'] == 'SUCCEEDED':
+                    client.publish(prefix + 'notify', b'', qos=1, retain=True)
+                state['done'] = True
+            return
+
+        if state['start'] is None:
+            state['start'] = time.time()
+        if payload['offset'] + payload['len'] > len(image):
+            return
+        if options['--reorder']:
+            pending.append(payload)
+        else:
+            send(client, payload)
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    port = options['--port']
+    if options['--cafile']:
+        client.tls_set(ca_certs=options['--cafile'], certfile=options['--cert'], keyfile=options['--key'])
+        port = port or 8883
+    client.connect(options['--host'], int(port or 1883))
+
+    while not state['done']:
+        client.loop(timeout=0.1)
+        while pending:
+            send(client, pending.pop())
+
+    elapsed = time.time() - state['start'] if state['start'] else 0
+    print('mqtt_ota_server: %d bytes sent in %.1f s' % (state['sent'], elapsed))
+    client.disconnect()
+
+
+if __name__ == '__main__':
+    main()
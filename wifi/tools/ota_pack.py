@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""
+OTA artifact packer.
+
+Builds the compressed and delta images accepted by /OTAupdate (see
+main/include/ota_decoder.h) from the application image, and checks that they
+decode back to it. Also writes the manifest polled by pull mode OTA (see
+main/include/ota_pull.h).
+
+Usage:
+  ota_pack.py compress <image.bin> <out.bin.z>
+  ota_pack.py delta <base.bin> <image.bin> <out.delta>
+  ota_pack.py verify <image.bin> <artifact> [<base.bin>]
+  ota_pack.py artifacts <image.bin> <out_dir> [<base.bin>]
+  ota_pack.py manifest <image.bin> <url> <out.json>
+
+A delta is made against base.bin, the image running on the device, and is
+zlib compressed as well. 'artifacts' writes wifi.bin.z, and wifi.delta when a
+base image is given, and verifies both. 'manifest' takes the version from the
+application description of the image, e.g. to test against a local server:
+
+  ota_pack.py manifest build/wifi.bin http://<host>:8000/wifi.bin build/manifest.json
+  cd build && python -m http.server 8000
+"""
+
+import hashlib
+import json
+import os
+import struct
+import sys
+import zlib
+
+# Must match ota_decoder.h
+DELTA_MAGIC = b'ESPD'
+DELTA_OP_COPY = 1
+DELTA_OP_INSERT = 2
+IMAGE_MAGIC = 0xE9
+
+# esp_app_desc_t follows the image header and the first segment header
+APP_DESC_OFFSET = 24 + 8
+APP_DESC_MAGIC = 0xABCD5432
+APP_DESC_VERSION_OFFSET = APP_DESC_OFFSET + 16
+APP_DESC_VERSION_LEN = 32
+
+# Matches shorter than this are cheaper to insert than to copy
+MIN_MATCH = 32
+
+# Size of the chunks the device receives, used to check the streaming decode
+CHUNK_SIZE = 1024
+
+
+def compress(data):
+    # zlib keeps the default 32 KB window, the device inflates into a 32 KB dictionary
+    return zlib.compress(data, 9)
+
+
+def make_delta(base, image):
+    """
+    Greedy block matching: every MIN_MATCH aligned block of the base is
+    indexed, the image is scanned for those blocks and matches are extended
+    both ways.
+    """
+    index = {}
+    for offset in range(0, len(base) - MIN_MATCH + 1, MIN_MATCH):
+        index.setdefault(base[offset:offset + MIN_MATCH], offset)
+
+    ops = []
+    literal_start = 0
+    i = 0
+    while i + MIN_MATCH <= len(image):
+        src = index.get(image[i:i + MIN_MATCH])
+        if src is None:
+            i += 1
+            continue
+
+        # extend backwards into the pending literal, then forwards
+        while i > literal_start and src > 0 and image[i - 1] == base[src - 1]:
+            i -= 1
+            src -= 1
+        length = MIN_MATCH
+        while i + length < len(image) and src + length < len(base) and image[i + length] == base[src + length]:
+            length += 1
+
+        if i > literal_start:
+            ops.append((DELTA_OP_INSERT, 0, image[literal_start:i]))
+        ops.append((DELTA_OP_COPY, src, length))
+        i += length
+        literal_start = i
+
+    if literal_start < len(image):
+        ops.append((DELTA_OP_INSERT, 0, image[literal_start:]))
+
+    out = [DELTA_MAGIC, struct.pack('<II', len(base), len(image)), hashlib.sha256(base).digest()]
+    for op, offset, arg in ops:
+        if op == DELTA_OP_COPY:
+            out.append(struct.pack('<BII', op, offset, arg))
+        else:
+            out.append(struct.pack('<BII', op, 0, len(arg)))
+            out.append(arg)
+    return compress(b''.join(out))
+
+
+def inflate(data):
+    """
+    Inflates in device sized chunks, like ota_decoder does.
+    """
+    inflator = zlib.decompressobj()
+    out = []
+    for offset in range(0, len(data), CHUNK_SIZE):
+        out.append(inflator.decompress(data[offset:offset + CHUNK_SIZE]))
+    out.append(inflator.flush())
+    if not inflator.eof or inflator.unused_data:
+        raise ValueError('truncated or trailing bytes after the zlib stream')
+    return b''.join(out)
+
+
+def apply_delta(base, delta):
+    if delta[:4] != DELTA_MAGIC:
+        raise ValueError('not a delta')
+    source_size, target_size = struct.unpack_from('<II', delta, 4)
+    if source_size > len(base) or hashlib.sha256(base[:source_size]).digest() != delta[12:44]:
+        raise ValueError('the delta was made against another image')
+
+    out = bytearray()
+    pos = 44
+    while pos < len(delta):
+        op, offset, length = struct.unpack_from('<BII', delta, pos)
+        pos += 9
+        if op == DELTA_OP_COPY and offset + length <= source_size:
+            out += base[offset:offset + length]
+        elif op == DELTA_OP_INSERT and offset == 0 and pos + length <= len(delta):
+            out += delta[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError('corrupt operation at %d' % (pos - 9))
+    if len(out) != target_size:
+        raise ValueError('delta rebuilds %d bytes, %d expected' % (len(out), target_size))
+    return bytes(out)
+
+
+def decode(artifact, base):
+    """
+    Decodes an artifact the way the device does: the first byte tells a plain
+    image, a delta or a zlib stream holding either of them.
+    """
+    data = artifact
+    if data[0] != IMAGE_MAGIC and data[:4] != DELTA_MAGIC:
+        data = inflate(data)
+    if data[:4] == DELTA_MAGIC:
+        if base is None:
+            raise ValueError('a base image is needed to decode a delta')
+        data = apply_delta(base, data)
+    return data
+
+
+def verify(image, artifact, base):
+    if decode(artifact, base) != image:
+        raise ValueError('the artifact does not decode to the image')
+
+
+def make_manifest(image, url):
+    magic, = struct.unpack_from('<I', image, APP_DESC_OFFSET)
+    if image[0] != IMAGE_MAGIC or magic != APP_DESC_MAGIC:
+        raise ValueError('not an application image')
+    version = image[APP_DESC_VERSION_OFFSET:APP_DESC_VERSION_OFFSET + APP_DESC_VERSION_LEN]
+    return {
+        'version': version.split(b'\0', 1)[0].decode('utf-8'),
+        'size': len(image),
+        'sha256': hashlib.sha256(image).hexdigest(),
+        'url': url,
+    }
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def write(path, data):
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) < 3:
+        sys.exit(__doc__)
+
+    command = args[0]
+    try:
+        if command == 'compress' and len(args) == 3:
+            write(args[2], compress(read(args[1])))
+        elif command == 'delta' and len(args) == 4:
+            write(args[3], make_delta(read(args[1]), read(args[2])))
+        elif command == 'verify' and len(args) in (3, 4):
+            verify(read(args[1]), read(args[2]), read(args[3]) if len(args) == 4 else None)
+            print('ota_pack: %s decodes to %s' % (args[2], args[1]))
+        elif command == 'artifacts' and len(args) in (3, 4):
+            image = read(args[1])
+            out_dir = args[2]
+            os.makedirs(out_dir, exist_ok=True)
+
+            artifacts = [('wifi.bin.z', compress(image), None)]
+            if len(args) == 4:
+                base = read(args[3])
+                artifacts.append(('wifi.delta', make_delta(base, image), base))
+
+            for name, data, base in artifacts:
+                verify(image, data, base)
+                write(os.path.join(out_dir, name), data)
+                print('ota_pack: %s %d -> %d bytes (%.1f%%)' % (name, len(image), len(data),
+                                                               100.0 * len(data) / len(image)))
+        elif command == 'manifest' and len(args) == 4:
+            manifest = make_manifest(read(args[1]), args[2])
+            with open(args[3], 'w') as f:
+                json.dump(manifest, f, indent=2)
+            print('ota_pack: %s version %s, %d bytes' % (args[3], manifest['version'], manifest['size']))
+        else:
+            sys.exit(__doc__)
+    except ValueError as e:
+        sys.exit('ota_pack: %s' % e)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+Build-time web asset pipeline.
+
+Minifies, gzips and content-hashes every file of the web page and writes a C
+source file holding a constant asset table (see main/include/web_assets.h).
+
+Usage: web_assets.py <output.c> <asset> [<asset> ...]
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+# File extension to mime type
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.ico': 'image/x-icon',
+    '.png': 'image/png',
+    '.svg': 'image/svg+xml',
+    '.json': 'application/json',
+}
+
+# Number of hex digits of the SHA-256 kept as the asset hash
+HASH_LENGTH = 16
+
+# Marker where the server splices dynamic content into a page, it is removed
+# from the asset and its offset is recorded instead
+SPLICE_MARKER = b'<!--@INITIAL_STATE-->'
+
+
+def strip_comments(text, line_comments):
+    """
+    Removes /* */ (and optionally //) comments outside of string literals.
+    """
+    out = []
+    i = 0
+    quote = None
+    while i < len(text):
+        c = text[i]
+        if quote:
+            out.append(c)
+            if c == '\\' and i + 1 < len(text):
+                out.append(text[i + 1])
+                i += 1
+            elif c == quote:
+                quote = None
+        elif c in '\'"`':
+            quote = c
+            out.append(c)
+        elif text.startswith('/*', i):
+            end = text.find('*/', i + 2)
+            i = len(text) if end < 0 else end + 2
+            continue
+        elif line_comments and text.startswith('//', i):
+            end = text.find('\n', i)
+            i = len(text) if end < 0 else end
+            continue
+        else:
+            out.append(c)
+        i += 1
+    return ''.join(out)
+
+
+def strip_lines(text):
+    """
+    Trims every line and drops the empty ones, newlines are kept so automatic
+    semicolon insertion still works for scripts.
+    """
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line) + '\n'
+
+
+def minify_js(text):
+    return strip_lines(strip_comments(text, True))
+
+
+def minify_css(text):
+    text = strip_comments(text, False)
+    text = re.sub(r'\s+', ' ', text)
+    text = re.sub(r'\s*([{};,>])\s*', r'\1', text)
+    text = re.sub(r':\s+', ':', text)
+    return text.replace(';}', '}').strip() + '\n'
+
+
+def minify_html(text):
+    text = re.sub(r'<!--(?!@).*?-->', '', text, flags=re.S)
+    return strip_lines(text)
+
+
+def minify(name, data):
+    """
+    Returns the minified bytes of an asset, already minified files and
+    binaries are returned untouched.
+    """
+    if name.endswith('.min.js') or name.endswith('.min.css'):
+        return data
+
+    minifiers = {'.js': minify_js, '.css': minify_css, '.html': minify_html}
+    func = minifiers.get(os.path.splitext(name)[1])
+    if func is None:
+        return data
+
+    return func(data.decode('utf-8')).encode('utf-8')
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('    ' + ' '.join('0x%02x,' % b for b in data[i:i + 16]))
+    return 'static const uint8_t %s[%d] = {\n%s\n};\n' % (name, len(data), '\n'.join(lines))
+
+
+def version_references(text, hashes):
+    """
+    Appends ?v=<hash> to every src/href reference of a known asset so the
+    browser can cache the versioned URL forever.
+    """
+    def replace(match):
+        name = match.group(2)
+        if name not in hashes:
+            return match.group(0)
+        return '%s%s?v=%s%s' % (match.group(1), name, hashes[name], match.group(3))
+
+    return re.sub(r'(\b(?:src|href)=[\'"])([^\'"?]+)([\'"])', replace, text)
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    output = sys.argv[1]
+    sources = sorted(sys.argv[2:], key=os.path.basename)
+
+    assets = []
+    for source in sources:
+        name = os.path.basename(source)
+        with open(source, 'rb') as f:
+            raw = f.read()
+        assets.append((name, raw, minify(name, raw)))
+
+    # Pages reference the other assets by versioned URL, so hash those first
+    hashes = {}
+    for name, _, identity in assets:
+        if not name.endswith('.html'):
+            hashes[name] = hashlib.sha256(identity).hexdigest()[:HASH_LENGTH]
+
+    arrays = []
+    entries = []
+    for index, (name, raw, identity) in enumerate(assets):
+        if name.endswith('.html'):
+            identity = version_references(identity.decode('utf-8'), hashes).encode('utf-8')
+
+        splice_offset = identity.find(SPLICE_MARKER)
+        if splice_offset >= 0:
+            identity = identity.replace(SPLICE_MARKER, b'', 1)
+
+        digest = hashlib.sha256(identity).hexdigest()[:HASH_LENGTH]
+        compressed = gzip.compress(identity, compresslevel=9, mtime=0)
+        mime = MIME_TYPES.get(os.path.splitext(name)[1], 'application/octet-stream')
+
+        identity_name = 'asset_%d_identity' % index
+        arrays.append(c_array(identity_name, identity))
+
+        # Only keep the gzip encoding when it actually saves bytes, spliced
+        # pages are streamed as plain bytes
+        if len(compressed) < len(identity) and splice_offset < 0:
+            gzip_name = 'asset_%d_gzip' % index
+            arrays.append(c_array(gzip_name, compressed))
+            encoding = '"gzip"'
+            data, data_len = gzip_name, len(compressed)
+        else:
+            encoding = 'NULL'
+            data, data_len = identity_name, len(identity)
+
+        entries.append('    {.path = "/%s",\n'
+                       '     .mime_type = "%s",\n'
+                       '     .encoding = %s,\n'
+                       '     .hash = "%s",\n'
+                       '     .data = %s,\n'
+                       '     .data_len = %d,\n'
+                       '     .identity_data = %s,\n'
+                       '     .identity_len = %d,\n'
+                       '     .splice_offset = %d},\n'
+                       % (name, mime, encoding, digest, data, data_len, identity_name, len(identity), splice_offset))
+
+        print('web_assets: /%s %d -> %d bytes (%s)' % (name, len(raw), data_len,
+                                                       'gzip' if encoding != 'NULL' else 'identity'))
+
+    with open(output, 'w') as f:
+        f.write('// Generated by tools/web_assets.py, do not edit.\n\n')
+        f.write('#include "web_assets.h"\n\n')
+        f.write('\n'.join(arrays))
+        f.write('\nconst web_asset_t web_assets[] = {\n%s};\n\n' % ''.join(entries))
+        f.write('const size_t web_assets_count = sizeof(web_assets) / sizeof(web_assets[0]);\n')
+
+
+if __name__ == '__main__':
+    main()